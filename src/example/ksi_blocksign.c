@@ -72,54 +72,16 @@ cleanup:
 static int getHash(char *inFile, KSI_DataHash **hsh) {
 	int res = KSI_UNKNOWN_ERROR;
 
-	unsigned char buf[1024];
-	size_t buf_len;
-	FILE *in = NULL;
-	KSI_DataHasher *hsr = NULL;
-	KSI_DataHash *tmp = NULL;
-
-	in = fopen(inFile, "rb");
-	if (in == NULL) {
-		fprintf(stderr, "%s: Unable to open file.\n", inFile);
-		res = KSI_IO_ERROR;
-		goto cleanup;
-	}
-
-	/* Create a data hasher using default algorithm. */
-	res = KSI_DataHasher_open(ksi, KSI_getHashAlgorithmByName("default"), &hsr);
+	/* Hash the contents of the input file using default algorithm. */
+	res = KSI_DataHash_fromFile(ksi, inFile, KSI_getHashAlgorithmByName("default"), hsh);
 	if (res != KSI_OK) {
-		fprintf(stderr, "Unable to create hasher.\n");
+		fprintf(stderr, "%s: Unable to hash file.\n", inFile);
 		goto cleanup;
 	}
 
-	/* Read the input file and calculate the hash of its contents. */
-	while (!feof(in)) {
-		buf_len = fread(buf, 1, sizeof(buf), in);
-
-		/* Add  next block to the calculation. */
-		res = KSI_DataHasher_add(hsr, buf, buf_len);
-		if (res != KSI_OK) {
-			fprintf(stderr, "Unable to add data to hasher.\n");
-			goto cleanup;
-		}
-	}
-
-	/* Close the data hasher and retreive the data hash. */
-	res = KSI_DataHasher_close(hsr, &tmp);
-	if (res != KSI_OK) {
-		fprintf(stderr, "Unable to create hash.\n");
-		goto cleanup;
-	}
-	*hsh = tmp;
-	tmp = NULL;
-
 	res = KSI_OK;
 
 cleanup:
-	if (in != NULL) fclose(in);
-
-	KSI_DataHash_free(tmp);
-	KSI_DataHasher_free(hsr);
 
 	return res;
 }
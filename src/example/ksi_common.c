@@ -19,6 +19,13 @@
 
 #include <stdio.h>
 #include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
 #include <ksi/ksi.h>
 #include <ksi/policy.h>
 
@@ -61,9 +68,6 @@ int GetDocumentHash(char *fileName, KSI_Signature *sig, KSI_DataHash **hsh) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHash *tmp = NULL;
 	KSI_DataHasher *hsr = NULL;
-	FILE *in = NULL;
-	unsigned char buf[1024];
-	size_t buf_len;
 
 	if (fileName == NULL || sig == NULL || hsh == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -77,21 +81,11 @@ int GetDocumentHash(char *fileName, KSI_Signature *sig, KSI_DataHash **hsh) {
 		goto cleanup;
 	}
 
-	/* Open the document for reading. */
-	in = fopen(fileName, "rb");
-	if (in == NULL) {
-		fprintf(stderr, "Unable to open data file '%s'.\n", fileName);
-		goto cleanup;
-	}
-
 	/* Calculate the hash of the document. */
-	while (!feof(in)) {
-		buf_len = fread(buf, 1, sizeof(buf), in);
-		res = KSI_DataHasher_add(hsr, buf, buf_len);
-		if (res != KSI_OK) {
-			fprintf(stderr, "Unable hash the document.\n");
-			goto cleanup;
-		}
+	res = KSI_DataHasher_addFile(hsr, fileName);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to hash the data file '%s'.\n", fileName);
+		goto cleanup;
 	}
 
 	/* Finalize the hash computation. */
@@ -109,7 +103,6 @@ cleanup:
 
 	KSI_DataHasher_free(hsr);
 	KSI_DataHash_free(tmp);
-	if (in != NULL) fclose(in);
 
 	return res;
 }
@@ -152,3 +145,21 @@ cleanup:
 
 	return res;
 }
+
+unsigned long long GetTimeUs(void) {
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!QueryPerformanceFrequency(&freq) || !QueryPerformanceCounter(&now) || freq.QuadPart == 0) return 0;
+
+	return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000ULL +
+			(unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000ULL / (unsigned long long)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+	return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+#endif
+}
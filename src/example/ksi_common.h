@@ -60,6 +60,12 @@ int GetDocumentHash(char *fileName, KSI_Signature *sig, KSI_DataHash **hsh);
  */
 int PrintVerificationInfo(KSI_PolicyVerificationResult *result);
 
+/**
+ * Reads a monotonic clock for measuring the elapsed time.
+ * \return Time in microseconds since an unspecified starting point, 0 on error.
+ */
+unsigned long long GetTimeUs(void);
+
 #ifdef __cplusplus
 }
 #endif
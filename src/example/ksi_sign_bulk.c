@@ -0,0 +1,693 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+/*
+ * Signs a list of files, or hash imprints, read line by line from the standard input.
+ *
+ * The input is read in batches which are hashed in parallel by the executor. The hashes are
+ * signed either one by one via the async service, or aggregated into a local tree per batch
+ * of which only the root hash value is sent out (block mode). At most a window of items is in
+ * progress at once: reading of the input is paused while the oldest item of the window is
+ * waiting for its signature. The results are written in the input order.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  define sleep_ms(x) Sleep((x))
+#else
+#  include <unistd.h>
+#  define sleep_ms(x) usleep((x)*1000)
+#endif
+
+#include <ksi/ksi.h>
+#include <ksi/net_async.h>
+#include <ksi/executor.h>
+#include <ksi/local_aggregator.h>
+#include <ksi/compatibility.h>
+
+#include "ksi_common.h"
+
+#define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_WINDOW_SIZE 1024
+#define DEFAULT_RETRY_COUNT 3
+
+#define MAX_LINE_LEN 4096
+
+enum {
+	MODE_ASYNC = 0,
+	MODE_BLOCK
+};
+
+typedef struct Item_st {
+	/* File name or hash imprint as read from the input. */
+	char *name;
+	KSI_DataHash *hash;
+	KSI_LocalAggregatorHandle *blockHandle;
+	KSI_Signature *sig;
+	/* Status code of the failed item. */
+	int error;
+	/* The item has been signed or has failed. */
+	int done;
+	unsigned retries;
+} Item;
+
+typedef struct BulkSigner_st {
+	KSI_CTX *ksi;
+	KSI_Executor *exec;
+	KSI_AsyncService *as;
+	KSI_LocalAggregator *la;
+
+	int mode;
+	int hexInput;
+	KSI_HashAlgorithm algo;
+	size_t batchSize;
+	size_t windowSize;
+	unsigned retryCount;
+	FILE *container;
+
+	/* Ring of the items in progress, item number n is kept at slot n % windowSize. */
+	Item *items;
+	/* Number of the next item to be read, submitted and written. */
+	size_t nextRead;
+	size_t nextSubmit;
+	size_t nextWrite;
+	/* First item of the batch being hashed. */
+	size_t hashBase;
+	int eof;
+
+	size_t succeeded;
+	size_t failed;
+} BulkSigner;
+
+static Item *getItem(BulkSigner *bs, size_t n) {
+	return &bs->items[n % bs->windowSize];
+}
+
+static void Item_clear(Item *item) {
+	KSI_free(item->name);
+	KSI_DataHash_free(item->hash);
+	KSI_LocalAggregatorHandle_free(item->blockHandle);
+	KSI_Signature_free(item->sig);
+	memset(item, 0, sizeof(Item));
+}
+
+static void Item_fail(Item *item, int error) {
+	item->error = error;
+	item->done = 1;
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static int hashFromHex(KSI_CTX *ksi, const char *hex, KSI_DataHash **hsh) {
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t len = 0;
+
+	while (hex[0] != '\0') {
+		int hi = hexValue(hex[0]);
+		int lo = hexValue(hex[1]);
+
+		if (hi < 0 || lo < 0 || len == sizeof(imprint)) return KSI_INVALID_FORMAT;
+		imprint[len++] = (unsigned char)((hi << 4) | lo);
+		hex += 2;
+	}
+
+	return KSI_DataHash_fromImprint(ksi, imprint, len, hsh);
+}
+
+static int hashTask(void *taskCtx, size_t index) {
+	BulkSigner *bs = taskCtx;
+	Item *item = getItem(bs, bs->hashBase + index);
+	int res;
+
+	if (bs->hexInput) {
+		res = hashFromHex(bs->ksi, item->name, &item->hash);
+	} else {
+		res = KSI_DataHash_fromFile(bs->ksi, item->name, bs->algo, &item->hash);
+	}
+	/* A failed item does not stop the others. */
+	if (res != KSI_OK) Item_fail(item, res);
+
+	return KSI_OK;
+}
+
+/* Reads the next batch of the input, limited by the free room in the window, and hashes it. */
+static int readBatch(BulkSigner *bs) {
+	int res = KSI_UNKNOWN_ERROR;
+	char line[MAX_LINE_LEN];
+	size_t room = bs->windowSize - (bs->nextRead - bs->nextWrite);
+	size_t count = 0;
+
+	bs->hashBase = bs->nextRead;
+
+	while (count < room && count < bs->batchSize) {
+		Item *item = NULL;
+		size_t len;
+
+		if (fgets(line, sizeof(line), stdin) == NULL) {
+			bs->eof = 1;
+			break;
+		}
+
+		len = strlen(line);
+		while (len > 0 && isspace((unsigned char)line[len - 1])) line[--len] = '\0';
+		if (len == 0) continue;
+
+		item = getItem(bs, bs->nextRead);
+		res = KSI_strdup(line, &item->name);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to copy the input line.\n");
+			goto cleanup;
+		}
+
+		bs->nextRead++;
+		count++;
+	}
+
+	if (count > 0) {
+		res = KSI_Executor_forEach(bs->exec, count, hashTask, bs);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to hash the input.\n");
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int submitItem(BulkSigner *bs, Item *item) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncHandle *handle = NULL;
+	KSI_DataHash *hashRef = NULL;
+
+	if (bs->mode == MODE_BLOCK) {
+		return KSI_LocalAggregator_add(bs->la, item->hash, &item->blockHandle);
+	}
+
+	res = KSI_AsyncSigningHandle_new(bs->ksi, (hashRef = KSI_DataHash_ref(item->hash)), 0, &handle);
+	if (res != KSI_OK) {
+		KSI_DataHash_free(hashRef);
+		goto cleanup;
+	}
+
+	res = KSI_AsyncHandle_setRequestCtx(handle, item, NULL);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AsyncService_addRequest(bs->as, handle);
+	if (res != KSI_OK) goto cleanup;
+	/* The service has taken ownership of the handle until it is returned by KSI_AsyncService_run. */
+	handle = NULL;
+
+cleanup:
+
+	KSI_AsyncHandle_free(handle);
+
+	return res;
+}
+
+/* Submits the hashed items in the input order, until the service is out of room. */
+static void submitItems(BulkSigner *bs) {
+	while (bs->nextSubmit < bs->nextRead) {
+		Item *item = getItem(bs, bs->nextSubmit);
+
+		if (!item->done) {
+			int res = submitItem(bs, item);
+			if (res == KSI_ASYNC_REQUEST_CACHE_FULL) break;
+			if (res != KSI_OK) Item_fail(item, res);
+		}
+		bs->nextSubmit++;
+	}
+}
+
+/* Resubmits a failed item, unless it has run out of retries. */
+static void retryItem(BulkSigner *bs, Item *item, int error) {
+	int res;
+
+	if (item->retries >= bs->retryCount) {
+		Item_fail(item, error);
+		return;
+	}
+	item->retries++;
+
+	KSI_LocalAggregatorHandle_free(item->blockHandle);
+	item->blockHandle = NULL;
+
+	res = submitItem(bs, item);
+	if (res != KSI_OK) Item_fail(item, error);
+}
+
+static void handleAsyncResponse(BulkSigner *bs, KSI_AsyncHandle *respHandle) {
+	Item *item = NULL;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	int err = KSI_UNKNOWN_ERROR;
+	int res;
+
+	if (KSI_AsyncHandle_getRequestCtx(respHandle, (const void **)&item) != KSI_OK || item == NULL) {
+		KSI_AsyncHandle_free(respHandle);
+		return;
+	}
+
+	KSI_AsyncHandle_getState(respHandle, &state);
+	switch (state) {
+		case KSI_ASYNC_STATE_RESPONSE_RECEIVED:
+			res = KSI_AsyncHandle_getSignature(respHandle, &item->sig);
+			if (res != KSI_OK) {
+				Item_fail(item, res);
+			} else {
+				item->done = 1;
+			}
+			KSI_AsyncHandle_free(respHandle);
+			break;
+
+		case KSI_ASYNC_STATE_ERROR:
+			KSI_AsyncHandle_getError(respHandle, &err);
+			if (item->retries < bs->retryCount && KSI_AsyncService_addRequest(bs->as, respHandle) == KSI_OK) {
+				item->retries++;
+			} else {
+				Item_fail(item, err);
+				KSI_AsyncHandle_free(respHandle);
+			}
+			break;
+
+		default:
+			KSI_AsyncHandle_free(respHandle);
+			break;
+	}
+}
+
+/* Runs the service and collects the signatures available. Sets \c progress if any item was finished. */
+static int collectSignatures(BulkSigner *bs, int *progress) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i;
+
+	if (bs->mode == MODE_ASYNC) {
+		KSI_AsyncHandle *respHandle = NULL;
+
+		do {
+			respHandle = NULL;
+			res = KSI_AsyncService_run(bs->as, &respHandle, NULL);
+			if (res != KSI_OK) {
+				fprintf(stderr, "Failed to run async service.\n");
+				goto cleanup;
+			}
+
+			if (respHandle != NULL) {
+				handleAsyncResponse(bs, respHandle);
+				*progress = 1;
+			}
+		} while (respHandle != NULL);
+	} else {
+		res = KSI_LocalAggregator_run(bs->la, NULL);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Failed to run local aggregator.\n");
+			goto cleanup;
+		}
+
+		for (i = bs->nextWrite; i < bs->nextSubmit; i++) {
+			Item *item = getItem(bs, i);
+			int state = KSI_ASYNC_STATE_UNDEFINED;
+			int err = KSI_UNKNOWN_ERROR;
+
+			if (item->done || item->blockHandle == NULL) continue;
+
+			KSI_LocalAggregatorHandle_getState(item->blockHandle, &state);
+			if (state == KSI_ASYNC_STATE_RESPONSE_RECEIVED) {
+				res = KSI_LocalAggregatorHandle_getSignature(item->blockHandle, &item->sig);
+				if (res != KSI_OK) {
+					Item_fail(item, res);
+				} else {
+					item->done = 1;
+				}
+				*progress = 1;
+			} else if (state == KSI_ASYNC_STATE_ERROR) {
+				KSI_LocalAggregatorHandle_getError(item->blockHandle, &err);
+				retryItem(bs, item, err);
+				*progress = 1;
+			}
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int writeSignature(BulkSigner *bs, Item *item) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	char *sigFileName = NULL;
+	size_t sigFileName_len;
+	FILE *out = NULL;
+
+	res = KSI_Signature_serialize(item->sig, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (bs->container != NULL) {
+		out = bs->container;
+	} else {
+		sigFileName_len = strlen(item->name) + sizeof(".ksig");
+		sigFileName = malloc(sigFileName_len);
+		if (sigFileName == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+		KSI_snprintf(sigFileName, sigFileName_len, "%s.ksig", item->name);
+
+		out = fopen(sigFileName, "wb");
+		if (out == NULL) {
+			res = KSI_IO_ERROR;
+			goto cleanup;
+		}
+	}
+
+	if (fwrite(raw, 1, raw_len, out) != raw_len) {
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (out != NULL && out != bs->container) fclose(out);
+	free(sigFileName);
+	KSI_free(raw);
+
+	return res;
+}
+
+/* Writes out the finished items at the head of the window. */
+static void writeResults(BulkSigner *bs) {
+	while (bs->nextWrite < bs->nextSubmit) {
+		Item *item = getItem(bs, bs->nextWrite);
+
+		if (!item->done) break;
+
+		if (item->error == KSI_OK) {
+			int res = writeSignature(bs, item);
+			if (res != KSI_OK) item->error = res;
+		}
+
+		if (item->error == KSI_OK) {
+			printf("OK\t%s\n", item->name);
+			bs->succeeded++;
+		} else {
+			printf("FAILED\t%s\t0x%x %s\n", item->name, item->error, KSI_getErrorString(item->error));
+			bs->failed++;
+		}
+
+		Item_clear(item);
+		bs->nextWrite++;
+	}
+}
+
+static int parseNumber(const char *str, size_t *value) {
+	char *end = NULL;
+	unsigned long tmp;
+
+	if (str == NULL) return 0;
+	tmp = strtoul(str, &end, 10);
+	if (end == str || *end != '\0') return 0;
+
+	*value = (size_t)tmp;
+	return 1;
+}
+
+static void printUsage(const char *command) {
+	fprintf(stderr, "Usage:\n"
+			"  %s [options] <aggregator-uri> <user> <pass> < <input-list>\n"
+			"\n"
+			"Reads file names (or hash imprints with -x) from the standard input, one per line,\n"
+			"and signs them. For every input line a result line 'OK<TAB>name' or\n"
+			"'FAILED<TAB>name<TAB>error' is printed in the input order.\n"
+			"\n"
+			"Options:\n"
+			"  -m async|block  Sign every hash separately (default), or aggregate each batch into\n"
+			"                  a local tree and sign only its root hash value.\n"
+			"  -x              Input lines are hex encoded hash imprints instead of file names.\n"
+			"  -a <alg>        Hash algorithm for the files (default: %s).\n"
+			"  -o <file>       Write the signatures into a single container file in the input\n"
+			"                  order, skipping the failed items. Without it every signature is\n"
+			"                  written next to its file as <file>.ksig.\n"
+			"  -j <threads>    Number of hashing threads, 0 for the number of processors (default).\n"
+			"  -b <count>      Number of items hashed at once, and the block size (default: %d).\n"
+			"  -w <count>      Maximum number of items in progress (default: %d).\n"
+			"  -r <count>      Maximum number of requests per second sent to the aggregator\n"
+			"                  (default: the window size).\n"
+			"  -R <count>      Number of retries of a failed request (default: %d).\n",
+			command, KSI_getHashAlgorithmName(KSI_getHashAlgorithmByName("default")),
+			DEFAULT_BATCH_SIZE, DEFAULT_WINDOW_SIZE, DEFAULT_RETRY_COUNT);
+}
+
+int main(int argc, char **argv) {
+	KSI_CTX *ksi = NULL;
+	int res = KSI_UNKNOWN_ERROR;
+	BulkSigner bs;
+	FILE *logFile = NULL;
+	const char *containerFile = NULL;
+	size_t threadCount = 0;
+	size_t maxRequests = 0;
+	size_t retries = DEFAULT_RETRY_COUNT;
+	unsigned long long startTime;
+	double elapsed;
+	int argi;
+	size_t i;
+
+	memset(&bs, 0, sizeof(bs));
+	bs.mode = MODE_ASYNC;
+	bs.batchSize = DEFAULT_BATCH_SIZE;
+	bs.windowSize = DEFAULT_WINDOW_SIZE;
+	bs.algo = KSI_getHashAlgorithmByName("default");
+
+	/* Handle command line parameters. */
+	for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char *opt = argv[argi];
+		const char *val = (argi + 1 < argc) ? argv[argi + 1] : NULL;
+		int ok = 1;
+
+		if (!strcmp(opt, "-x")) {
+			bs.hexInput = 1;
+			continue;
+		}
+
+		if (val == NULL) {
+			ok = 0;
+		} else if (!strcmp(opt, "-m")) {
+			if (!strcmp(val, "async")) {
+				bs.mode = MODE_ASYNC;
+			} else if (!strcmp(val, "block")) {
+				bs.mode = MODE_BLOCK;
+			} else {
+				ok = 0;
+			}
+		} else if (!strcmp(opt, "-a")) {
+			bs.algo = KSI_getHashAlgorithmByName(val);
+			ok = KSI_isHashAlgorithmSupported(bs.algo);
+		} else if (!strcmp(opt, "-o")) {
+			containerFile = val;
+		} else if (!strcmp(opt, "-j")) {
+			ok = parseNumber(val, &threadCount);
+		} else if (!strcmp(opt, "-b")) {
+			ok = parseNumber(val, &bs.batchSize) && bs.batchSize > 0;
+		} else if (!strcmp(opt, "-w")) {
+			ok = parseNumber(val, &bs.windowSize) && bs.windowSize > 0;
+		} else if (!strcmp(opt, "-r")) {
+			ok = parseNumber(val, &maxRequests) && maxRequests > 0;
+		} else if (!strcmp(opt, "-R")) {
+			ok = parseNumber(val, &retries);
+		} else {
+			ok = 0;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "Invalid option: %s.\n", opt);
+			printUsage(argv[0]);
+			res = KSI_INVALID_ARGUMENT;
+			goto cleanup;
+		}
+		argi++;
+	}
+	bs.retryCount = (unsigned)retries;
+
+	if (argc - argi != 3) {
+		printUsage(argv[0]);
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (bs.hexInput && containerFile == NULL) {
+		fprintf(stderr, "Signing hash imprints requires a container file (-o).\n");
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	bs.items = calloc(bs.windowSize, sizeof(Item));
+	if (bs.items == NULL) {
+		fprintf(stderr, "Unable to allocate the item window.\n");
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	if (containerFile != NULL) {
+		bs.container = fopen(containerFile, "wb");
+		if (bs.container == NULL) {
+			fprintf(stderr, "%s: Unable to open output file.\n", containerFile);
+			res = KSI_IO_ERROR;
+			goto cleanup;
+		}
+	}
+
+	/* Create new KSI context for this thread. */
+	res = KSI_CTX_new(&ksi);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to create context.\n");
+		goto cleanup;
+	}
+	bs.ksi = ksi;
+
+	/* Configure the logger. */
+	res = OpenLogging(ksi, "ksi_sign_bulk.log", &logFile);
+	if (res != KSI_OK) goto cleanup;
+
+	KSI_LOG_info(ksi, "Using KSI version: '%s'", KSI_getVersion());
+
+	/* The input files are hashed by the executor threads. */
+	res = KSI_Executor_new(ksi, threadCount, &bs.exec);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to create executor.\n");
+		goto cleanup;
+	}
+
+	res = KSI_CTX_setExecutor(ksi, bs.exec);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to set executor.\n");
+		KSI_Executor_free(bs.exec);
+		goto cleanup;
+	}
+
+	/* Create new async service provider. */
+	res = KSI_SigningAsyncService_new(ksi, &bs.as);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to create new async service object.\n");
+		goto cleanup;
+	}
+
+	res = KSI_AsyncService_setEndpoint(bs.as, argv[argi], argv[argi + 1], argv[argi + 2]);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to set aggregator to the async service client.\n");
+		goto cleanup;
+	}
+
+	/* No more requests than the window holds are ever in progress. */
+	res = KSI_AsyncService_setOption(bs.as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)bs.windowSize);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to set request cache size.\n");
+		goto cleanup;
+	}
+
+	/* The default of the service is a single request per round. */
+	res = KSI_AsyncService_setOption(bs.as, KSI_ASYNC_OPT_MAX_REQUEST_COUNT, (void *)(maxRequests > 0 ? maxRequests : bs.windowSize));
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to set maximum request count.\n");
+		goto cleanup;
+	}
+
+	if (bs.mode == MODE_BLOCK) {
+		res = KSI_LocalAggregator_new(ksi, bs.as, bs.algo, &bs.la);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to create local aggregator.\n");
+			goto cleanup;
+		}
+
+		/* Every batch read is closed into a tree of its own on the next run. */
+		res = KSI_LocalAggregator_setMaxLeafCount(bs.la, bs.batchSize);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to set block size.\n");
+			goto cleanup;
+		}
+	}
+
+	startTime = GetTimeUs();
+
+	while (!bs.eof || bs.nextWrite < bs.nextRead) {
+		int progress = 0;
+
+		if (!bs.eof && bs.nextRead - bs.nextWrite < bs.windowSize) {
+			res = readBatch(&bs);
+			if (res != KSI_OK) goto cleanup;
+			progress = 1;
+		}
+
+		submitItems(&bs);
+
+		res = collectSignatures(&bs, &progress);
+		if (res != KSI_OK) goto cleanup;
+
+		writeResults(&bs);
+
+		/* Wait for a while to avoid busy loop. */
+		if (!progress) sleep_ms(1);
+	}
+
+	elapsed = (double)(GetTimeUs() - startTime) / 1000000.0;
+	fprintf(stderr, "Succeeded: %lu, failed: %lu, %.3f s", (unsigned long)bs.succeeded, (unsigned long)bs.failed, elapsed);
+	if (elapsed > 0) fprintf(stderr, " (%.1f signatures/s)", (double)bs.succeeded / elapsed);
+	fprintf(stderr, ".\n");
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (res != KSI_OK && ksi != NULL) {
+		KSI_ERR_statusDump(ksi, stderr);
+	}
+
+	if (bs.items != NULL) {
+		for (i = 0; i < bs.windowSize; i++) Item_clear(&bs.items[i]);
+		free(bs.items);
+	}
+
+	KSI_LocalAggregator_free(bs.la);
+	KSI_AsyncService_free(bs.as);
+
+	if (bs.container != NULL) fclose(bs.container);
+	if (logFile != NULL) fclose(logFile);
+
+	/* The executor is freed with the context. */
+	KSI_CTX_free(ksi);
+
+	/* The status codes do not fit into the exit status. */
+	return (res == KSI_OK && bs.failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
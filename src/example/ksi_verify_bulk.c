@@ -0,0 +1,801 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+/*
+ * Verifies all the signatures found in the given files and directories.
+ *
+ * Every file is read as a sequence of signatures, thus a plain signature file and a container
+ * of concatenated signatures (e.g. written by ksi_sign_bulk) are handled the same way. The
+ * directories are walked recursively for files with the .ksig extension. The signatures are
+ * read in batches, and each batch is parsed and verified in parallel by the executor. The
+ * publications file is downloaded and verified only once, before the verification starts.
+ *
+ * The results are written to the standard output as JSON lines in the input order, followed
+ * by the failure counts per verification rule and the summary of the run.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#  include <sys/stat.h>
+#endif
+
+#include <ksi/ksi.h>
+#include <ksi/policy.h>
+#include <ksi/executor.h>
+#include <ksi/fast_tlv.h>
+#include <ksi/compatibility.h>
+
+#include "ksi_common.h"
+
+#define DEFAULT_BATCH_SIZE 256
+
+/* Maximum size of a signature, as it is encoded as a single TLV16. */
+#define MAX_SIGNATURE_LEN (0xffff + 4)
+
+#define SIGNATURE_EXT ".ksig"
+
+typedef struct Entry_st {
+	/* File containing the signature. */
+	const char *file;
+	/* Position of the signature in the file. */
+	size_t index;
+	unsigned char *raw;
+	size_t raw_len;
+
+	/* Status code of reading, parsing or verifying the signature. */
+	int status;
+	/* The document was hashed and verified along with the signature. */
+	int withDocument;
+	int resultCode;
+	int errorCode;
+	const char *ruleName;
+	const char *policyName;
+} Entry;
+
+typedef struct RuleStat_st {
+	const char *ruleName;
+	int errorCode;
+	size_t failed;
+	size_t inconclusive;
+} RuleStat;
+
+typedef struct BulkVerifier_st {
+	KSI_CTX *ksi;
+	KSI_Executor *exec;
+	const KSI_Policy *policy;
+	KSI_PublicationsFile *pubFile;
+	KSI_PublicationData *userPublication;
+	int extendingAllowed;
+	int hashDocuments;
+
+	/* Signature files to be verified. */
+	char **files;
+	size_t fileCount;
+	size_t fileCapacity;
+
+	/* The file being read. */
+	size_t nextFile;
+	FILE *in;
+	size_t nextIndex;
+
+	Entry *entries;
+	size_t batchSize;
+
+	RuleStat *rules;
+	size_t ruleCount;
+	size_t ruleCapacity;
+
+	size_t ok;
+	size_t failed;
+	size_t inconclusive;
+	size_t errors;
+} BulkVerifier;
+
+static int addFile(BulkVerifier *bv, const char *path) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (bv->fileCount == bv->fileCapacity) {
+		size_t capacity = bv->fileCapacity == 0 ? 64 : 2 * bv->fileCapacity;
+		char **tmp = realloc(bv->files, capacity * sizeof(char *));
+
+		if (tmp == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+		bv->files = tmp;
+		bv->fileCapacity = capacity;
+	}
+
+	res = KSI_strdup(path, &bv->files[bv->fileCount]);
+	if (res != KSI_OK) goto cleanup;
+	bv->fileCount++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int hasSignatureExt(const char *name) {
+	size_t len = strlen(name);
+	return len > strlen(SIGNATURE_EXT) && !strcmp(name + len - strlen(SIGNATURE_EXT), SIGNATURE_EXT);
+}
+
+static int compareNames(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int addPath(BulkVerifier *bv, const char *path, int explicit);
+
+/* Adds the signature files in the directory and its subdirectories, in the order of their names. */
+static int addDirectory(BulkVerifier *bv, const char *dir) {
+	int res = KSI_UNKNOWN_ERROR;
+	char **names = NULL;
+	size_t count = 0;
+	size_t capacity = 0;
+	char *path = NULL;
+	size_t i;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = INVALID_HANDLE_VALUE;
+#else
+	DIR *d = NULL;
+	struct dirent *de;
+#endif
+
+#ifdef _WIN32
+	path = malloc(strlen(dir) + 3);
+	if (path == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	sprintf(path, "%s\\*", dir);
+
+	find = FindFirstFileA(path, &data);
+	free(path);
+	path = NULL;
+	if (find == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "%s: Unable to open directory.\n", dir);
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+	do {
+		const char *name = data.cFileName;
+#else
+	d = opendir(dir);
+	if (d == NULL) {
+		fprintf(stderr, "%s: Unable to open directory.\n", dir);
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+	while ((de = readdir(d)) != NULL) {
+		const char *name = de->d_name;
+#endif
+		if (!strcmp(name, ".") || !strcmp(name, "..")) continue;
+
+		if (count == capacity) {
+			char **tmp = NULL;
+
+			capacity = capacity == 0 ? 64 : 2 * capacity;
+			tmp = realloc(names, capacity * sizeof(char *));
+			if (tmp == NULL) {
+				res = KSI_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			names = tmp;
+		}
+
+		res = KSI_strdup(name, &names[count]);
+		if (res != KSI_OK) goto cleanup;
+		count++;
+#ifdef _WIN32
+	} while (FindNextFileA(find, &data));
+#else
+	}
+#endif
+
+	if (count > 0) qsort(names, count, sizeof(char *), compareNames);
+
+	for (i = 0; i < count; i++) {
+		path = malloc(strlen(dir) + strlen(names[i]) + 2);
+		if (path == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+#ifdef _WIN32
+		sprintf(path, "%s\\%s", dir, names[i]);
+#else
+		sprintf(path, "%s/%s", dir, names[i]);
+#endif
+
+		res = addPath(bv, path, 0);
+		if (res != KSI_OK) goto cleanup;
+
+		free(path);
+		path = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+#ifdef _WIN32
+	if (find != INVALID_HANDLE_VALUE) FindClose(find);
+#else
+	if (d != NULL) closedir(d);
+#endif
+	for (i = 0; i < count; i++) KSI_free(names[i]);
+	free(names);
+	free(path);
+
+	return res;
+}
+
+/* Adds a file or the contents of a directory. Files found in a directory are added only with the signature extension. */
+static int addPath(BulkVerifier *bv, const char *path, int explicit) {
+#ifdef _WIN32
+	DWORD attr = GetFileAttributesA(path);
+
+	if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY)) {
+		return addDirectory(bv, path);
+	}
+#else
+	struct stat st;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		return addDirectory(bv, path);
+	}
+#endif
+
+	/* A given file is added regardless of its name, if it can not be read it is reported as a failed entry. */
+	if (!explicit && !hasSignatureExt(path)) return KSI_OK;
+
+	return addFile(bv, path);
+}
+
+/* Reads the next signature of the input files. Returns 0 if all the files have been read. */
+static int readEntry(BulkVerifier *bv, Entry *entry, unsigned char *buf) {
+	KSI_FTLV ftlv;
+	size_t consumed = 0;
+	int res;
+
+	while (bv->nextFile < bv->fileCount) {
+		const char *file = bv->files[bv->nextFile];
+
+		memset(entry, 0, sizeof(Entry));
+		entry->file = file;
+		entry->index = bv->nextIndex;
+
+		if (bv->in == NULL) {
+			bv->in = fopen(file, "rb");
+			if (bv->in == NULL) {
+				entry->status = KSI_IO_ERROR;
+				bv->nextFile++;
+				return 1;
+			}
+		}
+
+		res = KSI_FTLV_fileRead(bv->in, buf, MAX_SIGNATURE_LEN, &consumed, &ftlv);
+		if (res == KSI_OK) {
+			entry->raw = malloc(consumed);
+			if (entry->raw == NULL) {
+				entry->status = KSI_OUT_OF_MEMORY;
+			} else {
+				memcpy(entry->raw, buf, consumed);
+				entry->raw_len = consumed;
+			}
+			bv->nextIndex++;
+			return 1;
+		}
+
+		fclose(bv->in);
+		bv->in = NULL;
+		bv->nextFile++;
+		bv->nextIndex = 0;
+
+		/* The end of a non-empty file. */
+		if (consumed == 0 && entry->index > 0) continue;
+
+		/* The rest of the file can not be read after a broken signature. */
+		entry->status = (res == KSI_INVALID_FORMAT || res == KSI_BUFFER_OVERFLOW) ? KSI_INVALID_FORMAT : res;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int getDocumentHash(BulkVerifier *bv, const Entry *entry, KSI_Signature *sig, KSI_DataHash **hsh) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *sigHash = NULL;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	char *docName = NULL;
+	size_t docName_len = strlen(entry->file) - strlen(SIGNATURE_EXT);
+
+	/* Use the same algorithm as the signature. */
+	res = KSI_Signature_getDocumentHash(sig, &sigHash);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getHashAlg(sigHash, &algo);
+	if (res != KSI_OK) goto cleanup;
+
+	docName = malloc(docName_len + 1);
+	if (docName == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	memcpy(docName, entry->file, docName_len);
+	docName[docName_len] = '\0';
+
+	res = KSI_DataHash_fromFile(bv->ksi, docName, algo, hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	free(docName);
+
+	return res;
+}
+
+static int verifyTask(void *taskCtx, size_t index) {
+	BulkVerifier *bv = taskCtx;
+	Entry *entry = &bv->entries[index];
+	KSI_Signature *sig = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_VerificationContext context;
+	KSI_PolicyVerificationResult *result = NULL;
+	int res;
+
+	if (entry->status != KSI_OK) return KSI_OK;
+
+	/* The signature is verified with the selected policy only. */
+	res = KSI_Signature_parseWithPolicy(bv->ksi, entry->raw, entry->raw_len, KSI_VERIFICATION_POLICY_EMPTY, NULL, &sig);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Only the signature files are accompanied by a document. */
+	if (bv->hashDocuments && hasSignatureExt(entry->file)) {
+		res = getDocumentHash(bv, entry, sig, &hsh);
+		if (res != KSI_OK) goto cleanup;
+		entry->withDocument = 1;
+	}
+
+	res = KSI_VerificationContext_init(&context, bv->ksi);
+	if (res != KSI_OK) goto cleanup;
+
+	context.signature = sig;
+	context.documentHash = hsh;
+	context.userPublication = bv->userPublication;
+	context.userPublicationsFile = bv->pubFile;
+	context.extendingAllowed = bv->extendingAllowed;
+
+	res = KSI_SignatureVerifier_verify(bv->policy, &context, &result);
+	if (res != KSI_OK) goto cleanup;
+
+	entry->resultCode = result->finalResult.resultCode;
+	entry->errorCode = result->finalResult.errorCode;
+	/* The names are static strings of the library. */
+	entry->ruleName = result->finalResult.ruleName;
+	entry->policyName = result->finalResult.policyName;
+
+cleanup:
+
+	entry->status = res;
+
+	KSI_PolicyVerificationResult_free(result);
+	KSI_DataHash_free(hsh);
+	KSI_Signature_free(sig);
+	free(entry->raw);
+	entry->raw = NULL;
+
+	return KSI_OK;
+}
+
+static void printJsonString(const char *str) {
+	const unsigned char *p = (const unsigned char *)str;
+
+	putchar('"');
+	for (; *p != '\0'; p++) {
+		switch (*p) {
+			case '"': fputs("\\\"", stdout); break;
+			case '\\': fputs("\\\\", stdout); break;
+			case '\n': fputs("\\n", stdout); break;
+			case '\r': fputs("\\r", stdout); break;
+			case '\t': fputs("\\t", stdout); break;
+			default:
+				if (*p < 0x20) {
+					printf("\\u%04x", *p);
+				} else {
+					putchar(*p);
+				}
+		}
+	}
+	putchar('"');
+}
+
+static const char *resultString(int resultCode) {
+	switch (resultCode) {
+		case KSI_VER_RES_OK: return "OK";
+		case KSI_VER_RES_NA: return "NA";
+		case KSI_VER_RES_FAIL: return "FAIL";
+		default: return "UNKNOWN";
+	}
+}
+
+static int countRule(BulkVerifier *bv, const Entry *entry) {
+	RuleStat *rule = NULL;
+	size_t i;
+
+	for (i = 0; i < bv->ruleCount; i++) {
+		if (bv->rules[i].errorCode == entry->errorCode && !strcmp(bv->rules[i].ruleName, entry->ruleName)) {
+			rule = &bv->rules[i];
+			break;
+		}
+	}
+
+	if (rule == NULL) {
+		if (bv->ruleCount == bv->ruleCapacity) {
+			size_t capacity = bv->ruleCapacity == 0 ? 16 : 2 * bv->ruleCapacity;
+			RuleStat *tmp = realloc(bv->rules, capacity * sizeof(RuleStat));
+
+			if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+			bv->rules = tmp;
+			bv->ruleCapacity = capacity;
+		}
+
+		rule = &bv->rules[bv->ruleCount++];
+		memset(rule, 0, sizeof(RuleStat));
+		rule->ruleName = entry->ruleName;
+		rule->errorCode = entry->errorCode;
+	}
+
+	if (entry->resultCode == KSI_VER_RES_FAIL) {
+		rule->failed++;
+	} else {
+		rule->inconclusive++;
+	}
+
+	return KSI_OK;
+}
+
+static int printEntry(BulkVerifier *bv, const Entry *entry) {
+	printf("{\"file\":");
+	printJsonString(entry->file);
+	printf(",\"index\":%lu", (unsigned long)entry->index);
+
+	if (entry->status != KSI_OK) {
+		bv->errors++;
+		printf(",\"result\":\"ERROR\",\"status\":\"0x%x\",\"message\":", entry->status);
+		printJsonString(KSI_getErrorString(entry->status));
+		printf("}\n");
+		return KSI_OK;
+	}
+
+	switch (entry->resultCode) {
+		case KSI_VER_RES_OK: bv->ok++; break;
+		case KSI_VER_RES_FAIL: bv->failed++; break;
+		default: bv->inconclusive++; break;
+	}
+
+	printf(",\"result\":\"%s\",\"document\":%s", resultString(entry->resultCode), entry->withDocument ? "true" : "false");
+	if (entry->resultCode != KSI_VER_RES_OK) {
+		printf(",\"error\":");
+		printJsonString(KSI_VerificationErrorCode_toString(entry->errorCode));
+		printf(",\"rule\":");
+		printJsonString(entry->ruleName != NULL ? entry->ruleName : "");
+		printf(",\"policy\":");
+		printJsonString(entry->policyName != NULL ? entry->policyName : "");
+	}
+	printf("}\n");
+
+	if (entry->resultCode != KSI_VER_RES_OK && entry->ruleName != NULL) {
+		return countRule(bv, entry);
+	}
+
+	return KSI_OK;
+}
+
+static int parseNumber(const char *str, size_t *value) {
+	char *end = NULL;
+	unsigned long tmp;
+
+	if (str == NULL) return 0;
+	tmp = strtoul(str, &end, 10);
+	if (end == str || *end != '\0') return 0;
+
+	*value = (size_t)tmp;
+	return 1;
+}
+
+static const KSI_Policy *getPolicyByName(const char *name) {
+	if (!strcmp(name, "internal")) return KSI_VERIFICATION_POLICY_INTERNAL;
+	if (!strcmp(name, "calendar")) return KSI_VERIFICATION_POLICY_CALENDAR_BASED;
+	if (!strcmp(name, "key")) return KSI_VERIFICATION_POLICY_KEY_BASED;
+	if (!strcmp(name, "publications")) return KSI_VERIFICATION_POLICY_PUBLICATIONS_FILE_BASED;
+	if (!strcmp(name, "user")) return KSI_VERIFICATION_POLICY_USER_PUBLICATION_BASED;
+	if (!strcmp(name, "general")) return KSI_VERIFICATION_POLICY_GENERAL;
+	return NULL;
+}
+
+static void printUsage(const char *command) {
+	fprintf(stderr, "Usage:\n"
+			"  %s [options] <signature file | container | directory>...\n"
+			"\n"
+			"Verifies every signature found in the given files, and in the .ksig files of the\n"
+			"given directories. A line of JSON is printed for every signature in the input order,\n"
+			"followed by the failure counts per rule and a summary.\n"
+			"\n"
+			"Options:\n"
+			"  -p <policy>     Verification policy: internal, calendar, key, publications, user or\n"
+			"                  general (default).\n"
+			"  -d              Verify the signatures of <document>.ksig also against the document.\n"
+			"  -X <uri>        Extender URI, enables extending for the policies that allow it.\n"
+			"  -u <user>       Extender user name (default: anon).\n"
+			"  -k <key>        Extender key (default: anon).\n"
+			"  -P <uri>        Publications file URI.\n"
+			"  -E <email>      E-mail of the publications file certificate\n"
+			"                  (default: publications@guardtime.com).\n"
+			"  -s <string>     Publication string for the user publication based policy.\n"
+			"  -j <threads>    Number of verifying threads, 0 for the number of processors (default).\n"
+			"  -b <count>      Number of signatures verified at once (default: %d).\n",
+			command, DEFAULT_BATCH_SIZE);
+}
+
+int main(int argc, char **argv) {
+	KSI_CTX *ksi = NULL;
+	int res = KSI_UNKNOWN_ERROR;
+	BulkVerifier bv;
+	FILE *logFile = NULL;
+	unsigned char *buf = NULL;
+	const char *extenderUri = NULL;
+	const char *extenderUser = "anon";
+	const char *extenderKey = "anon";
+	const char *pubFileUri = NULL;
+	char *pubFileEmail = "publications@guardtime.com";
+	const char *pubString = NULL;
+	size_t threadCount = 0;
+	size_t total = 0;
+	unsigned long long startTime;
+	double elapsed;
+	int argi;
+	size_t i;
+
+	memset(&bv, 0, sizeof(bv));
+	bv.policy = KSI_VERIFICATION_POLICY_GENERAL;
+	bv.batchSize = DEFAULT_BATCH_SIZE;
+
+	/* Handle command line parameters. */
+	for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char *opt = argv[argi];
+		const char *val = (argi + 1 < argc) ? argv[argi + 1] : NULL;
+		int ok = 1;
+
+		if (!strcmp(opt, "-d")) {
+			bv.hashDocuments = 1;
+			continue;
+		}
+
+		if (val == NULL) {
+			ok = 0;
+		} else if (!strcmp(opt, "-p")) {
+			bv.policy = getPolicyByName(val);
+			ok = bv.policy != NULL;
+		} else if (!strcmp(opt, "-X")) {
+			extenderUri = val;
+		} else if (!strcmp(opt, "-u")) {
+			extenderUser = val;
+		} else if (!strcmp(opt, "-k")) {
+			extenderKey = val;
+		} else if (!strcmp(opt, "-P")) {
+			pubFileUri = val;
+		} else if (!strcmp(opt, "-E")) {
+			pubFileEmail = argv[argi + 1];
+		} else if (!strcmp(opt, "-s")) {
+			pubString = val;
+		} else if (!strcmp(opt, "-j")) {
+			ok = parseNumber(val, &threadCount);
+		} else if (!strcmp(opt, "-b")) {
+			ok = parseNumber(val, &bv.batchSize) && bv.batchSize > 0;
+		} else {
+			ok = 0;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "Invalid option: %s.\n", opt);
+			printUsage(argv[0]);
+			res = KSI_INVALID_ARGUMENT;
+			goto cleanup;
+		}
+		argi++;
+	}
+
+	if (argi == argc) {
+		printUsage(argv[0]);
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Init context. */
+	res = KSI_CTX_new(&ksi);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to init KSI context.\n");
+		goto cleanup;
+	}
+	bv.ksi = ksi;
+
+	/* Configure the logger. */
+	res = OpenLogging(ksi, "ksi_verify_bulk.log", &logFile);
+	if (res != KSI_OK) goto cleanup;
+
+	KSI_LOG_info(ksi, "Using KSI version: '%s'", KSI_getVersion());
+
+	if (extenderUri != NULL) {
+		res = KSI_CTX_setExtender(ksi, extenderUri, extenderUser, extenderKey);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to set extender parameters.\n");
+			goto cleanup;
+		}
+		bv.extendingAllowed = 1;
+	}
+
+	if (pubFileUri != NULL) {
+		const KSI_CertConstraint pubFileCertConstr[] = {
+				{ KSI_CERT_EMAIL, pubFileEmail },
+				{ NULL, NULL }
+		};
+
+		res = KSI_CTX_setPublicationUrl(ksi, pubFileUri);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to set publications file url.\n");
+			goto cleanup;
+		}
+
+		res = KSI_CTX_setDefaultPubFileCertConstraints(ksi, pubFileCertConstr);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to configure publications file cert constraints.\n");
+			goto cleanup;
+		}
+
+		/* Receive and verify the publications file once, instead of for every signature. */
+		res = KSI_receivePublicationsFile(ksi, &bv.pubFile);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to receive publications file.\n");
+			goto cleanup;
+		}
+
+		res = KSI_verifyPublicationsFile(ksi, bv.pubFile);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to verify publications file.\n");
+			goto cleanup;
+		}
+	}
+
+	if (pubString != NULL) {
+		res = KSI_PublicationData_fromBase32(ksi, pubString, &bv.userPublication);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to parse publication string.\n");
+			goto cleanup;
+		}
+	}
+
+	res = KSI_Executor_new(ksi, threadCount, &bv.exec);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to create executor.\n");
+		goto cleanup;
+	}
+
+	res = KSI_CTX_setExecutor(ksi, bv.exec);
+	if (res != KSI_OK) {
+		fprintf(stderr, "Unable to set executor.\n");
+		KSI_Executor_free(bv.exec);
+		goto cleanup;
+	}
+
+	for (; argi < argc; argi++) {
+		res = addPath(&bv, argv[argi], 1);
+		if (res != KSI_OK) {
+			fprintf(stderr, "%s: Unable to list signature files.\n", argv[argi]);
+			goto cleanup;
+		}
+	}
+
+	bv.entries = calloc(bv.batchSize, sizeof(Entry));
+	buf = malloc(MAX_SIGNATURE_LEN);
+	if (bv.entries == NULL || buf == NULL) {
+		fprintf(stderr, "Unable to allocate the signature batch.\n");
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	startTime = GetTimeUs();
+
+	for (;;) {
+		size_t count = 0;
+
+		while (count < bv.batchSize && readEntry(&bv, &bv.entries[count], buf)) count++;
+		if (count == 0) break;
+
+		res = KSI_Executor_forEach(bv.exec, count, verifyTask, &bv);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to verify the signatures.\n");
+			goto cleanup;
+		}
+
+		for (i = 0; i < count; i++) {
+			res = printEntry(&bv, &bv.entries[i]);
+			if (res != KSI_OK) {
+				fprintf(stderr, "Unable to collect rule statistics.\n");
+				goto cleanup;
+			}
+		}
+		fflush(stdout);
+
+		total += count;
+	}
+
+	elapsed = (double)(GetTimeUs() - startTime) / 1000000.0;
+
+	for (i = 0; i < bv.ruleCount; i++) {
+		printf("{\"rule\":");
+		printJsonString(bv.rules[i].ruleName);
+		printf(",\"error\":");
+		printJsonString(KSI_VerificationErrorCode_toString(bv.rules[i].errorCode));
+		printf(",\"fail\":%lu,\"na\":%lu}\n", (unsigned long)bv.rules[i].failed, (unsigned long)bv.rules[i].inconclusive);
+	}
+
+	printf("{\"summary\":{\"total\":%lu,\"ok\":%lu,\"fail\":%lu,\"na\":%lu,\"error\":%lu,\"seconds\":%.3f,\"perSecond\":%.1f}}\n",
+			(unsigned long)total, (unsigned long)bv.ok, (unsigned long)bv.failed, (unsigned long)bv.inconclusive,
+			(unsigned long)bv.errors, elapsed, elapsed > 0 ? (double)total / elapsed : 0.0);
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (res != KSI_OK && ksi != NULL) {
+		KSI_ERR_statusDump(ksi, stderr);
+	}
+
+	if (bv.in != NULL) fclose(bv.in);
+	for (i = 0; i < bv.fileCount; i++) KSI_free(bv.files[i]);
+	free(bv.files);
+	if (bv.entries != NULL) {
+		for (i = 0; i < bv.batchSize; i++) free(bv.entries[i].raw);
+		free(bv.entries);
+	}
+	free(bv.rules);
+	free(buf);
+
+	KSI_PublicationData_free(bv.userPublication);
+	KSI_PublicationsFile_free(bv.pubFile);
+
+	if (logFile != NULL) fclose(logFile);
+
+	/* The executor is freed with the context. */
+	KSI_CTX_free(ksi);
+
+	/* The status codes do not fit into the exit status. */
+	return (res == KSI_OK && bv.failed == 0 && bv.errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,6 +25,10 @@
 #include "net_http.h"
 #include "net_uri.h"
 #include "impl/ctx_impl.h"
+#include "impl/hash_impl.h"
+#include "impl/net_impl.h"
+#include "impl/publicationsfile_impl.h"
+#include "executor.h"
 #include "pkitruststore.h"
 #include "policy.h"
 
@@ -205,6 +209,18 @@ static void initOptions(KSI_CTX *ctx) {
 	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void*)KSI_CTX_PUBFILE_CACHE_DEFAULT_TTL);
 
 	KSI_CTX_setOption(ctx, KSI_OPT_HA_SAFEGUARD, (void*)KSI_CTX_HA_MAX_SUBSERVICES);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS, (void*)0);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_BACKGROUND_REFRESH, (void*)0);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_SHARED_IMAGE, (void*)0);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_DATAHASHER_CACHE_SIZE, (void*)16);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_NATIVE_SHA2, (void*)0);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_HASH_FILE_MMAP, (void*)0);
 }
 
 /**
@@ -255,6 +271,206 @@ cleanup:
 	return res;
 }
 
+/** Key of the list of the thread states of the calling thread, shared by all the contexts. */
+static KSI_ThreadKey threadStateKey;
+/** Guards the links between the thread states and the contexts. */
+static KSI_Mutex threadStateLock;
+/** State of the initialization of the globals above: 0 - not done, 1 - in progress, 2 - done. */
+static KSI_uint64_t threadStateInit = 0;
+
+/* Releases the objects kept for reuse by the thread. */
+static void threadState_clear(KSI_ThreadState *state) {
+	size_t i;
+	size_t len;
+
+	for (i = 0; i < KSI_NUMBER_OF_KNOWN_HASHALGS; i++) {
+		while (state->dataHasherRecycle[i] != NULL) {
+			KSI_DataHasher *hsr = state->dataHasherRecycle[i];
+			state->dataHasherRecycle[i] = hsr->next;
+			if (hsr->cleanup != NULL) hsr->cleanup(hsr);
+			KSI_free(hsr);
+		}
+		state->dataHasherRecycle_len[i] = 0;
+	}
+
+	/* The recycled hashes have no references left, thus #KSI_DataHash_free does not apply. */
+	while (state->dataHashRecycle != NULL && (len = KSI_DataHashList_length(state->dataHashRecycle)) > 0) {
+		KSI_DataHash *hsh = NULL;
+		if (KSI_DataHashList_remove(state->dataHashRecycle, len - 1, &hsh) != KSI_OK) break;
+		KSI_free(hsh);
+	}
+	KSI_DataHashList_free(state->dataHashRecycle);
+	state->dataHashRecycle = NULL;
+	KSI_AsyncHandleList_free(state->asyncHandleRecycle);
+	state->asyncHandleRecycle = NULL;
+	KSI_HighAvailabilityRequestList_free(state->haRequestRecycle);
+	state->haRequestRecycle = NULL;
+}
+
+/* Removes the state from the list of the context. The caller must hold the thread state lock. */
+static void threadState_unlink(KSI_ThreadState *state) {
+	if (state->prev != NULL) state->prev->next = state->next;
+	else state->ctx->threadStates = state->next;
+	if (state->next != NULL) state->next->prev = state->prev;
+	state->prev = state->next = NULL;
+}
+
+/* Destructor of the thread state key, called when the thread exits. */
+static void threadState_free(void *p) {
+	KSI_ThreadState *state = p;
+
+	KSI_Mutex_lock(&threadStateLock);
+	while (state != NULL) {
+		KSI_ThreadState *next = state->nextOfThread;
+
+		/* The states of the freed contexts have already been cleared. */
+		if (state->ctx != NULL) {
+			threadState_unlink(state);
+			threadState_clear(state);
+		}
+		KSI_free(state);
+		state = next;
+	}
+	KSI_Mutex_unlock(&threadStateLock);
+}
+
+static int threadState_initGlobals(void) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	for (;;) {
+		KSI_uint64_t init = KSI_ATOMIC_LOAD64(&threadStateInit);
+
+		if (init == 2) return KSI_OK;
+		/* Another thread is initializing the globals, wait for it to complete. */
+		if (init == 0 && KSI_ATOMIC_CAS64(&threadStateInit, 0, 1)) break;
+	}
+
+	res = KSI_Mutex_init(&threadStateLock);
+	if (res != KSI_OK) goto cleanup;
+
+	/* The states of an exiting thread are released by the destructor. */
+	res = KSI_ThreadKey_init(&threadStateKey, threadState_free);
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&threadStateLock);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_ATOMIC_STORE64(&threadStateInit, res == KSI_OK ? 2 : 0);
+
+	return res;
+}
+
+static KSI_ThreadState *threadState_new(KSI_CTX *ctx) {
+	KSI_ThreadState *tmp = NULL;
+	KSI_ThreadState **link = NULL;
+
+	tmp = KSI_new(KSI_ThreadState);
+	if (tmp == NULL) goto cleanup;
+
+	memset(tmp, 0, sizeof(*tmp));
+	tmp->ctx = ctx;
+
+	if (KSI_DataHashList_new(&tmp->dataHashRecycle) != KSI_OK ||
+			KSI_AsyncHandleList_new(&tmp->asyncHandleRecycle) != KSI_OK ||
+			KSI_HighAvailabilityRequestList_new(&tmp->haRequestRecycle) != KSI_OK) {
+		goto cleanup;
+	}
+
+	tmp->nextOfThread = KSI_ThreadKey_get(&threadStateKey);
+	if (KSI_ThreadKey_set(&threadStateKey, tmp) != KSI_OK) goto cleanup;
+
+	KSI_Mutex_lock(&threadStateLock);
+
+	/* Drop the states left behind by the freed contexts. */
+	link = &tmp->nextOfThread;
+	while (*link != NULL) {
+		KSI_ThreadState *state = *link;
+		if (state->ctx == NULL) {
+			*link = state->nextOfThread;
+			KSI_free(state);
+		} else {
+			link = &state->nextOfThread;
+		}
+	}
+
+	tmp->next = ctx->threadStates;
+	if (tmp->next != NULL) tmp->next->prev = tmp;
+	ctx->threadStates = tmp;
+
+	KSI_Mutex_unlock(&threadStateLock);
+
+	return tmp;
+
+cleanup:
+
+	if (tmp != NULL) {
+		threadState_clear(tmp);
+		KSI_free(tmp);
+	}
+
+	return NULL;
+}
+
+KSI_ThreadState *KSI_CTX_getThreadState(KSI_CTX *ctx, int create) {
+	KSI_ThreadState *state = NULL;
+
+	if (ctx == NULL) return NULL;
+
+	/* The list is only changed by the calling thread, the context of a state is cleared when the context is freed. */
+	for (state = KSI_ThreadKey_get(&threadStateKey); state != NULL; state = state->nextOfThread) {
+		if (KSI_ATOMIC_LOAD_PTR(&state->ctx) == ctx) return state;
+	}
+
+	return create ? threadState_new(ctx) : NULL;
+}
+
+static int initSync(KSI_CTX *ctx) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	res = KSI_Mutex_init(&ctx->lock);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Mutex_init(&ctx->publicationsFileLock);
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&ctx->lock);
+		goto cleanup;
+	}
+
+	res = KSI_Mutex_init(&ctx->publicationsFileDownloadLock);
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&ctx->publicationsFileLock);
+		KSI_Mutex_destroy(&ctx->lock);
+		goto cleanup;
+	}
+
+	res = KSI_Mutex_init(&ctx->hmacKeysLock);
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&ctx->publicationsFileDownloadLock);
+		KSI_Mutex_destroy(&ctx->publicationsFileLock);
+		KSI_Mutex_destroy(&ctx->lock);
+		goto cleanup;
+	}
+
+	res = threadState_initGlobals();
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&ctx->hmacKeysLock);
+		KSI_Mutex_destroy(&ctx->publicationsFileDownloadLock);
+		KSI_Mutex_destroy(&ctx->publicationsFileLock);
+		KSI_Mutex_destroy(&ctx->lock);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_CTX_new(KSI_CTX **context) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -266,16 +482,25 @@ int KSI_CTX_new(KSI_CTX **context) {
 		res = KSI_OUT_OF_MEMORY;
 		goto cleanup;
 	}
-	/* Init error stack. */
-	ctx->errors_size = KSI_ERR_STACK_LEN;
-	ctx->errors = KSI_malloc(sizeof(KSI_ERR) * ctx->errors_size);
-	if (ctx->errors == NULL) {
-		res = KSI_OUT_OF_MEMORY;
+
+	/* Init the synchronization primitives, they are expected to be valid by #KSI_CTX_free. */
+	res = initSync(ctx);
+	if (res != KSI_OK) {
+		KSI_free(ctx);
+		ctx = NULL;
 		goto cleanup;
 	}
-	ctx->errors_count = 0;
+
+	/* Init error stack. */
+	ctx->threadStates = NULL;
 	ctx->publicationsFile = NULL;
 	ctx->publicationsFileCachedAt = 0;
+	ctx->publicationsFileRefresh = NULL;
+	ctx->publicationsFileGeneration = 0;
+	ctx->publicationsFileRefreshFailures = 0;
+	ctx->publicationsFileRefreshRetryAt = 0;
+	ctx->publicationsFileCacheDir = NULL;
+	ctx->publicationUrl = NULL;
 	ctx->pkiTruststore = NULL;
 	ctx->netProvider = NULL;
 	ctx->publicationCertEmail_DEPRECATED = NULL;
@@ -285,9 +510,14 @@ int KSI_CTX_new(KSI_CTX **context) {
 	ctx->certConstraints = NULL;
 	ctx->freeCertConstraintsArray = freeCertConstraintsArray;
 	ctx->lastFailedSignature = NULL;
-	ctx->dataHashRecycle = NULL;
-	ctx->asyncHandleRecycle = NULL;
-	ctx->haRequestRecycle = NULL;
+	ctx->executor = NULL;
+	memset(&ctx->metrics, 0, sizeof(ctx->metrics));
+	ctx->metricsCallback = NULL;
+	ctx->metricsCallbackCtx = NULL;
+	ctx->metricsInterval = 0;
+	ctx->metricsReportAt = 0;
+	memset(ctx->hmacKeys, 0, sizeof(ctx->hmacKeys));
+	ctx->hmacKeysNext = 0;
 	ctx->cleanupFnList = NULL;
 	ctx->globalObjList = NULL;
 	ctx->registerGlobalObject = registerGlobalObject;
@@ -323,14 +553,6 @@ int KSI_CTX_new(KSI_CTX **context) {
 	res = KSI_PKITruststore_registerGlobals(ctx);
 	if (res != KSI_OK) goto cleanup;
 
-	/* Garbage collection. */
-	res = KSI_DataHashList_new(&ctx->dataHashRecycle);
-	if (res != KSI_OK) goto cleanup;
-	res = KSI_AsyncHandleList_new(&ctx->asyncHandleRecycle);
-	if (res != KSI_OK) goto cleanup;
-	res = KSI_HighAvailabilityRequestList_new(&ctx->haRequestRecycle);
-	if (res != KSI_OK) goto cleanup;
-
 	/* Return the context. */
 	*context = ctx;
 	ctx = NULL;
@@ -413,31 +635,59 @@ static void globalCleanup(KSI_CTX *ctx) {
 	}
 }
 
+static void waitPublicationsFileRefresh(KSI_CTX *ctx, bool block);
+
 /**
  *
  */
 void KSI_CTX_free(KSI_CTX *ctx) {
+	size_t i;
+
 	if (ctx != NULL) {
+		/* Stop the workers before anything they might use is released. */
+		KSI_Executor_free(ctx->executor);
+		ctx->executor = NULL;
+
+		/* The refresh may depend on the global objects, wait for it first. */
+		waitPublicationsFileRefresh(ctx, true);
+
 		/* Call cleanup methods. */
 		globalCleanup(ctx);
 
 		KSI_List_free(ctx->cleanupFnList);
 		KSI_List_free(ctx->globalObjList);
 
-		KSI_free(ctx->errors);
-
 		KSI_NetworkClient_free(ctx->netProvider);
 		KSI_PKITruststore_free(ctx->pkiTruststore);
 
 		KSI_PublicationsFile_free(ctx->publicationsFile);
+		KSI_free(ctx->publicationsFileCacheDir);
+		KSI_free(ctx->publicationUrl);
 		KSI_free(ctx->publicationCertEmail_DEPRECATED);
 
 		freeCertConstraintsArray(ctx->certConstraints);
 		KSI_Signature_free(ctx->lastFailedSignature);
 
-		KSI_DataHashList_free(ctx->dataHashRecycle);
-		KSI_AsyncHandleList_free(ctx->asyncHandleRecycle);
-		KSI_HighAvailabilityRequestList_free(ctx->haRequestRecycle);
+		for (i = 0; i < KSI_HMAC_KEY_CACHE_LEN; i++) {
+			KSI_HmacHasher_free(ctx->hmacKeys[i].hasher);
+			KSI_free(ctx->hmacKeys[i].key);
+		}
+
+		/* Release the error stacks and the recycled objects of all the threads. The threads drop
+		 * the cleared states when they exit or create a state for another context. */
+		KSI_Mutex_lock(&threadStateLock);
+		while (ctx->threadStates != NULL) {
+			KSI_ThreadState *state = ctx->threadStates;
+			threadState_unlink(state);
+			threadState_clear(state);
+			KSI_ATOMIC_CAS_PTR(&state->ctx, ctx, NULL);
+		}
+		KSI_Mutex_unlock(&threadStateLock);
+
+		KSI_Mutex_destroy(&ctx->hmacKeysLock);
+		KSI_Mutex_destroy(&ctx->publicationsFileDownloadLock);
+		KSI_Mutex_destroy(&ctx->publicationsFileLock);
+		KSI_Mutex_destroy(&ctx->lock);
 
 		KSI_free(ctx);
 	}
@@ -479,63 +729,514 @@ int KSI_sendExtenderRequest(KSI_CTX *ctx, KSI_ExtendReq *request, KSI_RequestHan
 	KSI_RequestHandle *tmp = NULL;
 	KSI_NetworkClient *netProvider = NULL;
 
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || request == NULL || handle == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || request == NULL || handle == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	netProvider = ctx->netProvider;
+
+	res = KSI_NetworkClient_sendExtendRequest(netProvider, request, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	*handle = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_RequestHandle_free(tmp);
+
+	return res;
+}
+
+int KSI_sendPublicationRequest(KSI_CTX *ctx, const unsigned char KSI_UNUSED(*request), size_t KSI_UNUSED(request_length), KSI_RequestHandle **handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_NetworkClient *netProvider = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || handle == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	netProvider = ctx->netProvider;
+
+	res = KSI_NetworkClient_sendPublicationsFileRequest(netProvider, handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+
+}
+
+/* Delay before retrying a failed background refresh of the publications file, doubled after every failure. */
+#define KSI_PUBFILE_REFRESH_BACKOFF_MIN_SECONDS 10
+#define KSI_PUBFILE_REFRESH_BACKOFF_MAX_SECONDS 3600
+
+/**
+ * Background refresh of the publications file (see #KSI_OPT_PUBFILE_BACKGROUND_REFRESH).
+ */
+struct KSI_PublicationsFileRefresh_st {
+	KSI_CTX *ctx;
+	KSI_Thread thread;
+	/* Generation of the publications file being refreshed, see #replacePublicationsFile. */
+	size_t generation;
+	/* Set when the thread has finished, guarded by the publications file lock. */
+	bool done;
+};
+
+/* Must be called with the publications file lock held. */
+static void replacePublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile *pubFile) {
+	if (pubFile != NULL) KSI_Metrics_count(ctx, NULL, KSI_METRIC_PUBFILE_REFRESHES, 1);
+
+	KSI_PublicationsFile_free(ctx->publicationsFile);
+	ctx->publicationsFile = pubFile;
+	/* Clear the cache timeout. */
+	ctx->publicationsFileCachedAt = 0;
+	/* A refresh in progress must not override the new value. */
+	ctx->publicationsFileGeneration++;
+}
+
+/* Must be called with the publications file lock held. */
+static bool isPublicationsFileExpired(KSI_CTX *ctx, time_t now) {
+	return ctx->publicationsFile == NULL ||
+			difftime(now, ctx->publicationsFileCachedAt) >= ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS];
+}
+
+/**
+ * Releases the background refresh of the publications file, if it has finished. If \c block is set, waits
+ * for the refresh to finish, this must be done before reconfiguring anything the refresh depends on.
+ */
+static void waitPublicationsFileRefresh(KSI_CTX *ctx, bool block) {
+	KSI_PublicationsFileRefresh *refresh = NULL;
+
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	if (ctx->publicationsFileRefresh != NULL && (block || ctx->publicationsFileRefresh->done)) {
+		refresh = ctx->publicationsFileRefresh;
+		ctx->publicationsFileRefresh = NULL;
+	}
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
+
+	if (refresh != NULL) {
+		KSI_Thread_join(&refresh->thread);
+		KSI_free(refresh);
+	}
+}
+
+static int loadPublicationsFileCache(KSI_CTX *ctx, KSI_PublicationsFileCacheEntry *entry) {
+	int res = KSI_OK;
+
+	if (ctx->publicationsFileCacheDir != NULL) {
+		res = KSI_PublicationsFileCache_load(ctx, ctx->publicationsFileCacheDir, ctx->publicationUrl, entry);
+		if (res != KSI_OK) {
+			/* An unusable cache is equivalent to an empty one. */
+			KSI_LOG_logCtxError(ctx, KSI_LOG_WARN);
+			KSI_LOG_warn(ctx, "Unable to read publications file cache, ignoring it.");
+			KSI_ERR_clearErrors(ctx);
+			KSI_PublicationsFileCacheEntry_clear(entry);
+			res = KSI_OK;
+		}
+	}
+
+	return res;
+}
+
+static void attachPublicationsFileImage(KSI_CTX *ctx, const KSI_PublicationsFileCacheEntry *cached, KSI_PublicationsFile **pubFile) {
+	KSI_PublicationsFile *tmp = NULL;
+
+	if (KSI_PublicationsFileCache_attach(ctx, ctx->publicationsFileCacheDir, &tmp) != KSI_OK) {
+		KSI_LOG_logCtxError(ctx, KSI_LOG_WARN);
+		KSI_LOG_warn(ctx, "Unable to attach to the shared publications file image, using a private copy.");
+		KSI_ERR_clearErrors(ctx);
+	} else if (tmp->raw_len != cached->raw_len || memcmp(tmp->raw, cached->raw, cached->raw_len) != 0) {
+		/* The image has been replaced after the cache entry was read, its state is unknown. */
+		KSI_LOG_debug(ctx, "Shared publications file image has changed, using a private copy.");
+		KSI_PublicationsFile_free(tmp);
+		tmp = NULL;
+	}
+
+	*pubFile = tmp;
+}
+
+static int sendPublicationsFileRequest(KSI_CTX *ctx, const KSI_PublicationsFileCacheEntry *cached, KSI_RequestHandle **handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_RequestHandle *tmp = NULL;
+
+	res = KSI_sendPublicationRequest(ctx, NULL, 0, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	/* Make the download conditional, if there is a cached copy. */
+	if (cached->raw != NULL) {
+		if ((cached->etag != NULL && (res = KSI_strdup(cached->etag, &tmp->ifNoneMatch)) != KSI_OK) ||
+				(cached->lastModified != NULL && (res = KSI_strdup(cached->lastModified, &tmp->ifModifiedSince)) != KSI_OK)) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
+	}
+
+	*handle = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_RequestHandle_free(tmp);
+
+	return res;
+}
+
+static int updatePublicationsFileCache(KSI_CTX *ctx, KSI_RequestHandle *handle, KSI_PublicationsFileCacheEntry *entry,
+		const unsigned char *raw, size_t raw_len, bool verified, time_t now) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *tmp = NULL;
+
+	if (entry->raw != raw) {
+		tmp = KSI_malloc(raw_len);
+		if (tmp == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+		memcpy(tmp, raw, raw_len);
+
+		KSI_free(entry->raw);
+		entry->raw = tmp;
+		entry->raw_len = raw_len;
+		tmp = NULL;
+
+		/* The validators of the previous file are not valid any more. */
+		KSI_free(entry->etag);
+		entry->etag = NULL;
+		KSI_free(entry->lastModified);
+		entry->lastModified = NULL;
+	}
+
+	if (handle->etag != NULL) {
+		KSI_free(entry->etag);
+		entry->etag = handle->etag;
+		handle->etag = NULL;
+	}
+
+	if (handle->lastModified != NULL) {
+		KSI_free(entry->lastModified);
+		entry->lastModified = handle->lastModified;
+		handle->lastModified = NULL;
+	}
+
+	entry->fetchedAt = now;
+	entry->verified = verified;
+
+	res = KSI_PublicationsFileCache_store(ctx, ctx->publicationsFileCacheDir, ctx->publicationUrl, entry);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmp);
+
+	return res;
+}
+
+/**
+ * Parses the received publications file. If the persistent cache is enabled, the file is verified (unless
+ * the cached copy has the same content and has already been verified) and the cache is updated.
+ */
+static int acceptPublicationsFile(KSI_CTX *ctx, KSI_RequestHandle *handle, KSI_PublicationsFileCacheEntry *cached, bool mustVerify, time_t now, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	KSI_PublicationsFile *tmp = NULL;
+	bool unchanged = false;
+
+	res = KSI_RequestHandle_getResponse(handle, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	if (cached->raw != NULL) {
+		if (handle->err.code == 304) {
+			KSI_LOG_debug(ctx, "Publications file not modified, using the cached copy.");
+			raw = cached->raw;
+			raw_len = cached->raw_len;
+		}
+		unchanged = raw_len == cached->raw_len && memcmp(raw, cached->raw, raw_len) == 0;
+	}
+
+	res = KSI_PublicationsFile_parse(ctx, raw, raw_len, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	if (unchanged && cached->verified) {
+		res = KSI_PublicationsFile_setSignatureVerified(tmp, true);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
+	} else if (mustVerify || ctx->publicationsFileCacheDir != NULL) {
+		res = KSI_verifyPublicationsFile(ctx, tmp);
+		if (res == KSI_OK) {
+			res = KSI_PublicationsFile_setSignatureVerified(tmp, ctx->publicationsFileCacheDir != NULL);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx,res, NULL);
+				goto cleanup;
+			}
+		} else if (mustVerify) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		} else {
+			/* Leave it to the caller to find out, as without the cache. */
+			KSI_LOG_logCtxError(ctx, KSI_LOG_DEBUG);
+			KSI_ERR_clearErrors(ctx);
+		}
+	}
+
+	if (ctx->publicationsFileCacheDir != NULL) {
+		res = updatePublicationsFileCache(ctx, handle, cached, raw, raw_len, tmp->signatureVerified, now);
+		if (res != KSI_OK) {
+			KSI_LOG_logCtxError(ctx, KSI_LOG_WARN);
+			KSI_LOG_warn(ctx, "Unable to update publications file cache.");
+			KSI_ERR_clearErrors(ctx);
+		}
+	}
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/**
+ * Downloads and parses the publications file. Must not be called with the publications file lock held.
+ */
+static int fetchPublicationsFile(KSI_CTX *ctx, KSI_PublicationsFileCacheEntry *cached, bool mustVerify, time_t now, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_RequestHandle *handle = NULL;
+
+	res = sendPublicationsFileRequest(ctx, cached, &handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_RequestHandle_perform(handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	res = acceptPublicationsFile(ctx, handle, cached, mustVerify, now, pubFile);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_RequestHandle_free(handle);
+
+	return res;
+}
+
+static void publicationsFileRefresh_run(void *arg) {
+	KSI_PublicationsFileRefresh *refresh = arg;
+	KSI_CTX *ctx = refresh->ctx;
+	KSI_PublicationsFileCacheEntry cached;
+	KSI_PublicationsFile *tmp = NULL;
+	unsigned failures = 0;
+	time_t delay = 0;
+	bool replaced = false;
+	time_t now;
+	int res;
+
+	memset(&cached, 0, sizeof(cached));
+	time(&now);
+
+	KSI_LOG_debug(ctx, "Refreshing publications file in the background.");
+
+	res = loadPublicationsFileCache(ctx, &cached);
+	/* Never replace the cached file with one that can not be trusted. */
+	if (res == KSI_OK) res = fetchPublicationsFile(ctx, &cached, true, now, &tmp);
+
+	/* Only the result is published under the lock. */
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	if (res != KSI_OK) {
+		failures = ++ctx->publicationsFileRefreshFailures;
+		for (delay = KSI_PUBFILE_REFRESH_BACKOFF_MIN_SECONDS; --failures > 0 && delay < KSI_PUBFILE_REFRESH_BACKOFF_MAX_SECONDS; delay *= 2);
+		if (delay > KSI_PUBFILE_REFRESH_BACKOFF_MAX_SECONDS) delay = KSI_PUBFILE_REFRESH_BACKOFF_MAX_SECONDS;
+		ctx->publicationsFileRefreshRetryAt = now + delay;
+	} else {
+		ctx->publicationsFileRefreshFailures = 0;
+		ctx->publicationsFileRefreshRetryAt = 0;
+		/* Drop the result, if the file has been replaced in the meanwhile. */
+		if (refresh->generation == ctx->publicationsFileGeneration) {
+			replacePublicationsFile(ctx, tmp);
+			tmp = NULL;
+			ctx->publicationsFileCachedAt = now;
+			replaced = true;
+		}
+	}
+	refresh->done = true;
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
+
+	if (res != KSI_OK) {
+		/* Keep serving the cached file, the failure is only reported in the log. */
+		KSI_LOG_logCtxError(ctx, KSI_LOG_WARN);
+		KSI_LOG_warn(ctx, "Publications file refresh failed, using the cached file. Retrying in %u seconds.", (unsigned)delay);
+		KSI_ERR_clearErrors(ctx);
+	} else {
+		KSI_LOG_debug(ctx, replaced ? "Publications file refreshed." : "Publications file replaced during the refresh, dropping the result.");
+	}
+
+	KSI_PublicationsFile_free(tmp);
+	KSI_PublicationsFileCacheEntry_clear(&cached);
+}
+
+/* Must be called with the publications file lock held. */
+static void startPublicationsFileRefresh(KSI_CTX *ctx, time_t now) {
+	KSI_PublicationsFileRefresh *tmp = NULL;
+
+	if (ctx->publicationsFileRefresh != NULL || difftime(ctx->publicationsFileRefreshRetryAt, now) > 0) return;
+
+	tmp = KSI_new(KSI_PublicationsFileRefresh);
+	if (tmp == NULL) {
+		KSI_LOG_warn(ctx, "Unable to start publications file refresh: out of memory.");
+		return;
+	}
+
+	tmp->ctx = ctx;
+	tmp->generation = ctx->publicationsFileGeneration;
+	tmp->done = false;
+
+	if (KSI_Thread_start(&tmp->thread, publicationsFileRefresh_run, tmp) != KSI_OK) {
+		KSI_LOG_warn(ctx, "Unable to start publications file refresh thread.");
+		KSI_free(tmp);
+		return;
+	}
+
+	ctx->publicationsFileRefresh = tmp;
+}
+
+/**
+ * Loads the publications file from the persistent cache or downloads it, and makes it the cached file of the
+ * context. The publications file lock is only held for checking and replacing the cached file.
+ */
+static int updatePublicationsFile(KSI_CTX *ctx, time_t now, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFile *tmp = NULL;
+	KSI_PublicationsFileCacheEntry cached;
+	time_t cachedAt = now;
+	size_t generation = 0;
+	bool hasFile = false;
+
+	memset(&cached, 0, sizeof(cached));
+
+	/* The file may have been updated by a concurrent caller. */
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	if (!isPublicationsFileExpired(ctx, now)) tmp = KSI_PublicationsFile_ref(ctx->publicationsFile);
+	hasFile = ctx->publicationsFile != NULL;
+	generation = ctx->publicationsFileGeneration;
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
+
+	if (tmp != NULL) {
+		*pubFile = tmp;
+		res = KSI_OK;
 		goto cleanup;
 	}
 
-	netProvider = ctx->netProvider;
-
-	res = KSI_NetworkClient_sendExtendRequest(netProvider, request, &tmp);
+	res = loadPublicationsFileCache(ctx, &cached);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx,res, NULL);
 		goto cleanup;
 	}
 
-	*handle = tmp;
-	tmp = NULL;
-
-	res = KSI_OK;
+	if (!hasFile && cached.raw != NULL &&
+			difftime(now, cached.fetchedAt) < ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS]) {
+		KSI_LOG_debug(ctx, "Loading publications file from the cache.");
 
-cleanup:
+		if (ctx->options[KSI_OPT_PUBFILE_SHARED_IMAGE]) {
+			attachPublicationsFileImage(ctx, &cached, &tmp);
+		}
 
-	KSI_RequestHandle_free(tmp);
+		if (tmp == NULL) {
+			res = KSI_PublicationsFile_parse(ctx, cached.raw, cached.raw_len, &tmp);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx,res, NULL);
+				goto cleanup;
+			}
+		}
+		res = KSI_PublicationsFile_setSignatureVerified(tmp, cached.verified);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
 
-	return res;
-}
+		/* Keep the original download time, for the cache timeout. */
+		cachedAt = cached.fetchedAt;
+	} else {
+		KSI_LOG_debug(ctx, "Receiving publications file.");
 
-int KSI_sendPublicationRequest(KSI_CTX *ctx, const unsigned char KSI_UNUSED(*request), size_t KSI_UNUSED(request_length), KSI_RequestHandle **handle) {
-	int res = KSI_UNKNOWN_ERROR;
-	KSI_NetworkClient *netProvider = NULL;
+		res = fetchPublicationsFile(ctx, &cached, false, now, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
 
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || handle == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
+		KSI_LOG_debug(ctx, "Publications file received.");
 	}
 
-	netProvider = ctx->netProvider;
-
-	res = KSI_NetworkClient_sendPublicationsFileRequest(netProvider, handle);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx,res, NULL);
-		goto cleanup;
+	/* Do not override a file set in the meanwhile. */
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	if (generation == ctx->publicationsFileGeneration) {
+		replacePublicationsFile(ctx, KSI_PublicationsFile_ref(tmp));
+		ctx->publicationsFileCachedAt = cachedAt;
 	}
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
+
+	*pubFile = tmp;
+	tmp = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-	return res;
+	KSI_PublicationsFile_free(tmp);
+	KSI_PublicationsFileCacheEntry_clear(&cached);
 
+	return res;
 }
 
 int KSI_receivePublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile **pubFile) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_RequestHandle *handle = NULL;
-	const unsigned char *raw = NULL;
-	size_t raw_len = 0;
 	KSI_PublicationsFile *tmp = NULL;
 	time_t now = 0;
 
@@ -545,53 +1246,38 @@ int KSI_receivePublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile **pubFile) {
 		goto cleanup;
 	}
 
-	if (difftime(time(&now), ctx->publicationsFileCachedAt) >= ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] ||
-			ctx->publicationsFile == NULL) {
-		KSI_LOG_debug(ctx, "Receiving publications file.");
-
-		res = KSI_sendPublicationRequest(ctx, NULL, 0, &handle);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
-
-		res = KSI_RequestHandle_perform(handle);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
+	time(&now);
 
-		res = KSI_RequestHandle_getResponse(handle, &raw, &raw_len);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
+	waitPublicationsFileRefresh(ctx, false);
 
-		res = KSI_PublicationsFile_parse(ctx, raw, raw_len, &tmp);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	if (!isPublicationsFileExpired(ctx, now)) {
+		tmp = KSI_PublicationsFile_ref(ctx->publicationsFile);
+	} else if (ctx->options[KSI_OPT_PUBFILE_BACKGROUND_REFRESH] && ctx->publicationsFile != NULL) {
+		/* Keep serving the expired file while the new one is downloaded. */
+		startPublicationsFileRefresh(ctx, now);
+		tmp = KSI_PublicationsFile_ref(ctx->publicationsFile);
+	}
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
 
-		res = KSI_CTX_setPublicationsFile(ctx, tmp);
+	if (tmp == NULL) {
+		/* Concurrent callers wait for a single download. */
+		KSI_Mutex_lock(&ctx->publicationsFileDownloadLock);
+		res = updatePublicationsFile(ctx, now, &tmp);
+		KSI_Mutex_unlock(&ctx->publicationsFileDownloadLock);
 		if (res != KSI_OK) {
 			KSI_pushError(ctx,res, NULL);
 			goto cleanup;
 		}
-		tmp = NULL;
-
-		ctx->publicationsFileCachedAt = now;
-
-		KSI_LOG_debug(ctx, "Publications file received.");
 	}
 
-	*pubFile = KSI_PublicationsFile_ref(ctx->publicationsFile);
+	*pubFile = tmp;
+	tmp = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_RequestHandle_free(handle);
 	KSI_PublicationsFile_free(tmp);
 
 	return res;
@@ -807,6 +1493,51 @@ cleanup:
 	return res;
 }
 
+typedef struct SignatureBatch_st {
+	KSI_CTX *ctx;
+	KSI_Signature * const *sig;
+	KSI_Signature **extended;
+	int *results;
+} SignatureBatch;
+
+static int verifyBatchElement(void *c, size_t i) {
+	SignatureBatch *batch = c;
+	int res;
+
+	res = KSI_verifySignature(batch->ctx, batch->sig[i]);
+	if (batch->results != NULL) batch->results[i] = res;
+
+	return res;
+}
+
+int KSI_verifySignatures(KSI_CTX *ctx, KSI_Signature * const *sig, size_t count, int *results) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureBatch batch;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || (count > 0 && sig == NULL)) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	batch.ctx = ctx;
+	batch.sig = sig;
+	batch.extended = NULL;
+	batch.results = results;
+
+	res = KSI_Executor_forEach(ctx->executor, count, verifyBatchElement, &batch);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_createSignature(KSI_CTX *ctx, KSI_DataHash *dataHash, KSI_Signature **sig) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_Signature *tmp = NULL;
@@ -895,6 +1626,48 @@ cleanup:
 	return res;
 }
 
+static int extendBatchElement(void *c, size_t i) {
+	SignatureBatch *batch = c;
+	int res;
+
+	res = KSI_extendSignature(batch->ctx, batch->sig[i], &batch->extended[i]);
+	if (batch->results != NULL) batch->results[i] = res;
+
+	return res;
+}
+
+int KSI_extendSignatures(KSI_CTX *ctx, const KSI_Signature * const *sig, size_t count, KSI_Signature **extended, int *results) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureBatch batch;
+	size_t i;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || (count > 0 && (sig == NULL || extended == NULL))) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) extended[i] = NULL;
+
+	batch.ctx = ctx;
+	/* The signatures are only read. */
+	batch.sig = (KSI_Signature * const *)sig;
+	batch.extended = extended;
+	batch.results = results;
+
+	res = KSI_Executor_forEach(ctx->executor, count, extendBatchElement, &batch);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_CTX_setLogLevel(KSI_CTX *ctx, int level) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -914,6 +1687,7 @@ cleanup:
 }
 
 void KSI_ERR_push(KSI_CTX *ctx, int statusCode, long extErrorCode, const char *fileName, unsigned int lineNr, const char *message) {
+	KSI_ThreadState *stack = NULL;
 	KSI_ERR *ctxErr = NULL;
 	const char *tmp = NULL;
 
@@ -923,8 +1697,12 @@ void KSI_ERR_push(KSI_CTX *ctx, int statusCode, long extErrorCode, const char *f
 	/* Do nothing if there's no error. */
 	if (statusCode == KSI_OK) return;
 
+	/* The stack is created on the first error reported by the thread. The error is dropped if it fails. */
+	stack = KSI_CTX_getThreadState(ctx, 1);
+	if (stack == NULL) return;
+
 	/* Get the error container to use for storage. */
-	ctxErr = &ctx->errors[ctx->errors_count % ctx->errors_size];
+	ctxErr = &stack->errors[stack->count % KSI_ERR_STACK_LEN];
 
 	ctxErr->statusCode = statusCode;
 	ctxErr->extErrorCode = extErrorCode;
@@ -934,17 +1712,19 @@ void KSI_ERR_push(KSI_CTX *ctx, int statusCode, long extErrorCode, const char *f
 	tmp = KSI_strnvl(message);
 	KSI_strncpy(ctxErr->message, tmp, sizeof(ctxErr->message));
 
-	ctx->errors_count++;
+	stack->count++;
 }
 
 void KSI_ERR_clearErrors(KSI_CTX *ctx) {
-	if (ctx != NULL) {
-		ctx->errors_count = 0;
+	KSI_ThreadState *stack = KSI_CTX_getThreadState(ctx, 0);
+	if (stack != NULL) {
+		stack->count = 0;
 	}
 }
 
 static int ksi_err_toPrinter(KSI_CTX *ctx, void *to, size_t buf_len, void* (*printer)(void *to, size_t to_len, size_t *count, const char *format, ...)) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_ThreadState *stack = NULL;
 	KSI_ERR *err = NULL;
 	size_t i;
 	size_t count = 0;
@@ -955,21 +1735,23 @@ static int ksi_err_toPrinter(KSI_CTX *ctx, void *to, size_t buf_len, void* (*pri
 		goto cleanup;
 	}
 
+	stack = KSI_CTX_getThreadState(ctx, 0);
+
 	nextWrite = printer(nextWrite, buf_len - count, &count, "KSI error trace:\n");
-	if (ctx->errors_count == 0) {
+	if (stack == NULL || stack->count == 0) {
 		printer(nextWrite, buf_len - count, &count, "No errors.\n");
 		res = KSI_OK;
 		goto cleanup;
 	}
 
 	/* List all errors, starting from the most general. */
-	for (i = 0; i < ctx->errors_count && i < ctx->errors_size; i++) {
-		err = ctx->errors + ((ctx->errors_count - i - 1) % ctx->errors_size);
-		nextWrite = printer(nextWrite, buf_len - count, &count, "  %3lu) %s:%u - (%d/%ld) %s\n", ctx->errors_count - i, err->fileName, err->lineNr,err->statusCode, err->extErrorCode, *err->message != '\0' ? err->message : KSI_getErrorString(err->statusCode));
+	for (i = 0; i < stack->count && i < KSI_ERR_STACK_LEN; i++) {
+		err = stack->errors + ((stack->count - i - 1) % KSI_ERR_STACK_LEN);
+		nextWrite = printer(nextWrite, buf_len - count, &count, "  %3lu) %s:%u - (%d/%ld) %s\n", stack->count - i, err->fileName, err->lineNr,err->statusCode, err->extErrorCode, *err->message != '\0' ? err->message : KSI_getErrorString(err->statusCode));
 	}
 
 	/* If there where more errors than buffers for the errors, indicate the fact. */
-	if (ctx->errors_count > ctx->errors_size) {
+	if (stack->count > KSI_ERR_STACK_LEN) {
 		printer(nextWrite, buf_len - count, &count, "  ... (more errors)\n");
 	}
 
@@ -1009,15 +1791,17 @@ char *KSI_ERR_toString(KSI_CTX *ctx, char *buf, size_t buf_len) {
 }
 
 int KSI_ERR_getBaseErrorMessage(KSI_CTX *ctx, char *buf, size_t len, int *error, int *ext){
+	KSI_ThreadState *stack = NULL;
 	KSI_ERR *err = NULL;
 
 	if (ctx == NULL || buf == NULL){
 		return KSI_INVALID_ARGUMENT;
 	}
 
-	err = ctx->errors;
+	stack = KSI_CTX_getThreadState(ctx, 0);
 
-	if (ctx->errors_count) {
+	if (stack != NULL && stack->count) {
+		err = stack->errors;
 		KSI_strncpy(buf, *err->message != '\0' ? err->message : KSI_getErrorString(err->statusCode), len);
 		if (error != NULL)	*error = err->statusCode;
 		if (ext != NULL)	*ext = err->extErrorCode;
@@ -1030,18 +1814,153 @@ int KSI_ERR_getBaseErrorMessage(KSI_CTX *ctx, char *buf, size_t len, int *error,
 	return KSI_OK;
 }
 
-void *KSI_malloc(size_t size) {
+/** Number of the object types counted by the allocation statistics. */
+#define ALLOC_STATS_SLOTS 256
+
+typedef struct AllocStatSlot_st {
+	const char *type;
+	KSI_uint64_t calls;
+	KSI_uint64_t bytes;
+} AllocStatSlot;
+
+static KSI_Allocator allocator = { NULL, NULL, NULL, NULL };
+static int allocStatsEnabled = 0;
+static AllocStatSlot allocStats[ALLOC_STATS_SLOTS];
+static KSI_uint64_t allocStatsFrees = 0;
+
+/**
+ * Finds the slot of the type, the slots are claimed with a compare-and-swap of the type name
+ * and never released, thus no lock is needed. Returns \c NULL if the table is full.
+ */
+static AllocStatSlot *allocStatSlot(const char *type) {
+	size_t h = 5381;
+	const char *p;
+	size_t i;
+
+	for (p = type; *p != '\0'; p++) h = h * 33 + (unsigned char)*p;
+
+	for (i = 0; i < ALLOC_STATS_SLOTS; i++) {
+		AllocStatSlot *slot = &allocStats[(h + i) % ALLOC_STATS_SLOTS];
+		const char *name = KSI_ATOMIC_LOAD_PTR(&slot->type);
+
+		if (name == NULL) {
+			if (KSI_ATOMIC_CAS_PTR(&slot->type, NULL, type)) return slot;
+			name = KSI_ATOMIC_LOAD_PTR(&slot->type);
+		}
+		if (name == type || strcmp(name, type) == 0) return slot;
+	}
+
+	return NULL;
+}
+
+static void countAllocation(const char *type, size_t size) {
+	AllocStatSlot *slot = allocStatSlot(type != NULL ? type : "other");
+
+	if (slot != NULL) {
+		KSI_ATOMIC_ADD64(&slot->calls, 1);
+		KSI_ATOMIC_ADD64(&slot->bytes, size);
+	}
+}
+
+void *KSI_mallocTyped(size_t size, const char *type) {
+	if (allocStatsEnabled) countAllocation(type, size);
+
+	if (allocator.mallocFn != NULL) {
+		return allocator.mallocFn(allocator.allocCtx, size);
+	}
 	return malloc(size);
 }
 
+void *KSI_malloc(size_t size) {
+	return KSI_mallocTyped(size, NULL);
+}
+
 void *KSI_calloc(size_t num, size_t size) {
+	if (allocStatsEnabled) countAllocation(NULL, num * size);
+
+	if (allocator.callocFn != NULL) {
+		return allocator.callocFn(allocator.allocCtx, num, size);
+	}
+	if (allocator.mallocFn != NULL) {
+		void *ptr;
+
+		/* Guard the multiplication against overflow as calloc does. */
+		if (size != 0 && num > ((size_t)-1) / size) return NULL;
+
+		ptr = allocator.mallocFn(allocator.allocCtx, num * size);
+		if (ptr != NULL) memset(ptr, 0, num * size);
+		return ptr;
+	}
 	return calloc(num, size);
 }
 
 void KSI_free(void *ptr) {
 	if (ptr != NULL) {
-		free(ptr);
+		if (allocStatsEnabled) KSI_ATOMIC_ADD64(&allocStatsFrees, 1);
+
+		if (allocator.freeFn != NULL) {
+			allocator.freeFn(allocator.allocCtx, ptr);
+		} else {
+			free(ptr);
+		}
+	}
+}
+
+int KSI_setAllocator(const KSI_Allocator *alloc) {
+	if (alloc == NULL) {
+		memset(&allocator, 0, sizeof(allocator));
+		return KSI_OK;
+	}
+
+	if (alloc->mallocFn == NULL || alloc->freeFn == NULL) return KSI_INVALID_ARGUMENT;
+
+	allocator = *alloc;
+
+	return KSI_OK;
+}
+
+void KSI_setAllocationStats(int enabled) {
+	allocStatsEnabled = enabled;
+}
+
+int KSI_getAllocationStats(KSI_AllocationStat *stats, size_t stats_len, size_t *count, KSI_uint64_t *frees) {
+	size_t i;
+	size_t n = 0;
+
+	if ((stats == NULL && stats_len > 0) || count == NULL) return KSI_INVALID_ARGUMENT;
+
+	for (i = 0; i < ALLOC_STATS_SLOTS; i++) {
+		const char *type = KSI_ATOMIC_LOAD_PTR(&allocStats[i].type);
+		KSI_uint64_t calls;
+
+		if (type == NULL) continue;
+
+		calls = KSI_ATOMIC_LOAD64(&allocStats[i].calls);
+		if (calls == 0) continue;
+
+		if (n < stats_len) {
+			stats[n].type = type;
+			stats[n].calls = calls;
+			stats[n].bytes = KSI_ATOMIC_LOAD64(&allocStats[i].bytes);
+		}
+		n++;
+	}
+
+	*count = n;
+	if (frees != NULL) *frees = KSI_ATOMIC_LOAD64(&allocStatsFrees);
+
+	return KSI_OK;
+}
+
+void KSI_resetAllocationStats(void) {
+	size_t i;
+
+	/* The type names are kept, the slots stay claimed. */
+	for (i = 0; i < ALLOC_STATS_SLOTS; i++) {
+		allocStats[i].calls = 0;
+		allocStats[i].bytes = 0;
 	}
+	allocStatsFrees = 0;
 }
 
 static int KSI_CTX_setUri(KSI_CTX *ctx,
@@ -1094,12 +2013,24 @@ int KSI_CTX_setPublicationUrl(KSI_CTX *ctx, const char *uri){
 		goto cleanup;
 	}
 
+	/* The background refresh uses the URL. */
+	waitPublicationsFileRefresh(ctx, true);
+
 	res = KSI_CTX_setUri(ctx, uri, uri, uri, KSI_UriClient_setPublicationUrl_wrapper);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx,res, NULL);
 		goto cleanup;
 	}
 
+	/* Keep the URL as the key of the persistent publications file cache. */
+	KSI_free(ctx->publicationUrl);
+	ctx->publicationUrl = NULL;
+	res = KSI_strdup(uri, &ctx->publicationUrl);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx,res, NULL);
+		goto cleanup;
+	}
+
 	/* Clear the cached publications file. */
 	res = KSI_CTX_setPublicationsFile(ctx, NULL);
 	if (res != KSI_OK) {
@@ -1107,10 +2038,49 @@ int KSI_CTX_setPublicationUrl(KSI_CTX *ctx, const char *uri){
 		goto cleanup;
 	}
 
+	/* The failures of the previous URL do not delay the refresh. */
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	ctx->publicationsFileRefreshFailures = 0;
+	ctx->publicationsFileRefreshRetryAt = 0;
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CTX_setPublicationsFileCacheDir(KSI_CTX *ctx, const char *dir) {
+	int res = KSI_UNKNOWN_ERROR;
+	char *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (dir != NULL) {
+		res = KSI_strdup(dir, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
+	}
+
+	waitPublicationsFileRefresh(ctx, true);
+
+	KSI_free(ctx->publicationsFileCacheDir);
+	ctx->publicationsFileCacheDir = tmp;
+	tmp = NULL;
+
 	res = KSI_OK;
 
 cleanup:
 
+	KSI_free(tmp);
+
 	return res;
 }
 
@@ -1191,7 +2161,28 @@ cleanup:																					\
 	CTX_VALUEP_SETTER(var, nam, typ, fre)													\
 	CTX_VALUEP_GETTER(var, nam, typ)														\
 
-CTX_VALUEP_SETTER(pkiTruststore, PKITruststore, KSI_PKITruststore, KSI_PKITruststore_free)
+int KSI_CTX_setPKITruststore(KSI_CTX *ctx, KSI_PKITruststore *pkiTruststore) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (ctx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* The truststore is used for verifying the refreshed publications file. */
+	waitPublicationsFileRefresh(ctx, true);
+
+	KSI_PKITruststore_free(ctx->pkiTruststore);
+	ctx->pkiTruststore = pkiTruststore;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+CTX_GET_SET_VALUE(executor, Executor, KSI_Executor, KSI_Executor_free)
 
 CTX_VALUEP_GETTER(publicationsFile, PublicationsFile, KSI_PublicationsFile)
 
@@ -1203,10 +2194,9 @@ int KSI_CTX_setPublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile *var) {
 		goto cleanup;
 	}
 
-	KSI_PublicationsFile_free(ctx->publicationsFile);
-	ctx->publicationsFile = var;
-	/* Clear the cache timeout. */
-	ctx->publicationsFileCachedAt = 0;
+	KSI_Mutex_lock(&ctx->publicationsFileLock);
+	replacePublicationsFile(ctx, var);
+	KSI_Mutex_unlock(&ctx->publicationsFileLock);
 
 	res = KSI_OK;
 cleanup:
@@ -1246,9 +2236,15 @@ int KSI_CTX_getPKITruststore(KSI_CTX *ctx, KSI_PKITruststore **pki) {
 		/* Create and set the PKI truststore. */
 		res = KSI_PKITruststore_new(ctx, 1, &pkiTruststore);
 		if (res != KSI_OK) goto cleanup;
-		res = KSI_CTX_setPKITruststore(ctx, pkiTruststore);
-		if (res != KSI_OK) goto cleanup;
-		pkiTruststore = NULL;
+
+		/* Not installed by #KSI_CTX_setPKITruststore, as it waits for the publications file
+		 * refresh, which itself may get here while verifying the downloaded file. */
+		KSI_Mutex_lock(&ctx->lock);
+		if (ctx->pkiTruststore == NULL) {
+			ctx->pkiTruststore = pkiTruststore;
+			pkiTruststore = NULL;
+		}
+		KSI_Mutex_unlock(&ctx->lock);
 	}
 
 	*pki = ctx->pkiTruststore;
@@ -1269,6 +2265,8 @@ int KSI_CTX_setNetworkProvider(KSI_CTX *ctx, KSI_NetworkClient *netProvider){
 		goto cleanup;
 	}
 
+	waitPublicationsFileRefresh(ctx, true);
+
 	if (ctx->netProvider != NULL) {
 		KSI_NetworkClient_free (ctx->netProvider);
 	}
@@ -1406,6 +2404,8 @@ int KSI_CTX_setDefaultPubFileCertConstraints(KSI_CTX *ctx, const KSI_CertConstra
 	tmp[i].oid = NULL;
 	tmp[i].val = NULL;
 
+	waitPublicationsFileRefresh(ctx, true);
+
 	/* Free the existing constraints. */
 	freeCertConstraintsArray(ctx->certConstraints);
 
@@ -33,13 +33,18 @@ struct KSI_BlockSigner_st {
 	size_t ref;
 	KSI_TreeBuilder *builder;
 	KSI_Signature *signature;
-	KSI_DataHash *prevLeaf;
+	/** The previous leaf value used for masking, valid when origPrevLeaf is not NULL. */
+	KSI_DataHashValue prevLeaf;
 	KSI_DataHash *origPrevLeaf;
+	/** The input node of the last masking operation, its parent holds the masked leaf value. */
+	KSI_TreeNode *maskedNode;
 	KSI_OctetString *iv;
 	KSI_MetaData *metaData;
 
 	/** Common hasher object. */
 	KSI_DataHasher *hsr;
+	/** Non-zero if the leaves are aggregated by a separate thread, see #KSI_BlockSigner_setPipelined. */
+	int pipelined;
 
 	KSI_TreeBuilderLeafProcessor metaDataProcessor;
 	KSI_TreeBuilderLeafProcessor maskingProcessor;
@@ -127,9 +132,7 @@ static int maskingProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_BlockSigner *signer = c;
 	KSI_TreeNode *tmp = NULL;
-	KSI_DataHash *mask = NULL;
-	KSI_DataHash *leafHash = NULL;
-	unsigned char tmpLvl;
+	KSI_DataHashValue mask;
 
 	if (in == NULL || c == NULL || out == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -138,87 +141,55 @@ static int maskingProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
 
 	KSI_ERR_clearErrors(signer->ctx);
 
-	if (signer->iv != NULL && signer->prevLeaf != NULL) {
+	if (signer->iv != NULL && signer->origPrevLeaf != NULL) {
 		/* For now only masking real hash values is supported. */
-		if (in->hash == NULL) {
+		if (in->metaData != NULL) {
 			KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "Only a tree node with a hash value may be used for masking.");
 			goto cleanup;
 		}
 
-		/* Calculate the mask value. */
-		res = KSI_DataHasher_reset(signer->builder->hsr);
-		if (res != KSI_OK) {
-			KSI_pushError(signer->ctx, res, NULL);
-			goto cleanup;
-		}
-
-		/* Change here, if there is a need, to add previous values that are not nodes containing hash values. */
-		res = KSI_DataHasher_addImprint(signer->builder->hsr, signer->prevLeaf);
-		if (res != KSI_OK) {
-			KSI_pushError(signer->ctx, res, NULL);
-			goto cleanup;
-		}
-
-		res = KSI_DataHasher_addOctetString(signer->builder->hsr, signer->iv);
-		if (res != KSI_OK) {
-			KSI_pushError(signer->ctx, res, NULL);
-			goto cleanup;
-		}
-
-		res = KSI_DataHasher_close(signer->builder->hsr, &mask);
-		if (res != KSI_OK) {
-			KSI_pushError(signer->ctx, res, NULL);
-			goto cleanup;
-		}
-
-		/* Add the mask as left link of the calculation. */
-		res = KSI_TreeNode_new(signer->ctx, mask, NULL, (int)in->level, &tmp);
-		if (res != KSI_OK) {
-			KSI_pushError(signer->ctx, res, NULL);
+		if (!KSI_IS_VALID_TREE_LEVEL(in->level + 1)) {
+			KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The tree height is too large.");
 			goto cleanup;
 		}
 
-		/* Calculate the actual leaf value. */
-		res = KSI_DataHasher_reset(signer->builder->hsr);
+		/* Calculate the mask value. */
+		res = KSI_DataHasher_reset(signer->hsr);
 		if (res != KSI_OK) {
 			KSI_pushError(signer->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		res = KSI_DataHasher_addImprint(signer->builder->hsr, mask);
+		/* Change here, if there is a need, to add previous values that are not nodes containing hash values. */
+		res = KSI_DataHasher_addValue(signer->hsr, &signer->prevLeaf);
 		if (res != KSI_OK) {
 			KSI_pushError(signer->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		res = KSI_DataHasher_addImprint(signer->builder->hsr, in->hash);
+		res = KSI_DataHasher_addOctetString(signer->hsr, signer->iv);
 		if (res != KSI_OK) {
 			KSI_pushError(signer->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		if (!KSI_IS_VALID_TREE_LEVEL(in->level + 1)) {
-			KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The tree height is too large.");
-			goto cleanup;
-		}
-
-		tmpLvl = (unsigned char)(in->level + 1);
-
-		res = KSI_DataHasher_add(signer->builder->hsr, &tmpLvl, 1);
+		res = KSI_DataHasher_closeValue(signer->hsr, &mask);
 		if (res != KSI_OK) {
 			KSI_pushError(signer->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		res = KSI_DataHasher_close(signer->builder->hsr, &leafHash);
+		/* Add the mask as left link of the calculation. */
+		res = KSI_TreeNode_fromValue(signer->ctx, &mask, (int)in->level, &tmp);
 		if (res != KSI_OK) {
 			KSI_pushError(signer->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		/* Swap the previous leaf hash value. */
-		KSI_DataHash_free(signer->prevLeaf);
-		signer->prevLeaf = KSI_DataHash_ref(leafHash);
+		/* The tree builder joins the mask with the input node, the resulting parent node holds the
+		 * masked leaf value. It is picked up as the next previous leaf value once the leaf has been
+		 * inserted (see #KSI_BlockSigner_addLeaf), instead of hashing the same value twice. */
+		signer->maskedNode = in;
 
 		*out = tmp;
 		tmp = NULL;
@@ -230,9 +201,6 @@ static int maskingProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
 
 cleanup:
 
-	KSI_DataHash_free(mask);
-	KSI_DataHash_free(leafHash);
-
 	KSI_TreeNode_free(tmp);
 
 	return res;
@@ -266,11 +234,12 @@ int KSI_BlockSigner_new(KSI_CTX *ctx, KSI_HashAlgorithm algoId, KSI_DataHash *pr
 	tmp->ref = 1;
 	tmp->builder = NULL;
 	tmp->signature = NULL;
-	tmp->prevLeaf = NULL;
 	tmp->origPrevLeaf = NULL;
+	tmp->maskedNode = NULL;
 	tmp->iv = NULL;
 	tmp->metaData = NULL;
 	tmp->hsr = NULL;
+	tmp->pipelined = 0;
 
 	tmp->metaDataProcessor.c = tmp;
 	tmp->metaDataProcessor.fn = metaDataProcessor;
@@ -286,7 +255,13 @@ int KSI_BlockSigner_new(KSI_CTX *ctx, KSI_HashAlgorithm algoId, KSI_DataHash *pr
 	res = KSI_TreeBuilder_new(ctx, algoId, &tmp->builder);
 	if (res != KSI_OK) goto cleanup;
 
-	tmp->prevLeaf = KSI_DataHash_ref(prevLeaf);
+	if (prevLeaf != NULL) {
+		res = KSI_DataHashValue_fromDataHash(&tmp->prevLeaf, prevLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
 	tmp->origPrevLeaf = KSI_DataHash_ref(prevLeaf);
 	tmp->iv = KSI_OctetString_ref(initVal);
 
@@ -330,17 +305,16 @@ void KSI_BlockSigner_free(KSI_BlockSigner *signer) {
 		KSI_TreeBuilder_free(signer->builder);
 		KSI_Signature_free(signer->signature);
 		KSI_OctetString_free(signer->iv);
-		KSI_DataHash_free(signer->prevLeaf);
 		KSI_DataHash_free(signer->origPrevLeaf);
 		KSI_DataHasher_free(signer->hsr);
 		KSI_free(signer);
 	}
 }
 
-int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
+int KSI_BlockSigner_closeTree(KSI_BlockSigner *signer, KSI_DataHash **rootHash, KSI_uint64_t *rootLevel) {
 	int res = KSI_UNKNOWN_ERROR;
 
-	if (signer == NULL) {
+	if (signer == NULL || rootHash == NULL || rootLevel == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
@@ -356,20 +330,62 @@ int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
 		goto cleanup;
 	}
 
+	*rootHash = KSI_DataHash_ref(signer->builder->rootNode->hash);
+	*rootLevel = signer->builder->rootNode->level;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSigner_setRootSignature(KSI_BlockSigner *signer, KSI_Signature *sig) {
+	if (signer == NULL || sig == NULL) return KSI_INVALID_ARGUMENT;
+
+	KSI_Signature_free(signer->signature);
+	signer->signature = sig;
+
+	return KSI_OK;
+}
+
+int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *rootHash = NULL;
+	KSI_uint64_t rootLevel = 0;
+	KSI_Signature *sig = NULL;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = KSI_BlockSigner_closeTree(signer, &rootHash, &rootLevel);
+	if (res != KSI_OK) goto cleanup;
+
 	KSI_LOG_debug(signer->ctx, "Signing the root hash value of the block signer.");
 
 	/* Sign the root hash. */
-	res = KSI_Signature_signAggregated(signer->ctx, signer->builder->rootNode->hash, signer->builder->rootNode->level, &signer->signature);
+	res = KSI_Signature_signAggregated(signer->ctx, rootHash, rootLevel, &sig);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
 	}
 
+	res = KSI_BlockSigner_setRootSignature(signer, sig);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+	sig = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
+	KSI_DataHash_free(rootHash);
+	KSI_Signature_free(sig);
+
 	return res;
 }
 
@@ -415,8 +431,21 @@ int KSI_BlockSigner_reset(KSI_BlockSigner *signer) {
 		goto cleanup;
 	}
 
-	KSI_DataHash_free(signer->prevLeaf);
-	signer->prevLeaf = KSI_DataHash_ref(signer->origPrevLeaf);
+	if (signer->origPrevLeaf != NULL) {
+		res = KSI_DataHashValue_fromDataHash(&signer->prevLeaf, signer->origPrevLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (signer->pipelined) {
+		res = KSI_TreeBuilder_setPipelined(signer->builder, 1);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
 	res = KSI_OK;
 
 cleanup:
@@ -426,6 +455,32 @@ cleanup:
 	return res;
 }
 
+int KSI_BlockSigner_setPipelined(KSI_BlockSigner *signer, int enable) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	/* The masking stays in the calling thread, as the next leaf depends on the previous masked one. */
+	res = KSI_TreeBuilder_setPipelined(signer->builder, enable);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	signer->pipelined = enable;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_BlockSigner_addLeaf(KSI_BlockSigner *signer, KSI_DataHash *hsh, int level, KSI_MetaData *metaData, KSI_BlockSignerHandle **handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_TreeLeafHandle *leafHandle = NULL;
@@ -454,12 +509,24 @@ int KSI_BlockSigner_addLeaf(KSI_BlockSigner *signer, KSI_DataHash *hsh, int leve
 	/* Set the pointer to the meta data value. */
 	signer->metaData = metaData;
 
+	signer->maskedNode = NULL;
+
 	res = KSI_TreeBuilder_addDataHash(signer->builder, hsh, level, &leafHandle);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
 	}
 
+	/* Swap the previous leaf hash value with the masked leaf value calculated by the tree builder. */
+	if (signer->maskedNode != NULL) {
+		if (signer->maskedNode->parent == NULL || signer->maskedNode->parent->metaData != NULL) {
+			KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "Masked leaf value not calculated.");
+			goto cleanup;
+		}
+
+		signer->prevLeaf = signer->maskedNode->parent->value;
+	}
+
 	res = KSI_BlockSignerHandle_new(signer->ctx, &tmp);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
@@ -482,6 +549,7 @@ cleanup:
 	/* Cleanup the value, as this is only a pointer to a memory we do not control. */
 	if (signer != NULL) {
 		signer->metaData = NULL;
+		signer->maskedNode = NULL;
 	}
 
 	KSI_BlockSignerHandle_free(tmp);
@@ -500,7 +568,15 @@ int KSI_BlockSigner_getPrevLeaf(const KSI_BlockSigner *signer, KSI_DataHash **pr
 
 	KSI_ERR_clearErrors(signer->ctx);
 
-	*prevLeaf = KSI_DataHash_ref(signer->prevLeaf);
+	if (signer->origPrevLeaf == NULL) {
+		*prevLeaf = NULL;
+	} else {
+		res = KSI_DataHash_fromValue(signer->ctx, &signer->prevLeaf, prevLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
 
 	res = KSI_OK;
 
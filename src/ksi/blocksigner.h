@@ -67,6 +67,27 @@ int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer);
 
 KSI_FN_DEPRECATED(int KSI_BlockSigner_close(KSI_BlockSigner *signer, void *), Use #KSI_BlockSigner_closeAndSign instead.);
 
+/**
+ * This function finalizes the computation of the tree without signing the root hash value. The root
+ * hash value may be signed by other means (e.g. via #KSI_AsyncService) and the resulting signature
+ * handed back to the signer with #KSI_BlockSigner_setRootSignature.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[out]	rootHash	Pointer to the receiving pointer of the root hash value.
+ * \param[out]	rootLevel	Level of the root node.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note Ownership of \c rootHash is passed to the caller who is responsible for freeing the object.
+ */
+int KSI_BlockSigner_closeTree(KSI_BlockSigner *signer, KSI_DataHash **rootHash, KSI_uint64_t *rootLevel);
+
+/**
+ * Setter for the signature of the root hash value of a tree finalized with #KSI_BlockSigner_closeTree.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	sig			Signature of the root hash value.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The signer takes ownership of \c sig.
+ */
+int KSI_BlockSigner_setRootSignature(KSI_BlockSigner *signer, KSI_Signature *sig);
+
 /**
  * Resets the block signer to its initial state. This will invalidate all the
  * #KSI_BlockSignerHandle instances still remaining.
@@ -75,6 +96,18 @@ KSI_FN_DEPRECATED(int KSI_BlockSigner_close(KSI_BlockSigner *signer, void *), Us
  */
 int KSI_BlockSigner_reset(KSI_BlockSigner *signer);
 
+/**
+ * Enables or disables the pipelined mode of the block signer. In the pipelined mode the masking
+ * and the meta-data of the leaves are processed in the calling thread, while a separate thread
+ * aggregates the masked leaves into the tree, see #KSI_TreeBuilder_setPipelined. The setting is
+ * kept by #KSI_BlockSigner_reset.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	enable		Non-zero to enable, zero to disable the pipelined mode.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The signatures are the same as without the pipelined mode.
+ */
+int KSI_BlockSigner_setPipelined(KSI_BlockSigner *signer, int enable);
+
 /**
  * Add a new leaf to the tree.
  * \param[in]	signer		Instance of the #KSI_BlockSigner.
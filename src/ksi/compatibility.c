@@ -23,6 +23,11 @@
 
 #include "ksi.h"
 #include "compatibility.h"
+#include "internal.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#endif
 
 #ifdef _WIN32
 size_t KSI_vsnprintf(char *buf, size_t n, const char *format, va_list va){
@@ -203,3 +208,21 @@ int KSI_strcasecmp(const char *s1, const char *s2) {
 		return strcasecmp(s1, s2);
 	#endif
 }
+
+unsigned long long KSI_getMonotonicTimeUs(void) {
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!QueryPerformanceFrequency(&freq) || !QueryPerformanceCounter(&now) || freq.QuadPart == 0) return 0;
+
+	return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000ULL +
+			(unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000ULL / (unsigned long long)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+	return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+#endif
+}
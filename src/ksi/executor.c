@@ -0,0 +1,556 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "executor.h"
+#include "impl/thread_impl.h"
+
+/** Initial capacity of a work queue. */
+#define EXECUTOR_QUEUE_INITIAL_CAP 16
+
+/** Number of ranges a batch is split into per participating thread. */
+#define EXECUTOR_SPLITS_PER_THREAD 4
+
+typedef struct ExecutorBatch_st {
+	KSI_ExecutorTask fn;
+	void *arg;
+	/** Ranges not larger than this are not split further. */
+	size_t grain;
+	/** Number of elements not yet processed, guarded by the executor lock. */
+	size_t remaining;
+	/** Status code of the first failed call, guarded by the executor lock. */
+	int res;
+} ExecutorBatch;
+
+/** A range of elements of a batch. */
+typedef struct ExecutorRange_st {
+	ExecutorBatch *batch;
+	size_t begin;
+	size_t end;
+} ExecutorRange;
+
+/**
+ * Double-ended work queue. The owner pushes and pops at the bottom, the other threads steal
+ * from the top, thus the thieves take the oldest and largest ranges.
+ */
+typedef struct ExecutorQueue_st {
+	KSI_Mutex lock;
+	ExecutorRange *ranges;
+	size_t cap;
+	/** Position of the top element. */
+	size_t top;
+	size_t count;
+} ExecutorQueue;
+
+typedef struct ExecutorWorker_st {
+	KSI_Executor *exec;
+	ExecutorQueue queue;
+	KSI_Thread thread;
+} ExecutorWorker;
+
+struct KSI_Executor_st {
+	KSI_CTX *ctx;
+	size_t ref;
+
+	/** Guards the fields below and the batch states. */
+	KSI_Mutex lock;
+	/** Signalled when work is queued, a batch finishes or the executor is stopped. */
+	KSI_Cond wake;
+
+	/** Number of the queued ranges in all the queues. */
+	size_t queued;
+	/** Number of the running workers. */
+	size_t running;
+	int stop;
+
+	/** Queue of the threads that are not workers of this executor. */
+	ExecutorQueue shared;
+
+	ExecutorWorker *workers;
+	size_t workerCount;
+	/** Next victim of the non-worker threads. */
+	size_t victim;
+
+	/** Number of the threads started by the executor, zero if the workers run on the threads of the user. */
+	size_t threadsStarted;
+};
+
+/** Key of the worker structure of the calling thread, shared by all the executors. */
+static KSI_ThreadKey workerKey;
+/** State of the initialization of the key: 0 - not done, 1 - in progress, 2 - done. */
+static KSI_uint64_t workerKeyInit = 0;
+
+static int workerKey_init(void) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	for (;;) {
+		KSI_uint64_t init = KSI_ATOMIC_LOAD64(&workerKeyInit);
+
+		if (init == 2) return KSI_OK;
+		/* Another thread is initializing the key, wait for it to complete. */
+		if (init == 0 && KSI_ATOMIC_CAS64(&workerKeyInit, 0, 1)) break;
+	}
+
+	res = KSI_ThreadKey_init(&workerKey, NULL);
+
+	KSI_ATOMIC_STORE64(&workerKeyInit, res == KSI_OK ? 2 : 0);
+
+	return res;
+}
+
+static int ExecutorQueue_init(ExecutorQueue *q) {
+	q->ranges = NULL;
+	q->cap = 0;
+	q->top = 0;
+	q->count = 0;
+	return KSI_Mutex_init(&q->lock);
+}
+
+static void ExecutorQueue_destroy(ExecutorQueue *q) {
+	KSI_Mutex_destroy(&q->lock);
+	KSI_free(q->ranges);
+}
+
+static int ExecutorQueue_pushBottom(ExecutorQueue *q, const ExecutorRange *r) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	KSI_Mutex_lock(&q->lock);
+
+	if (q->count == q->cap) {
+		size_t cap = q->cap == 0 ? EXECUTOR_QUEUE_INITIAL_CAP : q->cap * 2;
+		ExecutorRange *tmp = KSI_calloc(cap, sizeof(ExecutorRange));
+		size_t i;
+
+		if (tmp == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+
+		for (i = 0; i < q->count; i++) {
+			tmp[i] = q->ranges[(q->top + i) % q->cap];
+		}
+
+		KSI_free(q->ranges);
+		q->ranges = tmp;
+		q->cap = cap;
+		q->top = 0;
+	}
+
+	q->ranges[(q->top + q->count) % q->cap] = *r;
+	q->count++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Mutex_unlock(&q->lock);
+
+	return res;
+}
+
+static int ExecutorQueue_popBottom(ExecutorQueue *q, ExecutorRange *r) {
+	int found = 0;
+
+	KSI_Mutex_lock(&q->lock);
+	if (q->count > 0) {
+		q->count--;
+		*r = q->ranges[(q->top + q->count) % q->cap];
+		found = 1;
+	}
+	KSI_Mutex_unlock(&q->lock);
+
+	return found;
+}
+
+static int ExecutorQueue_stealTop(ExecutorQueue *q, ExecutorRange *r) {
+	int found = 0;
+
+	KSI_Mutex_lock(&q->lock);
+	if (q->count > 0) {
+		*r = q->ranges[q->top];
+		q->top = (q->top + 1) % q->cap;
+		q->count--;
+		found = 1;
+	}
+	KSI_Mutex_unlock(&q->lock);
+
+	return found;
+}
+
+static int pushRange(KSI_Executor *exec, ExecutorQueue *own, const ExecutorRange *r) {
+	int res;
+
+	res = ExecutorQueue_pushBottom(own, r);
+	if (res != KSI_OK) return res;
+
+	KSI_Mutex_lock(&exec->lock);
+	exec->queued++;
+	KSI_Cond_signal(&exec->wake);
+	KSI_Mutex_unlock(&exec->lock);
+
+	return KSI_OK;
+}
+
+static void rangeTaken(KSI_Executor *exec) {
+	KSI_Mutex_lock(&exec->lock);
+	exec->queued--;
+	KSI_Mutex_unlock(&exec->lock);
+}
+
+/**
+ * Takes a range from the own queue, or steals one from the other queues.
+ */
+static int takeRange(KSI_Executor *exec, ExecutorWorker *self, ExecutorQueue *own, ExecutorRange *r) {
+	size_t start;
+	size_t i;
+
+	if (ExecutorQueue_popBottom(own, r)) goto found;
+
+	if (own != &exec->shared && ExecutorQueue_stealTop(&exec->shared, r)) goto found;
+
+	if (self != NULL) {
+		start = (size_t)(self - exec->workers) + 1;
+	} else {
+		KSI_Mutex_lock(&exec->lock);
+		start = exec->victim++;
+		KSI_Mutex_unlock(&exec->lock);
+	}
+
+	for (i = 0; i < exec->workerCount; i++) {
+		ExecutorWorker *victim = &exec->workers[(start + i) % exec->workerCount];
+		if (victim != self && ExecutorQueue_stealTop(&victim->queue, r)) goto found;
+	}
+
+	return 0;
+
+found:
+
+	rangeTaken(exec);
+	return 1;
+}
+
+/**
+ * Processes the range. The upper halves of a large range are queued for the other threads,
+ * if that fails the calling thread processes them itself.
+ */
+static void runRange(KSI_Executor *exec, ExecutorQueue *own, ExecutorRange *r) {
+	ExecutorBatch *batch = r->batch;
+	int res = KSI_OK;
+	size_t i;
+
+	while (r->end - r->begin > batch->grain) {
+		ExecutorRange upper;
+
+		upper.batch = batch;
+		upper.begin = r->begin + (r->end - r->begin) / 2;
+		upper.end = r->end;
+
+		if (pushRange(exec, own, &upper) != KSI_OK) break;
+		r->end = upper.begin;
+	}
+
+	for (i = r->begin; i < r->end; i++) {
+		int tmp = batch->fn(batch->arg, i);
+		if (tmp != KSI_OK && res == KSI_OK) res = tmp;
+	}
+
+	KSI_Mutex_lock(&exec->lock);
+	if (res != KSI_OK && batch->res == KSI_OK) batch->res = res;
+	batch->remaining -= r->end - r->begin;
+	if (batch->remaining == 0) KSI_Cond_broadcast(&exec->wake);
+	KSI_Mutex_unlock(&exec->lock);
+}
+
+static void workerMain(void *arg) {
+	ExecutorWorker *self = arg;
+	KSI_Executor *exec = self->exec;
+	ExecutorWorker *prev = KSI_ThreadKey_get(&workerKey);
+	ExecutorRange r;
+
+	KSI_ThreadKey_set(&workerKey, self);
+
+	for (;;) {
+		if (takeRange(exec, self, &self->queue, &r)) {
+			runRange(exec, &self->queue, &r);
+			continue;
+		}
+
+		KSI_Mutex_lock(&exec->lock);
+		while (exec->queued == 0 && !exec->stop) {
+			KSI_Cond_wait(&exec->wake, &exec->lock);
+		}
+		if (exec->stop) {
+			/* The executor may be freed as soon as the counter reaches zero. */
+			KSI_ThreadKey_set(&workerKey, prev);
+			exec->running--;
+			KSI_Cond_broadcast(&exec->wake);
+			KSI_Mutex_unlock(&exec->lock);
+			break;
+		}
+		KSI_Mutex_unlock(&exec->lock);
+	}
+}
+
+static int threadSubmitter(void *KSI_UNUSED(c), void (*worker)(void *), void *workerArg) {
+	ExecutorWorker *w = workerArg;
+	return KSI_Thread_start(&w->thread, worker, workerArg);
+}
+
+static int executorCreate(KSI_CTX *ctx, size_t workerCount, KSI_ExecutorSubmitter submit, void *submitCtx, int ownThreads, KSI_Executor **exec) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Executor *tmp = NULL;
+	size_t i;
+
+	res = workerKey_init();
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_Executor);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memset(tmp, 0, sizeof(KSI_Executor));
+	tmp->ctx = ctx;
+	tmp->ref = 1;
+
+	/* Until the primitives are initialized, the executor can not be released by #KSI_Executor_free. */
+	res = KSI_Mutex_init(&tmp->lock);
+	if (res != KSI_OK) {
+		KSI_free(tmp);
+		tmp = NULL;
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Cond_init(&tmp->wake);
+	if (res != KSI_OK) {
+		KSI_Mutex_destroy(&tmp->lock);
+		KSI_free(tmp);
+		tmp = NULL;
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = ExecutorQueue_init(&tmp->shared);
+	if (res != KSI_OK) {
+		KSI_Cond_destroy(&tmp->wake);
+		KSI_Mutex_destroy(&tmp->lock);
+		KSI_free(tmp);
+		tmp = NULL;
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (workerCount > 0) {
+		tmp->workers = KSI_calloc(workerCount, sizeof(ExecutorWorker));
+		if (tmp->workers == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+	}
+
+	for (i = 0; i < workerCount; i++) {
+		tmp->workers[i].exec = tmp;
+		res = ExecutorQueue_init(&tmp->workers[i].queue);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+		tmp->workerCount++;
+	}
+
+	for (i = 0; i < workerCount; i++) {
+		/* Count the worker before starting it, it may exit before the submit function returns. */
+		KSI_Mutex_lock(&tmp->lock);
+		tmp->running++;
+		KSI_Mutex_unlock(&tmp->lock);
+
+		res = submit(submitCtx, workerMain, &tmp->workers[i]);
+		if (res != KSI_OK) {
+			KSI_Mutex_lock(&tmp->lock);
+			tmp->running--;
+			KSI_Mutex_unlock(&tmp->lock);
+
+			KSI_pushError(ctx, res, "Unable to start executor worker.");
+			goto cleanup;
+		}
+		if (ownThreads) tmp->threadsStarted++;
+	}
+
+	*exec = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Executor_free(tmp);
+
+	return res;
+}
+
+int KSI_Executor_new(KSI_CTX *ctx, size_t threadCount, KSI_Executor **exec) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || exec == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (threadCount == 0) threadCount = KSI_Thread_getCpuCount();
+
+	res = executorCreate(ctx, threadCount, threadSubmitter, NULL, 1, exec);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_Executor_newWithSubmitter(KSI_CTX *ctx, size_t workerCount, KSI_ExecutorSubmitter submit, void *submitCtx, KSI_Executor **exec) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || submit == NULL || exec == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = executorCreate(ctx, workerCount, submit, submitCtx, 0, exec);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+KSI_IMPLEMENT_ATOMIC_REF(KSI_Executor);
+
+void KSI_Executor_free(KSI_Executor *exec) {
+	if (exec != NULL && KSI_ATOMIC_DEC_REF(&exec->ref) == 0) {
+		size_t i;
+
+		KSI_Mutex_lock(&exec->lock);
+		exec->stop = 1;
+		KSI_Cond_broadcast(&exec->wake);
+		while (exec->running > 0) {
+			KSI_Cond_wait(&exec->wake, &exec->lock);
+		}
+		KSI_Mutex_unlock(&exec->lock);
+
+		for (i = 0; i < exec->threadsStarted; i++) {
+			KSI_Thread_join(&exec->workers[i].thread);
+		}
+
+		for (i = 0; i < exec->workerCount; i++) {
+			ExecutorQueue_destroy(&exec->workers[i].queue);
+		}
+		KSI_free(exec->workers);
+
+		ExecutorQueue_destroy(&exec->shared);
+		KSI_Cond_destroy(&exec->wake);
+		KSI_Mutex_destroy(&exec->lock);
+
+		KSI_free(exec);
+	}
+}
+
+size_t KSI_Executor_getWorkerCount(const KSI_Executor *exec) {
+	return exec == NULL ? 0 : exec->workerCount;
+}
+
+int KSI_Executor_forEach(KSI_Executor *exec, size_t count, KSI_ExecutorTask task, void *taskCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	ExecutorBatch batch;
+	ExecutorRange r;
+	ExecutorWorker *self = NULL;
+	ExecutorQueue *own = NULL;
+	size_t i;
+
+	if (task == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (count == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	/* Without workers there is nobody to share the work with. */
+	if (exec == NULL || exec->workerCount == 0) {
+		res = KSI_OK;
+		for (i = 0; i < count; i++) {
+			int tmp = task(taskCtx, i);
+			if (tmp != KSI_OK && res == KSI_OK) res = tmp;
+		}
+		goto cleanup;
+	}
+
+	batch.fn = task;
+	batch.arg = taskCtx;
+	batch.grain = count / ((exec->workerCount + 1) * EXECUTOR_SPLITS_PER_THREAD);
+	if (batch.grain == 0) batch.grain = 1;
+	batch.remaining = count;
+	batch.res = KSI_OK;
+
+	/* A task of this executor calling the function keeps using its own queue. */
+	self = KSI_ThreadKey_get(&workerKey);
+	if (self != NULL && self->exec != exec) self = NULL;
+	own = self != NULL ? &self->queue : &exec->shared;
+
+	r.batch = &batch;
+	r.begin = 0;
+	r.end = count;
+	runRange(exec, own, &r);
+
+	/* Help with the queued work until the batch is finished. */
+	for (;;) {
+		KSI_Mutex_lock(&exec->lock);
+		if (batch.remaining == 0) {
+			KSI_Mutex_unlock(&exec->lock);
+			break;
+		}
+		if (exec->queued == 0) KSI_Cond_wait(&exec->wake, &exec->lock);
+		KSI_Mutex_unlock(&exec->lock);
+
+		if (takeRange(exec, self, own, &r)) {
+			runRange(exec, own, &r);
+		}
+	}
+
+	res = batch.res;
+
+cleanup:
+
+	return res;
+}
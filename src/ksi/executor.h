@@ -0,0 +1,116 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include "ksi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * \addtogroup executor Executor
+	 * The executor is a pool of worker threads running the batch operations of the SDK
+	 * (#KSI_DataHash_createBatch, #KSI_TreeBuilder_addDataHashes, #KSI_Signature_parseBatch,
+	 * #KSI_verifySignatures and #KSI_extendSignatures) in parallel. Every worker has a queue of
+	 * its own and the idle workers steal work from the others. The thread waiting for a batch
+	 * to finish takes part in processing it. An executor is attached to a context with
+	 * #KSI_CTX_setExecutor; without one the batch operations run in the calling thread.
+	 * @{
+	 */
+
+	/**
+	 * Function for starting a worker on a thread managed by the user. The function must arrange
+	 * \c worker to be called with \c workerArg on a thread of its own; the call returns when the
+	 * executor is freed.
+	 * \param[in]	submitCtx		The context passed to #KSI_Executor_newWithSubmitter.
+	 * \param[in]	worker			The worker function.
+	 * \param[in]	workerArg		Argument of the worker function.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	typedef int (*KSI_ExecutorSubmitter)(void *submitCtx, void (*worker)(void *), void *workerArg);
+
+	/**
+	 * Function processing a single element of a batch.
+	 * \param[in]	taskCtx			The context passed to #KSI_Executor_forEach.
+	 * \param[in]	index			Index of the element.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	typedef int (*KSI_ExecutorTask)(void *taskCtx, size_t index);
+
+	/**
+	 * Creates an executor running its workers on threads of its own.
+	 * \param[in]	ctx				KSI context.
+	 * \param[in]	threadCount		Number of worker threads, if 0 the number of processors is used.
+	 * \param[out]	exec			Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_Executor_new(KSI_CTX *ctx, size_t threadCount, KSI_Executor **exec);
+
+	/**
+	 * Creates an executor running its workers on the threads provided by the user.
+	 * \param[in]	ctx				KSI context.
+	 * \param[in]	workerCount		Number of the workers to be submitted.
+	 * \param[in]	submit			Function for starting a worker.
+	 * \param[in]	submitCtx		Context of the submit function.
+	 * \param[out]	exec			Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note #KSI_Executor_free blocks until all the submitted workers have returned.
+	 */
+	int KSI_Executor_newWithSubmitter(KSI_CTX *ctx, size_t workerCount, KSI_ExecutorSubmitter submit, void *submitCtx, KSI_Executor **exec);
+
+	/**
+	 * Stops the workers and frees the executor. Must not be called while a batch is running.
+	 * \param[in]	exec			The executor.
+	 */
+	void KSI_Executor_free(KSI_Executor *exec);
+
+	/**
+	 * Getter for the number of the workers.
+	 * \param[in]	exec			The executor.
+	 * \return The number of the workers, 0 if \c exec is \c NULL.
+	 */
+	size_t KSI_Executor_getWorkerCount(const KSI_Executor *exec);
+
+	/**
+	 * Calls \c task for every index from 0 to \c count - 1 and waits for the calls to finish.
+	 * The calls are made from the workers and the calling thread in an unspecified order. The
+	 * function may be called from a task, the waiting thread keeps processing the queued work.
+	 * \param[in]	exec			The executor, if \c NULL the calls are made in the calling thread.
+	 * \param[in]	count			Number of elements.
+	 * \param[in]	task			Function processing an element.
+	 * \param[in]	taskCtx			Context of the task function.
+	 * \return #KSI_OK if all the calls succeeded, otherwise the status code of a failed call.
+	 * \note All the elements are processed even if some of the calls fail.
+	 */
+	int KSI_Executor_forEach(KSI_Executor *exec, size_t count, KSI_ExecutorTask task, void *taskCtx);
+
+	KSI_DEFINE_REF(KSI_Executor);
+
+	/**
+	 * @}
+	 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXECUTOR_H_ */
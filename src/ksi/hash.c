@@ -25,6 +25,7 @@
 #include "impl/hash_impl.h"
 #include "tlv.h"
 #include "impl/ctx_impl.h"
+#include "executor.h"
 
 
 const int KSI_HASHALG_INVALID = -1;
@@ -90,22 +91,23 @@ void KSI_DataHash_free(KSI_DataHash *hsh) {
 	/* Do nothing if the object is NULL. */
 	if (hsh == NULL) return;
 
-	/* If the reference count is already 0, it means the object is actually located
-	 * in the object cache. In case of a user double free, this might become an issue. */
-	if (hsh->ref == 0) {
-		KSI_free(hsh);
-	} else {
-		if (--hsh->ref == 0) {
-			if (hsh->ctx != NULL && KSI_DataHashList_length(hsh->ctx->dataHashRecycle) < (size_t)hsh->ctx->options[KSI_OPT_DATAHASH_CACHE_SIZE]) {
-				res = KSI_DataHashList_append(hsh->ctx->dataHashRecycle, hsh);
+	/* The objects in the recycle bin are released by the context, see #KSI_CTX_free. */
+	if (KSI_ATOMIC_DEC_REF(&hsh->ref) == 0) {
+		if (hsh->ctx != NULL && hsh->ctx->options[KSI_OPT_DATAHASH_CACHE_SIZE] > 0) {
+			/* The object is kept for reuse by the calling thread. */
+			KSI_ThreadState *state = KSI_CTX_getThreadState(hsh->ctx, 1);
 
-				/* Return if all went well. */
-				if (res == KSI_OK) return;
+			res = KSI_BUFFER_OVERFLOW;
+			if (state != NULL && KSI_DataHashList_length(state->dataHashRecycle) < (size_t)hsh->ctx->options[KSI_OPT_DATAHASH_CACHE_SIZE]) {
+				res = KSI_DataHashList_append(state->dataHashRecycle, hsh);
 			}
 
-			/* Free the element if the recycle bin was full or the KSI context was not set. */
-			KSI_free(hsh);
+			/* Return if all went well. */
+			if (res == KSI_OK) return;
 		}
+
+		/* Free the element if the recycle bin was full or the KSI context was not set. */
+		KSI_free(hsh);
 	}
 }
 
@@ -193,6 +195,7 @@ cleanup:
 static int alloc_dataHash(KSI_CTX *ctx, KSI_DataHash **out) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHash *tmp = NULL;
+	KSI_ThreadState *state = NULL;
 	size_t len;
 
 	if (out == NULL) {
@@ -200,10 +203,12 @@ static int alloc_dataHash(KSI_CTX *ctx, KSI_DataHash **out) {
 		goto cleanup;
 	}
 
-	if (ctx != NULL && (len = KSI_DataHashList_length(ctx->dataHashRecycle)) > 0) {
-		res = KSI_DataHashList_remove(ctx->dataHashRecycle, len - 1, &tmp);
-		if (res != KSI_OK) goto cleanup;
-	} else {
+	state = KSI_CTX_getThreadState(ctx, 0);
+	if (state != NULL && (len = KSI_DataHashList_length(state->dataHashRecycle)) > 0) {
+		res = KSI_DataHashList_remove(state->dataHashRecycle, len - 1, &tmp);
+	}
+
+	if (tmp == NULL) {
 		tmp = KSI_new(KSI_DataHash);
 		if (tmp == NULL) {
 			res = KSI_OUT_OF_MEMORY;
@@ -406,6 +411,60 @@ cleanup:
 	return res;
 }
 
+typedef struct HashBatch_st {
+	KSI_CTX *ctx;
+	const void * const *data;
+	const size_t *data_length;
+	KSI_HashAlgorithm algo_id;
+	KSI_DataHash **hash;
+} HashBatch;
+
+static int hashBatchElement(void *c, size_t i) {
+	HashBatch *batch = c;
+	return KSI_DataHash_create(batch->ctx, batch->data[i], batch->data_length[i], batch->algo_id, &batch->hash[i]);
+}
+
+int KSI_DataHash_createBatch(KSI_CTX *ctx, const void * const *data, const size_t *data_length, size_t count, KSI_HashAlgorithm algo_id, KSI_DataHash **hash) {
+	int res = KSI_UNKNOWN_ERROR;
+	HashBatch batch;
+	size_t i;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || (count > 0 && (data == NULL || data_length == NULL || hash == NULL))) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmSupported(algo_id)) {
+		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) hash[i] = NULL;
+
+	batch.ctx = ctx;
+	batch.data = data;
+	batch.data_length = data_length;
+	batch.algo_id = algo_id;
+	batch.hash = hash;
+
+	res = KSI_Executor_forEach(ctx->executor, count, hashBatchElement, &batch);
+	if (res != KSI_OK) {
+		for (i = 0; i < count; i++) {
+			KSI_DataHash_free(hash[i]);
+			hash[i] = NULL;
+		}
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_DataHash_clone(KSI_DataHash *from, KSI_DataHash **to) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -415,7 +474,7 @@ int KSI_DataHash_clone(KSI_DataHash *from, KSI_DataHash **to) {
 	}
 	KSI_ERR_clearErrors(from->ctx);
 
-	from->ref++;
+	KSI_ATOMIC_INC_REF(&from->ref);
 	*to = from;
 
 	res = KSI_OK;
@@ -656,8 +715,83 @@ cleanup:
 	return res;
 }
 
+int KSI_DataHasher_copy(KSI_DataHasher *hsr, const KSI_DataHasher *from) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hsr == NULL || from == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hsr->ctx);
+
+	if (!from->isOpen || hsr->algorithm != from->algorithm) {
+		KSI_pushError(hsr->ctx, res = KSI_INVALID_STATE, "Hasher state can not be copied.");
+		goto cleanup;
+	}
+
+	if (hsr->copy == NULL) {
+		KSI_pushError(hsr->ctx, res = KSI_INVALID_STATE, "Hasher not properly initialized.");
+		goto cleanup;
+	}
+
+	res = hsr->copy(hsr, from);
+	if (res != KSI_OK) {
+		KSI_pushError(hsr->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	hsr->isOpen = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+KSI_DataHasher *KSI_DataHasher_fromPool(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, int (*reset)(KSI_DataHasher *)) {
+	KSI_DataHasher *hsr = NULL;
+	KSI_ThreadState *state = NULL;
+
+	if (ctx == NULL || !ksi_isHashAlgorithmIdValid(algo_id)) return NULL;
+
+	state = KSI_CTX_getThreadState(ctx, 0);
+	if (state == NULL) return NULL;
+
+	hsr = state->dataHasherRecycle[algo_id];
+	if (hsr != NULL) {
+		state->dataHasherRecycle[algo_id] = hsr->next;
+		state->dataHasherRecycle_len[algo_id]--;
+		hsr->next = NULL;
+	}
+
+	/* A hasher of another implementation is released, see #KSI_OPT_NATIVE_SHA2. */
+	if (hsr != NULL && reset != NULL && hsr->reset != reset) {
+		if (hsr->cleanup != NULL) hsr->cleanup(hsr);
+		KSI_free(hsr);
+		hsr = NULL;
+	}
+
+	return hsr;
+}
+
 void KSI_DataHasher_free(KSI_DataHasher *hsr) {
 	if (hsr != NULL) {
+		/* Keep the hasher with its implementation context for the next open, if the pool is not full. */
+		if (hsr->ctx != NULL && hsr->hashContext != NULL && ksi_isHashAlgorithmIdValid(hsr->algorithm) &&
+				hsr->ctx->options[KSI_OPT_DATAHASHER_CACHE_SIZE] > 0) {
+			/* The pool of the calling thread is used without locking. */
+			KSI_ThreadState *state = KSI_CTX_getThreadState(hsr->ctx, 1);
+
+			if (state != NULL && state->dataHasherRecycle_len[hsr->algorithm] < hsr->ctx->options[KSI_OPT_DATAHASHER_CACHE_SIZE]) {
+				hsr->isOpen = false;
+				hsr->next = state->dataHasherRecycle[hsr->algorithm];
+				state->dataHasherRecycle[hsr->algorithm] = hsr;
+				state->dataHasherRecycle_len[hsr->algorithm]++;
+				return;
+			}
+		}
+
 		if (hsr->cleanup != NULL) {
 			hsr->cleanup(hsr);
 		}
@@ -763,5 +897,201 @@ cleanup:
 }
 
 
-KSI_IMPLEMENT_REF(KSI_DataHash);
+int KSI_DataHasher_closeValue(KSI_DataHasher *hsr, KSI_DataHashValue *value) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash tmp;
+
+	if (hsr == NULL || value == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hsr->ctx);
+
+	if (!hsr->isOpen) {
+		KSI_pushError(hsr->ctx, res = KSI_INVALID_STATE, "Hasher is already closed.");
+		goto cleanup;
+	}
+
+	if (hsr->closeExisting == NULL) {
+		KSI_pushError(hsr->ctx, res = KSI_INVALID_STATE, "Hasher not properly initialized.");
+		goto cleanup;
+	}
+
+	/* The digest is written into a temporary on the stack, it is never shared. */
+	tmp.ctx = hsr->ctx;
+	tmp.ref = 0;
+	tmp.imprint_length = 0;
+
+	res = hsr->closeExisting(hsr, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(hsr->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (tmp.imprint_length > sizeof(value->imprint)) {
+		KSI_pushError(hsr->ctx, res = KSI_CRYPTO_FAILURE, "Internal buffer too short to hold imprint.");
+		goto cleanup;
+	}
+
+	memcpy(value->imprint, tmp.imprint, tmp.imprint_length);
+	value->imprint_length = tmp.imprint_length;
+
+	hsr->isOpen = false;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_DataHasher_addValue(KSI_DataHasher *hasher, const KSI_DataHashValue *value) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t len;
+
+	if (hasher == NULL || value == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+	len = KSI_DataHashValue_getImprintLength(value);
+	if (len == 0) {
+		KSI_pushError(hasher->ctx, res = KSI_INVALID_ARGUMENT, "Hash value is not set.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_add(hasher, value->imprint, len);
+	if (res != KSI_OK) {
+		KSI_pushError(hasher->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_DataHashValue_create(KSI_CTX *ctx, const void *data, size_t data_length, KSI_HashAlgorithm algo_id, KSI_DataHashValue *value) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (value == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, algo_id, &hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (data != NULL && data_length > 0) {
+		res = KSI_DataHasher_add(hsr, data, data_length);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_DataHasher_closeValue(hsr, value);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+int KSI_DataHashValue_fromImprint(KSI_DataHashValue *value, const unsigned char *imprint, size_t imprint_length) {
+	if (value == NULL || imprint == NULL || imprint_length == 0) return KSI_INVALID_ARGUMENT;
+
+	if (!ksi_isHashAlgorithmIdValid(imprint[0])) return KSI_UNAVAILABLE_HASH_ALGORITHM;
+
+	/* Verify the length of the digest with the algorithm. */
+	if (KSI_getHashLength(imprint[0]) + 1 != imprint_length) return KSI_INVALID_FORMAT;
+
+	memcpy(value->imprint, imprint, imprint_length);
+	value->imprint_length = imprint_length;
+
+	return KSI_OK;
+}
+
+int KSI_DataHashValue_fromDataHash(KSI_DataHashValue *value, const KSI_DataHash *hash) {
+	if (value == NULL || hash == NULL) return KSI_INVALID_ARGUMENT;
+
+	return KSI_DataHashValue_fromImprint(value, hash->imprint, hash->imprint_length);
+}
+
+int KSI_DataHash_fromValue(KSI_CTX *ctx, const KSI_DataHashValue *value, KSI_DataHash **hash) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t len;
+
+	KSI_ERR_clearErrors(ctx);
+	if (value == NULL || hash == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	len = KSI_DataHashValue_getImprintLength(value);
+	if (len == 0) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Hash value is not set.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_fromImprint(ctx, value->imprint, len, hash);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+size_t KSI_DataHashValue_getImprintLength(const KSI_DataHashValue *value) {
+	if (value == NULL || value->imprint_length > sizeof(value->imprint)) return 0;
+	return value->imprint_length;
+}
+
+int KSI_DataHashValue_equals(const KSI_DataHashValue *left, const KSI_DataHashValue *right) {
+	size_t len = KSI_DataHashValue_getImprintLength(left);
+
+	return len != 0 && len == KSI_DataHashValue_getImprintLength(right) && !memcmp(left->imprint, right->imprint, len);
+}
+
+char *KSI_DataHashValue_toString(const KSI_DataHashValue *value, char *buf, size_t buf_len) {
+	char *ret = NULL;
+	size_t i;
+	size_t len = 0;
+	size_t imprint_len = KSI_DataHashValue_getImprintLength(value);
+
+	if (imprint_len == 0 || buf == NULL) goto cleanup;
+
+	for (i = 0; i < imprint_len && len < buf_len; i++) {
+		len += KSI_snprintf(buf + len, buf_len - len, "%02x", value->imprint[i]);
+	}
+
+	ret = buf;
+
+cleanup:
+
+	return ret;
+}
+
+
+KSI_IMPLEMENT_ATOMIC_REF(KSI_DataHash);
 KSI_IMPLEMENT_LIST(KSI_DataHash, KSI_DataHash_free);
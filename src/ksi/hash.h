@@ -94,6 +94,19 @@ extern "C" {
 	 */
 	#define KSI_MAX_IMPRINT_LEN 65 /* Algorithm ID (1 byte) + longest digest. */
 
+	/**
+	 * A hash value stored by value. Unlike #KSI_DataHash it is not allocated, reference counted nor bound
+	 * to a KSI context, so it can be embedded in other structures and arrays, copied with an assignment
+	 * and passed by value. A zero-initialized value is not set, and is rejected by the functions taking
+	 * a hash value as an input.
+	 */
+	typedef struct KSI_DataHashValue_st {
+		/** Imprint: 1 byte for the algorithm id followed by the digest, the rest of the buffer is not used. */
+		unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+		/** Length of the imprint, 0 if the value is not set. */
+		size_t imprint_length;
+	} KSI_DataHashValue;
+
 	/**
 	 * Starts a hash computation.
 	 * \param[in]		ctx			KSI context.
@@ -146,6 +159,32 @@ extern "C" {
 	 */
 	int KSI_DataHasher_addOctetString(KSI_DataHasher *hasher, const KSI_OctetString *data);
 
+	/**
+	 * Adds the contents of the file to the hash computation. See #KSI_DataHasher_addFd for how the
+	 * file is read.
+	 * \param[in]	hasher				Hasher object.
+	 * \param[in]	path				Path to the file.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \see #KSI_DataHash_fromFile, #KSI_Signature_createDataHasher
+	 */
+	int KSI_DataHasher_addFile(KSI_DataHasher *hasher, const char *path);
+
+	/**
+	 * Adds the data read from the file descriptor, starting from its current position until the end of
+	 * the file, to the hash computation. The input is read by a separate thread into alternating buffers,
+	 * so reading overlaps with hashing. If #KSI_OPT_HASH_FILE_MMAP is enabled, a regular file is memory
+	 * mapped instead and hashed in chunks, the kernel is advised to read the next chunk ahead while the
+	 * current one is hashed. The regular files reporting a zero size, as some special files do, are read.
+	 * \param[in]	hasher				Hasher object.
+	 * \param[in]	fd					Open file descriptor.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On success the file position is at the end of the file.
+	 * \note If a mapped file is truncated while being hashed, the process receives \c SIGBUS, see
+	 * 		#KSI_OPT_HASH_FILE_MMAP.
+	 * \see #KSI_DataHasher_addFile
+	 */
+	int KSI_DataHasher_addFd(KSI_DataHasher *hasher, int fd);
+
 	/**
 	 * Finalizes a hash computation.
 	 * \param[in]	hasher			Hasher object.
@@ -169,6 +208,7 @@ extern "C" {
 	 *
 	 * \param[in]	hash			#KSI_DataHash object that is to be freed.
 	 *
+	 * \note The reference count is updated atomically, thus a data hash may be shared between threads.
 	 * \see #KSI_DataHasher_close, #KSI_DataHash_fromImprint, #KSI_DataHash_fromDigest
 	 */
 	void KSI_DataHash_free(KSI_DataHash *hash);
@@ -189,6 +229,36 @@ extern "C" {
 	 */
 	int KSI_DataHash_create(KSI_CTX *ctx, const void *data, size_t data_length, KSI_HashAlgorithm algo_id, KSI_DataHash **hash);
 
+	/**
+	 * Calculates the data hash objects of a batch of inputs. The inputs are hashed in parallel
+	 * by the executor of the context (see #KSI_CTX_setExecutor).
+	 *
+	 * \param[in]	ctx				KSI context.
+	 * \param[in]	data			Array of pointers to the input data.
+	 * \param[in]	data_length		Array of the lengths of the input data.
+	 * \param[in]	count			Number of the inputs.
+	 * \param[in]	algo_id			Hash algorithm id.
+	 * \param[out]	hash			Array of \c count pointers receiving the data hash objects.
+	 *
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On failure none of the output hashes is set.
+	 * \see #KSI_DataHash_create
+	 */
+	int KSI_DataHash_createBatch(KSI_CTX *ctx, const void * const *data, const size_t *data_length, size_t count, KSI_HashAlgorithm algo_id, KSI_DataHash **hash);
+
+	/**
+	 * Calculates the data hash object of the contents of the file.
+	 *
+	 * \param[in]	ctx				KSI context.
+	 * \param[in]	path			Path to the file.
+	 * \param[in]	algo_id			Hash algorithm id.
+	 * \param[out]	hash			Pointer to the pointer receiving the data hash object.
+	 *
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \see #KSI_DataHasher_addFile, #KSI_DataHash_free
+	 */
+	int KSI_DataHash_fromFile(KSI_CTX *ctx, const char *path, KSI_HashAlgorithm algo_id, KSI_DataHash **hash);
+
 	/**
 	 * Creates a clone of the data hash.
 	 *
@@ -400,6 +470,83 @@ extern "C" {
 	 */
 	int KSI_DataHash_createZero(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHash **hsh);
 
+	/**
+	 * Finalizes a hash computation into a hash value. The hasher is closed as by #KSI_DataHasher_close.
+	 * \param[in]		hasher		Hasher object.
+	 * \param[out]		value		Pointer to the receiving hash value.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHasher_closeValue(KSI_DataHasher *hasher, KSI_DataHashValue *value);
+
+	/**
+	 * Adds the imprint of the hash value to the hash computation.
+	 * \param[in]		hasher		Hasher object.
+	 * \param[in]		value		Hash value.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHasher_addValue(KSI_DataHasher *hasher, const KSI_DataHashValue *value);
+
+	/**
+	 * Calculates the hash value of the data.
+	 * \param[in]		ctx			KSI context.
+	 * \param[in]		data		Pointer to the data to be hashed.
+	 * \param[in]		data_length	Length of the data.
+	 * \param[in]		algo_id		Hash algorithm id.
+	 * \param[out]		value		Pointer to the receiving hash value.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHashValue_create(KSI_CTX *ctx, const void *data, size_t data_length, KSI_HashAlgorithm algo_id, KSI_DataHashValue *value);
+
+	/**
+	 * Sets the hash value from an imprint.
+	 * \param[out]		value			Pointer to the receiving hash value.
+	 * \param[in]		imprint			Pointer to the imprint.
+	 * \param[in]		imprint_length	Length of the imprint.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHashValue_fromImprint(KSI_DataHashValue *value, const unsigned char *imprint, size_t imprint_length);
+
+	/**
+	 * Sets the hash value from a data hash object.
+	 * \param[out]		value		Pointer to the receiving hash value.
+	 * \param[in]		hash		The data hash object.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHashValue_fromDataHash(KSI_DataHashValue *value, const KSI_DataHash *hash);
+
+	/**
+	 * Creates a data hash object with the hash value.
+	 * \param[in]		ctx			KSI context.
+	 * \param[in]		value		The hash value.
+	 * \param[out]		hash		Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHash_fromValue(KSI_CTX *ctx, const KSI_DataHashValue *value, KSI_DataHash **hash);
+
+	/**
+	 * Returns the length of the imprint of the hash value.
+	 * \param[in]		value		The hash value.
+	 * \return The length of the imprint, or 0 if the value is not set.
+	 */
+	size_t KSI_DataHashValue_getImprintLength(const KSI_DataHashValue *value);
+
+	/**
+	 * Compares the hash values.
+	 * \param[in]		left		Left hash value.
+	 * \param[in]		right		Right hash value.
+	 * \return 0 if the values are not equal or not set, otherwise a value != 0.
+	 */
+	int KSI_DataHashValue_equals(const KSI_DataHashValue *left, const KSI_DataHashValue *right);
+
+	/**
+	 * Creates a hex string representation of the imprint of the hash value.
+	 * \param[in]		value		The hash value.
+	 * \param[in,out]	buf			Pointer to the receiving buffer.
+	 * \param[in]		buf_len		Length of the receiving buffer.
+	 * \return Returns the pointer to the buffer or NULL on error.
+	 */
+	char *KSI_DataHashValue_toString(const KSI_DataHashValue *value, char *buf, size_t buf_len);
+
 	KSI_DEFINE_REF(KSI_DataHash);
 	KSI_DEFINE_LIST(KSI_DataHash);
 #define KSI_DataHashList_append(lst, o) KSI_APPLY_TO_NOT_NULL((lst), append, ((lst), (o)))
@@ -24,6 +24,7 @@
 
 #include "impl/hash_impl.h"
 
+#include <string.h>
 #include <CommonCrypto/CommonCrypto.h>
 
 #define CC_SHA384_CTX CC_SHA512_CTX
@@ -166,6 +167,24 @@ cleanup:
 	return res;
 }
 
+static int ksi_DataHasher_copy(KSI_DataHasher *hasher, const KSI_DataHasher *from) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL || from == NULL || hasher->hashContext == NULL || from->hashContext == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* The CommonCrypto contexts are plain structures. */
+	memcpy(hasher->hashContext, from->hashContext, cc[hasher->algorithm].ctx_size);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHasher *tmp_hasher = NULL;
@@ -176,25 +195,37 @@ int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher
 		goto cleanup;
 	}
 
+	/* The built-in SHA-2 implementation replaces the hash provider, if enabled. */
+	if (KSI_DataHasher_preferNative(ctx, algo_id)) {
+		res = KSI_DataHasher_openNative(ctx, algo_id, hasher);
+		goto cleanup;
+	}
+
 	if (!KSI_isHashAlgorithmSupported(algo_id)) {
 		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
 		goto cleanup;
 	}
 
-	tmp_hasher = KSI_new(KSI_DataHasher);
+	/* A pooled hasher only needs to be reset. */
+	tmp_hasher = KSI_DataHasher_fromPool(ctx, algo_id, ksi_DataHasher_reset);
 	if (tmp_hasher == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
-		goto cleanup;
-	}
+		tmp_hasher = KSI_new(KSI_DataHasher);
+		if (tmp_hasher == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
 
-	tmp_hasher->hashContext = NULL;
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->algorithm = algo_id;
-	tmp_hasher->closeExisting = closeExisting;
-	tmp_hasher->isOpen = false;
-	tmp_hasher->reset = ksi_DataHasher_reset;
-	tmp_hasher->add = ksi_DataHasher_add;
-	tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->hashContext = NULL;
+		tmp_hasher->ctx = ctx;
+		tmp_hasher->algorithm = algo_id;
+		tmp_hasher->closeExisting = closeExisting;
+		tmp_hasher->isOpen = false;
+		tmp_hasher->reset = ksi_DataHasher_reset;
+		tmp_hasher->add = ksi_DataHasher_add;
+		tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->copy = ksi_DataHasher_copy;
+		tmp_hasher->next = NULL;
+	}
 
 	res = KSI_DataHasher_reset(tmp_hasher);
 	if (res != KSI_OK) {
@@ -246,6 +246,37 @@ cleanup:
 	return res;
 }
 
+static int ksi_DataHasher_copy(KSI_DataHasher *hasher, const KSI_DataHasher *from) {
+	int res = KSI_UNKNOWN_ERROR;
+	CRYPTO_HASH_CTX *pCryptoCTX = NULL;
+	const CRYPTO_HASH_CTX *pFromCTX = NULL;
+	HCRYPTHASH pTmp_hash = 0;
+
+	if (hasher == NULL || from == NULL || hasher->hashContext == NULL || from->hashContext == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	pCryptoCTX = (CRYPTO_HASH_CTX*)hasher->hashContext;
+	pFromCTX = (const CRYPTO_HASH_CTX*)from->hashContext;
+
+	if (!CryptDuplicateHash(pFromCTX->pt_hHash, NULL, 0, &pTmp_hash)) {
+		DWORD error = GetLastError();
+		KSI_LOG_debug(hasher->ctx, "Cryptoapi: Duplicate hash error %i.", error);
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, NULL);
+		goto cleanup;
+	}
+
+	if (pCryptoCTX->pt_hHash != 0) CryptDestroyHash(pCryptoCTX->pt_hHash);
+	pCryptoCTX->pt_hHash = pTmp_hash;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHasher *tmp_hasher = NULL;
@@ -258,50 +289,62 @@ int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher
 		goto cleanup;
 	}
 
+	/* The built-in SHA-2 implementation replaces the hash provider, if enabled. */
+	if (KSI_DataHasher_preferNative(ctx, algo_id)) {
+		res = KSI_DataHasher_openNative(ctx, algo_id, hasher);
+		goto cleanup;
+	}
+
 	/* Test if the hash algorithm is valid. */
 	if (!KSI_isHashAlgorithmSupported(algo_id)) {
 		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
 		goto cleanup;
 	}
 
-	/* Create new abstract data hasher object. */
-	tmp_hasher = KSI_new(KSI_DataHasher);
+	/* A pooled hasher keeps its crypto service provider and only needs to be reset. */
+	tmp_hasher = KSI_DataHasher_fromPool(ctx, algo_id, ksi_DataHasher_reset);
 	if (tmp_hasher == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
-		goto cleanup;
-	}
+		/* Create new abstract data hasher object. */
+		tmp_hasher = KSI_new(KSI_DataHasher);
+		if (tmp_hasher == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
 
-	tmp_hasher->hashContext = NULL;
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->algorithm = algo_id;
-	tmp_hasher->closeExisting = closeExisting;
-	tmp_hasher->isOpen = false;
-	tmp_hasher->reset = ksi_DataHasher_reset;
-	tmp_hasher->add = ksi_DataHasher_add;
-	tmp_hasher->cleanup = ksi_DataHasher_cleanup;
-
-	/* Create new helper context for crypto api. */
-	res = CRYPTO_HASH_CTX_new(&tmp_cryptoCTX);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
+		tmp_hasher->hashContext = NULL;
+		tmp_hasher->ctx = ctx;
+		tmp_hasher->algorithm = algo_id;
+		tmp_hasher->closeExisting = closeExisting;
+		tmp_hasher->isOpen = false;
+		tmp_hasher->reset = ksi_DataHasher_reset;
+		tmp_hasher->add = ksi_DataHasher_add;
+		tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->copy = ksi_DataHasher_copy;
+		tmp_hasher->next = NULL;
+
+		/* Create new helper context for crypto api. */
+		res = CRYPTO_HASH_CTX_new(&tmp_cryptoCTX);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
 
-	/* Create new crypto service provider (CSP). */
-	if (!CryptAcquireContext(&tmp_CSP, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT)) {
-		char errm[1024];
-		KSI_snprintf(errm, sizeof(errm), "Wincrypt Error (%d).", GetLastError());
-		KSI_pushError(ctx, res = KSI_CRYPTO_FAILURE, errm);
-		goto cleanup;
-	}
+		/* Create new crypto service provider (CSP). */
+		if (!CryptAcquireContext(&tmp_CSP, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT)) {
+			char errm[1024];
+			KSI_snprintf(errm, sizeof(errm), "Wincrypt Error (%d).", GetLastError());
+			KSI_pushError(ctx, res = KSI_CRYPTO_FAILURE, errm);
+			goto cleanup;
+		}
 
-	/* Set CSP in helper struct. */
-	tmp_cryptoCTX->pt_CSP = tmp_CSP;
-	tmp_CSP = 0;
+		/* Set CSP in helper struct. */
+		tmp_cryptoCTX->pt_CSP = tmp_CSP;
+		tmp_CSP = 0;
 
-	/* Set helper struct in abstract struct. */
-	tmp_hasher->hashContext = tmp_cryptoCTX;
-	tmp_cryptoCTX = NULL;
+		/* Set helper struct in abstract struct. */
+		tmp_hasher->hashContext = tmp_cryptoCTX;
+		tmp_cryptoCTX = NULL;
+	}
 
 	res = KSI_DataHasher_reset(tmp_hasher);
 	if (res != KSI_OK) {
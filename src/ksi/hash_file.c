@@ -0,0 +1,394 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+#include "hash.h"
+#include "internal.h"
+#include "impl/ctx_impl.h"
+#include "impl/hash_impl.h"
+#include "impl/thread_impl.h"
+
+/** Size of the mapped region hashed at once, the next region is read ahead meanwhile. */
+#define FILE_CHUNK_SIZE (4 * 1024 * 1024)
+
+/** Size of the buffers filled by the reader thread. */
+#define FILE_READ_BUFFER_SIZE (1024 * 1024)
+
+typedef struct FileReader_st {
+	int fd;
+	KSI_Mutex lock;
+	KSI_Cond cond;
+	unsigned char *buf[2];
+	size_t len[2];
+	/** The buffer is filled by the reader and not yet hashed. */
+	bool full[2];
+	/** The reader failed to read the data of the last filled buffer. */
+	bool failed;
+	/** The hashing was aborted, the reader has to exit. */
+	bool stop;
+} FileReader;
+
+static int readFully(int fd, unsigned char *buf, size_t size, size_t *len) {
+	size_t count = 0;
+
+	while (count < size) {
+#ifdef _WIN32
+		int n = _read(fd, buf + count, (unsigned)(size - count));
+#else
+		ssize_t n = read(fd, buf + count, size - count);
+		if (n < 0 && errno == EINTR) continue;
+#endif
+		if (n < 0) return 0;
+		if (n == 0) break;
+		count += (size_t)n;
+	}
+
+	*len = count;
+	return 1;
+}
+
+static void readerThread(void *arg) {
+	FileReader *r = arg;
+	size_t i = 0;
+
+	for (;;) {
+		size_t len = 0;
+		int ok;
+
+		KSI_Mutex_lock(&r->lock);
+		while (r->full[i] && !r->stop) KSI_Cond_wait(&r->cond, &r->lock);
+		if (r->stop) {
+			KSI_Mutex_unlock(&r->lock);
+			break;
+		}
+		KSI_Mutex_unlock(&r->lock);
+
+		ok = readFully(r->fd, r->buf[i], FILE_READ_BUFFER_SIZE, &len);
+
+		KSI_Mutex_lock(&r->lock);
+		r->len[i] = len;
+		r->full[i] = true;
+		if (!ok) r->failed = true;
+		KSI_Cond_broadcast(&r->cond);
+		KSI_Mutex_unlock(&r->lock);
+
+		/* A short read marks the end of the input. */
+		if (!ok || len < FILE_READ_BUFFER_SIZE) break;
+		i ^= 1;
+	}
+}
+
+/* Reads the input on a separate thread into two alternating buffers, while the calling thread is hashing the other one. */
+static int hashPipelined(KSI_DataHasher *hasher, int fd) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = hasher->ctx;
+	FileReader r;
+	KSI_Thread thread;
+	bool lockInit = false;
+	bool condInit = false;
+	bool started = false;
+	size_t i = 0;
+
+	memset(&r, 0, sizeof(r));
+	r.fd = fd;
+
+	res = KSI_Mutex_init(&r.lock);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+	lockInit = true;
+
+	res = KSI_Cond_init(&r.cond);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+	condInit = true;
+
+	r.buf[0] = KSI_malloc(FILE_READ_BUFFER_SIZE);
+	r.buf[1] = KSI_malloc(FILE_READ_BUFFER_SIZE);
+	if (r.buf[0] == NULL || r.buf[1] == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Thread_start(&thread, readerThread, &r);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, "Unable to start the file reader thread.");
+		goto cleanup;
+	}
+	started = true;
+
+	for (;;) {
+		size_t len;
+		bool failed;
+
+		KSI_Mutex_lock(&r.lock);
+		while (!r.full[i]) KSI_Cond_wait(&r.cond, &r.lock);
+		len = r.len[i];
+		failed = r.failed;
+		KSI_Mutex_unlock(&r.lock);
+
+		if (failed) {
+			KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to read the file.");
+			goto cleanup;
+		}
+
+		if (len > 0) {
+			res = KSI_DataHasher_add(hasher, r.buf[i], len);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		if (len < FILE_READ_BUFFER_SIZE) break;
+
+		KSI_Mutex_lock(&r.lock);
+		r.full[i] = false;
+		KSI_Cond_broadcast(&r.cond);
+		KSI_Mutex_unlock(&r.lock);
+
+		i ^= 1;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (started) {
+		KSI_Mutex_lock(&r.lock);
+		r.stop = true;
+		KSI_Cond_broadcast(&r.cond);
+		KSI_Mutex_unlock(&r.lock);
+
+		KSI_Thread_join(&thread);
+	}
+	if (condInit) KSI_Cond_destroy(&r.cond);
+	if (lockInit) KSI_Mutex_destroy(&r.lock);
+	KSI_free(r.buf[0]);
+	KSI_free(r.buf[1]);
+
+	return res;
+}
+
+#ifndef _WIN32
+/* Maps the rest of a regular file and hashes it in chunks, advising the kernel to read the next chunk ahead.
+ * Sets \c mapped to false without an error when the file can not be mapped. Accessing the pages beyond the
+ * end of a file truncated meanwhile raises SIGBUS, thus the mapping is used only if enabled with
+ * #KSI_OPT_HASH_FILE_MMAP. */
+static int hashMapped(KSI_DataHasher *hasher, int fd, bool *mapped) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = hasher->ctx;
+	struct stat st;
+	off_t pos;
+	off_t base;
+	long page;
+	size_t len;
+	size_t skip;
+	unsigned char *ptr = MAP_FAILED;
+	size_t off;
+
+	*mapped = false;
+
+	/* Some regular files (e.g. in procfs) report a zero size but do have contents, these are read. */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) return KSI_OK;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	page = sysconf(_SC_PAGESIZE);
+	if (pos < 0 || page <= 0) return KSI_OK;
+
+	*mapped = true;
+
+	/* Nothing left to hash. */
+	if (st.st_size <= pos) return KSI_OK;
+
+	/* The mapping has to start at a page boundary. */
+	base = pos - pos % page;
+	skip = (size_t)(pos - base);
+	if ((KSI_uint64_t)(st.st_size - base) > SIZE_MAX) {
+		*mapped = false;
+		return KSI_OK;
+	}
+	len = (size_t)(st.st_size - base);
+
+	ptr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, base);
+	if (ptr == MAP_FAILED) {
+		*mapped = false;
+		return KSI_OK;
+	}
+
+	madvise(ptr, len, MADV_SEQUENTIAL);
+
+	for (off = skip; off < len; off += FILE_CHUNK_SIZE) {
+		size_t chunk = len - off < FILE_CHUNK_SIZE ? len - off : FILE_CHUNK_SIZE;
+		size_t next = off + chunk;
+
+		if (next < len) {
+			/* The advised range has to start at a page boundary as well. */
+			size_t from = next - next % (size_t)page;
+			madvise(ptr + from, (len - from < FILE_CHUNK_SIZE ? len - from : FILE_CHUNK_SIZE), MADV_WILLNEED);
+		}
+
+		res = KSI_DataHasher_add(hasher, ptr + off, chunk);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* Leave the file position at the end, as reading would. */
+	if (lseek(fd, st.st_size, SEEK_SET) < 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to seek the file.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	munmap(ptr, len);
+
+	return res;
+}
+#endif
+
+int KSI_DataHasher_addFd(KSI_DataHasher *hasher, int fd) {
+	int res = KSI_UNKNOWN_ERROR;
+	bool mapped = false;
+
+	if (hasher == NULL || fd < 0) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+#ifndef _WIN32
+	if (hasher->ctx != NULL && hasher->ctx->options[KSI_OPT_HASH_FILE_MMAP]) {
+		res = hashMapped(hasher, fd, &mapped);
+		if (res != KSI_OK) {
+			KSI_pushError(hasher->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+#endif
+
+	if (!mapped) {
+		res = hashPipelined(hasher, fd);
+		if (res != KSI_OK) {
+			KSI_pushError(hasher->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_DataHasher_addFile(KSI_DataHasher *hasher, const char *path) {
+	int res = KSI_UNKNOWN_ERROR;
+	int fd = -1;
+
+	if (hasher == NULL || path == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+#ifdef _WIN32
+	fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+	fd = open(path, O_RDONLY);
+#endif
+	if (fd < 0) {
+		KSI_pushError(hasher->ctx, res = KSI_IO_ERROR, "Unable to open the file.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_addFd(hasher, fd);
+	if (res != KSI_OK) {
+		KSI_pushError(hasher->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+#ifdef _WIN32
+	if (fd >= 0) _close(fd);
+#else
+	if (fd >= 0) close(fd);
+#endif
+
+	return res;
+}
+
+int KSI_DataHash_fromFile(KSI_CTX *ctx, const char *path, KSI_HashAlgorithm algo_id, KSI_DataHash **hash) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || path == NULL || hash == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, algo_id, &hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_addFile(hsr, path);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_close(hsr, hash);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
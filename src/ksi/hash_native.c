@@ -0,0 +1,249 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "hash.h"
+#include "impl/hash_impl.h"
+#include "impl/sha_impl.h"
+#include "impl/ctx_impl.h"
+
+typedef union NativeHashContext_un {
+	KSI_Sha1 sha1;
+	KSI_Sha256 sha256;
+	KSI_Sha512 sha512;
+} NativeHashContext;
+
+static bool isSha2Algorithm(KSI_HashAlgorithm algo_id) {
+	return algo_id == KSI_HASHALG_SHA2_256 || algo_id == KSI_HASHALG_SHA2_384 || algo_id == KSI_HASHALG_SHA2_512;
+}
+
+/* SHA-1 is only needed to verify the older signatures, when there is no other hash provider. */
+static bool isNativeAlgorithm(KSI_HashAlgorithm algo_id) {
+	return algo_id == KSI_HASHALG_SHA1 || isSha2Algorithm(algo_id);
+}
+
+static int closeExisting(KSI_DataHasher *hasher, KSI_DataHash *data_hash) {
+	int res = KSI_UNKNOWN_ERROR;
+	NativeHashContext *context = NULL;
+
+	if (hasher == NULL || data_hash == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+	context = hasher->hashContext;
+
+	switch (hasher->algorithm) {
+		case KSI_HASHALG_SHA1:
+			KSI_Sha1_final(&context->sha1, data_hash->imprint + 1);
+			break;
+		case KSI_HASHALG_SHA2_256:
+			KSI_Sha256_final(&context->sha256, data_hash->imprint + 1);
+			break;
+		case KSI_HASHALG_SHA2_384:
+		case KSI_HASHALG_SHA2_512:
+			KSI_Sha512_final(&context->sha512, data_hash->imprint + 1);
+			break;
+		default:
+			KSI_pushError(hasher->ctx, res = KSI_INVALID_ARGUMENT, "Algorithm ID not supported.");
+			goto cleanup;
+	}
+
+	data_hash->imprint[0] = (0xff & hasher->algorithm);
+	data_hash->imprint_length = KSI_getHashLength(hasher->algorithm) + 1;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static void ksi_DataHasher_cleanup(KSI_DataHasher *hasher) {
+	if (hasher != NULL) {
+		KSI_free(hasher->hashContext);
+		hasher->hashContext = NULL;
+	}
+}
+
+static int ksi_DataHasher_reset(KSI_DataHasher *hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+	NativeHashContext *context = NULL;
+
+	if (hasher == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+	context = hasher->hashContext;
+	if (context == NULL) {
+		context = KSI_new(NativeHashContext);
+		if (context == NULL) {
+			KSI_pushError(hasher->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		hasher->hashContext = context;
+	}
+
+	switch (hasher->algorithm) {
+		case KSI_HASHALG_SHA1:
+			KSI_Sha1_init(&context->sha1);
+			break;
+		case KSI_HASHALG_SHA2_256:
+			KSI_Sha256_init(&context->sha256);
+			break;
+		case KSI_HASHALG_SHA2_384:
+			KSI_Sha512_init(&context->sha512, 48);
+			break;
+		case KSI_HASHALG_SHA2_512:
+			KSI_Sha512_init(&context->sha512, 64);
+			break;
+		default:
+			KSI_pushError(hasher->ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+			goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int ksi_DataHasher_add(KSI_DataHasher *hasher, const void *data, size_t data_length) {
+	int res = KSI_UNKNOWN_ERROR;
+	NativeHashContext *context = NULL;
+
+	if (hasher == NULL || data == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	context = hasher->hashContext;
+
+	switch (hasher->algorithm) {
+		case KSI_HASHALG_SHA1:
+			KSI_Sha1_update(&context->sha1, data, data_length);
+			break;
+		case KSI_HASHALG_SHA2_256:
+			KSI_Sha256_update(&context->sha256, data, data_length);
+			break;
+		default:
+			KSI_Sha512_update(&context->sha512, data, data_length);
+			break;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int ksi_DataHasher_copy(KSI_DataHasher *hasher, const KSI_DataHasher *from) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL || from == NULL || hasher->hashContext == NULL || from->hashContext == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	memcpy(hasher->hashContext, from->hashContext, sizeof(NativeHashContext));
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+bool KSI_DataHasher_preferNative(const KSI_CTX *ctx, KSI_HashAlgorithm algo_id) {
+	return ctx != NULL && ctx->options[KSI_OPT_NATIVE_SHA2] && isSha2Algorithm(algo_id);
+}
+
+int KSI_DataHasher_openNative(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *tmp_hasher = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (hasher == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (!isNativeAlgorithm(algo_id)) {
+		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+
+	/* A pooled hasher only needs to be reset. */
+	tmp_hasher = KSI_DataHasher_fromPool(ctx, algo_id, ksi_DataHasher_reset);
+	if (tmp_hasher == NULL) {
+		tmp_hasher = KSI_new(KSI_DataHasher);
+		if (tmp_hasher == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		tmp_hasher->hashContext = NULL;
+		tmp_hasher->ctx = ctx;
+		tmp_hasher->algorithm = algo_id;
+		tmp_hasher->closeExisting = closeExisting;
+		tmp_hasher->isOpen = false;
+		tmp_hasher->reset = ksi_DataHasher_reset;
+		tmp_hasher->add = ksi_DataHasher_add;
+		tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->copy = ksi_DataHasher_copy;
+		tmp_hasher->next = NULL;
+	}
+
+	res = KSI_DataHasher_reset(tmp_hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*hasher = tmp_hasher;
+	tmp_hasher = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(tmp_hasher);
+
+	return res;
+}
+
+#if KSI_HASH_IMPL == KSI_IMPL_NATIVE
+
+int KSI_isHashAlgorithmSupported(KSI_HashAlgorithm algo_id) {
+	return isNativeAlgorithm(algo_id);
+}
+
+int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher) {
+	return KSI_DataHasher_openNative(ctx, algo_id, hasher);
+}
+
+#endif
@@ -185,6 +185,26 @@ cleanup:
 	return res;
 }
 
+static int ksi_DataHasher_copy(KSI_DataHasher *hasher, const KSI_DataHasher *from) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL || from == NULL || hasher->hashContext == NULL || from->hashContext == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (!EVP_MD_CTX_copy_ex(hasher->hashContext, from->hashContext)) {
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHasher *tmp_hasher = NULL;
@@ -195,25 +215,37 @@ int KSI_DataHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher
 		goto cleanup;
 	}
 
+	/* The built-in SHA-2 implementation replaces the hash provider, if enabled. */
+	if (KSI_DataHasher_preferNative(ctx, algo_id)) {
+		res = KSI_DataHasher_openNative(ctx, algo_id, hasher);
+		goto cleanup;
+	}
+
 	if (!KSI_isHashAlgorithmSupported(algo_id)) {
 		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
 		goto cleanup;
 	}
 
-	tmp_hasher = KSI_new(KSI_DataHasher);
+	/* A pooled hasher only needs to be reset. */
+	tmp_hasher = KSI_DataHasher_fromPool(ctx, algo_id, ksi_DataHasher_reset);
 	if (tmp_hasher == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
-		goto cleanup;
-	}
+		tmp_hasher = KSI_new(KSI_DataHasher);
+		if (tmp_hasher == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
 
-	tmp_hasher->hashContext = NULL;
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->algorithm = algo_id;
-	tmp_hasher->closeExisting = closeExisting;
-	tmp_hasher->isOpen = false;
-	tmp_hasher->reset = ksi_DataHasher_reset;
-	tmp_hasher->add = ksi_DataHasher_add;
-	tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->hashContext = NULL;
+		tmp_hasher->ctx = ctx;
+		tmp_hasher->algorithm = algo_id;
+		tmp_hasher->closeExisting = closeExisting;
+		tmp_hasher->isOpen = false;
+		tmp_hasher->reset = ksi_DataHasher_reset;
+		tmp_hasher->add = ksi_DataHasher_add;
+		tmp_hasher->cleanup = ksi_DataHasher_cleanup;
+		tmp_hasher->copy = ksi_DataHasher_copy;
+		tmp_hasher->next = NULL;
+	}
 
 	res = KSI_DataHasher_reset(tmp_hasher);
 	if (res != KSI_OK) {
@@ -236,7 +268,6 @@ cleanup:
 #ifdef KSI_NATIVE_HMAC
 
 #include <string.h>
-#include <openssl/hmac.h>
 
 #include "hmac.h"
 
@@ -249,53 +280,45 @@ struct KSI_HmacHasher_st {
 	/** KSI context. */
 	KSI_CTX *ctx;
 
-	/** OpenSSL HMAC context. */
-	HMAC_CTX *openssl_ctx;
+	/** Inner and outer hash states after processing the padded key. */
+	EVP_MD_CTX *keyedInner;
+	EVP_MD_CTX *keyedOuter;
 
-	/** Hash algorithm id for reset. */
-	KSI_HashAlgorithm hash_id;
+	/** Hash state of the current message. */
+	EVP_MD_CTX *inner;
 
-	/** HMAC key for reset. */
-	char *key;
+	/** Hash algorithm id. */
+	KSI_HashAlgorithm hash_id;
 };
 
-int KSI_HMAC_create(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, const unsigned char *data, size_t data_len, KSI_DataHash **hmac) {
+static int hmacHasher_new(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_HmacHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_HmacHasher *hasher = NULL;
-	KSI_DataHash *tmp_hmac = NULL;
-
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || hmac == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
-	}
+	KSI_HmacHasher *tmp_hasher = NULL;
 
-	res = KSI_HmacHasher_open(ctx, algo_id, key, &hasher);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
+	tmp_hasher = KSI_new(KSI_HmacHasher);
+	if (tmp_hasher == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_HmacHasher_add(hasher, data, data_len);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
+	tmp_hasher->ctx = ctx;
+	tmp_hasher->hash_id = algo_id;
+	tmp_hasher->keyedInner = KSI_EVP_MD_CTX_create();
+	tmp_hasher->keyedOuter = KSI_EVP_MD_CTX_create();
+	tmp_hasher->inner = KSI_EVP_MD_CTX_create();
 
-	res = KSI_HmacHasher_close(hasher, &tmp_hmac);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
+	if (tmp_hasher->keyedInner == NULL || tmp_hasher->keyedOuter == NULL || tmp_hasher->inner == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, "Unable to create HMAC context.");
 		goto cleanup;
 	}
 
-	*hmac = tmp_hmac;
-	tmp_hmac = NULL;
+	*hasher = tmp_hasher;
+	tmp_hasher = NULL;
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_DataHash_free(tmp_hmac);
-	KSI_HmacHasher_free(hasher);
+	KSI_HmacHasher_free(tmp_hasher);
 
 	return res;
 }
@@ -303,8 +326,15 @@ cleanup:
 int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, KSI_HmacHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_HmacHasher *tmp_hasher = NULL;
-
-	unsigned int key_len = 0;
+	const EVP_MD *evp_md = NULL;
+	unsigned char ipad[MAX_BUF_LEN];
+	unsigned char opad[MAX_BUF_LEN];
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_len = 0;
+	const unsigned char *key_ptr = NULL;
+	size_t key_len = 0;
+	size_t block_len = 0;
+	size_t i;
 
 	KSI_ERR_clearErrors(ctx);
 	if (ctx == NULL || key == NULL || hasher == NULL) {
@@ -318,32 +348,49 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 		goto cleanup;
 	}
 
-	tmp_hasher = KSI_new(KSI_HmacHasher);
-	if (tmp_hasher == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+	if (!KSI_isHashAlgorithmSupported(algo_id) || (evp_md = hashAlgorithmToEVP(algo_id)) == NULL) {
+		KSI_pushError(ctx, res = KSI_UNKNOWN_HASH_ALGORITHM_ID, "Unsupported hash algorithm");
 		goto cleanup;
 	}
 
-	memset(tmp_hasher, 0, sizeof(KSI_HmacHasher));
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->openssl_ctx = NULL;
-	tmp_hasher->key = NULL;
-
-	tmp_hasher->openssl_ctx = HMAC_CTX_new();
-	if (tmp_hasher->openssl_ctx == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, "Unable to create HMAC context.");
+	block_len = (size_t)EVP_MD_block_size(evp_md);
+	if (block_len == 0 || block_len > MAX_BUF_LEN) {
+		KSI_pushError(ctx, res = KSI_UNKNOWN_HASH_ALGORITHM_ID, "Unsupported hash algorithm block size.");
 		goto cleanup;
 	}
 
-	res = KSI_strdup(key, &tmp_hasher->key);
+	res = hmacHasher_new(ctx, algo_id, &tmp_hasher);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	tmp_hasher->hash_id = algo_id;
-	if (!KSI_isHashAlgorithmSupported(algo_id)) {
-		KSI_pushError(ctx, res = KSI_UNKNOWN_HASH_ALGORITHM_ID, "Unsupported hash algorithm");
+	/* A key longer than the block is replaced by its hash. */
+	key_ptr = (const unsigned char *)key;
+	if (key_len > block_len) {
+		if (!EVP_DigestInit_ex(tmp_hasher->inner, evp_md, NULL) ||
+				!EVP_DigestUpdate(tmp_hasher->inner, key, key_len) ||
+				!EVP_DigestFinal_ex(tmp_hasher->inner, digest, &digest_len)) {
+			KSI_pushError(ctx, res = KSI_CRYPTO_FAILURE, "Unable to hash the HMAC key.");
+			goto cleanup;
+		}
+		key_ptr = digest;
+		key_len = digest_len;
+	}
+
+	memset(ipad, 0x36, block_len);
+	memset(opad, 0x5c, block_len);
+	for (i = 0; i < key_len; i++) {
+		ipad[i] ^= key_ptr[i];
+		opad[i] ^= key_ptr[i];
+	}
+
+	/* The key is processed only here, the later resets continue from the keyed states. */
+	if (!EVP_DigestInit_ex(tmp_hasher->keyedInner, evp_md, NULL) ||
+			!EVP_DigestUpdate(tmp_hasher->keyedInner, ipad, block_len) ||
+			!EVP_DigestInit_ex(tmp_hasher->keyedOuter, evp_md, NULL) ||
+			!EVP_DigestUpdate(tmp_hasher->keyedOuter, opad, block_len)) {
+		KSI_pushError(ctx, res = KSI_CRYPTO_FAILURE, "Unable to init OpenSSL HMAC");
 		goto cleanup;
 	}
 
@@ -359,27 +406,65 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 
 cleanup:
 
+	memset(ipad, 0, sizeof(ipad));
+	memset(opad, 0, sizeof(opad));
+	memset(digest, 0, sizeof(digest));
 	KSI_HmacHasher_free(tmp_hasher);
 
 	return res;
 }
 
-int KSI_HmacHasher_reset(KSI_HmacHasher *hasher) {
+int KSI_HmacHasher_clone(const KSI_HmacHasher *hasher, KSI_HmacHasher **clone) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_HmacHasher *tmp_hasher = NULL;
 
-	if (hasher == NULL) {
+	if (hasher == NULL || clone == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 	KSI_ERR_clearErrors(hasher->ctx);
 
-	if (!HMAC_CTX_reset(hasher->openssl_ctx)) {
-		KSI_pushError(hasher->ctx, res = KSI_UNKNOWN_ERROR, "Unable to reset OpenSSL HMAC");
+	res = hmacHasher_new(hasher->ctx, hasher->hash_id, &tmp_hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(hasher->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Only the keyed states are copied, the clone starts a new message. */
+	if (!EVP_MD_CTX_copy_ex(tmp_hasher->keyedInner, hasher->keyedInner) ||
+			!EVP_MD_CTX_copy_ex(tmp_hasher->keyedOuter, hasher->keyedOuter)) {
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, "Unable to copy OpenSSL HMAC");
 		goto cleanup;
 	}
 
-	if(!HMAC_Init_ex(hasher->openssl_ctx, hasher->key, strlen(hasher->key), hashAlgorithmToEVP(hasher->hash_id), NULL)) {
-		KSI_pushError(hasher->ctx, res = KSI_UNKNOWN_ERROR, "Unable to init OpenSSL HMAC");
+	res = KSI_HmacHasher_reset(tmp_hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(hasher->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*clone = tmp_hasher;
+	tmp_hasher = NULL;
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_HmacHasher_free(tmp_hasher);
+
+	return res;
+}
+
+int KSI_HmacHasher_reset(KSI_HmacHasher *hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+	if (!EVP_MD_CTX_copy_ex(hasher->inner, hasher->keyedInner)) {
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, "Unable to reset OpenSSL HMAC");
 		goto cleanup;
 	}
 
@@ -399,8 +484,8 @@ int KSI_HmacHasher_add(KSI_HmacHasher *hasher, const void *data, size_t data_len
 	}
 	KSI_ERR_clearErrors(hasher->ctx);
 
-	if (!HMAC_Update(hasher->openssl_ctx, data, data_length)) {
-		KSI_pushError(hasher->ctx, res = KSI_UNKNOWN_ERROR, "Unable to update OpenSSL HMAC");
+	if (!EVP_DigestUpdate(hasher->inner, data, data_length)) {
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, "Unable to update OpenSSL HMAC");
 		goto cleanup;
 	}
 
@@ -415,7 +500,7 @@ int KSI_HmacHasher_close(KSI_HmacHasher *hasher, KSI_DataHash **hmac) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHash *tmp = NULL;
 
-	unsigned char digest[64];
+	unsigned char digest[EVP_MAX_MD_SIZE];
 	unsigned int digest_len = 0;
 
 	if (hasher == NULL || hmac == NULL) {
@@ -424,9 +509,12 @@ int KSI_HmacHasher_close(KSI_HmacHasher *hasher, KSI_DataHash **hmac) {
 	}
 	KSI_ERR_clearErrors(hasher->ctx);
 
-
-	if (!HMAC_Final(hasher->openssl_ctx, digest, &digest_len)) {
-		KSI_pushError(hasher->ctx, res = KSI_UNKNOWN_ERROR, "Unable to finalize OpenSSL HMAC");
+	/* The inner hash is finalized and the state is reused for the outer hash. */
+	if (!EVP_DigestFinal_ex(hasher->inner, digest, &digest_len) ||
+			!EVP_MD_CTX_copy_ex(hasher->inner, hasher->keyedOuter) ||
+			!EVP_DigestUpdate(hasher->inner, digest, digest_len) ||
+			!EVP_DigestFinal_ex(hasher->inner, digest, &digest_len)) {
+		KSI_pushError(hasher->ctx, res = KSI_CRYPTO_FAILURE, "Unable to finalize OpenSSL HMAC");
 		goto cleanup;
 	}
 
@@ -450,8 +538,9 @@ cleanup:
 
 void KSI_HmacHasher_free(KSI_HmacHasher *hasher) {
 	if (hasher != NULL) {
-		if (hasher->openssl_ctx != NULL) HMAC_CTX_free(hasher->openssl_ctx);
-		if (hasher->key != NULL) KSI_free(hasher->key);
+		if (hasher->keyedInner != NULL) KSI_EVP_MD_CTX_destroy(hasher->keyedInner);
+		if (hasher->keyedOuter != NULL) KSI_EVP_MD_CTX_destroy(hasher->keyedOuter);
+		if (hasher->inner != NULL) KSI_EVP_MD_CTX_destroy(hasher->inner);
 		KSI_free(hasher);
 	}
 }
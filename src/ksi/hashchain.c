@@ -25,7 +25,9 @@
 #include "tlv.h"
 #include "tlv_template.h"
 #include "impl/hashchain_impl.h"
+#include "impl/hash_impl.h"
 #include "impl/meta_data_element_impl.h"
+#include "impl/thread_impl.h"
 #include "compatibility.h"
 
 KSI_IMPORT_TLV_TEMPLATE(KSI_AggregationHashChain);
@@ -47,27 +49,6 @@ static long long int highBit(long long int n) {
 }
 
 
-static int dataHasher_addNvlImprint(KSI_DataHasher *hsr, const KSI_DataHash *first, const KSI_DataHash *second) {
-	int res = KSI_UNKNOWN_ERROR;
-	const KSI_DataHash *hsh = first;
-
-	if (hsh == NULL) {
-		if (second == NULL) {
-			res = KSI_INVALID_ARGUMENT;
-			goto cleanup;
-		}
-		hsh = second;
-	}
-
-	res = KSI_DataHasher_addImprint(hsr, hsh);
-	if (res != KSI_OK) goto cleanup;
-
-	res = KSI_OK;
-
-cleanup:
-	return res;
-}
-
 static int dataHasher_addLinkImprint(KSI_CTX *ctx, KSI_DataHasher *hsr, const KSI_HashChainLink *link) {
 	int res = KSI_UNKNOWN_ERROR;
 	int mode = 0;
@@ -158,23 +139,108 @@ cleanup:
 	return res;
 }
 
-static int aggregateChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, const KSI_DataHash *inputHash, int startLevel, KSI_HashAlgorithm aggr_algo_id, int isCalendar, int *endLevel, KSI_DataHash **outputHash) {
+/**
+ * Hash chain aggregation kernel. The intermediate results are written into a #KSI_DataHashValue
+ * embedded in the kernel and the hashers are kept open per algorithm, so aggregating any number
+ * of chains does not allocate memory except for the hashers and the final result.
+ */
+typedef struct AggregationKernel_st {
+	KSI_CTX *ctx;
+	/** Hashers by algorithm id, opened on first use. */
+	KSI_DataHasher *hasher[KSI_NUMBER_OF_KNOWN_HASHALGS];
+	/** Result of the last aggregation step, valid if hasValue is set. */
+	KSI_DataHashValue value;
+	/** Indicates if any aggregation steps have been made. */
+	bool hasValue;
+} AggregationKernel;
+
+static void aggregationKernel_init(AggregationKernel *k, KSI_CTX *ctx) {
+	memset(k, 0, sizeof(*k));
+	k->ctx = ctx;
+	k->hasValue = false;
+}
+
+static void aggregationKernel_cleanup(AggregationKernel *k) {
+	size_t i;
+
+	for (i = 0; i < KSI_NUMBER_OF_KNOWN_HASHALGS; i++) {
+		KSI_DataHasher_free(k->hasher[i]);
+	}
+}
+
+static int aggregationKernel_getHasher(AggregationKernel *k, KSI_HashAlgorithm algo_id, KSI_DataHasher **hsr) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (algo_id < 0 || algo_id >= KSI_NUMBER_OF_KNOWN_HASHALGS) {
+		KSI_pushError(k->ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+
+	if (k->hasher[algo_id] == NULL) {
+		res = KSI_DataHasher_open(k->ctx, algo_id, &k->hasher[algo_id]);
+	} else {
+		res = KSI_DataHasher_reset(k->hasher[algo_id]);
+	}
+	if (res != KSI_OK) {
+		KSI_pushError(k->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*hsr = k->hasher[algo_id];
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Returns the result of the kernel as a new #KSI_DataHash, or \c NULL if no steps have been made.
+ */
+static int aggregationKernel_getResult(AggregationKernel *k, KSI_DataHash **outputHash) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *tmp = NULL;
+
+	if (k->hasValue) {
+		res = KSI_DataHash_fromValue(k->ctx, &k->value, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(k->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	*outputHash = tmp;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int aggregateChain(AggregationKernel *k, KSI_LIST(KSI_HashChainLink) *chain, const KSI_DataHash *inputHash, int startLevel, KSI_HashAlgorithm aggr_algo_id, int isCalendar, int *endLevel) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = k->ctx;
 	int level = startLevel;
 	KSI_DataHasher *hsr = NULL;
-	KSI_DataHash *hsh = NULL;
 	KSI_HashChainLink *link = NULL;
 	KSI_HashAlgorithm algo_id = aggr_algo_id;
+	const unsigned char *prev = NULL;
+	size_t prev_len = 0;
 	char chr_level;
-	char logMsg[0xff];
 	size_t i;
 
 	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || chain == NULL || inputHash == NULL || outputHash == NULL) {
+	if (chain == NULL || inputHash == NULL) {
 		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
+	k->hasValue = false;
+	prev = inputHash->imprint;
+	prev_len = inputHash->imprint_length;
+
 	/* If we are calculating the calendar chain, initialize the hash algorithm id using
 	 * the input hash. */
 	if (isCalendar) {
@@ -185,8 +251,9 @@ static int aggregateChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, cons
 		}
 	}
 
-	KSI_snprintf(logMsg, sizeof(logMsg), "Starting %s hash chain aggregation with input hash.", isCalendar ? "calendar": "aggregation");
-	KSI_LOG_logDataHash(ctx, KSI_LOG_DEBUG, logMsg, inputHash);
+	KSI_LOG_logDataHash(ctx, KSI_LOG_DEBUG, isCalendar ?
+			"Starting calendar hash chain aggregation with input hash." :
+			"Starting aggregation hash chain aggregation with input hash.", inputHash);
 
 	/* Loop over all the links in the chain. */
 	for (i = 0; i < KSI_HashChainLinkList_length(chain); i++) {
@@ -201,42 +268,23 @@ static int aggregateChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, cons
 			if (levelCorrection > 0xff || level + levelCorrection + 1 > 0xff)
 				KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Aggregation chain level out of range.");
 			level += (int)levelCorrection + 1;
-		} else {
+		} else if (link->isLeft) {
 			/* Update the hash algo id when we encounter a left link. */
-			if (link->isLeft) {
-				KSI_HashAlgorithm tmp;
-				res = KSI_DataHash_extract(link->imprint, &tmp, NULL, NULL);
-				if (res != KSI_OK) {
-					KSI_pushError(ctx, res, NULL);
-					goto cleanup;
-				}
-				/* Update hasher if algo id has changed. */
-				if (tmp != algo_id) {
-					algo_id = tmp;
-
-					KSI_DataHasher_free(hsr);
-					res = KSI_DataHasher_open(ctx, algo_id, &hsr);
-					if (res != KSI_OK) {
-						KSI_pushError(ctx, res, NULL);
-						goto cleanup;
-					}
-				}
+			res = KSI_DataHash_extract(link->imprint, &algo_id, NULL, NULL);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
 			}
 		}
 
-		/* Create or reset the hasher. */
-		if (hsr == NULL) {
-			res = KSI_DataHasher_open(ctx, algo_id, &hsr);
-		} else {
-			res = KSI_DataHasher_reset(hsr);
-		}
+		res = aggregationKernel_getHasher(k, algo_id, &hsr);
 		if (res != KSI_OK) {
 			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
 		}
 
 		if (link->isLeft) {
-			res = dataHasher_addNvlImprint(hsr, hsh, inputHash);
+			res = KSI_DataHasher_add(hsr, prev, prev_len);
 			if (res != KSI_OK) {
 				KSI_pushError(ctx, res, NULL);
 				goto cleanup;
@@ -254,7 +302,7 @@ static int aggregateChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, cons
 				goto cleanup;
 			}
 
-			res = dataHasher_addNvlImprint(hsr, hsh, inputHash);
+			res = KSI_DataHasher_add(hsr, prev, prev_len);
 			if (res != KSI_OK) {
 				KSI_pushError(ctx, res, NULL);
 				goto cleanup;
@@ -270,32 +318,59 @@ static int aggregateChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, cons
 		chr_level = (char) level;
 		KSI_DataHasher_add(hsr, &chr_level, 1);
 
-		if (hsh != NULL) {
-			KSI_DataHash_free(hsh);
-			hsh = NULL;
-		}
-
-		res = KSI_DataHasher_close(hsr, &hsh);
+		/* The previous value has already been consumed, overwrite it with the new one. */
+		res = KSI_DataHasher_closeValue(hsr, &k->value);
 		if (res != KSI_OK) {
 			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
 		}
+		k->hasValue = true;
+		prev = k->value.imprint;
+		prev_len = KSI_DataHashValue_getImprintLength(&k->value);
 	}
 
-	KSI_snprintf(logMsg, sizeof(logMsg), "Finished %s hash chain aggregation with output hash.", isCalendar ? "calendar": "aggregation");
-	KSI_LOG_logDataHash(ctx, KSI_LOG_DEBUG, logMsg, hsh);
+	KSI_LOG_logBlob(ctx, KSI_LOG_DEBUG, isCalendar ?
+			"Finished calendar hash chain aggregation with output hash." :
+			"Finished aggregation hash chain aggregation with output hash.", k->hasValue ? k->value.imprint : NULL, k->hasValue ? prev_len : 0);
 
 	if (endLevel != NULL) *endLevel = level;
-	if (outputHash != NULL) *outputHash = hsh;
-	hsh = NULL;
 
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int aggregateSingleChain(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, const KSI_DataHash *inputHash, int startLevel, KSI_HashAlgorithm aggr_algo_id, int isCalendar, int *endLevel, KSI_DataHash **outputHash) {
+	int res = KSI_UNKNOWN_ERROR;
+	AggregationKernel kernel;
+
+	aggregationKernel_init(&kernel, ctx);
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || outputHash == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = aggregateChain(&kernel, chain, inputHash, startLevel, aggr_algo_id, isCalendar, endLevel);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = aggregationKernel_getResult(&kernel, outputHash);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_DataHasher_free(hsr);
-	KSI_DataHash_free(hsh);
+	aggregationKernel_cleanup(&kernel);
 
 	return res;
 }
@@ -363,14 +438,14 @@ cleanup:
  *
  */
 int KSI_HashChain_aggregate(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, const KSI_DataHash *inputHash, int startLevel, KSI_HashAlgorithm algo_id, int *endLevel, KSI_DataHash **outputHash) {
-	return aggregateChain(ctx, chain, inputHash, startLevel, algo_id, 0, endLevel, outputHash);
+	return aggregateSingleChain(ctx, chain, inputHash, startLevel, algo_id, 0, endLevel, outputHash);
 }
 
 /**
  *
  */
 int KSI_HashChain_aggregateCalendar(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *chain, const KSI_DataHash *inputHash, KSI_DataHash **outputHash) {
-	return aggregateChain(ctx, chain, inputHash, 0xff, -1, 1, NULL, outputHash);
+	return aggregateSingleChain(ctx, chain, inputHash, 0xff, -1, 1, NULL, outputHash);
 }
 
 /**
@@ -827,7 +902,7 @@ int KSI_HashChainLink_LegacyId_toTlv(KSI_CTX *ctx, const KSI_OctetString *legacy
 }
 
 void KSI_HashChainLinkIdentity_free(KSI_HashChainLinkIdentity *identity) {
-	if (identity != NULL && --identity->ref == 0) {
+	if (identity != NULL && KSI_ATOMIC_DEC_REF(&identity->ref) == 0) {
 		KSI_Utf8String_free(identity->clientId);
 		KSI_Utf8String_free(identity->machineId);
 		KSI_Integer_free(identity->sequenceNr);
@@ -945,7 +1020,7 @@ KSI_IMPLEMENT_GETTER(KSI_HashChainLinkIdentity, KSI_Utf8String *, clientId, Clie
 KSI_IMPLEMENT_GETTER(KSI_HashChainLinkIdentity, KSI_Utf8String *, machineId, MachineId);
 KSI_IMPLEMENT_GETTER(KSI_HashChainLinkIdentity, KSI_Integer *, sequenceNr, SequenceNr);
 KSI_IMPLEMENT_GETTER(KSI_HashChainLinkIdentity, KSI_Integer *, requestTime, RequestTime);
-KSI_IMPLEMENT_REF(KSI_HashChainLinkIdentity);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_HashChainLinkIdentity);
 KSI_IMPLEMENT_LIST(KSI_HashChainLinkIdentity, KSI_HashChainLinkIdentity_free);
 
 int KSI_AggregationHashChain_getIdentity(const KSI_AggregationHashChain *aggr, KSI_LIST(KSI_HashChainLinkIdentity) **identity) {
@@ -1174,18 +1249,21 @@ KSI_IMPLEMENT_SETTER(KSI_AggregationHashChain, KSI_LIST(KSI_HashChainLink) *, ch
 
 int KSI_AggregationHashChainList_aggregate(KSI_AggregationHashChainList *chainList, KSI_CTX *ctx, int level, KSI_DataHash **outputHash) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_DataHash *hsh = NULL;
+	AggregationKernel kernel;
+	const KSI_DataHash *last = NULL;
+	bool lastFromKernel = false;
 	size_t i;
 
+	aggregationKernel_init(&kernel, ctx);
+
 	if (chainList == NULL || ctx == NULL || !KSI_IS_VALID_TREE_LEVEL(level) || outputHash == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	/* Aggregate all the aggregation hash chains. */
+	/* Aggregate all the aggregation hash chains, only the output of the last one is kept. */
 	for (i = 0; i < KSI_AggregationHashChainList_length(chainList); i++) {
 		KSI_AggregationHashChain* aggrChain = NULL;
-		KSI_DataHash *tmp = NULL;
 
 		res = KSI_AggregationHashChainList_elementAt(chainList, i, (KSI_AggregationHashChain **)&aggrChain);
 		if (res != KSI_OK || aggrChain == NULL) {
@@ -1193,26 +1271,42 @@ int KSI_AggregationHashChainList_aggregate(KSI_AggregationHashChainList *chainLi
 			goto cleanup;
 		}
 
-		res = KSI_AggregationHashChain_aggregate(aggrChain, level, &level, &tmp);
+		/* Reuse the result of a previous aggregation from the same level. */
+		if (aggrChain->outputHash != NULL && level == aggrChain->inputLevel) {
+			level = aggrChain->outputLevel;
+			last = aggrChain->outputHash;
+			lastFromKernel = false;
+			continue;
+		}
+
+		if (aggrChain->aggrHashId == NULL || aggrChain->chain == NULL || aggrChain->inputHash == NULL) {
+			KSI_pushError(ctx, res = KSI_INVALID_STATE, NULL);
+			goto cleanup;
+		}
+
+		res = aggregateChain(&kernel, aggrChain->chain, aggrChain->inputHash, level, (KSI_HashAlgorithm)KSI_Integer_getUInt64(aggrChain->aggrHashId), 0, &level);
 		if (res != KSI_OK){
 			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
 		}
+		lastFromKernel = true;
+	}
 
-		if (hsh != NULL) {
-			KSI_DataHash_free(hsh);
+	if (lastFromKernel) {
+		res = aggregationKernel_getResult(&kernel, outputHash);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
 		}
-		hsh = tmp;
+	} else {
+		*outputHash = KSI_DataHash_ref((KSI_DataHash *)last);
 	}
 
-	*outputHash = hsh;
-	hsh = NULL;
-
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_DataHash_free(hsh);
+	aggregationKernel_cleanup(&kernel);
 
 	return res;
 }
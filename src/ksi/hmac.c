@@ -16,19 +16,37 @@
  * Guardtime, Inc., and no license to trademarks is granted; Guardtime
  * reserves and retains all trademark rights.
  */
-#include "internal.h"
-
-#ifndef KSI_NATIVE_HMAC
 
 #include <string.h>
 
+#include "internal.h"
 #include "hmac.h"
+#include "impl/ctx_impl.h"
+
+#ifndef KSI_NATIVE_HMAC
+
+#include "impl/hash_impl.h"
+#include "impl/thread_impl.h"
 
 /**
 * The maximum block size of an algorithm.
 */
 #define MAX_BUF_LEN 256
 
+/**
+ * Hash states after processing the inner and the outer padded key, shared by the clones of a hasher.
+ */
+typedef struct HmacKey_st {
+	/** Reference count. */
+	size_t ref;
+
+	/** Open hasher with the inner padded key added. */
+	KSI_DataHasher *inner;
+
+	/** Open hasher with the outer padded key added. */
+	KSI_DataHasher *outer;
+} HmacKey;
+
 struct KSI_HmacHasher_st {
 	/** KSI context. */
 	KSI_CTX *ctx;
@@ -36,62 +54,26 @@ struct KSI_HmacHasher_st {
 	/** Data hasher. */
 	KSI_DataHasher *dataHasher;
 
-	/** Inner buffer for XOR-ed key, padded with zeros. */
-	unsigned char ipadXORkey[MAX_BUF_LEN];
-
-	/** Outer buffer for XOR-ed key, padded with zeros. */
-	unsigned char opadXORkey[MAX_BUF_LEN];
-
-	/** Block size of algorithm. */
-	unsigned blockSize;
+	/** Keyed hash states. */
+	HmacKey *key;
 };
 
-int KSI_HMAC_create(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, const unsigned char *data, size_t data_len, KSI_DataHash **hmac) {
-	int res = KSI_UNKNOWN_ERROR;
-	KSI_HmacHasher *hasher = NULL;
-	KSI_DataHash *tmp_hmac = NULL;
-
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || hmac == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
-	}
-
-	res = KSI_HmacHasher_open(ctx, algo_id, key, &hasher);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
+static void HmacKey_free(HmacKey *key) {
+	if (key != NULL && KSI_ATOMIC_DEC_REF(&key->ref) == 0) {
+		KSI_DataHasher_free(key->inner);
+		KSI_DataHasher_free(key->outer);
+		KSI_free(key);
 	}
-
-	res = KSI_HmacHasher_add(hasher, data, data_len);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
-
-	res = KSI_HmacHasher_close(hasher, &tmp_hmac);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
-
-	*hmac = tmp_hmac;
-	tmp_hmac = NULL;
-	res = KSI_OK;
-
-cleanup:
-
-	KSI_DataHash_free(tmp_hmac);
-	KSI_HmacHasher_free(hasher);
-
-	return res;
 }
 
-int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, KSI_HmacHasher **hasher) {
+static int HmacKey_new(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, HmacKey **out) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_HmacHasher *tmp_hasher = NULL;
+	HmacKey *tmp = NULL;
+	KSI_DataHasher *keyHasher = NULL;
 	KSI_DataHash *hashedKey = NULL;
 	unsigned blockSize = 0;
+	unsigned char ipadXORkey[MAX_BUF_LEN];
+	unsigned char opadXORkey[MAX_BUF_LEN];
 
 	size_t key_len;
 	const unsigned char *bufKey = NULL;
@@ -100,12 +82,6 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 	size_t digest_len = 0;
 	size_t i;
 
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || key == NULL || hasher == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
-	}
-
 	key_len = strlen(key);
 	if (key_len == 0 || key_len > 0xffff) {
 		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Invalid key length.");
@@ -123,37 +99,32 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 		goto cleanup;
 	}
 
-	tmp_hasher = KSI_new(KSI_HmacHasher);
-	if (tmp_hasher == NULL) {
+	tmp = KSI_new(HmacKey);
+	if (tmp == NULL) {
 		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
 		goto cleanup;
 	}
 
-	memset(tmp_hasher, 0, sizeof(KSI_HmacHasher));
-	tmp_hasher->blockSize = 0;
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->dataHasher = NULL;
-
-	/* Open the data hasher. */
-	res = KSI_DataHasher_open(ctx, algo_id, &tmp_hasher->dataHasher);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
-
-	tmp_hasher->ctx = ctx;
-	tmp_hasher->blockSize = blockSize;
+	tmp->ref = 1;
+	tmp->inner = NULL;
+	tmp->outer = NULL;
 
 	/* Prepare the key for hashing. */
 	/* If the key is longer than 64, hash it. If the key or its hash is shorter than 64 bit, append zeros. */
 	if (key_len > blockSize) {
-		res = KSI_DataHasher_add(tmp_hasher->dataHasher, key, key_len);
+		res = KSI_DataHasher_open(ctx, algo_id, &keyHasher);
 		if (res != KSI_OK) {
 			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
 		}
 
-		res = KSI_DataHasher_close(tmp_hasher->dataHasher, &hashedKey);
+		res = KSI_DataHasher_add(keyHasher, key, key_len);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_DataHasher_close(keyHasher, &hashedKey);
 		if (res != KSI_OK) {
 			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
@@ -178,13 +149,75 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 	}
 
 	for (i = 0; i < buf_len; i++) {
-		tmp_hasher->ipadXORkey[i] = 0x36 ^ bufKey[i];
-		tmp_hasher->opadXORkey[i] = 0x5c ^ bufKey[i];
+		ipadXORkey[i] = 0x36 ^ bufKey[i];
+		opadXORkey[i] = 0x5c ^ bufKey[i];
 	}
 
 	for (; i < blockSize; i++) {
-		tmp_hasher->ipadXORkey[i] = 0x36;
-		tmp_hasher->opadXORkey[i] = 0x5c;
+		ipadXORkey[i] = 0x36;
+		opadXORkey[i] = 0x5c;
+	}
+
+	/* Hash the padded keys once, the messages continue from these states. */
+	res = KSI_DataHasher_open(ctx, algo_id, &tmp->inner);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_add(tmp->inner, ipadXORkey, blockSize);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, algo_id, &tmp->outer);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_add(tmp->outer, opadXORkey, blockSize);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*out = tmp;
+	tmp = NULL;
+	res = KSI_OK;
+
+cleanup:
+
+	memset(ipadXORkey, 0, sizeof(ipadXORkey));
+	memset(opadXORkey, 0, sizeof(opadXORkey));
+	KSI_DataHash_free(hashedKey);
+	KSI_DataHasher_free(keyHasher);
+	HmacKey_free(tmp);
+
+	return res;
+}
+
+static int hmacHasher_new(KSI_CTX *ctx, HmacKey *key, KSI_HmacHasher **hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HmacHasher *tmp_hasher = NULL;
+
+	tmp_hasher = KSI_new(KSI_HmacHasher);
+	if (tmp_hasher == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp_hasher->ctx = ctx;
+	tmp_hasher->dataHasher = NULL;
+	tmp_hasher->key = key;
+	KSI_ATOMIC_INC_REF(&key->ref);
+
+	/* Open the data hasher. */
+	res = KSI_DataHasher_open(ctx, key->inner->algorithm, &tmp_hasher->dataHasher);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
 	}
 
 	res = KSI_HmacHasher_reset(tmp_hasher);
@@ -199,29 +232,76 @@ int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key
 
 cleanup:
 
-	KSI_DataHash_free(hashedKey);
 	KSI_HmacHasher_free(tmp_hasher);
 
 	return res;
 }
 
-int KSI_HmacHasher_reset(KSI_HmacHasher *hasher) {
+int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, KSI_HmacHasher **hasher) {
 	int res = KSI_UNKNOWN_ERROR;
+	HmacKey *hmacKey = NULL;
 
-	if (hasher == NULL) {
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || key == NULL || hasher == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = HmacKey_new(ctx, algo_id, key, &hmacKey);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = hmacHasher_new(ctx, hmacKey, hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	HmacKey_free(hmacKey);
+
+	return res;
+}
+
+int KSI_HmacHasher_clone(const KSI_HmacHasher *hasher, KSI_HmacHasher **clone) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL || clone == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 	KSI_ERR_clearErrors(hasher->ctx);
 
-	res = KSI_DataHasher_reset(hasher->dataHasher);
+	/* The keyed states are immutable, the clone shares them. */
+	res = hmacHasher_new(hasher->ctx, hasher->key, clone);
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	/* Hash inner data. */
-	res = KSI_DataHasher_add(hasher->dataHasher, hasher->ipadXORkey, hasher->blockSize);
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_HmacHasher_reset(KSI_HmacHasher *hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (hasher == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(hasher->ctx);
+
+	/* Continue from the state after hashing the inner padded key. */
+	res = KSI_DataHasher_copy(hasher->dataHasher, hasher->key->inner);
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
@@ -258,11 +338,7 @@ cleanup:
 
 int KSI_HmacHasher_close(KSI_HmacHasher *hasher, KSI_DataHash **hmac) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_DataHash *innerHash = NULL;
-	KSI_DataHash *outerHash = NULL;
-
-	const unsigned char *digest = NULL;
-	size_t digest_len = 0;
+	KSI_DataHash innerHash;
 
 	if (hasher == NULL || hmac == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -270,60 +346,168 @@ int KSI_HmacHasher_close(KSI_HmacHasher *hasher, KSI_DataHash **hmac) {
 	}
 	KSI_ERR_clearErrors(hasher->ctx);
 
-	res = KSI_DataHasher_close(hasher->dataHasher, &innerHash);
+	if (!hasher->dataHasher->isOpen) {
+		KSI_pushError(hasher->ctx, res = KSI_INVALID_STATE, "Hasher is already closed.");
+		goto cleanup;
+	}
+
+	/* The inner hash is only needed until it is added to the outer hash. */
+	res = hasher->dataHasher->closeExisting(hasher->dataHasher, &innerHash);
+	hasher->dataHasher->isOpen = false;
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
 	}
 
 	/* Hash outer data. */
-	res = KSI_DataHasher_reset(hasher->dataHasher);
+	res = KSI_DataHasher_copy(hasher->dataHasher, hasher->key->outer);
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_DataHasher_add(hasher->dataHasher, hasher->opadXORkey, hasher->blockSize);
+	res = KSI_DataHasher_add(hasher->dataHasher, innerHash.imprint + 1, innerHash.imprint_length - 1);
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_DataHash_extract(innerHash, NULL, &digest, &digest_len);
+	res = KSI_DataHasher_close(hasher->dataHasher, hmac);
 	if (res != KSI_OK) {
 		KSI_pushError(hasher->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_DataHasher_add(hasher->dataHasher, digest, digest_len);
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+void KSI_HmacHasher_free(KSI_HmacHasher *hasher) {
+	if (hasher != NULL) {
+		KSI_DataHasher_free(hasher->dataHasher);
+		HmacKey_free(hasher->key);
+		KSI_free(hasher);
+	}
+}
+
+#endif
+
+/**
+ * Opens a hasher for the key by cloning the hasher kept in the context, so the key is processed only
+ * once for all the PDUs of an endpoint.
+ */
+static int openCachedHasher(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, KSI_HmacHasher **hasher) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HmacHasher *keyed = NULL;
+	KSI_HmacHasher *evictedHasher = NULL;
+	char *keyCopy = NULL;
+	char *evictedKey = NULL;
+	KSI_HmacKeyCacheEntry *entry = NULL;
+	bool found = false;
+	size_t i;
+
+	KSI_Mutex_lock(&ctx->hmacKeysLock);
+	for (i = 0; i < KSI_HMAC_KEY_CACHE_LEN; i++) {
+		entry = &ctx->hmacKeys[i];
+		if (entry->hasher != NULL && entry->algo_id == algo_id && !strcmp(entry->key, key)) {
+			res = KSI_HmacHasher_clone(entry->hasher, hasher);
+			found = true;
+			break;
+		}
+	}
+	KSI_Mutex_unlock(&ctx->hmacKeysLock);
+
+	if (found) {
+		if (res != KSI_OK) KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_HmacHasher_open(ctx, algo_id, key, &keyed);
 	if (res != KSI_OK) {
-		KSI_pushError(hasher->ctx, res, NULL);
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_DataHasher_close(hasher->dataHasher, &outerHash);
+	res = KSI_HmacHasher_clone(keyed, hasher);
 	if (res != KSI_OK) {
-		KSI_pushError(hasher->ctx, res, NULL);
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_strdup(key, &keyCopy);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	*hmac = KSI_DataHash_ref(outerHash);
+	/* Replace the oldest entry, the replaced values are released outside of the lock. */
+	KSI_Mutex_lock(&ctx->hmacKeysLock);
+	entry = &ctx->hmacKeys[ctx->hmacKeysNext];
+	ctx->hmacKeysNext = (ctx->hmacKeysNext + 1) % KSI_HMAC_KEY_CACHE_LEN;
+
+	evictedHasher = entry->hasher;
+	evictedKey = entry->key;
+
+	entry->algo_id = algo_id;
+	entry->hasher = keyed;
+	entry->key = keyCopy;
+	KSI_Mutex_unlock(&ctx->hmacKeysLock);
+
+	keyed = NULL;
+	keyCopy = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_DataHash_free(innerHash);
-	KSI_DataHash_free(outerHash);
+	KSI_HmacHasher_free(evictedHasher);
+	KSI_HmacHasher_free(keyed);
+	KSI_free(evictedKey);
+	KSI_free(keyCopy);
 
 	return res;
 }
 
-void KSI_HmacHasher_free(KSI_HmacHasher *hasher) {
-	if (hasher != NULL) {
-		KSI_DataHasher_free(hasher->dataHasher);
-		KSI_free(hasher);
+int KSI_HMAC_create(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, const unsigned char *data, size_t data_len, KSI_DataHash **hmac) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HmacHasher *hasher = NULL;
+	KSI_DataHash *tmp_hmac = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || key == NULL || hmac == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
 	}
-}
 
-#endif
+	res = openCachedHasher(ctx, algo_id, key, &hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_HmacHasher_add(hasher, data, data_len);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_HmacHasher_close(hasher, &tmp_hmac);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*hmac = tmp_hmac;
+	tmp_hmac = NULL;
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(tmp_hmac);
+	KSI_HmacHasher_free(hasher);
+
+	return res;
+}
@@ -63,6 +63,18 @@ extern "C" {
 	 */
 	int KSI_HmacHasher_open(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, const char *key, KSI_HmacHasher **hasher);
 
+	/**
+	 * Creates a new hasher with the key of an open hasher. The key is not processed again, so keeping
+	 * a hasher open for a key and cloning it per message is cheaper than opening a new hasher every time.
+	 * The clone starts a new HMAC computation regardless of the data added to \c hasher.
+	 * \param[in]	hasher			The hasher to be cloned.
+	 * \param[out]	clone			Pointer that will receive pointer to the new hasher object.
+	 *
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \see #KSI_HmacHasher_open, #KSI_HmacHasher_free
+	 */
+	int KSI_HmacHasher_clone(const KSI_HmacHasher *hasher, KSI_HmacHasher **clone);
+
 	/**
 	 * Resets the state of the HMAC computation.
 	 * \param[in]	hasher			The hasher.
@@ -20,35 +20,98 @@
 #ifndef CTX_IMPL_H_
 #define CTX_IMPL_H_
 
+#include "../internal.h"
 #include "../types.h"
 #include "../hash.h"
+#include "../hmac.h"
 #include "../ksi.h"
+#include "thread_impl.h"
+#include "metrics_impl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define KSI_ERR_STACK_LEN 16
+#define KSI_HMAC_KEY_CACHE_LEN 8
 
 	typedef void (*GlobalCleanupFn)(void);
 	typedef int (*GlobalInitFn)(void);
 
 	KSI_DEFINE_LIST(GlobalCleanupFn)
 
+	typedef struct KSI_ThreadState_st KSI_ThreadState;
+
+	/** Background refresh of the publications file, defined in base.c. */
+	typedef struct KSI_PublicationsFileRefresh_st KSI_PublicationsFileRefresh;
+
+	/**
+	 * HMAC hasher kept open for a recently used key.
+	 */
+	typedef struct KSI_HmacKeyCacheEntry_st {
+		KSI_HashAlgorithm algo_id;
+		char *key;
+		KSI_HmacHasher *hasher;
+	} KSI_HmacKeyCacheEntry;
+
+	/**
+	 * State of a single thread using the context: the error stack and the objects released by the
+	 * thread for reuse. Only the owning thread accesses the state, until the thread exits or the
+	 * context is freed.
+	 */
+	struct KSI_ThreadState_st {
+		/** The context, set to \c NULL when the context is freed. */
+		KSI_CTX *ctx;
+
+		/** Array of errors. */
+		KSI_ERR errors[KSI_ERR_STACK_LEN];
+
+		/** Count of errors (may be larger than #KSI_ERR_STACK_LEN, the oldest errors are overwritten). */
+		size_t count;
+
+		/* Released #KSI_DataHash objects kept for reuse by the thread. */
+		KSI_LIST(KSI_DataHash) *dataHashRecycle;
+
+		/* Released #KSI_DataHasher objects by algorithm, linked through KSI_DataHasher::next. */
+		KSI_DataHasher *dataHasherRecycle[KSI_NUMBER_OF_KNOWN_HASHALGS];
+		size_t dataHasherRecycle_len[KSI_NUMBER_OF_KNOWN_HASHALGS];
+
+		/* Released #KSI_AsyncHandle and #KSI_HighAvailabilityRequest objects kept for reuse by the thread. */
+		KSI_LIST(KSI_AsyncHandle) *asyncHandleRecycle;
+		KSI_LIST(KSI_HighAvailabilityRequest) *haRequestRecycle;
+
+		/** Links of the list of the states of the context. */
+		KSI_ThreadState *prev;
+		KSI_ThreadState *next;
+
+		/** The next state of the same thread. */
+		KSI_ThreadState *nextOfThread;
+	};
+
 	struct KSI_CTX_st {
 
 		/******************
-		 *  ERROR HANDLING.
+		 *  SYNCHRONIZATION.
 		 ******************/
 
-		/** Array of errors. */
-		KSI_ERR *errors;
+		/** Guards the error stack list, the object recycle lists and the last failed signature. */
+		KSI_Mutex lock;
+
+		/** Guards the publications file and its cache state. */
+		KSI_Mutex publicationsFileLock;
+
+		/** Serializes the downloads of the publications file by #KSI_receivePublicationsFile. */
+		KSI_Mutex publicationsFileDownloadLock;
+
+		/** Guards the HMAC key cache. */
+		KSI_Mutex hmacKeysLock;
 
-		/** Length of error array. */
-		unsigned int errors_size;
+		/******************
+		 *  ERROR HANDLING.
+		 ******************/
 
-		/** Count of errors (usually #error_end - #error_start + 1, unless error count > #errors_size. */
-		size_t errors_count;
+		/** List of the states of all the threads using the context, see #KSI_CTX_getThreadState. */
+		KSI_ThreadState *threadStates;
 
 		/** Logger callback function. */
 		KSI_LoggerCallback loggerCB;
@@ -76,6 +139,18 @@ extern "C" {
 		KSI_PublicationsFile *publicationsFile;
 		/** Publications file cached timestamp. */
 		time_t publicationsFileCachedAt;
+		/** Background refresh of the publications file, \c NULL if not running or already joined. */
+		KSI_PublicationsFileRefresh *publicationsFileRefresh;
+		/** Incremented when the publications file is replaced. */
+		size_t publicationsFileGeneration;
+		/** Number of consecutive failed background refreshes. */
+		unsigned publicationsFileRefreshFailures;
+		/** Time before which a failed background refresh is not retried. */
+		time_t publicationsFileRefreshRetryAt;
+		/** Directory of the persistent publications file cache, \c NULL if disabled. */
+		char *publicationsFileCacheDir;
+		/** Publications file URL, the key of the persistent publications file cache. */
+		char *publicationUrl;
 
 		/** This field is kept only for compatibility - will be removed in the future. */
 		char *publicationCertEmail_DEPRECATED;
@@ -92,27 +167,45 @@ extern "C" {
 		/** Array of configuration options. */
 		size_t options[__KSI_NUMBER_OF_OPTIONS];
 
-		/** Counter for the requests sent by this context. */
-		KSI_uint64_t requestCounter;
-
 		/** A NULL-terminated array of key-value pairs of OID and expected values for publications file certificate verification. */
 		KSI_CertConstraint *certConstraints;
 
 		/** Pointer to function for freeing the certificate constraints array. */
 		void (*freeCertConstraintsArray)(KSI_CertConstraint *);
 
+		/** Executor of the batch operations, \c NULL if the batches are processed by the calling thread. */
+		KSI_Executor *executor;
+
+		/** Metrics of all the requests made with the context. */
+		KSI_Metrics metrics;
+		/** Periodic metrics callback. */
+		KSI_MetricsCallback metricsCallback;
+		void *metricsCallbackCtx;
+		/** Interval of the metrics callback in microseconds. */
+		KSI_uint64_t metricsInterval;
+		/** Monotonic time (in microseconds) of the next metrics callback. */
+		KSI_uint64_t metricsReportAt;
+
 		/** Pointer to the last signature that failed background verification. */
 		KSI_Signature *lastFailedSignature;
 
 		size_t dataHashRecycle_maxSize;
-		/* This list is used to recycle #KSI_DataHash objects to reduce the number of allocs. */
-		KSI_LIST(KSI_DataHash) *dataHashRecycle;
 
-		/* This list is used to recycle #KSI_AsyncHandle objects to reduce the number of allocs. */
-		KSI_LIST(KSI_AsyncHandle) *asyncHandleRecycle;
-		KSI_LIST(KSI_HighAvailabilityRequest) *haRequestRecycle;
+		/* Hashers of the endpoint keys, cloned by #KSI_HMAC_create instead of processing the key for every PDU. */
+		KSI_HmacKeyCacheEntry hmacKeys[KSI_HMAC_KEY_CACHE_LEN];
+		/* The entry to be replaced next. */
+		size_t hmacKeysNext;
 	};
 
+	/**
+	 * Getter for the state of the calling thread. The objects released by the thread are recycled
+	 * through its state without locking.
+	 * \param[in]	ctx		KSI context.
+	 * \param[in]	create	If non-zero, the state is created if the thread does not have one yet.
+	 * \return The state, or \c NULL if it does not exist and could not be created.
+	 */
+	KSI_ThreadState *KSI_CTX_getThreadState(KSI_CTX *ctx, int create);
+
 #ifdef __cplusplus
 }
 #endif
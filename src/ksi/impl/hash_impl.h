@@ -75,8 +75,52 @@ extern "C" {
 
 		/** Closes the hasher and returns a #KSI_DataHash object. Must not check or modify the DataHasher::isOpen value. */
 		int (*close)(KSI_DataHasher *, KSI_DataHash **);
+
+		/** Replaces the state of the first hasher with a copy of the state of the second hasher of the same
+		 * algorithm. Must not check or modify the DataHasher::isOpen value. */
+		int (*copy)(KSI_DataHasher *, const KSI_DataHasher *);
+
+		/** Next hasher in the recycle pool of the context. */
+		KSI_DataHasher *next;
 	};
 
+	/**
+	 * Takes a hasher of the given algorithm from the recycle pool of the calling thread. The backend implementation
+	 * of #KSI_DataHasher_open uses this to reuse the hashers released by #KSI_DataHasher_free.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	algo_id		Hash algorithm.
+	 * \param[in]	reset		The \c reset function of the implementation, a pooled hasher of another
+	 * 							implementation is freed instead of being returned. \c NULL accepts any hasher.
+	 * \return A closed hasher with the implementation context still allocated, or \c NULL if the pool is empty.
+	 */
+	KSI_DataHasher *KSI_DataHasher_fromPool(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, int (*reset)(KSI_DataHasher *));
+
+	/**
+	 * Opens a hasher using the built-in implementation, regardless of the hash provider.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	algo_id		Hash algorithm, one of SHA-1, SHA-256, SHA-384 or SHA-512.
+	 * \param[out]	hasher		Pointer that will receive pointer to the hasher object.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHasher_openNative(KSI_CTX *ctx, KSI_HashAlgorithm algo_id, KSI_DataHasher **hasher);
+
+	/**
+	 * Checks if the hash provider should open the hashers of the algorithm with #KSI_DataHasher_openNative.
+	 * \param[in]	ctx			KSI context (can be \c NULL).
+	 * \param[in]	algo_id		Hash algorithm.
+	 * \return \c true if #KSI_OPT_NATIVE_SHA2 is enabled and the algorithm is implemented.
+	 */
+	bool KSI_DataHasher_preferNative(const KSI_CTX *ctx, KSI_HashAlgorithm algo_id);
+
+	/**
+	 * Replaces the state of the hasher with a copy of the state of another open hasher of the same algorithm.
+	 * This allows to hash a common prefix once and continue from it any number of times.
+	 * \param[in]	hasher		The hasher to be updated.
+	 * \param[in]	from		The hasher to be copied.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_DataHasher_copy(KSI_DataHasher *hasher, const KSI_DataHasher *from);
+
 #ifdef __cplusplus
 }
 #endif
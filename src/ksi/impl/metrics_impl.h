@@ -0,0 +1,78 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef METRICS_IMPL_H_
+#define METRICS_IMPL_H_
+
+#include "../metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * Metrics collected by a context or a service. The values are updated with atomic operations,
+	 * so the object is shared by the threads without a lock. A zero-filled object is initialized.
+	 */
+	typedef struct KSI_Metrics_st {
+		KSI_uint64_t counters[KSI_NUMBER_OF_METRIC_COUNTERS];
+		KSI_uint64_t latency[KSI_NUMBER_OF_METRIC_HISTOGRAMS][KSI_METRIC_LATENCY_BUCKETS];
+		/** Error code slots, a slot is claimed by storing the code + 1, 0 marks a free slot. */
+		KSI_uint64_t errorCodes[KSI_METRIC_ERROR_CODES];
+		KSI_uint64_t errorCounts[KSI_METRIC_ERROR_CODES];
+	} KSI_Metrics;
+
+	/**
+	 * Adds \c value to the counter of the context and of the service (can be \c NULL).
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	service		Metrics of the service.
+	 * \param[in]	counter		The counter.
+	 * \param[in]	value		Value to be added.
+	 */
+	void KSI_Metrics_count(KSI_CTX *ctx, KSI_Metrics *service, KSI_MetricCounter counter, KSI_uint64_t value);
+
+	/**
+	 * Adds a latency measured in microseconds to the histogram of the context and of the service (can be \c NULL).
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	service		Metrics of the service.
+	 * \param[in]	histogram	The histogram.
+	 * \param[in]	us			The latency in microseconds.
+	 */
+	void KSI_Metrics_latency(KSI_CTX *ctx, KSI_Metrics *service, KSI_MetricHistogram histogram, unsigned long long us);
+
+	/**
+	 * Counts a failed request with the status code \c err for the context and the service (can be \c NULL).
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	service		Metrics of the service.
+	 * \param[in]	err			Status code of the failure.
+	 */
+	void KSI_Metrics_error(KSI_CTX *ctx, KSI_Metrics *service, int err);
+
+	/**
+	 * Adds the values of the metrics to the snapshot.
+	 * \param[in]	metrics		The metrics.
+	 * \param[in]	snapshot	The snapshot to be updated.
+	 */
+	void KSI_Metrics_addToSnapshot(const KSI_Metrics *metrics, KSI_MetricsSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_IMPL_H_ */
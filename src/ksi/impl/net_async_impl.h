@@ -22,6 +22,7 @@
 
 #include "../net_async.h"
 #include "../internal.h"
+#include "metrics_impl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -76,6 +77,14 @@ extern "C" {
 		time_t sndTime;
 		/** Time when the response has been received. */
 		time_t rcvTime;
+		/** Monotonic time (in microseconds) when the query has been sent out, for the latency metrics. */
+		unsigned long long sndTimeUs;
+
+		/** Metrics of the async client handling the request. */
+		KSI_Metrics *metrics;
+
+		/** Coalesced request handles carried by this handle. */
+		KSI_LIST(KSI_AsyncHandle) *batch;
 	};
 
 	/**
@@ -105,9 +114,77 @@ extern "C" {
 		 */
 		KSI_ASYNC_PRIVOPT_ENDPOINT_ID,
 
+		/**
+		 * Max request count per aggregation period as advertised by the server (0 if unknown).
+		 * \param		count			Paramer of type size_t.
+		 */
+		KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT,
+
+		/**
+		 * Aggregation period in milliseconds as advertised by the server (0 if unknown).
+		 * \param		period			Paramer of type size_t.
+		 */
+		KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS,
+
 		__NOF_KSI_ASYNC_OPT
 	};
 
+	/**
+	 * Token bucket for pacing the outgoing requests of a single endpoint. The bucket is refilled
+	 * continuously at the rate defined by #KSI_ASYNC_OPT_MAX_REQUEST_COUNT per #KSI_ASYNC_PRIVOPT_ROUND_DURATION,
+	 * or by the server advertised limits in case they are more restrictive. The bucket capacity equals to
+	 * the request count of a single round.
+	 */
+	typedef struct KSI_AsyncPacer_st {
+		/** Monotonic time (in microseconds) of the last refill. Value 0 means that the bucket is not initialized. */
+		unsigned long long refillAt;
+		/**
+		 * Available credit. Sending a single request payload costs the duration of a round (in microseconds).
+		 * The credit may become negative, if a multi-payload PDU costs more than the bucket holds.
+		 */
+		long long credit;
+	} KSI_AsyncPacer;
+
+	/**
+	 * Initializes the pacer with a full bucket.
+	 */
+	void KSI_AsyncPacer_init(KSI_AsyncPacer *pacer);
+
+	/**
+	 * Refills the bucket and checks whether a request may be sent out.
+	 * \param[in]	pacer		Token bucket.
+	 * \param[in]	options		Async client options.
+	 * \param[in]	cost		Number of request payloads in the PDU (see #KSI_AsyncHandle_getPayloadCount).
+	 * \return \c true if a request may be sent, \c false otherwise.
+	 * \note A PDU carrying more payloads than the round limit is let through once the bucket is full,
+	 * the excess is paid back before any further requests are sent out.
+	 */
+	bool KSI_AsyncPacer_isReady(KSI_AsyncPacer *pacer, const size_t *options, size_t cost);
+
+	/**
+	 * Takes the cost of the request from the bucket. Should be called after the request has been sent out.
+	 * \param[in]	pacer		Token bucket.
+	 * \param[in]	options		Async client options.
+	 * \param[in]	cost		Number of request payloads in the PDU (see #KSI_AsyncHandle_getPayloadCount).
+	 */
+	void KSI_AsyncPacer_consume(KSI_AsyncPacer *pacer, const size_t *options, size_t cost);
+
+	/**
+	 * Returns the number of request payloads carried by the handle. A multi-payload PDU (see
+	 * #KSI_ASYNC_OPT_COALESCE_MAX_COUNT) carries the coalesced requests, any other handle carries a single one.
+	 * \param[in]	handle		The request handle.
+	 * \return Number of payloads.
+	 */
+	size_t KSI_AsyncHandle_getPayloadCount(const KSI_AsyncHandle *handle);
+
+	/**
+	 * Marks the request as sent out. Must be called by the transport layer instead of setting the
+	 * #KSI_ASYNC_STATE_WAITING_FOR_RESPONSE state directly, before the serialized payload is released.
+	 * \param[in]	handle		The request handle.
+	 * \param[in]	sndTime		Time when the request was sent out.
+	 */
+	void KSI_AsyncHandle_setSent(KSI_AsyncHandle *handle, time_t sndTime);
+
 	/**
 	 * Async service presentation layer context object.
 	 */
@@ -148,8 +225,20 @@ extern "C" {
 		/** Push config is not part of the request cache, as it can not be assigned to a particular request handle. */
 		KSI_AsyncHandle *serverConf;
 
+		/** Requests held back for coalescing. */
+		KSI_LIST(KSI_AsyncHandle) *coalesceQueue;
+		/** Monotonic time (in microseconds) when the first request was added to the coalescing queue. */
+		unsigned long long coalesceStartAt;
+		/** Serialized size of the requests held back for coalescing. */
+		size_t coalesceSize;
+		/** Handles carrying the coalesced requests, which are still being processed. */
+		KSI_LIST(KSI_AsyncHandle) *carriers;
+
 		/** Array of configuration options. */
 		size_t options[__NOF_KSI_ASYNC_OPT];
+
+		/** Metrics of the requests handled by the client. */
+		KSI_Metrics metrics;
 	};
 
 	/**
@@ -170,6 +259,7 @@ extern "C" {
 		int (*run)(void *, int (*)(void *), KSI_AsyncHandle **, size_t *);
 		int (*getPendingCount)(void *, size_t *);
 		int (*getReceivedCount)(void *, size_t *);
+		int (*getMetrics)(void *, KSI_MetricsSnapshot *);
 
 		int (*setOption)(void *, const int, void *);
 		int (*getOption)(void *, const int, void *);
@@ -219,6 +309,9 @@ extern "C" {
 		/** Consolidated configuration based on the responses from individual subservices. */
 		KSI_Config *consolidatedConfig;
 
+		/** Metrics of the failovers between the subservices. */
+		KSI_Metrics metrics;
+
 		/** Private helper method for subservice construction. */
 		int (*subservice_new)(KSI_CTX *, KSI_AsyncService **);
 	};
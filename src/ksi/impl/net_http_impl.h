@@ -42,6 +42,8 @@ extern "C" {
 
 		void *implCtx;
 		void (*implCtx_free)(void *);
+		/* Drops the cached connections of the implementation, may be NULL. */
+		void (*implCtx_reset)(void *);
 	};
 
 #ifdef __cplusplus
@@ -65,7 +65,7 @@ extern "C" {
 		/** Cleanup for the provider, gets the #providerCtx as parameter. */
 		void (*implFree)(void *);
 
-		size_t requestCount;
+		KSI_uint64_t requestCount;
 
 		/** Private helper functions. */
 		int (*setStringParam)(char **param, const char *val);
@@ -86,6 +86,11 @@ extern "C" {
 		/** Has the request completeted. */
 		bool completed;
 
+		/** Monotonic time in microseconds when the request was sent, 0 if not sent. */
+		unsigned long long sentAt;
+		/** Latency histogram of the request (see #KSI_MetricHistogram), -1 if not measured. */
+		int histogram;
+
 		/** Request destination. */
 		unsigned char *request;
 		/** Length of the original request. */
@@ -96,6 +101,16 @@ extern "C" {
 		/** Length of the response. */
 		size_t response_length;
 
+		/** Validators of a previously received copy of the resource. If set, the transport may turn the request
+		 * into a conditional request, in which case an unchanged resource is reported with an empty response
+		 * and status code 304 (HTTP only). */
+		char *ifNoneMatch;
+		char *ifModifiedSince;
+
+		/** Validators of the received resource, \c NULL if not provided by the transport. */
+		char *etag;
+		char *lastModified;
+
 		int (*readResponse)(KSI_RequestHandle *);
 
 		KSI_NetworkClient *client;
@@ -25,6 +25,8 @@
 
 #include "net_impl.h"
 #include "net_http_impl.h"
+#include "net_sock_impl.h"
+#include "thread_impl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,13 +35,22 @@ extern "C" {
 	struct TcpClient_Endpoint_st {
 		char *host;
 		unsigned port;
+
+		/* Guards the persistent connection state, as the client may be shared between threads. */
+		KSI_Mutex lock;
+		/* Persistent connection (see #KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS). */
+		int sockfd;
+		/* Time when the persistent connection was last used. */
+		time_t lastUsedAt;
+		/* Cached address resolution of the persistent connection. */
+		struct addrinfo *addr;
 	};
 
 	struct KSI_TcpClient_st {
 		/* TODO: Is it required to be a signed int? */
 		int transferTimeoutSeconds;
 
-		int (*sendRequest)(KSI_NetworkClient *, KSI_RequestHandle *, char *host, unsigned port);
+		int (*sendRequest)(KSI_NetworkClient *, KSI_RequestHandle *, struct TcpClient_Endpoint_st *endp);
 		KSI_NetworkClient *http;
 	};
 
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2013-2015 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef PKITRUSTSTORE_IMPL_H_
+#define PKITRUSTSTORE_IMPL_H_
+
+#include "../internal.h"
+#include "../hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * Appends a step of the trust configuration to the identity hash chain of a PKI truststore, see
+	 * #KSI_PKITruststore_getIdentity.
+	 * \param[in]		ctx			KSI context.
+	 * \param[in,out]	identity	Identity of the truststore, \c NULL for an empty configuration.
+	 * \param[in]		kind		Kind of the configuration step.
+	 * \param[in]		path		Path of the lookup file or directory, can be \c NULL.
+	 * \param[in]		hashContent	Should the content of the file at \c path be part of the identity.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_PKITruststore_updateIdentity(KSI_CTX *ctx, KSI_DataHash **identity, const char *kind, const char *path, bool hashContent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKITRUSTSTORE_IMPL_H_ */
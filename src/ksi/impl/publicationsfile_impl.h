@@ -20,10 +20,18 @@
 #ifndef PUBLICATIONSFILE_IMPL_H_
 #define PUBLICATIONSFILE_IMPL_H_
 
+#include "../internal.h"
+#include "../hash.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+	/** Buffer size of a hex encoded trust configuration identity, see #KSI_PublicationsFile_setSignatureVerified. */
+	#define KSI_PUBFILE_TRUST_IDENTITY_LEN (2 * KSI_MAX_IMPRINT_LEN + 1)
+
+	typedef struct KSI_PublicationsFileImage_st KSI_PublicationsFileImage;
+
 	struct KSI_PublicationsFile_st {
 		KSI_CTX *ctx;
 		size_t ref;
@@ -35,6 +43,13 @@ extern "C" {
 		size_t signedDataLength;
 		KSI_PKISignature *signature;
 		KSI_CertConstraint *certConstraints;
+		/** The signature has been verified by this context, see #KSI_PublicationsFile_setSignatureVerified. */
+		bool signatureVerified;
+		/** Hex encoded identity of the trust configuration the signature was verified with. */
+		char verifiedTrust[KSI_PUBFILE_TRUST_IDENTITY_LEN];
+		/** Shared read-only image the #raw value belongs to, \c NULL if the file has been parsed into private memory.
+		 * The publication records of an attached file are parsed on demand, see #KSI_PublicationsFileCache_attach. */
+		KSI_PublicationsFileImage *image;
 	};
 
 	struct KSI_PublicationData_st {
@@ -54,6 +69,75 @@ extern "C" {
 		KSI_LIST(KSI_Utf8String) *repositoryUriList;
 	};
 
+	/**
+	 * Marks the signature of the publications file as verified with the current trust configuration of its
+	 * context, i.e. the PKI truststore identity (see #KSI_PKITruststore_getIdentity) and the default
+	 * certificate constraints. The verification is skipped by #KSI_PublicationsFile_verify as long as the
+	 * configuration is not changed.
+	 * \param[in]	pubFile		Publications file.
+	 * \param[in]	verified	Has the signature been verified.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_PublicationsFile_setSignatureVerified(KSI_PublicationsFile *pubFile, bool verified);
+
+	/**
+	 * Entry of the persistent publications file cache.
+	 */
+	typedef struct KSI_PublicationsFileCacheEntry_st {
+		/** Raw publications file. */
+		unsigned char *raw;
+		size_t raw_len;
+		/** HTTP validators of the raw file, can be \c NULL. */
+		char *etag;
+		char *lastModified;
+		/** Time when the file was last downloaded or revalidated. */
+		time_t fetchedAt;
+		/** Has the PKI signature of the raw file been verified with the current trust configuration. */
+		bool verified;
+	} KSI_PublicationsFileCacheEntry;
+
+	/**
+	 * Releases the resources of the cache entry and resets its fields.
+	 * \param[in]	entry		Cache entry.
+	 */
+	void KSI_PublicationsFileCacheEntry_clear(KSI_PublicationsFileCacheEntry *entry);
+
+	/**
+	 * Reads the publications file cache entry from the cache directory. If the directory does not contain
+	 * an entry for the given URL or the metadata does not match the digest of the cached file, the function
+	 * succeeds and \c entry->raw is left \c NULL. The entry is only marked as verified, if it was verified
+	 * with the same PKI truststore identity (see #KSI_PKITruststore_getIdentity) and certificate constraints.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	dir			Cache directory.
+	 * \param[in]	url			Publications file URL, can be \c NULL.
+	 * \param[out]	entry		Cache entry to be filled.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_PublicationsFileCache_load(KSI_CTX *ctx, const char *dir, const char *url, KSI_PublicationsFileCacheEntry *entry);
+
+	/**
+	 * Replaces the publications file cache entry in the cache directory. Each file of the entry is replaced
+	 * atomically, the metadata records the digest of the raw file and the trust configuration of the context.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	dir			Cache directory.
+	 * \param[in]	url			Publications file URL, can be \c NULL.
+	 * \param[in]	entry		Cache entry.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_PublicationsFileCache_store(KSI_CTX *ctx, const char *dir, const char *url, const KSI_PublicationsFileCacheEntry *entry);
+
+	/**
+	 * Creates a publications file backed by the read-only memory mapping of the cached raw file and its
+	 * publication lookup index, which are shared by all the processes attached to the same cache directory.
+	 * Only the header, the certificates and the signature are parsed; the publication records are parsed
+	 * from the mapping on lookup.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	dir			Cache directory.
+	 * \param[out]	pubFile		Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On platforms without \c mmap the image is read into private memory.
+	 */
+	int KSI_PublicationsFileCache_attach(KSI_CTX *ctx, const char *dir, KSI_PublicationsFile **pubFile);
 
 #ifdef __cplusplus
 }
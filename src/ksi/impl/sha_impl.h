@@ -0,0 +1,146 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef SHA_IMPL_H_
+#define SHA_IMPL_H_
+
+#include "../internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * State of a SHA-1 computation.
+	 */
+	typedef struct KSI_Sha1_st {
+		uint32_t state[5];
+		/** Number of the bytes added. */
+		uint64_t length;
+		/** Input not yet processed, the first \c length % 64 bytes are valid. */
+		unsigned char buf[64];
+	} KSI_Sha1;
+
+	/**
+	 * State of a SHA-256 computation.
+	 */
+	typedef struct KSI_Sha256_st {
+		uint32_t state[8];
+		/** Number of the bytes added. */
+		uint64_t length;
+		/** Input not yet processed, the first \c length % 64 bytes are valid. */
+		unsigned char buf[64];
+	} KSI_Sha256;
+
+	/**
+	 * State of a SHA-384 or SHA-512 computation.
+	 */
+	typedef struct KSI_Sha512_st {
+		uint64_t state[8];
+		/** Number of the bytes added. */
+		uint64_t length;
+		/** Input not yet processed, the first \c length % 128 bytes are valid. */
+		unsigned char buf[128];
+		/** Length of the digest, 48 for SHA-384 and 64 for SHA-512. */
+		size_t digest_length;
+	} KSI_Sha512;
+
+	/**
+	 * Initializes the SHA-1 computation.
+	 * \param[in]	sha		The state.
+	 */
+	void KSI_Sha1_init(KSI_Sha1 *sha);
+
+	/**
+	 * Adds data to the SHA-1 computation.
+	 * \param[in]	sha		The state.
+	 * \param[in]	data	Pointer to the data.
+	 * \param[in]	len		Length of the data.
+	 */
+	void KSI_Sha1_update(KSI_Sha1 *sha, const void *data, size_t len);
+
+	/**
+	 * Finalizes the SHA-1 computation.
+	 * \param[in]	sha		The state, it has to be initialized again before reuse.
+	 * \param[out]	digest	Buffer receiving the 20 byte digest.
+	 */
+	void KSI_Sha1_final(KSI_Sha1 *sha, unsigned char *digest);
+
+	/**
+	 * Initializes the SHA-256 computation.
+	 * \param[in]	sha		The state.
+	 */
+	void KSI_Sha256_init(KSI_Sha256 *sha);
+
+	/**
+	 * Adds data to the SHA-256 computation.
+	 * \param[in]	sha		The state.
+	 * \param[in]	data	Pointer to the data.
+	 * \param[in]	len		Length of the data.
+	 */
+	void KSI_Sha256_update(KSI_Sha256 *sha, const void *data, size_t len);
+
+	/**
+	 * Finalizes the SHA-256 computation.
+	 * \param[in]	sha		The state, it has to be initialized again before reuse.
+	 * \param[out]	digest	Buffer receiving the 32 byte digest.
+	 */
+	void KSI_Sha256_final(KSI_Sha256 *sha, unsigned char *digest);
+
+	/**
+	 * Initializes the SHA-384 or SHA-512 computation.
+	 * \param[in]	sha				The state.
+	 * \param[in]	digest_length	48 for SHA-384, 64 for SHA-512.
+	 */
+	void KSI_Sha512_init(KSI_Sha512 *sha, size_t digest_length);
+
+	/**
+	 * Adds data to the SHA-384 or SHA-512 computation.
+	 * \param[in]	sha		The state.
+	 * \param[in]	data	Pointer to the data.
+	 * \param[in]	len		Length of the data.
+	 */
+	void KSI_Sha512_update(KSI_Sha512 *sha, const void *data, size_t len);
+
+	/**
+	 * Finalizes the SHA-384 or SHA-512 computation.
+	 * \param[in]	sha		The state, it has to be initialized again before reuse.
+	 * \param[out]	digest	Buffer receiving the digest of \c KSI_Sha512::digest_length bytes.
+	 */
+	void KSI_Sha512_final(KSI_Sha512 *sha, unsigned char *digest);
+
+	/**
+	 * Enables or disables the use of the CPU specific implementations. When enabled (the default), the
+	 * fastest implementation supported by the processor is selected on the first use. Disabling forces the
+	 * portable implementation, which is useful for testing and benchmarking.
+	 * \param[in]	enable	Non-zero to enable.
+	 * \note The setting is process wide and must not be changed while other threads are hashing.
+	 */
+	void KSI_Sha2_setAccelerated(int enable);
+
+	/**
+	 * Returns the name of the SHA-256 implementation in use, e.g. "sha-ni" or "portable".
+	 */
+	const char *KSI_Sha2_getImplementation(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHA_IMPL_H_ */
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef THREAD_IMPL_H_
+#define THREAD_IMPL_H_
+
+#include "../types_base.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * Mutual exclusion lock. The lock is not recursive.
+	 */
+	typedef struct KSI_Mutex_st {
+#ifdef _WIN32
+		CRITICAL_SECTION cs;
+#else
+		pthread_mutex_t mutex;
+#endif
+	} KSI_Mutex;
+
+	/**
+	 * Condition variable, used together with a #KSI_Mutex.
+	 */
+	typedef struct KSI_Cond_st {
+#ifdef _WIN32
+		CONDITION_VARIABLE cv;
+#else
+		pthread_cond_t cond;
+#endif
+	} KSI_Cond;
+
+	/**
+	 * Key of a thread specific value.
+	 */
+	typedef struct KSI_ThreadKey_st {
+#ifdef _WIN32
+		DWORD index;
+#else
+		pthread_key_t key;
+#endif
+	} KSI_ThreadKey;
+
+	/**
+	 * Thread handle.
+	 */
+	typedef struct KSI_Thread_st {
+#ifdef _WIN32
+		HANDLE thread;
+#else
+		pthread_t thread;
+#endif
+		void (*fn)(void *);
+		void *arg;
+	} KSI_Thread;
+
+/**
+ * Atomically increments the 64-bit counter pointed to by \c p and evaluates to the new value.
+ */
+#if defined(_WIN32)
+#  define KSI_ATOMIC_INC64(p) ((KSI_uint64_t)InterlockedIncrement64((volatile LONG64 *)(p)))
+#elif defined(__GNUC__)
+#  define KSI_ATOMIC_INC64(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#else
+#  define KSI_ATOMIC_INC64(p) (++(*(p)))
+#endif
+
+/**
+ * Atomically adds \c v to the 64-bit counter pointed to by \c p and evaluates to the new value.
+ * #KSI_ATOMIC_LOAD64 reads a value updated by other threads, #KSI_ATOMIC_STORE64 publishes a value
+ * together with the preceding writes and #KSI_ATOMIC_CAS64 replaces the value if it equals
+ * \c expected, evaluating to non-zero on success.
+ */
+#if defined(_WIN32)
+#  define KSI_ATOMIC_ADD64(p, v) ((KSI_uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v)) + (KSI_uint64_t)(v))
+#  define KSI_ATOMIC_LOAD64(p) ((KSI_uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0))
+#  define KSI_ATOMIC_STORE64(p, v) ((void)InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v)))
+#  define KSI_ATOMIC_CAS64(p, expected, desired) (InterlockedCompareExchange64((volatile LONG64 *)(p), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#  define KSI_ATOMIC_FENCE() MemoryBarrier()
+#elif defined(__GNUC__)
+#  define KSI_ATOMIC_ADD64(p, v) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#  define KSI_ATOMIC_LOAD64(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define KSI_ATOMIC_STORE64(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#  define KSI_ATOMIC_CAS64(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#  define KSI_ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#  define KSI_ATOMIC_ADD64(p, v) ((*(p)) += (v))
+#  define KSI_ATOMIC_LOAD64(p) (*(p))
+#  define KSI_ATOMIC_STORE64(p, v) ((void)(*(p) = (v)))
+#  define KSI_ATOMIC_CAS64(p, expected, desired) (*(p) == (expected) ? (*(p) = (desired), 1) : 0)
+#  define KSI_ATOMIC_FENCE()
+#endif
+
+/**
+ * Atomically replaces the pointer pointed to by \c p with \c desired if it equals \c expected,
+ * evaluates to non-zero on success. #KSI_ATOMIC_LOAD_PTR reads a pointer set by other threads.
+ */
+#if defined(_WIN32)
+#  define KSI_ATOMIC_CAS_PTR(p, expected, desired) (InterlockedCompareExchangePointer((PVOID volatile *)(p), (PVOID)(desired), (PVOID)(expected)) == (PVOID)(expected))
+#  define KSI_ATOMIC_LOAD_PTR(p) InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#elif defined(__GNUC__)
+#  define KSI_ATOMIC_CAS_PTR(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#  define KSI_ATOMIC_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#  define KSI_ATOMIC_CAS_PTR(p, expected, desired) (*(p) == (expected) ? (*(p) = (desired), 1) : 0)
+#  define KSI_ATOMIC_LOAD_PTR(p) (*(p))
+#endif
+
+/**
+ * Atomically increments and decrements the \c size_t reference count pointed to by \c p and
+ * evaluate to the new value. The decrement is ordered with the preceding accesses to the object,
+ * so the thread releasing the last reference may safely free it.
+ */
+#if defined(_WIN64)
+#  define KSI_ATOMIC_INC_REF(p) ((size_t)InterlockedIncrement64((volatile LONG64 *)(p)))
+#  define KSI_ATOMIC_DEC_REF(p) ((size_t)InterlockedDecrement64((volatile LONG64 *)(p)))
+#elif defined(_WIN32)
+#  define KSI_ATOMIC_INC_REF(p) ((size_t)InterlockedIncrement((volatile LONG *)(p)))
+#  define KSI_ATOMIC_DEC_REF(p) ((size_t)InterlockedDecrement((volatile LONG *)(p)))
+#elif defined(__GNUC__)
+#  define KSI_ATOMIC_INC_REF(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#  define KSI_ATOMIC_DEC_REF(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#else
+#  define KSI_ATOMIC_INC_REF(p) (++(*(p)))
+#  define KSI_ATOMIC_DEC_REF(p) (--(*(p)))
+#endif
+
+	/**
+	 * Initializes the mutex.
+	 * \param[in]	m		Pointer to the mutex.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_Mutex_init(KSI_Mutex *m);
+
+	/**
+	 * Releases the resources of an unlocked mutex.
+	 * \param[in]	m		Pointer to the mutex.
+	 */
+	void KSI_Mutex_destroy(KSI_Mutex *m);
+
+	/**
+	 * Locks the mutex, the calling thread is blocked until the lock is acquired.
+	 * \param[in]	m		Pointer to the mutex.
+	 */
+	void KSI_Mutex_lock(KSI_Mutex *m);
+
+	/**
+	 * Unlocks the mutex locked by the calling thread.
+	 * \param[in]	m		Pointer to the mutex.
+	 */
+	void KSI_Mutex_unlock(KSI_Mutex *m);
+
+	/**
+	 * Initializes the condition variable.
+	 * \param[in]	c		Pointer to the condition variable.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_Cond_init(KSI_Cond *c);
+
+	/**
+	 * Releases the resources of a condition variable no thread is waiting on.
+	 * \param[in]	c		Pointer to the condition variable.
+	 */
+	void KSI_Cond_destroy(KSI_Cond *c);
+
+	/**
+	 * Atomically unlocks the mutex and blocks the calling thread until the condition variable is
+	 * signalled, the mutex is locked again before returning. Spurious wakeups are possible, thus
+	 * the condition has to be checked in a loop.
+	 * \param[in]	c		Pointer to the condition variable.
+	 * \param[in]	m		Pointer to the mutex locked by the calling thread.
+	 */
+	void KSI_Cond_wait(KSI_Cond *c, KSI_Mutex *m);
+
+	/**
+	 * Same as #KSI_Cond_wait, but returns also when \c ms milliseconds have elapsed without the
+	 * condition variable being signalled.
+	 * \param[in]	c		Pointer to the condition variable.
+	 * \param[in]	m		Pointer to the mutex locked by the calling thread.
+	 * \param[in]	ms		Timeout in milliseconds.
+	 */
+	void KSI_Cond_timedWait(KSI_Cond *c, KSI_Mutex *m, unsigned ms);
+
+	/**
+	 * Wakes up at least one of the threads waiting on the condition variable.
+	 * \param[in]	c		Pointer to the condition variable.
+	 */
+	void KSI_Cond_signal(KSI_Cond *c);
+
+	/**
+	 * Wakes up all the threads waiting on the condition variable.
+	 * \param[in]	c		Pointer to the condition variable.
+	 */
+	void KSI_Cond_broadcast(KSI_Cond *c);
+
+	/**
+	 * Creates a new thread specific value key. The initial value of the key is \c NULL in every thread.
+	 * \param[in]	key		Pointer to the key.
+	 * \param[in]	dtor	Function called with the non-\c NULL value when the thread exits (can be \c NULL).
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On Windows the destructor is not called, the values have to be released by the owner of the key.
+	 */
+	int KSI_ThreadKey_init(KSI_ThreadKey *key, void (*dtor)(void *));
+
+	/**
+	 * Deletes the key. The destructors of the values still set are not called.
+	 * \param[in]	key		Pointer to the key.
+	 */
+	void KSI_ThreadKey_destroy(KSI_ThreadKey *key);
+
+	/**
+	 * Getter for the value of the calling thread.
+	 * \param[in]	key		Pointer to the key.
+	 * \return The value set by the calling thread, or \c NULL.
+	 */
+	void *KSI_ThreadKey_get(KSI_ThreadKey *key);
+
+	/**
+	 * Setter for the value of the calling thread.
+	 * \param[in]	key		Pointer to the key.
+	 * \param[in]	value	The value.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_ThreadKey_set(KSI_ThreadKey *key, void *value);
+
+	/**
+	 * Starts a new thread.
+	 * \param[in]	thread	Pointer to the thread handle.
+	 * \param[in]	fn		Thread function.
+	 * \param[in]	arg		Argument passed to \c fn.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_Thread_start(KSI_Thread *thread, void (*fn)(void *), void *arg);
+
+	/**
+	 * Waits for the thread to finish and releases the thread handle.
+	 * \param[in]	thread	Pointer to the thread handle.
+	 */
+	void KSI_Thread_join(KSI_Thread *thread);
+
+	/**
+	 * Returns the number of online processors, or 1 if it can not be determined.
+	 */
+	size_t KSI_Thread_getCpuCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREAD_IMPL_H_ */
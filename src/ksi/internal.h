@@ -62,6 +62,7 @@
 #define KSI_IMPL_OPENSSL		4
 #define KSI_IMPL_CRYPTOAPI		5
 #define KSI_IMPL_COMMONCRYPTO	6
+#define KSI_IMPL_NATIVE			7
 
 /**
  * Network client providers.
@@ -107,6 +108,10 @@
 #    define gmtime_r(time, resultp) gmtime_s(resultp, time)
 #  endif
 
+#  ifndef localtime_r
+#    define localtime_r(time, resultp) (localtime_s(resultp, time) == 0 ? (resultp) : NULL)
+#  endif
+
 #  ifndef DWORD_MAX
 #    define DWORD_MAX ((((long long int) 1) << (sizeof(DWORD) << 3)) - 1)
 #  endif
@@ -118,8 +123,37 @@
 #define KSI_UINT32_MINSIZE(val) (((val) > 0xffff) ? (2 + KSI_UINT16_MINSIZE((val) >> 16)) : KSI_UINT16_MINSIZE((val)))
 #define KSI_UINT64_MINSIZE(val) (((val) > 0xffffffff) ? (4 + KSI_UINT32_MINSIZE((val) >> 32)) : KSI_UINT32_MINSIZE((val)))
 
-/* Create a new object of type. */
-#define KSI_new(typeVar) (typeVar *)(KSI_malloc(sizeof(typeVar)))
+/* Create a new object of type, the type name is used by the allocation statistics. */
+#define KSI_new(typeVar) (typeVar *)(KSI_mallocTyped(sizeof(typeVar), #typeVar))
+
+/*
+ * The logging functions are shadowed by macros checking the log level first, thus neither the call
+ * nor the evaluation of the arguments happens when the level is disabled. log.c defines
+ * KSI_LOG_NO_LEVEL_CHECK to implement the functions.
+ */
+#ifndef KSI_LOG_NO_LEVEL_CHECK
+#  define KSI_LOG_debug(ctx, ...) (KSI_LOG_isEnabled((ctx), KSI_LOG_DEBUG) ? KSI_LOG_debug((ctx), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_info(ctx, ...) (KSI_LOG_isEnabled((ctx), KSI_LOG_INFO) ? KSI_LOG_info((ctx), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_notice(ctx, ...) (KSI_LOG_isEnabled((ctx), KSI_LOG_NOTICE) ? KSI_LOG_notice((ctx), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_warn(ctx, ...) (KSI_LOG_isEnabled((ctx), KSI_LOG_WARN) ? KSI_LOG_warn((ctx), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_error(ctx, ...) (KSI_LOG_isEnabled((ctx), KSI_LOG_ERROR) ? KSI_LOG_error((ctx), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_logBlob(ctx, level, ...) (KSI_LOG_isEnabled((ctx), (level)) ? KSI_LOG_logBlob((ctx), (level), __VA_ARGS__) : KSI_OK)
+#  define KSI_LOG_logTlv(ctx, level, prefix, tlv) (KSI_LOG_isEnabled((ctx), (level)) ? KSI_LOG_logTlv((ctx), (level), (prefix), (tlv)) : KSI_OK)
+#  define KSI_LOG_logDataHash(ctx, level, prefix, hsh) (KSI_LOG_isEnabled((ctx), (level)) ? KSI_LOG_logDataHash((ctx), (level), (prefix), (hsh)) : KSI_OK)
+#  define KSI_LOG_logCtxError(ctx, level) (KSI_LOG_isEnabled((ctx), (level)) ? KSI_LOG_logCtxError((ctx), (level)) : KSI_OK)
+#endif
+
+/**
+ * Same as #KSI_malloc, the \c type name (a string literal) is counted by the allocation statistics.
+ */
+void *KSI_mallocTyped(size_t size, const char *type);
+
+/**
+ * Platform independent monotonic clock. The returned value is not related to the wall clock
+ * time and should only be used for measuring time intervals.
+ * \return Elapsed time in microseconds since an unspecified starting point. On error 0 is returned.
+ */
+unsigned long long KSI_getMonotonicTimeUs(void);
 
 /* Returns Empty string if #str==NULL otherwise returns #str itself. */
 #define KSI_strnvl(str) ((str) == NULL)?"":(str)
@@ -167,6 +201,17 @@ KSI_DEFINE_REF(baseType) {													\
 	return o;																\
 }																			\
 
+/**
+ * Variant of #KSI_IMPLEMENT_REF for the types that are immutable after construction and
+ * may be shared between threads. The free function of the type has to release the reference
+ * with #KSI_ATOMIC_DEC_REF (see impl/thread_impl.h, which must be included by the user).
+ */
+#define KSI_IMPLEMENT_ATOMIC_REF(baseType)									\
+KSI_DEFINE_REF(baseType) {													\
+	if (o != NULL) KSI_ATOMIC_INC_REF(&o->ref);								\
+	return o;																\
+}																			\
+
 #define KSI_IMPLEMENT_TOTLV(type) \
 int type##_toTlv(KSI_CTX *ctx, const type *data, unsigned tag, int isNonCritical, int isForward, KSI_TLV **tlv) { \
 	int res; \
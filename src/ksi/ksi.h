@@ -383,7 +383,7 @@ typedef enum KSI_Option_en {
 	KSI_OPT_EXT_HMAC_ALGORITHM,
 
 	/**
-	 * The size of the dynamic recycle pool for #KSI_DataHash objects.
+	 * The size of the dynamic recycle pool for #KSI_DataHash objects. Each thread using the context has its own pool.
 	 * \param		count		Cache size. Paramer of type size_t.
 	 */
 	KSI_OPT_DATAHASH_CACHE_SIZE,
@@ -421,6 +421,71 @@ typedef enum KSI_Option_en {
 	 */
 	KSI_OPT_HA_SAFEGUARD,
 
+	/**
+	 * Idle timeout of the persistent connections of the synchronous TCP client (\c ksi+tcp:// scheme).
+	 * When enabled, the connection to the aggregator or extender is kept open between the requests and
+	 * is closed after it has not been used for the given period. The server address resolution is cached
+	 * for the lifetime of the endpoint configuration.
+	 * \param		timeout		Timeout in seconds. Paramer of type size_t.
+	 * \note		Setting the timeout to 0 (default) will open a new connection for every request.
+	 */
+	KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS,
+
+	/**
+	 * Background refresh of the cached publications file. When enabled and the cache timeout
+	 * #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS has expired, #KSI_receivePublicationsFile keeps returning the cached
+	 * publications file and starts a thread that downloads, parses and verifies the new one. The new file
+	 * replaces the cached one only after it has been successfully verified; in case of a failure the cached
+	 * file is kept and the refresh is retried after a delay, which is doubled after every consecutive failure
+	 * (from 10 seconds up to an hour).
+	 * \param		enable		Non-zero value to enable. Paramer of type size_t.
+	 * \note		The option has no effect until the first publications file has been received and cached.
+	 * \note		Replacing the network provider, the PKI truststore, the certificate constraints, the publications
+	 * 				file URL or the cache directory of the context waits for the running refresh to finish.
+	 */
+	KSI_OPT_PUBFILE_BACKGROUND_REFRESH,
+
+	/**
+	 * Attach to the publications file image shared through the persistent publications file cache, instead of
+	 * parsing a private copy of the file. The raw file and its publication lookup index are mapped read-only
+	 * into the memory of every process using the cache, and the publication records are parsed only when
+	 * looked up (e.g. by #KSI_PublicationsFile_getNearestPublication).
+	 * \param		enable		Non-zero value to enable. Paramer of type size_t.
+	 * \see			#KSI_CTX_setPublicationsFileCacheDir for enabling the cache.
+	 * \note		The cache is populated by the context that downloads the publications file.
+	 */
+	KSI_OPT_PUBFILE_SHARED_IMAGE,
+
+	/**
+	 * The size of the recycle pool for #KSI_DataHasher objects, per hash algorithm. A freed hasher is kept
+	 * in the pool and reset by the next #KSI_DataHasher_open call for the same algorithm, instead of
+	 * allocating and initializing a new hasher. Each thread using the context has its own pool.
+	 * \param		count		Pool size. Paramer of type size_t.
+	 * \note		Setting the size to 0 disables the pool.
+	 */
+	KSI_OPT_DATAHASHER_CACHE_SIZE,
+
+	/**
+	 * Use the built-in SHA-2 implementation for SHA-256, SHA-384 and SHA-512, instead of the hash provider
+	 * the library was built with (e.g. OpenSSL). The built-in implementation avoids the dispatch overhead of
+	 * the provider on short inputs such as the hash chain steps, and uses the SHA extensions of the processor
+	 * when available. The other algorithms are still hashed by the provider.
+	 * \param		enable		Non-zero value to enable. Paramer of type size_t.
+	 * \note		Has no effect if the library is built with the built-in hash provider, which is always used.
+	 */
+	KSI_OPT_NATIVE_SHA2,
+
+	/**
+	 * Hash the regular files passed to #KSI_DataHasher_addFd and #KSI_DataHasher_addFile by mapping them
+	 * into memory, instead of reading them into buffers. Mapping avoids copying the file contents, but if
+	 * the file is truncated while being hashed, the process receives \c SIGBUS when the pages past the new
+	 * end of the file are accessed.
+	 * \param		enable		Non-zero value to enable. Paramer of type size_t.
+	 * \note		Enable only if the hashed files are not truncated meanwhile (e.g. log files being rotated).
+	 * \note		Has no effect on Windows, where the files are always read.
+	 */
+	KSI_OPT_HASH_FILE_MMAP,
+
 	__KSI_NUMBER_OF_OPTIONS,
 } KSI_Option;
 
@@ -443,11 +508,20 @@ const char *KSI_getVersion(void);
 const char *KSI_getErrorString(int statusCode);
 
 /**
- * Constructor for the central KSI object #KSI_CTX. For thread safety, this object
- * may not be shared between threads. Also, this object may be freed only if there
+ * Constructor for the central KSI object #KSI_CTX. This object may be freed only if there
  * are no other objects created using this object - this applies recursively to other
  * objects created by the user.
  *
+ * The context may be shared between threads, once it has been configured (options, network
+ * provider, truststore and callbacks must be set before sharing). The error stack is kept
+ * separately for every thread, thus the error functions (e.g. #KSI_ERR_getBaseErrorMessage)
+ * report the errors of the calling thread. The publications file is downloaded only once by
+ * concurrent calls to #KSI_receivePublicationsFile. The immutable objects (#KSI_DataHash,
+ * #KSI_Signature, #KSI_PublicationsFile and #KSI_PKITruststore) have atomic reference counts and
+ * may be shared between threads for reading and verification; every thread should hold its own
+ * reference (e.g. #KSI_Signature_ref). Other objects created using the context (hashers, builders,
+ * services, etc.) are not thread safe and may be used by a single thread at a time.
+ *
  * \param[in]		ctx			Pointer to the receiving pointer.
  *
  * \return status code (#KSI_OK, when operation succeeded, otherwise an
@@ -539,6 +613,69 @@ void *KSI_calloc(size_t num, size_t size);
  */
 void KSI_free(void *ptr);
 
+/**
+ * Allocator callbacks used by #KSI_malloc, #KSI_calloc and #KSI_free.
+ * \see #KSI_setAllocator
+ */
+typedef struct KSI_Allocator_st {
+	/** Allocates \c size bytes of memory. */
+	void *(*mallocFn)(void *allocCtx, size_t size);
+	/** Allocates \c num times of \c size bytes of zeroed memory, if \c NULL #KSI_Allocator::mallocFn is used. */
+	void *(*callocFn)(void *allocCtx, size_t num, size_t size);
+	/** Frees the memory allocated by the functions above, never called with \c NULL. */
+	void (*freeFn)(void *allocCtx, void *ptr);
+	/** Context passed to the callbacks. */
+	void *allocCtx;
+} KSI_Allocator;
+
+/**
+ * Installs the process-wide allocator of the SDK. The allocator must be installed before the
+ * first #KSI_CTX is created and kept until the last object of the SDK is freed, as the memory
+ * is always released by the allocator active at the time.
+ * \param[in]	allocator	The allocator callbacks, \c NULL restores the C library allocator.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The allocator is process-wide, as the allocation functions have no context and objects
+ * created by one context may be released by another (e.g. the publications file shared between
+ * contexts).
+ */
+int KSI_setAllocator(const KSI_Allocator *allocator);
+
+/**
+ * Allocation statistics of a single object type.
+ * \see #KSI_getAllocationStats
+ */
+typedef struct KSI_AllocationStat_st {
+	/** Name of the allocated type, \c "other" for untyped allocations (e.g. buffers). */
+	const char *type;
+	/** Number of the allocation calls. */
+	KSI_uint64_t calls;
+	/** Number of the allocated bytes. */
+	KSI_uint64_t bytes;
+} KSI_AllocationStat;
+
+/**
+ * Enables or disables counting of the allocation calls and bytes by object type. The counting
+ * is disabled by default; when disabled it costs a single branch per allocation.
+ * \param[in]	enabled		Non-zero to enable counting.
+ */
+void KSI_setAllocationStats(int enabled);
+
+/**
+ * Copies the allocation statistics counted since the last #KSI_resetAllocationStats.
+ * \param[out]	stats		Array receiving the statistics by type (can be \c NULL if \c stats_len is 0).
+ * \param[in]	stats_len	Length of the array.
+ * \param[out]	count		Number of the types counted, may be larger than \c stats_len.
+ * \param[out]	frees		Number of the free calls (can be \c NULL).
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_getAllocationStats(KSI_AllocationStat *stats, size_t stats_len, size_t *count, KSI_uint64_t *frees);
+
+/**
+ * Resets the allocation counters to zero.
+ * \note The counters updated concurrently by other threads may not be reset.
+ */
+void KSI_resetAllocationStats(void);
+
 /**
  * Send a binary request to aggregator using the specified KSI context.
  * \param[in]		ctx					KSI context object.
@@ -585,6 +722,8 @@ int KSI_sendPublicationRequest(KSI_CTX *ctx, const unsigned char *request, size_
  * \note The publications file is not verified, use #KSI_PublicationsFile_verify to do so.
  * \note The downloaded publications file is cached. Sequential calls to this method will return the cached file, except
  * the cache timeout #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS has expired in which case a new download is triggered.
+ * \note If #KSI_OPT_PUBFILE_BACKGROUND_REFRESH is enabled, the expired file is returned until the new download has
+ * completed and the new file has been verified.
  *
  * \see #KSI_CTX_setPublicationUrl for setting publications file URL.
  * \see #KSI_PublicationsFile_verify for publication file verification.
@@ -635,6 +774,18 @@ int KSI_verifySignature(KSI_CTX *ctx, KSI_Signature *sig);
  * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
  */
 int KSI_verifyDataHash(KSI_CTX *ctx, KSI_Signature *sig, const KSI_DataHash *hsh);
+
+/**
+ * Verifies a batch of signatures as #KSI_verifySignature does. The signatures are verified in
+ * parallel by the executor of the context (see #KSI_CTX_setExecutor).
+ * \param[in]		ctx			KSI context.
+ * \param[in]		sig			Array of the signatures.
+ * \param[in]		count		Number of the signatures.
+ * \param[out]		results		Array of \c count status codes of the signatures (can be \c NULL).
+ *
+ * \return #KSI_OK if all the signatures were verified, otherwise an error code of a failed signature.
+ */
+int KSI_verifySignatures(KSI_CTX *ctx, KSI_Signature * const *sig, size_t count, int *results);
 /**
  * Create a KSI signature from a given data hash.
  * \param[in]		ctx			KSI context.
@@ -662,6 +813,22 @@ int KSI_extendSignatureWithPolicy(KSI_CTX *ctx, const KSI_Signature *sig, const
 
 #define KSI_extendSignature(ctx, sig, extended) KSI_extendSignatureWithPolicy(ctx, sig, KSI_VERIFICATION_POLICY_INTERNAL, NULL, extended)
 
+/**
+ * Extends a batch of signatures as #KSI_extendSignature does. The extension requests are sent in
+ * parallel by the executor of the context (see #KSI_CTX_setExecutor), thus the network provider
+ * receives concurrent requests.
+ * \param[in]		ctx			KSI context.
+ * \param[in]		sig			Array of the signatures to be extended.
+ * \param[in]		count		Number of the signatures.
+ * \param[out]		extended	Array of \c count pointers receiving the extended signatures, \c NULL for the failed ones.
+ * \param[out]		results		Array of \c count status codes of the signatures (can be \c NULL).
+ *
+ * \return #KSI_OK if all the signatures were extended, otherwise an error code of a failed signature.
+ * \note The extended signatures are returned also on failure and have to be freed by the caller.
+ * \see #KSI_Signature_free
+ */
+int KSI_extendSignatures(KSI_CTX *ctx, const KSI_Signature * const *sig, size_t count, KSI_Signature **extended, int *results);
+
 /**
  * Setter for the internal log level.
  * \param[in]		ctx			KSI context.
@@ -704,6 +871,27 @@ int KSI_CTX_setRequestHeaderCallback(KSI_CTX *ctx, KSI_RequestHeaderCallback cb)
  */
 int KSI_CTX_setPublicationUrl(KSI_CTX *ctx, const char *uri);
 
+/**
+ * Setter for the persistent publications file cache directory. The downloaded publications file is stored in the
+ * directory together with its HTTP validators and verification state, and is shared by all the contexts (and
+ * processes) using the same directory and publications file URL. As long as the cache timeout
+ * #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS has not expired, #KSI_receivePublicationsFile returns the cached file
+ * without accessing the network. Otherwise the download is conditional (\c If-None-Match and
+ * \c If-Modified-Since), and the PKI signature of the file is verified only if its content has changed.
+ * \param[in]	ctx		KSI context.
+ * \param[in]	dir		Existing directory, or \c NULL to disable the cache (default).
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note A file marked as verified in the cache is not verified again by #KSI_verifyPublicationsFile, thus the
+ * directory must not be writable by untrusted users.
+ * \note The verification state is bound to the trust configuration of the context that verified the file: the
+ * identity of the PKI truststore (see #KSI_PKITruststore_getIdentity) and the publications file certificate
+ * constraints. A context with a different truststore or different constraints verifies the file again, thus
+ * the cache does not have to be cleared when these are changed. The lookup directories of the truststore are
+ * identified by their paths only; if certificates are added to or removed from a lookup directory (or the
+ * system default locations), the cache should be cleared.
+ */
+int KSI_CTX_setPublicationsFileCacheDir(KSI_CTX *ctx, const char *dir);
+
 /**
  * Configuration method for the extender.
  * \param[in]	ctx		KSI context.
@@ -815,6 +1003,26 @@ KSI_FN_DEPRECATED(int KSI_CTX_setPublicationCertEmail(KSI_CTX *ctx, const char *
  */
 int KSI_CTX_setDefaultPubFileCertConstraints(KSI_CTX *ctx, const KSI_CertConstraint *arr);
 
+/**
+ * Setter for the executor of the batch operations (e.g. #KSI_verifySignatures). The context takes
+ * ownership of the executor, which is freed together with the context. If not set, the batch
+ * operations are processed by the calling thread.
+ * \param[in]	ctx		KSI context.
+ * \param[in]	exec	The executor (can be \c NULL).
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \see #KSI_Executor_new, #KSI_Executor_newWithSubmitter
+ */
+int KSI_CTX_setExecutor(KSI_CTX *ctx, KSI_Executor *exec);
+
+/**
+ * Getter for the executor of the batch operations.
+ * \param[in]	ctx		KSI context.
+ * \param[out]	exec	Pointer to the receiving pointer, \c NULL if no executor is set.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The user may not free the output pointer, as it belongs to the context.
+ */
+int KSI_CTX_getExecutor(KSI_CTX *ctx, KSI_Executor **exec);
+
 /**
  * Getter function for the PKI truststore object.
  * \param[in]	ctx		KSI context.
@@ -0,0 +1,722 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include "internal.h"
+#include "local_aggregator.h"
+#include "blocksigner.h"
+#include "impl/thread_impl.h"
+
+/** Interval of polling the signing service while waiting for a signature. */
+#define KSI_LOCAL_AGGREGATOR_POLL_MS 1
+
+/**
+ * The aggregator lock. It is shared with the trees, as the handles may outlive the aggregator.
+ */
+typedef struct LocalAggregatorLock_st {
+	size_t ref;
+	KSI_Mutex mutex;
+} LocalAggregatorLock;
+
+/**
+ * A single aggregation tree and the state of its root hash signing request.
+ */
+typedef struct LocalAggregatorBlock_st {
+	KSI_CTX *ctx;
+	size_t ref;
+
+	KSI_BlockSigner *signer;
+	size_t leafCount;
+
+	/** Root hash value of the closed tree, until it has been handed over to the signing service. */
+	KSI_DataHash *rootHash;
+	KSI_uint64_t rootLevel;
+
+	/** Block state (#KSI_AsyncHandleState). */
+	int state;
+	int err;
+	/** Guards the block state, see #KSI_LocalAggregator_st.lock. */
+	LocalAggregatorLock *lock;
+} LocalAggregatorBlock;
+
+struct KSI_LocalAggregator_st {
+	KSI_CTX *ctx;
+	KSI_AsyncService *service;
+	KSI_HashAlgorithm algoId;
+
+	size_t maxLeafCount;
+	size_t flushWindow;
+
+	/** The tree currently open for new leafs. */
+	LocalAggregatorBlock *current;
+	/** Monotonic time (in microseconds) when the first leaf was added to the current tree. */
+	unsigned long long openedAt;
+
+	/** Closed trees that have not been signed yet. */
+	KSI_List *blocks;
+
+	/** Nof document hashes waiting for a signature. */
+	size_t waiting;
+
+	/** Guards the trees and the block states against concurrent access. */
+	LocalAggregatorLock *lock;
+	/** Signalled when a run round has been completed. */
+	KSI_Cond roundDone;
+	/** Set while a thread is communicating with the signing service. */
+	bool running;
+	/** Set when the condition variable has been initialized. */
+	bool syncInit;
+};
+
+struct KSI_LocalAggregatorHandle_st {
+	KSI_CTX *ctx;
+	KSI_BlockSignerHandle *leaf;
+	LocalAggregatorBlock *block;
+};
+
+static void LocalAggregatorLock_free(LocalAggregatorLock *lock) {
+	if (lock != NULL && KSI_ATOMIC_DEC_REF(&lock->ref) == 0) {
+		KSI_Mutex_destroy(&lock->mutex);
+		KSI_free(lock);
+	}
+}
+
+static int LocalAggregatorLock_new(LocalAggregatorLock **lock) {
+	int res = KSI_UNKNOWN_ERROR;
+	LocalAggregatorLock *tmp = NULL;
+
+	tmp = KSI_new(LocalAggregatorLock);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = KSI_Mutex_init(&tmp->mutex);
+	if (res != KSI_OK) goto cleanup;
+	tmp->ref = 1;
+
+	*lock = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmp);
+
+	return res;
+}
+
+/* The blocks are shared between the aggregator and the handles, which may be released by any thread. */
+static LocalAggregatorBlock *LocalAggregatorBlock_ref(LocalAggregatorBlock *block) {
+	if (block != NULL) KSI_ATOMIC_INC_REF(&block->ref);
+	return block;
+}
+
+static void LocalAggregatorBlock_free(LocalAggregatorBlock *block) {
+	if (block != NULL && KSI_ATOMIC_DEC_REF(&block->ref) == 0) {
+		KSI_BlockSigner_free(block->signer);
+		KSI_DataHash_free(block->rootHash);
+		LocalAggregatorLock_free(block->lock);
+		KSI_free(block);
+	}
+}
+
+static int LocalAggregatorBlock_new(KSI_CTX *ctx, KSI_HashAlgorithm algoId, LocalAggregatorLock *lock, LocalAggregatorBlock **block) {
+	int res = KSI_UNKNOWN_ERROR;
+	LocalAggregatorBlock *tmp = NULL;
+
+	if (ctx == NULL || lock == NULL || block == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = KSI_new(LocalAggregatorBlock);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->ref = 1;
+	tmp->signer = NULL;
+	tmp->leafCount = 0;
+	tmp->rootHash = NULL;
+	tmp->rootLevel = 0;
+	tmp->state = KSI_ASYNC_STATE_WAITING_FOR_DISPATCH;
+	tmp->err = KSI_OK;
+	tmp->lock = lock;
+	KSI_ATOMIC_INC_REF(&lock->ref);
+
+	res = KSI_BlockSigner_new(ctx, algoId, NULL, NULL, &tmp->signer);
+	if (res != KSI_OK) goto cleanup;
+
+	*block = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	LocalAggregatorBlock_free(tmp);
+
+	return res;
+}
+
+static bool localAggregatorBlock_isFinal(const LocalAggregatorBlock *block) {
+	return block->state == KSI_ASYNC_STATE_RESPONSE_RECEIVED || block->state == KSI_ASYNC_STATE_ERROR;
+}
+
+static void localAggregator_finalizeBlock(KSI_LocalAggregator *la, LocalAggregatorBlock *block, int state, int err) {
+	/* The leafs of a block are only accounted once. */
+	if (localAggregatorBlock_isFinal(block)) return;
+
+	block->state = state;
+	block->err = err;
+	la->waiting -= block->leafCount;
+}
+
+int KSI_LocalAggregator_new(KSI_CTX *ctx, KSI_AsyncService *service, KSI_HashAlgorithm algoId, KSI_LocalAggregator **la) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LocalAggregator *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || service == NULL || la == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmTrusted(algoId)) {
+		KSI_pushError(ctx, res = KSI_UNTRUSTED_HASH_ALGORITHM, "The aggregation hash algorithm is no longer trusted.");
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_LocalAggregator);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->service = service;
+	tmp->algoId = algoId;
+	tmp->maxLeafCount = 0;
+	tmp->flushWindow = 0;
+	tmp->current = NULL;
+	tmp->openedAt = 0;
+	tmp->blocks = NULL;
+	tmp->waiting = 0;
+	tmp->running = false;
+	tmp->lock = NULL;
+	tmp->syncInit = false;
+
+	res = LocalAggregatorLock_new(&tmp->lock);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Cond_init(&tmp->roundDone);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+	tmp->syncInit = true;
+
+	res = KSI_List_new((void (*)(void *))LocalAggregatorBlock_free, &tmp->blocks);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*la = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_LocalAggregator_free(tmp);
+
+	return res;
+}
+
+void KSI_LocalAggregator_free(KSI_LocalAggregator *la) {
+	size_t i;
+
+	if (la == NULL) return;
+
+	/* The handles may outlive the aggregator. Make sure they do not wait for a signature forever. */
+	if (la->current != NULL) {
+		localAggregator_finalizeBlock(la, la->current, KSI_ASYNC_STATE_ERROR, KSI_INVALID_STATE);
+		LocalAggregatorBlock_free(la->current);
+	}
+
+	for (i = 0; i < KSI_List_length(la->blocks); i++) {
+		LocalAggregatorBlock *block = NULL;
+
+		if (KSI_List_elementAt(la->blocks, i, (void **)&block) != KSI_OK || block == NULL) continue;
+		/* Only the blocks still waiting for a signature are failed, the finalized ones keep their state. */
+		localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, KSI_INVALID_STATE);
+	}
+	KSI_List_free(la->blocks);
+
+	if (la->syncInit) KSI_Cond_destroy(&la->roundDone);
+	LocalAggregatorLock_free(la->lock);
+
+	KSI_free(la);
+}
+
+int KSI_LocalAggregator_setMaxLeafCount(KSI_LocalAggregator *la, size_t count) {
+	if (la == NULL) return KSI_INVALID_ARGUMENT;
+	la->maxLeafCount = count;
+	return KSI_OK;
+}
+
+int KSI_LocalAggregator_setFlushWindow(KSI_LocalAggregator *la, size_t usec) {
+	if (la == NULL) return KSI_INVALID_ARGUMENT;
+	la->flushWindow = usec;
+	return KSI_OK;
+}
+
+/* Closes the current tree. The caller must hold the aggregator lock. */
+static int localAggregator_flush(KSI_LocalAggregator *la) {
+	int res = KSI_UNKNOWN_ERROR;
+	LocalAggregatorBlock *block = NULL;
+
+	if (la->current == NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	block = la->current;
+	la->current = NULL;
+
+	res = KSI_BlockSigner_closeTree(block->signer, &block->rootHash, &block->rootLevel);
+	if (res != KSI_OK) {
+		KSI_pushError(la->ctx, res, NULL);
+		localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, res);
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(la->ctx, "Local aggregator closed a tree with %llu leafs.", (unsigned long long)block->leafCount);
+
+	res = KSI_List_append(la->blocks, block);
+	if (res != KSI_OK) {
+		KSI_pushError(la->ctx, res, NULL);
+		localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, res);
+		goto cleanup;
+	}
+	block = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	LocalAggregatorBlock_free(block);
+
+	return res;
+}
+
+int KSI_LocalAggregator_flush(KSI_LocalAggregator *la) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (la == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(la->ctx);
+
+	KSI_Mutex_lock(&la->lock->mutex);
+	res = localAggregator_flush(la);
+	KSI_Mutex_unlock(&la->lock->mutex);
+
+cleanup:
+
+	return res;
+}
+
+int KSI_LocalAggregator_add(KSI_LocalAggregator *la, KSI_DataHash *hsh, KSI_LocalAggregatorHandle **handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LocalAggregatorHandle *tmp = NULL;
+	bool locked = false;
+
+	if (la == NULL || hsh == NULL || handle == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(la->ctx);
+
+	KSI_Mutex_lock(&la->lock->mutex);
+	locked = true;
+
+	if (la->current == NULL) {
+		res = LocalAggregatorBlock_new(la->ctx, la->algoId, la->lock, &la->current);
+		if (res != KSI_OK) {
+			KSI_pushError(la->ctx, res, NULL);
+			goto cleanup;
+		}
+		la->openedAt = KSI_getMonotonicTimeUs();
+	}
+
+	tmp = KSI_new(KSI_LocalAggregatorHandle);
+	if (tmp == NULL) {
+		KSI_pushError(la->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = la->ctx;
+	tmp->leaf = NULL;
+	tmp->block = NULL;
+
+	res = KSI_BlockSigner_addLeaf(la->current->signer, hsh, 0, NULL, &tmp->leaf);
+	if (res != KSI_OK) {
+		KSI_pushError(la->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->block = LocalAggregatorBlock_ref(la->current);
+	la->current->leafCount++;
+	la->waiting++;
+
+	/* Close the tree if it is full. */
+	if (la->maxLeafCount != 0 && la->current->leafCount >= la->maxLeafCount) {
+		res = localAggregator_flush(la);
+		if (res != KSI_OK) {
+			KSI_pushError(la->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	*handle = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (locked) KSI_Mutex_unlock(&la->lock->mutex);
+	KSI_LocalAggregatorHandle_free(tmp);
+
+	return res;
+}
+
+static int localAggregator_submit(KSI_LocalAggregator *la) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncHandle *reqHandle = NULL;
+	size_t i;
+
+	for (i = 0; i < KSI_List_length(la->blocks); i++) {
+		LocalAggregatorBlock *block = NULL;
+		KSI_DataHash *rootRef = NULL;
+
+		res = KSI_List_elementAt(la->blocks, i, (void **)&block);
+		if (res != KSI_OK) goto cleanup;
+
+		if (block->state != KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) continue;
+
+		res = KSI_AsyncSigningHandle_new(la->ctx, (rootRef = KSI_DataHash_ref(block->rootHash)), block->rootLevel, &reqHandle);
+		if (res != KSI_OK) {
+			KSI_DataHash_free(rootRef);
+			goto cleanup;
+		}
+
+		res = KSI_AsyncHandle_setRequestCtx(reqHandle, LocalAggregatorBlock_ref(block), (void (*)(void *))LocalAggregatorBlock_free);
+		if (res != KSI_OK) {
+			LocalAggregatorBlock_free(block);
+			goto cleanup;
+		}
+
+		res = KSI_AsyncService_addRequest(la->service, reqHandle);
+		if (res == KSI_ASYNC_REQUEST_CACHE_FULL) {
+			/* Try again on the next round. */
+			break;
+		} else if (res != KSI_OK) {
+			KSI_LOG_error(la->ctx, "Local aggregator failed to send out the root hash value. Error: 0x%x.", res);
+			localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, res);
+			KSI_AsyncHandle_free(reqHandle);
+			reqHandle = NULL;
+			continue;
+		}
+		/* The service has taken ownership of the request handle. */
+		reqHandle = NULL;
+
+		block->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
+		KSI_DataHash_free(block->rootHash);
+		block->rootHash = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AsyncHandle_free(reqHandle);
+
+	return res;
+}
+
+static void localAggregator_handleResponse(KSI_LocalAggregator *la, KSI_AsyncHandle *respHandle) {
+	int res;
+	LocalAggregatorBlock *block = NULL;
+	KSI_Signature *sig = NULL;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	int err = KSI_OK;
+	size_t i;
+
+	if (KSI_AsyncHandle_getRequestCtx(respHandle, (const void **)&block) != KSI_OK || block == NULL) return;
+
+	/* Make sure the handle belongs to a block of this aggregator. */
+	for (i = 0; i < KSI_List_length(la->blocks); i++) {
+		void *tmp = NULL;
+		if (KSI_List_elementAt(la->blocks, i, &tmp) == KSI_OK && tmp == block) break;
+	}
+	if (i == KSI_List_length(la->blocks) || block->state != KSI_ASYNC_STATE_WAITING_FOR_RESPONSE) return;
+
+	KSI_AsyncHandle_getState(respHandle, &state);
+	switch (state) {
+		case KSI_ASYNC_STATE_RESPONSE_RECEIVED:
+			res = KSI_AsyncHandle_getSignature(respHandle, &sig);
+			if (res == KSI_OK) res = KSI_BlockSigner_setRootSignature(block->signer, sig);
+			if (res != KSI_OK) {
+				KSI_Signature_free(sig);
+				localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, res);
+				break;
+			}
+			localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_RESPONSE_RECEIVED, KSI_OK);
+			break;
+
+		case KSI_ASYNC_STATE_ERROR:
+			KSI_AsyncHandle_getError(respHandle, &err);
+			localAggregator_finalizeBlock(la, block, KSI_ASYNC_STATE_ERROR, err);
+			break;
+
+		default:
+			break;
+	}
+}
+
+int KSI_LocalAggregator_run(KSI_LocalAggregator *la, size_t *waiting) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncHandle *respHandle = NULL;
+	bool locked = false;
+	bool running = false;
+	size_t pending = 0;
+	size_t i;
+
+	if (la == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(la->ctx);
+
+	KSI_Mutex_lock(&la->lock->mutex);
+	locked = true;
+
+	/* Only one thread at a time may communicate with the signing service. */
+	while (la->running) KSI_Cond_wait(&la->roundDone, &la->lock->mutex);
+	la->running = running = true;
+
+	/* Close the current tree if the collecting window has elapsed. */
+	if (la->current != NULL &&
+			(la->flushWindow == 0 || KSI_getMonotonicTimeUs() - la->openedAt >= la->flushWindow)) {
+		res = localAggregator_flush(la);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = localAggregator_submit(la);
+	if (res != KSI_OK) {
+		KSI_pushError(la->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Do not block the threads adding new leafs while waiting for the responses. */
+	KSI_Mutex_unlock(&la->lock->mutex);
+	locked = false;
+
+	res = KSI_AsyncService_getPendingCount(la->service, &pending);
+	if (res != KSI_OK) {
+		KSI_pushError(la->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Process all the responses that are available. The service is not polled if nothing has been sent out. */
+	while (pending > 0) {
+		KSI_AsyncHandle_free(respHandle);
+		respHandle = NULL;
+
+		res = KSI_AsyncService_run(la->service, &respHandle, NULL);
+		if (res != KSI_OK) {
+			KSI_pushError(la->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (respHandle != NULL) {
+			KSI_Mutex_lock(&la->lock->mutex);
+			localAggregator_handleResponse(la, respHandle);
+			KSI_Mutex_unlock(&la->lock->mutex);
+		} else {
+			break;
+		}
+	}
+
+	KSI_Mutex_lock(&la->lock->mutex);
+	locked = true;
+
+	/* Release the finalized blocks. */
+	i = 0;
+	while (i < KSI_List_length(la->blocks)) {
+		LocalAggregatorBlock *block = NULL;
+
+		res = KSI_List_elementAt(la->blocks, i, (void **)&block);
+		if (res != KSI_OK) goto cleanup;
+
+		if (localAggregatorBlock_isFinal(block)) {
+			res = KSI_List_remove(la->blocks, i, NULL);
+			if (res != KSI_OK) goto cleanup;
+		} else {
+			i++;
+		}
+	}
+
+	if (waiting != NULL) *waiting = la->waiting;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (running) {
+		if (!locked) KSI_Mutex_lock(&la->lock->mutex);
+		locked = true;
+		la->running = false;
+		KSI_Cond_broadcast(&la->roundDone);
+	}
+	if (locked) KSI_Mutex_unlock(&la->lock->mutex);
+	KSI_AsyncHandle_free(respHandle);
+
+	return res;
+}
+
+int KSI_LocalAggregator_wait(KSI_LocalAggregator *la, const KSI_LocalAggregatorHandle *handle, int *state) {
+	int res = KSI_UNKNOWN_ERROR;
+	bool locked = false;
+
+	if (la == NULL || handle == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(la->ctx);
+
+	KSI_Mutex_lock(&la->lock->mutex);
+	locked = true;
+
+	while (!localAggregatorBlock_isFinal(handle->block)) {
+		if (la->running) {
+			/* Another thread is processing the responses, wait for it to complete the round. */
+			KSI_Cond_wait(&la->roundDone, &la->lock->mutex);
+			continue;
+		}
+
+		/* Nobody is processing the responses, so do it on the calling thread. */
+		KSI_Mutex_unlock(&la->lock->mutex);
+		locked = false;
+
+		res = KSI_LocalAggregator_run(la, NULL);
+		if (res != KSI_OK) {
+			KSI_pushError(la->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_Mutex_lock(&la->lock->mutex);
+		locked = true;
+
+		/* Give the service some time to receive the response, before polling it again. */
+		if (!localAggregatorBlock_isFinal(handle->block) && !la->running) {
+			KSI_Cond_timedWait(&la->roundDone, &la->lock->mutex, KSI_LOCAL_AGGREGATOR_POLL_MS);
+		}
+	}
+
+	if (state != NULL) *state = handle->block->state;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (locked) KSI_Mutex_unlock(&la->lock->mutex);
+
+	return res;
+}
+
+int KSI_LocalAggregatorHandle_getState(const KSI_LocalAggregatorHandle *handle, int *state) {
+	if (handle == NULL || state == NULL) return KSI_INVALID_ARGUMENT;
+	KSI_Mutex_lock(&handle->block->lock->mutex);
+	*state = handle->block->state;
+	KSI_Mutex_unlock(&handle->block->lock->mutex);
+	return KSI_OK;
+}
+
+int KSI_LocalAggregatorHandle_getError(const KSI_LocalAggregatorHandle *handle, int *error) {
+	if (handle == NULL || error == NULL) return KSI_INVALID_ARGUMENT;
+	KSI_Mutex_lock(&handle->block->lock->mutex);
+	*error = handle->block->err;
+	KSI_Mutex_unlock(&handle->block->lock->mutex);
+	return KSI_OK;
+}
+
+int KSI_LocalAggregatorHandle_getSignature(const KSI_LocalAggregatorHandle *handle, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	int state;
+
+	if (handle == NULL || sig == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(handle->ctx);
+
+	/* The root signature is not changed after the block has been finalized. */
+	KSI_LocalAggregatorHandle_getState(handle, &state);
+	if (state != KSI_ASYNC_STATE_RESPONSE_RECEIVED) {
+		KSI_pushError(handle->ctx, res = KSI_INVALID_STATE, "The root hash value has not been signed.");
+		goto cleanup;
+	}
+
+	res = KSI_BlockSignerHandle_getSignature(handle->leaf, sig);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+void KSI_LocalAggregatorHandle_free(KSI_LocalAggregatorHandle *handle) {
+	if (handle != NULL) {
+		KSI_BlockSignerHandle_free(handle->leaf);
+		LocalAggregatorBlock_free(handle->block);
+		KSI_free(handle);
+	}
+}
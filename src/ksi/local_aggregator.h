@@ -0,0 +1,170 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef LOCAL_AGGREGATOR_H_
+#define LOCAL_AGGREGATOR_H_
+
+#include "ksi.h"
+#include "net_async.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * \addtogroup localAggregator Local Aggregation
+	 * The local aggregator collects document hashes arriving within a short time window into an
+	 * aggregation tree (see #KSI_BlockSigner) and sends only the root hash value of the tree to the
+	 * aggregator via #KSI_AsyncService. Every added document hash is given a handle, which can be
+	 * used to retrieve a signature once the root hash value has been signed.
+	 * \note The local aggregator may be shared between threads: several threads may add document hashes
+	 * and wait for their signatures (see #KSI_LocalAggregator_wait) concurrently. Only one thread at a time
+	 * communicates with the signing service, the others are blocked until the round is completed. The
+	 * signing service and the KSI context must not be used by other threads meanwhile.
+	 * @{
+	 */
+
+	typedef struct KSI_LocalAggregator_st KSI_LocalAggregator;
+	typedef struct KSI_LocalAggregatorHandle_st KSI_LocalAggregatorHandle;
+
+	/**
+	 * Create a new instance of #KSI_LocalAggregator.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	service		Signing service used for signing the root hash values.
+	 * \param[in]	algoId		Algorithm to be used for the internal hash node computation.
+	 * \param[out]	la			Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The local aggregator does not take ownership of \c service, thus it may not be freed before
+	 * the aggregator. The service should not be used for other requests while it is attached to the aggregator.
+	 * \see #KSI_SigningAsyncService_new for creating the signing service.
+	 */
+	int KSI_LocalAggregator_new(KSI_CTX *ctx, KSI_AsyncService *service, KSI_HashAlgorithm algoId, KSI_LocalAggregator **la);
+
+	/**
+	 * Cleanup method for the #KSI_LocalAggregator.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \note The handles still waiting for a signature are set into #KSI_ASYNC_STATE_ERROR state, the
+	 * handles that have already been finalized keep their state.
+	 */
+	void KSI_LocalAggregator_free(KSI_LocalAggregator *la);
+
+	/**
+	 * Setter for the maximum number of leafs in a single aggregation tree. If the limit is reached,
+	 * the tree is closed and its root hash value is sent out for signing.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \param[in]	count		Maximum leaf count. Value 0 means no limit (default).
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LocalAggregator_setMaxLeafCount(KSI_LocalAggregator *la, size_t count);
+
+	/**
+	 * Setter for the time window during which the added document hashes are collected into the same
+	 * aggregation tree. The window is started when the first document hash is added to the tree.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \param[in]	usec		Time window in microseconds. Value 0 means that the tree is closed on
+	 * 							every call to #KSI_LocalAggregator_run (default).
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LocalAggregator_setFlushWindow(KSI_LocalAggregator *la, size_t usec);
+
+	/**
+	 * Add a document hash to the current aggregation tree.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \param[in]	hsh			Document hash.
+	 * \param[out]	handle		Handle for retrieving the signature of \c hsh.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The function does not take ownership of \c hsh, it is the responsibility of the caller to
+	 * free the object.
+	 * \see #KSI_LocalAggregatorHandle_free for cleaning up the handle.
+	 */
+	int KSI_LocalAggregator_add(KSI_LocalAggregator *la, KSI_DataHash *hsh, KSI_LocalAggregatorHandle **handle);
+
+	/**
+	 * Closes the current aggregation tree regardless of the time window and the leaf count, and queues its
+	 * root hash value for signing.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LocalAggregator_flush(KSI_LocalAggregator *la);
+
+	/**
+	 * Closes the current aggregation tree if the time window or the leaf count limit has been reached,
+	 * sends out the queued root hash values and processes the received responses. The state of the
+	 * affected handles is updated accordingly.
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \param[out]	waiting		Number of document hashes waiting for a signature (can be \c NULL).
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LocalAggregator_run(KSI_LocalAggregator *la, size_t *waiting);
+
+	/**
+	 * Blocks the calling thread until the root hash value of the tree containing the handle's document
+	 * hash has been signed or the signing has failed. If no other thread is running the aggregator, the
+	 * responses are processed on the calling thread (see #KSI_LocalAggregator_run).
+	 * \param[in]	la			Instance of the #KSI_LocalAggregator.
+	 * \param[in]	handle		Handle returned by #KSI_LocalAggregator_add.
+	 * \param[out]	state		Final handle state #KSI_AsyncHandleState (can be \c NULL).
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The tree is closed according to the time window and leaf count limit, thus the time window
+	 * should be set, if several threads are expected to add document hashes into the same tree.
+	 */
+	int KSI_LocalAggregator_wait(KSI_LocalAggregator *la, const KSI_LocalAggregatorHandle *handle, int *state);
+
+	/**
+	 * Get the state of the handle.
+	 * \param[in]	handle		Instance of the #KSI_LocalAggregatorHandle.
+	 * \param[out]	state		Handle state #KSI_AsyncHandleState.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The state may be read while other threads are running the aggregator, but to block until
+	 * the state is final, use #KSI_LocalAggregator_wait instead of polling.
+	 */
+	int KSI_LocalAggregatorHandle_getState(const KSI_LocalAggregatorHandle *handle, int *state);
+
+	/**
+	 * Get the error code for the handle which state is #KSI_ASYNC_STATE_ERROR.
+	 * \param[in]	handle		Instance of the #KSI_LocalAggregatorHandle.
+	 * \param[out]	error		Handle error #KSI_StatusCode.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LocalAggregatorHandle_getError(const KSI_LocalAggregatorHandle *handle, int *error);
+
+	/**
+	 * Creates a signature for the document hash associated with the handle.
+	 * \param[in]	handle		Instance of the #KSI_LocalAggregatorHandle.
+	 * \param[out]	sig			Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The signature will only be returned if the handle state is #KSI_ASYNC_STATE_RESPONSE_RECEIVED.
+	 */
+	int KSI_LocalAggregatorHandle_getSignature(const KSI_LocalAggregatorHandle *handle, KSI_Signature **sig);
+
+	/**
+	 * Cleanup method for the handle.
+	 * \param[in]	handle		Instance of the #KSI_LocalAggregatorHandle.
+	 */
+	void KSI_LocalAggregatorHandle_free(KSI_LocalAggregatorHandle *handle);
+
+	/**
+	 * @}
+	 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOCAL_AGGREGATOR_H_ */
@@ -21,10 +21,33 @@
 #include <string.h>
 #include <time.h>
 
+/* Implements the logging functions shadowed by the level check macros of internal.h. */
+#define KSI_LOG_NO_LEVEL_CHECK
+
 #include "internal.h"
 #include "impl/ctx_impl.h"
 #include "tlv.h"
 
+/** Marks a ring buffer record being written. */
+#define RING_RECORD_BUSY (~(KSI_uint64_t)0)
+
+typedef struct RingRecord_st {
+	/** Sequence number of the record, 0 if empty or #RING_RECORD_BUSY. */
+	KSI_uint64_t seq;
+	KSI_uint64_t time;
+	int level;
+	char message[KSI_LOG_RING_MESSAGE_LEN];
+} RingRecord;
+
+struct KSI_LOG_RingBuffer_st {
+	KSI_CTX *ctx;
+	/** Sequence number of the last reserved record. */
+	KSI_uint64_t next;
+	KSI_uint64_t dropped;
+	size_t mask;
+	RingRecord *records;
+};
+
 static const char *level2str(int level) {
 	switch (level) {
 		case KSI_LOG_DEBUG: return "DEBUG";
@@ -36,9 +59,20 @@ static const char *level2str(int level) {
 	}
 }
 
+int KSI_LOG_isEnabled(const KSI_CTX *ctx, int level) {
+	return ctx != NULL && ctx->loggerCB != NULL && level <= ctx->logLevel;
+}
+
+/* Kept apart from writeLog, so the message buffer is not reserved for the disabled levels. */
+static int formatLog(KSI_CTX *ctx, int logLevel, char *format, va_list va) {
+	char msg[0xffff + 1024];
+
+	KSI_vsnprintf(msg, sizeof(msg), format, va);
+	return ctx->loggerCB(ctx->loggerCtx, logLevel, msg);
+}
+
 static int writeLog(KSI_CTX *ctx, int logLevel, char *format, va_list va) {
 	int res = KSI_UNKNOWN_ERROR;
-	char msg[0xffff + 1024];
 
 	if (ctx == NULL) {
 		res = KSI_OK;
@@ -49,14 +83,13 @@ static int writeLog(KSI_CTX *ctx, int logLevel, char *format, va_list va) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
-	if (ctx->loggerCB == NULL || ctx->logLevel < logLevel) {
+	if (!KSI_LOG_isEnabled(ctx, logLevel)) {
 		/* Do not perform logging. */
 		res = KSI_OK;
 		goto cleanup;
 	}
 
-	KSI_vsnprintf(msg, sizeof(msg), format, va);
-	res = ctx->loggerCB(ctx->loggerCtx, logLevel, msg);
+	res = formatLog(ctx, logLevel, format, va);
 	if (res != KSI_OK) goto cleanup;
 
 	res = KSI_OK;
@@ -103,7 +136,10 @@ static int logBlob(KSI_CTX *ctx, int level, const char *prefix, const unsigned c
 		goto cleanup;
 	}
 
-	if (level > ctx->logLevel) goto cleanup;
+	if (!KSI_LOG_isEnabled(ctx, level)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
 
 	logStr_size = data_len * 2 + 1;
 
@@ -144,7 +180,10 @@ int KSI_LOG_logBlob(KSI_CTX *ctx, int level, const char *prefix_format, const un
 		goto cleanup;
 	}
 
-	if (level > ctx->logLevel) goto cleanup;
+	if (!KSI_LOG_isEnabled(ctx, level)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
 
 	if (prefix_format != NULL) {
 		va_list va;
@@ -161,23 +200,28 @@ cleanup:
 	return res;
 }
 
+static int logTlv(KSI_CTX *ctx, int level, const char *prefix, const KSI_TLV *tlv) {
+	char serialized[0x1ffff];
+
+	KSI_TLV_toString(tlv, serialized, sizeof(serialized));
+	return KSI_LOG_log(ctx, level, "%s:\n%s", prefix, serialized);
+}
+
 int KSI_LOG_logTlv(KSI_CTX *ctx, int level, const char *prefix, const KSI_TLV *tlv) {
 	int res = KSI_UNKNOWN_ERROR;
-	char serialized[0x1ffff];
 
 	if (ctx == NULL) {
 		res = KSI_OK;
 		goto cleanup;
 	}
 
-	if (level > ctx->logLevel) {
+	if (!KSI_LOG_isEnabled(ctx, level)) {
 		res = KSI_OK;
 		goto cleanup;
 	}
 
 	if (tlv != NULL) {
-		KSI_TLV_toString(tlv, serialized, sizeof(serialized));
-		res = KSI_LOG_log(ctx, level, "%s:\n%s", prefix, serialized);
+		res = logTlv(ctx, level, prefix, tlv);
 	} else {
 		res = KSI_LOG_log(ctx, level, "%s:\n%s", prefix, "(null)");
 	}
@@ -201,7 +245,7 @@ int KSI_LOG_logDataHash(KSI_CTX *ctx, int level, const char *prefix, const KSI_D
 		goto cleanup;
 	}
 
-	if (level > ctx->logLevel) {
+	if (!KSI_LOG_isEnabled(ctx, level)) {
 		res = KSI_OK;
 		goto cleanup;
 	}
@@ -227,6 +271,7 @@ cleanup:
 }
 
 int KSI_LOG_logCtxError(KSI_CTX *ctx, int level) {
+	KSI_ThreadState *stack = NULL;
 	KSI_ERR *err = NULL;
 	unsigned int i;
 	int res = KSI_UNKNOWN_ERROR;
@@ -236,24 +281,26 @@ int KSI_LOG_logCtxError(KSI_CTX *ctx, int level) {
 		goto cleanup;
 	}
 
-	if (level > ctx->logLevel) {
+	if (!KSI_LOG_isEnabled(ctx, level)) {
 		res = KSI_OK;
 		goto cleanup;
 	}
+	stack = KSI_CTX_getThreadState(ctx, 0);
+
 	KSI_LOG_log(ctx, level, "KSI error trace:");
-	if (ctx->errors_count == 0) {
+	if (stack == NULL || stack->count == 0) {
 		KSI_LOG_log(ctx, level, "  No errors.");
 		goto cleanup;
 	}
 
 	/* List all errors, starting from the most general. */
-	for (i = 0; i < ctx->errors_count && i < ctx->errors_size; i++) {
-		err = ctx->errors + ((ctx->errors_count - i - 1) % ctx->errors_size);
-		KSI_LOG_log(ctx, level, "  %3u) %s:%u - (%d/%ld) %s", ctx->errors_count - i, err->fileName, err->lineNr,err->statusCode, err->extErrorCode, err->message);
+	for (i = 0; i < stack->count && i < KSI_ERR_STACK_LEN; i++) {
+		err = stack->errors + ((stack->count - i - 1) % KSI_ERR_STACK_LEN);
+		KSI_LOG_log(ctx, level, "  %3u) %s:%u - (%d/%ld) %s", (unsigned)(stack->count - i), err->fileName, err->lineNr,err->statusCode, err->extErrorCode, err->message);
 	}
 
 	/* If there where more errors than buffers for the errors, indicate the fact. */
-	if (ctx->errors_count > ctx->errors_size) {
+	if (stack->count > KSI_ERR_STACK_LEN) {
 		KSI_LOG_log(ctx, level, "  ... (more errors)");
 	}
 
@@ -266,22 +313,150 @@ cleanup:
 
 int KSI_LOG_StreamLogger(void *logCtx, int logLevel, const char *message) {
 	char time_buf[32];
-	struct tm *tm_info;
+	struct tm tm_info;
 	time_t timer;
 	FILE *f = (FILE *) logCtx;
 
 	timer = time(NULL);
 
-	tm_info = localtime(&timer);
-	if (tm_info == NULL) {
+	/* The logger may be called by several threads at once. */
+	if (localtime_r(&timer, &tm_info) == NULL) {
 		return KSI_UNKNOWN_ERROR;
 	}
 
 	if (f != NULL) {
-		strftime(time_buf, sizeof(time_buf), "%d.%m.%Y %H:%M:%S", tm_info);
+		strftime(time_buf, sizeof(time_buf), "%d.%m.%Y %H:%M:%S", &tm_info);
 		fprintf(f, "%s [%s] - %s\n", level2str(logLevel), time_buf, message);
 	}
 
 	return KSI_OK;
 }
 
+int KSI_LOG_RingBuffer_new(KSI_CTX *ctx, size_t capacity, KSI_LOG_RingBuffer **ring) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LOG_RingBuffer *tmp = NULL;
+	size_t size = 1;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || capacity == 0 || ring == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/* The capacity is a power of two, so the record of a sequence number is found by masking. */
+	while (size < capacity) {
+		if (size > ((size_t)-1) / 2 / sizeof(RingRecord)) {
+			KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Ring buffer capacity too large.");
+			goto cleanup;
+		}
+		size *= 2;
+	}
+
+	tmp = KSI_new(KSI_LOG_RingBuffer);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->next = 0;
+	tmp->dropped = 0;
+	tmp->mask = size - 1;
+	tmp->records = KSI_calloc(size, sizeof(RingRecord));
+	if (tmp->records == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	*ring = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_LOG_RingBuffer_free(tmp);
+
+	return res;
+}
+
+void KSI_LOG_RingBuffer_free(KSI_LOG_RingBuffer *ring) {
+	if (ring != NULL) {
+		KSI_free(ring->records);
+		KSI_free(ring);
+	}
+}
+
+int KSI_LOG_RingBufferLogger(void *logCtx, int logLevel, const char *message) {
+	KSI_LOG_RingBuffer *ring = logCtx;
+	RingRecord *rec = NULL;
+	KSI_uint64_t seq;
+	KSI_uint64_t prev;
+	size_t len;
+
+	if (ring == NULL || message == NULL) return KSI_INVALID_ARGUMENT;
+
+	seq = KSI_ATOMIC_INC64(&ring->next);
+	rec = &ring->records[(size_t)(seq - 1) & ring->mask];
+
+	/* Claim the record. If a writer that wrapped around the buffer still holds it, or has
+	 * already stored a newer message, the message is dropped instead of waiting. */
+	prev = KSI_ATOMIC_LOAD64(&rec->seq);
+	if (prev == RING_RECORD_BUSY || prev > seq || !KSI_ATOMIC_CAS64(&rec->seq, prev, RING_RECORD_BUSY)) {
+		KSI_ATOMIC_INC64(&ring->dropped);
+		return KSI_OK;
+	}
+
+	len = strlen(message);
+	if (len > sizeof(rec->message) - 1) len = sizeof(rec->message) - 1;
+
+	rec->time = (KSI_uint64_t)time(NULL);
+	rec->level = logLevel;
+	memcpy(rec->message, message, len);
+	rec->message[len] = '\0';
+
+	/* Publish the record. */
+	KSI_ATOMIC_STORE64(&rec->seq, seq);
+
+	return KSI_OK;
+}
+
+int KSI_LOG_RingBuffer_read(KSI_LOG_RingBuffer *ring, KSI_LOG_RingBufferReader reader, void *readCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_uint64_t last;
+	KSI_uint64_t seq;
+	RingRecord copy;
+
+	if (ring == NULL || reader == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	last = KSI_ATOMIC_LOAD64(&ring->next);
+	seq = last > ring->mask ? last - ring->mask : 1;
+
+	for (; seq <= last; seq++) {
+		const RingRecord *rec = &ring->records[(size_t)(seq - 1) & ring->mask];
+
+		/* Copy the record and check it was not overwritten meanwhile. */
+		if (KSI_ATOMIC_LOAD64(&rec->seq) != seq) continue;
+		memcpy(&copy, rec, sizeof(copy));
+		KSI_ATOMIC_FENCE();
+		if (KSI_ATOMIC_LOAD64(&rec->seq) != seq) continue;
+
+		copy.message[sizeof(copy.message) - 1] = '\0';
+
+		res = reader(readCtx, seq, copy.time, copy.level, copy.message);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+KSI_uint64_t KSI_LOG_RingBuffer_getDropped(const KSI_LOG_RingBuffer *ring) {
+	return ring == NULL ? 0 : KSI_ATOMIC_LOAD64(&ring->dropped);
+}
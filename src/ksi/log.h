@@ -159,6 +159,76 @@ extern "C" {
 	 */
 	int KSI_LOG_StreamLogger(void *logCtx, int logLevel, const char *message);
 
+	/**
+	 * Checks if a message of the given level would be passed to the logger callback. Use it to
+	 * skip preparing the arguments of a log statement when the level is disabled.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	level		Log level.
+	 * \return Non-zero if the logger callback is set and the level is enabled, 0 otherwise.
+	 */
+	int KSI_LOG_isEnabled(const KSI_CTX *ctx, int level);
+
+	/**
+	 * Function called by #KSI_LOG_RingBuffer_read for every record, oldest first.
+	 * \param[in]	readCtx		The context passed to #KSI_LOG_RingBuffer_read.
+	 * \param[in]	seq			Sequence number of the record, starting from 1.
+	 * \param[in]	time		Time of the record in seconds since the epoch.
+	 * \param[in]	level		Log level.
+	 * \param[in]	message		The message, truncated to #KSI_LOG_RING_MESSAGE_LEN - 1 bytes.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	typedef int (*KSI_LOG_RingBufferReader)(void *readCtx, KSI_uint64_t seq, KSI_uint64_t time, int level, const char *message);
+
+	/** Size of the message buffer of a ring buffer record, including the terminating zero. */
+	#define KSI_LOG_RING_MESSAGE_LEN 232
+
+	/**
+	 * Creates a ring buffer for capturing high-volume debug logs in production. The records are kept
+	 * in binary form in a preallocated buffer, overwriting the oldest ones, and are written without
+	 * locks or I/O. Set #KSI_LOG_RingBufferLogger as the logger callback with the ring buffer as its
+	 * context and read the captured records with #KSI_LOG_RingBuffer_read, e.g. after a failure.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	capacity	Number of the records kept, rounded up to a power of two.
+	 * \param[out]	ring		Pointer to the receiving pointer.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LOG_RingBuffer_new(KSI_CTX *ctx, size_t capacity, KSI_LOG_RingBuffer **ring);
+
+	/**
+	 * Frees the ring buffer. The ring buffer must not be used as a logger context any more.
+	 * \param[in]	ring		The ring buffer.
+	 */
+	void KSI_LOG_RingBuffer_free(KSI_LOG_RingBuffer *ring);
+
+	/**
+	 * Logger callback storing the message into the ring buffer passed as \c logCtx. May be called
+	 * from several threads at once; if two threads contend for the same record, the older message
+	 * is dropped (see #KSI_LOG_RingBuffer_getDropped).
+	 * \param[in]	logCtx		The ring buffer.
+	 * \param[in]	logLevel	Log level.
+	 * \param[in]	message		Formatted log message.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \see #KSI_CTX_setLoggerCallback, #KSI_LoggerCallback
+	 */
+	int KSI_LOG_RingBufferLogger(void *logCtx, int logLevel, const char *message);
+
+	/**
+	 * Calls \c reader for the records of the ring buffer, oldest first. The records overwritten
+	 * while reading are skipped. Stops at the first error returned by the reader.
+	 * \param[in]	ring		The ring buffer.
+	 * \param[in]	reader		Function receiving the records.
+	 * \param[in]	readCtx		Context of the reader.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_LOG_RingBuffer_read(KSI_LOG_RingBuffer *ring, KSI_LOG_RingBufferReader reader, void *readCtx);
+
+	/**
+	 * Getter for the number of the messages dropped due to concurrent writers.
+	 * \param[in]	ring		The ring buffer.
+	 * \return The number of the dropped messages.
+	 */
+	KSI_uint64_t KSI_LOG_RingBuffer_getDropped(const KSI_LOG_RingBuffer *ring);
+
 /**
  * @}
  */
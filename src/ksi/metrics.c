@@ -0,0 +1,166 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "metrics.h"
+#include "impl/ctx_impl.h"
+#include "impl/net_async_impl.h"
+
+static void reportMetrics(KSI_CTX *ctx) {
+	KSI_MetricsCallback cb = ctx->metricsCallback;
+	KSI_MetricsSnapshot snapshot;
+	KSI_uint64_t now;
+	KSI_uint64_t at;
+
+	if (cb == NULL) return;
+
+	now = KSI_getMonotonicTimeUs();
+	at = KSI_ATOMIC_LOAD64(&ctx->metricsReportAt);
+
+	/* Only the thread moving the time of the next report forward invokes the callback. */
+	if (now < at || !KSI_ATOMIC_CAS64(&ctx->metricsReportAt, at, now + ctx->metricsInterval)) return;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	KSI_Metrics_addToSnapshot(&ctx->metrics, &snapshot);
+
+	cb(ctx->metricsCallbackCtx, &snapshot);
+}
+
+void KSI_Metrics_count(KSI_CTX *ctx, KSI_Metrics *service, KSI_MetricCounter counter, KSI_uint64_t value) {
+	if (ctx == NULL || counter >= KSI_NUMBER_OF_METRIC_COUNTERS) return;
+
+	KSI_ATOMIC_ADD64(&ctx->metrics.counters[counter], value);
+	if (service != NULL) KSI_ATOMIC_ADD64(&service->counters[counter], value);
+
+	reportMetrics(ctx);
+}
+
+void KSI_Metrics_latency(KSI_CTX *ctx, KSI_Metrics *service, KSI_MetricHistogram histogram, unsigned long long us) {
+	size_t bucket = 0;
+
+	if (ctx == NULL || histogram >= KSI_NUMBER_OF_METRIC_HISTOGRAMS) return;
+
+	/* The bucket is the bit length of the latency. */
+	while (us > 0 && bucket < KSI_METRIC_LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	KSI_ATOMIC_ADD64(&ctx->metrics.latency[histogram][bucket], 1);
+	if (service != NULL) KSI_ATOMIC_ADD64(&service->latency[histogram][bucket], 1);
+}
+
+static void countErrorCode(KSI_Metrics *metrics, int err) {
+	KSI_uint64_t code = (KSI_uint64_t)(unsigned)err + 1;
+	size_t i;
+
+	for (i = 0; i < KSI_METRIC_ERROR_CODES; i++) {
+		KSI_uint64_t slot = KSI_ATOMIC_LOAD64(&metrics->errorCodes[i]);
+
+		if (slot == 0) {
+			if (KSI_ATOMIC_CAS64(&metrics->errorCodes[i], (KSI_uint64_t)0, code)) slot = code;
+			else slot = KSI_ATOMIC_LOAD64(&metrics->errorCodes[i]);
+		}
+		if (slot == code) {
+			KSI_ATOMIC_ADD64(&metrics->errorCounts[i], 1);
+			return;
+		}
+	}
+	/* All the slots are taken, the failure is only counted by the total. */
+}
+
+void KSI_Metrics_error(KSI_CTX *ctx, KSI_Metrics *service, int err) {
+	if (ctx == NULL) return;
+
+	countErrorCode(&ctx->metrics, err);
+	if (service != NULL) countErrorCode(service, err);
+
+	KSI_Metrics_count(ctx, service, KSI_METRIC_ERRORS, 1);
+}
+
+void KSI_Metrics_addToSnapshot(const KSI_Metrics *metrics, KSI_MetricsSnapshot *snapshot) {
+	size_t i;
+	size_t j;
+
+	if (metrics == NULL || snapshot == NULL) return;
+
+	for (i = 0; i < KSI_NUMBER_OF_METRIC_COUNTERS; i++) {
+		snapshot->counters[i] += KSI_ATOMIC_LOAD64(&metrics->counters[i]);
+	}
+
+	for (i = 0; i < KSI_NUMBER_OF_METRIC_HISTOGRAMS; i++) {
+		for (j = 0; j < KSI_METRIC_LATENCY_BUCKETS; j++) {
+			snapshot->latency[i][j] += KSI_ATOMIC_LOAD64(&metrics->latency[i][j]);
+		}
+	}
+
+	for (i = 0; i < KSI_METRIC_ERROR_CODES; i++) {
+		KSI_uint64_t code = KSI_ATOMIC_LOAD64(&metrics->errorCodes[i]);
+		KSI_uint64_t count;
+
+		if (code == 0) break;
+		count = KSI_ATOMIC_LOAD64(&metrics->errorCounts[i]);
+
+		/* Merge with the entries of the other sources. */
+		for (j = 0; j < snapshot->errors_count; j++) {
+			if (snapshot->errors[j].code == (int)(code - 1)) break;
+		}
+		if (j == snapshot->errors_count) {
+			if (j == KSI_METRIC_ERROR_CODES) continue;
+			snapshot->errors[j].code = (int)(code - 1);
+			snapshot->errors[j].count = 0;
+			snapshot->errors_count++;
+		}
+		snapshot->errors[j].count += count;
+	}
+}
+
+int KSI_CTX_getMetrics(KSI_CTX *ctx, KSI_MetricsSnapshot *snapshot) {
+	if (ctx == NULL || snapshot == NULL) return KSI_INVALID_ARGUMENT;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	KSI_Metrics_addToSnapshot(&ctx->metrics, snapshot);
+
+	return KSI_OK;
+}
+
+int KSI_CTX_setMetricsCallback(KSI_CTX *ctx, KSI_MetricsCallback cb, void *cbCtx, unsigned intervalMs) {
+	if (ctx == NULL) return KSI_INVALID_ARGUMENT;
+
+	ctx->metricsCallback = NULL;
+	ctx->metricsCallbackCtx = cbCtx;
+	ctx->metricsInterval = (KSI_uint64_t)intervalMs * 1000;
+	KSI_ATOMIC_STORE64(&ctx->metricsReportAt, KSI_getMonotonicTimeUs() + ctx->metricsInterval);
+	ctx->metricsCallback = cb;
+
+	return KSI_OK;
+}
+
+int KSI_AsyncService_getMetrics(const KSI_AsyncService *service, KSI_MetricsSnapshot *snapshot) {
+	if (service == NULL || snapshot == NULL) return KSI_INVALID_ARGUMENT;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	/* A service without an endpoint has not made any requests. */
+	if (service->impl == NULL || service->getMetrics == NULL) return KSI_OK;
+
+	return service->getMetrics(service->impl, snapshot);
+}
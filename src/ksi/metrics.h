@@ -0,0 +1,156 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef KSI_METRICS_H_
+#define KSI_METRICS_H_
+
+#include "ksi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * \addtogroup metrics Metrics
+	 * Runtime counters and latency histograms of the network communication. The context collects the
+	 * metrics of all the requests made with it, both synchronous and asynchronous, every
+	 * #KSI_AsyncService additionally collects the metrics of its own requests. The metrics are always
+	 * collected, updating them costs a few atomic additions per request. They are read as a snapshot
+	 * with #KSI_CTX_getMetrics and #KSI_AsyncService_getMetrics, or pushed periodically to a callback
+	 * set with #KSI_CTX_setMetricsCallback.
+	 * @{
+	 */
+
+	/**
+	 * Metric counters.
+	 */
+	typedef enum KSI_MetricCounter_en {
+		/** Number of the request PDUs sent out. */
+		KSI_METRIC_REQUESTS_SENT = 0,
+		/** Number of the responses received and matched to a request. */
+		KSI_METRIC_RESPONSES_RECEIVED,
+		/** Number of the failed requests, see #KSI_MetricsSnapshot::errors for the breakdown by status code. */
+		KSI_METRIC_ERRORS,
+		/** Number of the bytes sent out. */
+		KSI_METRIC_BYTES_OUT,
+		/** Number of the bytes received. */
+		KSI_METRIC_BYTES_IN,
+		/** Number of the connections opened after the first one (TCP transport only). */
+		KSI_METRIC_RECONNECTS,
+		/** Number of the sub-service failures covered by other sub-services of a high availability service. */
+		KSI_METRIC_HA_FAILOVERS,
+		/** Number of the publications files taken into use by the context. */
+		KSI_METRIC_PUBFILE_REFRESHES,
+
+		KSI_NUMBER_OF_METRIC_COUNTERS
+	} KSI_MetricCounter;
+
+	/**
+	 * Latency histograms, measured from sending out a request until receiving its response.
+	 */
+	typedef enum KSI_MetricHistogram_en {
+		/** Latency of the aggregation requests. */
+		KSI_METRIC_AGGREGATION_LATENCY = 0,
+		/** Latency of the extending requests. */
+		KSI_METRIC_EXTENDING_LATENCY,
+
+		KSI_NUMBER_OF_METRIC_HISTOGRAMS
+	} KSI_MetricHistogram;
+
+	/**
+	 * Number of the buckets of a latency histogram. The bucket \c i counts the latencies below
+	 * 2^i microseconds not counted by the previous buckets, the last bucket counts the rest.
+	 */
+	#define KSI_METRIC_LATENCY_BUCKETS 32
+
+	/** Maximum number of the distinct error codes counted. */
+	#define KSI_METRIC_ERROR_CODES 16
+
+	/**
+	 * Number of the failed requests with a particular status code.
+	 */
+	typedef struct KSI_MetricErrorCount_st {
+		/** Status code of the failure (see #KSI_StatusCode). */
+		int code;
+		/** Number of the failures. */
+		KSI_uint64_t count;
+	} KSI_MetricErrorCount;
+
+	/**
+	 * A snapshot of the metrics.
+	 */
+	typedef struct KSI_MetricsSnapshot_st {
+		/** Counter values, indexed by #KSI_MetricCounter. */
+		KSI_uint64_t counters[KSI_NUMBER_OF_METRIC_COUNTERS];
+		/** Latency histograms, indexed by #KSI_MetricHistogram. */
+		KSI_uint64_t latency[KSI_NUMBER_OF_METRIC_HISTOGRAMS][KSI_METRIC_LATENCY_BUCKETS];
+		/** Failed requests by status code, the first #KSI_MetricsSnapshot::errors_count entries are valid. */
+		KSI_MetricErrorCount errors[KSI_METRIC_ERROR_CODES];
+		/** Number of the valid entries in #KSI_MetricsSnapshot::errors. */
+		size_t errors_count;
+		/** Number of the requests waiting for a response (only set by #KSI_AsyncService_getMetrics). */
+		size_t queueDepth;
+	} KSI_MetricsSnapshot;
+
+	/**
+	 * Callback for receiving the metrics periodically.
+	 * \param[in]	cbCtx		The context passed to #KSI_CTX_setMetricsCallback.
+	 * \param[in]	snapshot	Snapshot of the context metrics.
+	 * \see #KSI_CTX_setMetricsCallback
+	 */
+	typedef void (*KSI_MetricsCallback)(void *cbCtx, const KSI_MetricsSnapshot *snapshot);
+
+	/**
+	 * Takes a snapshot of the metrics of all the requests made with the context.
+	 * \param[in]	ctx			KSI context.
+	 * \param[out]	snapshot	Pointer to the receiving snapshot.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_CTX_getMetrics(KSI_CTX *ctx, KSI_MetricsSnapshot *snapshot);
+
+	/**
+	 * Sets the callback receiving a snapshot of the context metrics at most once per \c intervalMs.
+	 * The callback is invoked from the thread making a request once the interval has elapsed, no
+	 * threads are started for it; with no network activity the callback is not invoked.
+	 * \param[in]	ctx			KSI context.
+	 * \param[in]	cb			The callback, \c NULL to disable.
+	 * \param[in]	cbCtx		Context of the callback.
+	 * \param[in]	intervalMs	Minimum interval between the calls in milliseconds.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_CTX_setMetricsCallback(KSI_CTX *ctx, KSI_MetricsCallback cb, void *cbCtx, unsigned intervalMs);
+
+	/**
+	 * Takes a snapshot of the metrics of the requests made with the async service. For a high
+	 * availability service the metrics of its sub-services are summed up.
+	 * \param[in]	service		Async service.
+	 * \param[out]	snapshot	Pointer to the receiving snapshot.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_AsyncService_getMetrics(const KSI_AsyncService *service, KSI_MetricsSnapshot *snapshot);
+
+	/**
+	 * @}
+	 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KSI_METRICS_H_ */
@@ -374,11 +374,18 @@ int KSI_RequestHandle_new(KSI_CTX *ctx, const unsigned char *request, size_t req
 
 	tmp->response = NULL;
 	tmp->response_length = 0;
+	tmp->ifNoneMatch = NULL;
+	tmp->ifModifiedSince = NULL;
+	tmp->etag = NULL;
+	tmp->lastModified = NULL;
 	tmp->completed = false;
+	tmp->sentAt = 0;
+	tmp->histogram = -1;
 	tmp->err.code = 0;
 	memset(tmp->err.errm, 0, sizeof(tmp->err.errm));
 	tmp->err.res = KSI_UNKNOWN_ERROR;
 	tmp->status = NULL;
+	tmp->readResponse = NULL;
 
 	tmp->client = NULL;
 
@@ -416,10 +423,37 @@ void KSI_RequestHandle_free(KSI_RequestHandle *handle) {
 		}
 		KSI_free(handle->request);
 		KSI_free(handle->response);
+		KSI_free(handle->ifNoneMatch);
+		KSI_free(handle->ifModifiedSince);
+		KSI_free(handle->etag);
+		KSI_free(handle->lastModified);
 		KSI_free(handle);
 	}
 }
 
+static void requestSent(KSI_RequestHandle *handle, int histogram) {
+	handle->sentAt = KSI_getMonotonicTimeUs();
+	handle->histogram = histogram;
+
+	KSI_Metrics_count(handle->ctx, NULL, KSI_METRIC_REQUESTS_SENT, 1);
+	KSI_Metrics_count(handle->ctx, NULL, KSI_METRIC_BYTES_OUT, handle->request_length);
+}
+
+static void requestCompleted(KSI_RequestHandle *handle, int res) {
+	if (handle->sentAt == 0) return;
+
+	if (res != KSI_OK) {
+		KSI_Metrics_error(handle->ctx, NULL, res);
+	} else {
+		KSI_Metrics_count(handle->ctx, NULL, KSI_METRIC_RESPONSES_RECEIVED, 1);
+		KSI_Metrics_count(handle->ctx, NULL, KSI_METRIC_BYTES_IN, handle->response_length);
+		if (handle->histogram >= 0) {
+			KSI_Metrics_latency(handle->ctx, NULL, (KSI_MetricHistogram)handle->histogram, KSI_getMonotonicTimeUs() - handle->sentAt);
+		}
+	}
+	handle->sentAt = 0;
+}
+
 int KSI_NetworkClient_sendSignRequest(KSI_NetworkClient *provider, KSI_AggregationReq *request, KSI_RequestHandle **handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_RequestHandle *tmp = NULL;
@@ -445,6 +479,7 @@ int KSI_NetworkClient_sendSignRequest(KSI_NetworkClient *provider, KSI_Aggregati
 		KSI_pushError(provider->ctx, res, NULL);
 		goto cleanup;
 	}
+	requestSent(tmp, KSI_METRIC_AGGREGATION_LATENCY);
 
 	*handle = tmp;
 	tmp = NULL;
@@ -484,6 +519,7 @@ int KSI_NetworkClient_sendExtendRequest(KSI_NetworkClient *provider, KSI_ExtendR
 		KSI_pushError(provider->ctx, res, NULL);
 		goto cleanup;
 	}
+	requestSent(tmp, KSI_METRIC_EXTENDING_LATENCY);
 
 	*handle = tmp;
 	tmp = NULL;
@@ -523,6 +559,7 @@ int KSI_NetworkClient_sendPublicationsFileRequest(KSI_NetworkClient *provider, K
 		KSI_pushError(provider->ctx, res, NULL);
 		goto cleanup;
 	}
+	requestSent(tmp, -1);
 
 	*handle = tmp;
 	tmp = NULL;
@@ -663,6 +700,7 @@ int KSI_RequestHandle_perform(KSI_RequestHandle *handle) {
 
 
 	res = handle->readResponse(handle);
+	requestCompleted(handle, res);
 	if (res != KSI_OK) {
 		KSI_pushError(handle->ctx, res, NULL);
 		goto cleanup;
@@ -926,6 +964,7 @@ int KSI_RequestHandle_getAggregationResponse(const KSI_RequestHandle *handle, KS
 	KSI_ErrorPdu *error = NULL;
 	KSI_Config *tmpConf = NULL;
 	KSI_AggregationResp *tmp = NULL;
+	KSI_LIST(KSI_AggregationResp) *respList = NULL;
 	const unsigned char *raw = NULL;
 	size_t len;
 	KSI_AggregationReq *req = NULL;
@@ -994,6 +1033,17 @@ int KSI_RequestHandle_getAggregationResponse(const KSI_RequestHandle *handle, KS
 		goto cleanup;
 	}
 
+	/* A multi-payload PDU is only expected by the async service. */
+	res = KSI_AggregationPdu_getResponseList(pdu, &respList);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+	if (respList != NULL) {
+		KSI_pushError(handle->ctx, res = KSI_INVALID_FORMAT, "Unexpected multiple aggregation responses.");
+		goto cleanup;
+	}
+
 	/* Get response object. */
 	res = KSI_AggregationPdu_getResponse(pdu, &tmp);
 	if (res != KSI_OK) {
@@ -1340,6 +1390,7 @@ int KSI_AbstractAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 	tmp->run = NULL;
 	tmp->getPendingCount = NULL;
 	tmp->getReceivedCount = NULL;
+	tmp->getMetrics = NULL;
 	tmp->setOption = NULL;
 
 	tmp->setEndpoint = NULL;
@@ -27,6 +27,7 @@
 #include "net.h"
 #include "net_tcp.h"
 #include "net_http.h"
+#include "tlv.h"
 #include "impl/net_async_impl.h"
 #include "impl/net_uri_impl.h"
 #include "impl/ctx_impl.h"
@@ -40,9 +41,86 @@
 #define KSI_ASYNC_DEFAULT_REQUEST_CACHE_SIZE 1
 #define KSI_ASYNC_DEFAULT_TIMEOUT_SEC 10
 #define KSI_ASYNC_ROUND_DURATION_SEC 1
+#define KSI_ASYNC_DEFAULT_COALESCE_MAX_COUNT 1
+#define KSI_ASYNC_DEFAULT_COALESCE_WINDOW_US 0
+/* Maximum PDU payload size of a TLV16 element. */
+#define KSI_ASYNC_COALESCE_PDU_MAX_SIZE (0xffff + 4)
 
 #define KSI_ASYNC_CACHE_START_POS 1
 
+#define KSI_ASYNC_SERVER_MAX_REQUESTS 16000
+#define KSI_ASYNC_SERVER_MIN_PERIOD_MS 100
+#define KSI_ASYNC_SERVER_MAX_PERIOD_MS (20 * 1000)
+
+/* Resolves the effective request rate as count per period (in microseconds). */
+static void asyncPacer_getRate(const size_t *options, unsigned long long *count, unsigned long long *periodUs) {
+	unsigned long long srvCount = options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT];
+	unsigned long long srvPeriodUs = (unsigned long long)options[KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS] * 1000;
+
+	*count = options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT];
+	*periodUs = (unsigned long long)options[KSI_ASYNC_PRIVOPT_ROUND_DURATION] * 1000000;
+
+	/* Apply the server limits if they are more restrictive. */
+	if (srvCount != 0 && srvPeriodUs != 0 && (*periodUs == 0 || srvCount * *periodUs < *count * srvPeriodUs)) {
+		*count = srvCount;
+		*periodUs = srvPeriodUs;
+	}
+}
+
+void KSI_AsyncPacer_init(KSI_AsyncPacer *pacer) {
+	if (pacer == NULL) return;
+	pacer->refillAt = 0;
+	pacer->credit = 0;
+}
+
+bool KSI_AsyncPacer_isReady(KSI_AsyncPacer *pacer, const size_t *options, size_t cost) {
+	unsigned long long count = 0;
+	unsigned long long periodUs = 0;
+	unsigned long long now;
+	long long capacity;
+
+	if (pacer == NULL || options == NULL) return false;
+
+	asyncPacer_getRate(options, &count, &periodUs);
+	if (count == 0) return false;
+	if (periodUs == 0) return true;
+
+	capacity = (long long)(count * periodUs);
+
+	now = KSI_getMonotonicTimeUs();
+	if (pacer->refillAt == 0) {
+		pacer->credit = capacity;
+	} else {
+		unsigned long long elapsed = now - pacer->refillAt;
+
+		/* A full round refills the bucket (after the debt has been paid back). */
+		if (pacer->credit >= 0 && elapsed > periodUs) elapsed = periodUs;
+		pacer->credit += (long long)(elapsed * count);
+		if (pacer->credit > capacity) pacer->credit = capacity;
+	}
+	pacer->refillAt = now;
+
+	/* The PDU exceeding the bucket capacity can be sent out with a full bucket. */
+	if (cost > count) cost = (size_t)count;
+
+	return pacer->credit >= (long long)(cost * periodUs);
+}
+
+void KSI_AsyncPacer_consume(KSI_AsyncPacer *pacer, const size_t *options, size_t cost) {
+	unsigned long long count = 0;
+	unsigned long long periodUs = 0;
+
+	if (pacer == NULL || options == NULL) return;
+
+	asyncPacer_getRate(options, &count, &periodUs);
+	pacer->credit -= (long long)(cost * periodUs);
+}
+
+size_t KSI_AsyncHandle_getPayloadCount(const KSI_AsyncHandle *handle) {
+	if (handle == NULL) return 0;
+	return (handle->batch != NULL) ? KSI_AsyncHandleList_length(handle->batch) : 1;
+}
+
 static void KSI_AsyncHandle_cleanup(KSI_AsyncHandle *o) {
 	if (o != NULL) {
 		KSI_AggregationReq_free(o->aggrReq);
@@ -51,6 +129,7 @@ static void KSI_AsyncHandle_cleanup(KSI_AsyncHandle *o) {
 		if (o->userCtx_free) o->userCtx_free(o->userCtx);
 		KSI_free(o->raw);
 		KSI_Utf8String_free(o->errMsg);
+		KSI_AsyncHandleList_free(o->batch);
 
 		KSI_nofree(o->signature);
 		KSI_nofree(o->pubRec);
@@ -68,15 +147,21 @@ void KSI_AsyncHandle_free(KSI_AsyncHandle *o) {
 	if (--o->ref == 0) {
 		KSI_AsyncHandle_cleanup(o);
 
-		if (o->ctx == NULL || KSI_AsyncHandleList_append(o->ctx->asyncHandleRecycle, o) != KSI_OK) {
-			KSI_free(o);
+		if (o->ctx != NULL) {
+			/* The handle is kept for reuse by the calling thread. */
+			KSI_ThreadState *state = KSI_CTX_getThreadState(o->ctx, 1);
+
+			if (state != NULL && KSI_AsyncHandleList_append(state->asyncHandleRecycle, o) == KSI_OK) return;
 		}
+
+		KSI_free(o);
 	}
 }
 
 int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_AsyncHandle *tmp = NULL;
+	KSI_ThreadState *state = NULL;
 	size_t len;
 
 	if (ctx == NULL || o == NULL) {
@@ -84,10 +169,12 @@ int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 		goto cleanup;
 	}
 
-	if ((len = KSI_AsyncHandleList_length(ctx->asyncHandleRecycle)) > 0) {
-		res = KSI_AsyncHandleList_remove(ctx->asyncHandleRecycle, len - 1, &tmp);
-		if (res != KSI_OK) goto cleanup;
-	} else {
+	state = KSI_CTX_getThreadState(ctx, 0);
+	if (state != NULL && (len = KSI_AsyncHandleList_length(state->asyncHandleRecycle)) > 0) {
+		KSI_AsyncHandleList_remove(state->asyncHandleRecycle, len - 1, &tmp);
+	}
+
+	if (tmp == NULL) {
 		tmp = KSI_new(KSI_AsyncHandle);
 		if (tmp == NULL) {
 			res = KSI_OUT_OF_MEMORY;
@@ -115,6 +202,9 @@ int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 	tmp->reqTime = 0;
 	tmp->sndTime = 0;
 	tmp->rcvTime = 0;
+	tmp->sndTimeUs = 0;
+
+	tmp->metrics = NULL;
 
 	tmp->userCtx = NULL;
 	tmp->userCtx_free = NULL;
@@ -127,6 +217,8 @@ int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 
 	tmp->parentId = 0;
 
+	tmp->batch = NULL;
+
 	*o = tmp;
 	tmp = NULL;
 
@@ -575,6 +667,16 @@ cleanup:
 	return res;
 }
 
+void KSI_AsyncHandle_setSent(KSI_AsyncHandle *handle, time_t sndTime) {
+	if (handle == NULL) return;
+
+	handle->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
+	handle->sndTime = sndTime;
+	handle->sndTimeUs = KSI_getMonotonicTimeUs();
+
+	KSI_Metrics_count(handle->ctx, handle->metrics, KSI_METRIC_REQUESTS_SENT, 1);
+	KSI_Metrics_count(handle->ctx, handle->metrics, KSI_METRIC_BYTES_OUT, handle->len);
+}
 
 static int asyncClient_calculateRequestId(KSI_AsyncClient *c, KSI_uint64_t *id, KSI_uint64_t *offset) {
 	int res = KSI_UNKNOWN_ERROR;
@@ -789,6 +891,7 @@ static int addRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle, void *req,
 	raw = NULL;
 	handle->len = len;
 	handle->sentCount = 0;
+	handle->metrics = &c->metrics;
 
 	/* Add request to the impl output queue. The query might fail if the queue is full. */
 	res = c->addRequest(c->clientImpl, (hndlRef = KSI_AsyncHandle_ref(handle)));
@@ -854,6 +957,408 @@ cleanup:
 	return res;
 }
 
+static void asyncClient_setBatchError(KSI_LIST(KSI_AsyncHandle) *batch, int err) {
+	size_t i;
+
+	for (i = 0; i < KSI_AsyncHandleList_length(batch); i++) {
+		KSI_AsyncHandle *h = NULL;
+
+		if (KSI_AsyncHandleList_elementAt(batch, i, &h) != KSI_OK || h == NULL) continue;
+		if (h->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
+			h->state = KSI_ASYNC_STATE_ERROR;
+			h->err = err;
+		}
+	}
+}
+
+/* Returns the HMAC algorithm of the multi-payload PDUs: the one set for the client, otherwise the one of the context. */
+static KSI_HashAlgorithm asyncClient_coalescedHmacAlgorithm(const KSI_AsyncClient *c) {
+	KSI_HashAlgorithm algId = (KSI_HashAlgorithm)c->options[KSI_ASYNC_OPT_HMAC_ALGORITHM];
+
+	return KSI_isHashAlgorithmSupported(algId) ? algId : (KSI_HashAlgorithm)c->ctx->options[KSI_OPT_AGGR_HMAC_ALGORITHM];
+}
+
+static int asyncClient_flushCoalescedRequests(KSI_AsyncClient *c) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_AsyncHandle) *batch = NULL;
+	KSI_LIST(KSI_AggregationReq) *reqList = NULL;
+	KSI_AsyncHandle *carrier = NULL;
+	KSI_AsyncHandle *hndlRef = NULL;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_DataHash *hmac = NULL;
+	KSI_HashAlgorithm algId;
+	const char *pass = NULL;
+	size_t i;
+
+	if (c == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (KSI_AsyncHandleList_length(c->coalesceQueue) == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	/* Take over the held back requests. */
+	batch = c->coalesceQueue;
+	c->coalesceQueue = NULL;
+	c->coalesceSize = 0;
+
+	res = KSI_AggregationReqList_new(&reqList);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < KSI_AsyncHandleList_length(batch); i++) {
+		KSI_AsyncHandle *h = NULL;
+		KSI_AggregationReq *reqRef = NULL;
+
+		res = KSI_AsyncHandleList_elementAt(batch, i, &h);
+		if (res != KSI_OK) goto cleanup;
+
+		/* The state could have been changed in application layer. */
+		if (h->state != KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) continue;
+
+		res = KSI_AggregationReqList_append(reqList, (reqRef = KSI_AggregationReq_ref(h->aggrReq)));
+		if (res != KSI_OK) {
+			KSI_AggregationReq_free(reqRef);
+			goto cleanup;
+		}
+	}
+
+	if (KSI_AggregationReqList_length(reqList) == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = c->getCredentials(c->clientImpl, NULL, &pass);
+	if (res != KSI_OK) goto cleanup;
+
+	res = asyncClient_composeRequestHeader(c, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_new(c->ctx, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_AggregationPdu_setRequestList(pdu, reqList);
+	if (res != KSI_OK) goto cleanup;
+	reqList = NULL;
+
+	algId = asyncClient_coalescedHmacAlgorithm(c);
+	if (!KSI_isHashAlgorithmTrusted(algId)) {
+		KSI_pushError(c->ctx, res = KSI_UNTRUSTED_HASH_ALGORITHM, "Aggregation HMAC algorithm not trusted.");
+		goto cleanup;
+	}
+
+	/* Create and append initial empty HMAC. */
+	res = KSI_DataHash_createZero(c->ctx, algId, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_AggregationPdu_updateHmac(pdu, algId, pass);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AbstractAsyncHandle_new(c->ctx, &carrier);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_serialize(pdu, &carrier->raw, &carrier->len);
+	if (res != KSI_OK) goto cleanup;
+
+	carrier->parentId = c->options[KSI_ASYNC_PRIVOPT_ENDPOINT_ID];
+	carrier->metrics = &c->metrics;
+	carrier->batch = batch;
+	batch = NULL;
+
+	/* Add the carrier to the impl output queue. */
+	res = c->addRequest(c->clientImpl, (hndlRef = KSI_AsyncHandle_ref(carrier)));
+	if (res != KSI_OK) {
+		KSI_AsyncHandle_free(hndlRef);
+		goto cleanup;
+	}
+
+	if (c->carriers == NULL) {
+		res = KSI_AsyncHandleList_new(&c->carriers);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_AsyncHandleList_append(c->carriers, carrier);
+	if (res != KSI_OK) goto cleanup;
+	carrier = NULL;
+
+	res = KSI_OK;
+cleanup:
+	if (res != KSI_OK) {
+		/* The held back requests can not be sent out. Report the error via the request handles. */
+		asyncClient_setBatchError(batch, res);
+		if (carrier != NULL) asyncClient_setBatchError(carrier->batch, res);
+	}
+
+	KSI_AsyncHandleList_free(batch);
+	KSI_AggregationReqList_free(reqList);
+	KSI_AsyncHandle_free(carrier);
+	KSI_AggregationPdu_free(pdu);
+	KSI_Header_free(hdr);
+	KSI_DataHash_free(hmac);
+
+	return res;
+}
+
+/* Estimates the upper bound of the multi-payload PDU size without the requests (PDU, header and HMAC). */
+static int asyncClient_coalescedPduOverhead(KSI_AsyncClient *c, size_t *overhead) {
+	int res = KSI_UNKNOWN_ERROR;
+	const char *user = NULL;
+	size_t len = 0;
+
+	if (c == NULL || overhead == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = c->getCredentials(c->clientImpl, &user, NULL);
+	if (res != KSI_OK) goto cleanup;
+
+	/* PDU header. */
+	len += 4;
+	/* Header: login id, instance id and message id. */
+	len += 4 + (4 + (user != NULL ? strlen(user) + 1 : 0)) + (4 + 8) + (4 + 8);
+	/* HMAC imprint. */
+	len += 4 + 1 + KSI_getHashLength(asyncClient_coalescedHmacAlgorithm(c));
+
+	*overhead = len;
+
+	res = KSI_OK;
+cleanup:
+
+	return res;
+}
+
+/* Returns the serialized size of a TLV with the given tag and payload length. */
+static size_t asyncClient_tlvSize(unsigned tag, size_t payloadLen) {
+	return payloadLen + ((payloadLen > 0xff || tag > KSI_TLV_MASK_TLV8_TYPE) ? 4 : 2);
+}
+
+/* Returns the serialized size of an integer TLV, the value is encoded with the least number of bytes. */
+static size_t asyncClient_integerTlvSize(unsigned tag, const KSI_Integer *o) {
+	KSI_uint64_t val = KSI_Integer_getUInt64(o);
+	size_t len = 0;
+
+	while (val != 0) {
+		len++;
+		val >>= 8;
+	}
+
+	return asyncClient_tlvSize(tag, len);
+}
+
+/* Calculates the serialized size of the request as it will be appended into a multi-payload PDU, without
+ * serializing it. Only the plain signing requests (request id, hash and level) are coalesced. */
+static int asyncClient_coalescedRequestSize(KSI_AsyncClient *c, KSI_AggregationReq *req, size_t *size) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *reqId = NULL;
+	KSI_DataHash *reqHash = NULL;
+	KSI_Integer *reqLevel = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprintLen = 0;
+	size_t len = 0;
+
+	if (c == NULL || req == NULL || size == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = KSI_AggregationReq_getRequestId(req, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationReq_getRequestHash(req, &reqHash);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationReq_getRequestLevel(req, &reqLevel);
+	if (res != KSI_OK) goto cleanup;
+
+	if (reqId != NULL) len += asyncClient_integerTlvSize(0x01, reqId);
+	if (reqHash != NULL) {
+		res = KSI_DataHash_getImprint(reqHash, &imprint, &imprintLen);
+		if (res != KSI_OK) goto cleanup;
+
+		len += asyncClient_tlvSize(0x02, imprintLen);
+	}
+	if (reqLevel != NULL) len += asyncClient_integerTlvSize(0x03, reqLevel);
+
+	*size = asyncClient_tlvSize(0x02, len);
+
+	res = KSI_OK;
+cleanup:
+
+	return res;
+}
+
+static int asyncClient_coalesceAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *reqId = NULL;
+	KSI_AsyncHandle *hndlRef = NULL;
+	KSI_uint64_t id = 0;
+	KSI_uint64_t idOffset = 0;
+	KSI_uint64_t requestId = 0;
+	size_t overhead = 0;
+	size_t reqSize = 0;
+
+	if (c == NULL || handle == NULL || handle->aggrReq == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(c->ctx);
+
+	if (c->clientImpl == NULL || c->addRequest == NULL || c->getCredentials == NULL) {
+		KSI_pushError(c->ctx, res = KSI_INVALID_STATE, "Async client is not initialized properly.");
+		goto cleanup;
+	}
+
+	/* Cleanup the handle in case it has been added repeteadly. */
+	KSI_free(handle->raw);
+	handle->raw = NULL;
+	handle->len = 0;
+	KSI_Utf8String_free(handle->errMsg);
+	handle->errMsg = NULL;
+	if (handle->respCtx_free) handle->respCtx_free(handle->respCtx);
+	handle->respCtx_free = NULL;
+	handle->respCtx = NULL;
+	handle->id = 0;
+
+	/* Update the request handler. */
+	handle->parentId = c->options[KSI_ASYNC_PRIVOPT_ENDPOINT_ID];
+
+	res = KSI_AggregationReq_getRequestId(handle->aggrReq, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Clear the request id that was set. */
+	if (reqId != NULL) {
+		KSI_Integer_free(reqId);
+		res = KSI_AggregationReq_setRequestId(handle->aggrReq, (reqId = NULL));
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* Verify if there is spare place in the request cache and get the request id. */
+	res = asyncClient_calculateRequestId(c, &id, &idOffset);
+	if (res != KSI_OK) goto cleanup;
+
+	requestId = (idOffset << KSI_ASYNC_REQUEST_ID_OFFSET) | id;
+	res = KSI_Integer_new(c->ctx, requestId, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationReq_setRequestId(handle->aggrReq, reqId);
+	if (res != KSI_OK) goto cleanup;
+	reqId = NULL;
+
+	res = asyncClient_coalescedRequestSize(c, handle->aggrReq, &reqSize);
+	if (res != KSI_OK) goto cleanup;
+
+	res = asyncClient_coalescedPduOverhead(c, &overhead);
+	if (res != KSI_OK) goto cleanup;
+
+	if (overhead + reqSize > KSI_ASYNC_COALESCE_PDU_MAX_SIZE) {
+		KSI_pushError(c->ctx, res = KSI_BUFFER_OVERFLOW, "Aggregation request does not fit into a PDU.");
+		goto cleanup;
+	}
+
+	/* Send out the held back requests, if the PDU would exceed the maximum size. */
+	if (KSI_AsyncHandleList_length(c->coalesceQueue) > 0 &&
+			overhead + c->coalesceSize + reqSize > KSI_ASYNC_COALESCE_PDU_MAX_SIZE) {
+		/* In case of a failure, the error is reported via the request handles. */
+		if (asyncClient_flushCoalescedRequests(c) != KSI_OK) {
+			KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+		}
+	}
+
+	if (c->coalesceQueue == NULL) {
+		res = KSI_AsyncHandleList_new(&c->coalesceQueue);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_AsyncHandleList_append(c->coalesceQueue, (hndlRef = KSI_AsyncHandle_ref(handle)));
+	if (res != KSI_OK) {
+		KSI_AsyncHandle_free(hndlRef);
+		goto cleanup;
+	}
+	if (KSI_AsyncHandleList_length(c->coalesceQueue) == 1) c->coalesceStartAt = KSI_getMonotonicTimeUs();
+	c->coalesceSize += reqSize;
+
+	handle->id = requestId;
+	handle->sentCount = 0;
+	handle->state = KSI_ASYNC_STATE_WAITING_FOR_DISPATCH;
+	time(&handle->reqTime);
+
+	/* Set request into local cache. */
+	c->reqCache[id] = handle;
+	c->pending++;
+
+	if (KSI_AsyncHandleList_length(c->coalesceQueue) >= c->options[KSI_ASYNC_OPT_COALESCE_MAX_COUNT]) {
+		/* In case of a failure, the error is reported via the request handles. */
+		if (asyncClient_flushCoalescedRequests(c) != KSI_OK) {
+			KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+		}
+	}
+
+	res = KSI_OK;
+cleanup:
+	KSI_Integer_free(reqId);
+
+	return res;
+}
+
+static void asyncClient_updateCoalescedRequests(KSI_AsyncClient *c) {
+	size_t i = 0;
+
+	if (c == NULL) return;
+
+	while (i < KSI_AsyncHandleList_length(c->carriers)) {
+		KSI_AsyncHandle *carrier = NULL;
+		bool waiting = false;
+		size_t j;
+
+		if (KSI_AsyncHandleList_elementAt(c->carriers, i, &carrier) != KSI_OK || carrier == NULL) break;
+
+		if (carrier->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
+			i++;
+			continue;
+		}
+
+		/* Mirror the transport state of the carrier to the coalesced requests. */
+		for (j = 0; j < KSI_AsyncHandleList_length(carrier->batch); j++) {
+			KSI_AsyncHandle *h = NULL;
+
+			if (KSI_AsyncHandleList_elementAt(carrier->batch, j, &h) != KSI_OK || h == NULL) continue;
+
+			if (h->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH ||
+					(h->state == KSI_ASYNC_STATE_WAITING_FOR_RESPONSE && carrier->state == KSI_ASYNC_STATE_ERROR)) {
+				h->state = carrier->state;
+				h->sndTime = carrier->sndTime;
+				h->sndTimeUs = carrier->sndTimeUs;
+				h->err = carrier->err;
+				h->errExt = carrier->errExt;
+				if (carrier->errMsg != NULL) {
+					KSI_Utf8String_free(h->errMsg);
+					h->errMsg = KSI_Utf8String_ref(carrier->errMsg);
+				}
+			}
+			if (h->state == KSI_ASYNC_STATE_WAITING_FOR_RESPONSE) waiting = true;
+		}
+
+		/* Keep the carrier as long as a transport error may still be reported via it. */
+		if (waiting && carrier->state != KSI_ASYNC_STATE_ERROR) {
+			i++;
+		} else {
+			KSI_AsyncHandleList_remove(c->carriers, i, NULL);
+		}
+	}
+}
+
 static int asyncClient_addAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHash *reqHash = NULL;
@@ -870,6 +1375,13 @@ static int asyncClient_addAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle
 	res = KSI_AggregationReq_getConfig(handle->aggrReq, &reqConfig);
 	if (res != KSI_OK) goto cleanup;
 
+	/* Only plain signing requests can be carried by a multi-payload PDU. */
+	if (c->options[KSI_ASYNC_OPT_COALESCE_MAX_COUNT] > 1 && reqHash != NULL && reqConfig == NULL &&
+			c->ctx->options[KSI_OPT_AGGR_PDU_VER] == KSI_PDU_VERSION_2) {
+		res = asyncClient_coalesceAggregatorRequest(c, handle);
+		goto cleanup;
+	}
+
 	res = addRequest(c, handle, handle->aggrReq, (reqHash != NULL), (reqConfig != NULL),
 			(KSI_HashAlgorithm)c->ctx->options[KSI_OPT_AGGR_HMAC_ALGORITHM],
 			(int (*)(KSI_CTX *ctx, void **req))KSI_AggregationReq_new,
@@ -993,6 +1505,13 @@ static int handleResponse(KSI_AsyncClient *c, void *resp,
 		KSI_Integer *status = NULL;
 		void *req = NULL;
 
+		KSI_Metrics_count(c->ctx, &c->metrics, KSI_METRIC_RESPONSES_RECEIVED, 1);
+		if (handle->sndTimeUs != 0) {
+			KSI_Metrics_latency(c->ctx, &c->metrics,
+					handle->extReq != NULL ? KSI_METRIC_EXTENDING_LATENCY : KSI_METRIC_AGGREGATION_LATENCY,
+					KSI_getMonotonicTimeUs() - handle->sndTimeUs);
+		}
+
 		res = asyncHandle_getRequest(handle, &req);
 		if (res != KSI_OK) {
 			KSI_pushError(c->ctx, res, NULL);
@@ -1038,9 +1557,23 @@ cleanup:
 	return res;
 }
 
+static int asyncClient_handleAggregationPayload(KSI_AsyncClient *c, KSI_AggregationResp *resp) {
+	return handleResponse(c, resp,
+			(int (*)(const KSI_AsyncHandle *h, void **req))KSI_AsyncHandle_getAggregationReq,
+			KSI_convertAggregatorStatusCode,
+			(int (*)(const void *resp, KSI_Integer **requestId))KSI_AggregationResp_getRequestId,
+			(int (*)(const void *resp, const void *req))KSI_AggregationResp_verifyWithRequest,
+			(int (*)(const void *resp, KSI_Integer **status))KSI_AggregationResp_getStatus,
+			(int (*)(const void *resp, KSI_Utf8String **errorMsg))KSI_AggregationResp_getErrorMsg,
+			(void* (*)(void *resp))KSI_AggregationResp_ref,
+			(void (*)(void *resp))KSI_AggregationResp_free);
+}
+
 static int asyncClient_handleAggregationResp(KSI_AsyncClient *c, KSI_AggregationPdu *pdu) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_AggregationResp *resp = NULL;
+	KSI_LIST(KSI_AggregationResp) *respList = NULL;
+	size_t i;
 
 	if (c == NULL || pdu == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -1056,15 +1589,28 @@ static int asyncClient_handleAggregationResp(KSI_AsyncClient *c, KSI_Aggregation
 	}
 
 	if (resp != NULL) {
-		res =  handleResponse(c, resp,
-				(int (*)(const KSI_AsyncHandle *h, void **req))KSI_AsyncHandle_getAggregationReq,
-				KSI_convertAggregatorStatusCode,
-				(int (*)(const void *resp, KSI_Integer **requestId))KSI_AggregationResp_getRequestId,
-				(int (*)(const void *resp, const void *req))KSI_AggregationResp_verifyWithRequest,
-				(int (*)(const void *resp, KSI_Integer **status))KSI_AggregationResp_getStatus,
-				(int (*)(const void *resp, KSI_Utf8String **errorMsg))KSI_AggregationResp_getErrorMsg,
-				(void* (*)(void *resp))KSI_AggregationResp_ref,
-				(void (*)(void *resp))KSI_AggregationResp_free);
+		res = asyncClient_handleAggregationPayload(c, resp);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* Multi-payload response. */
+	res = KSI_AggregationPdu_getResponseList(pdu, &respList);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < KSI_AggregationRespList_length(respList); i++) {
+		res = KSI_AggregationRespList_elementAt(respList, i, &resp);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = asyncClient_handleAggregationPayload(c, resp);
 		if (res != KSI_OK) {
 			KSI_pushError(c->ctx, res, NULL);
 			goto cleanup;
@@ -1114,6 +1660,35 @@ cleanup:
 	return res;
 }
 
+static int asyncClient_updatePacingLimits(KSI_AsyncClient *c, KSI_Config *config) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *maxRequests = NULL;
+	KSI_Integer *aggrPeriod = NULL;
+
+	res = KSI_Config_getMaxRequests(config, &maxRequests);
+	if (res != KSI_OK) goto cleanup;
+	res = KSI_Config_getAggrPeriod(config, &aggrPeriod);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Values out of the valid range are discarded. */
+	if (maxRequests != NULL && KSI_Integer_getUInt64(maxRequests) > 0 &&
+			KSI_Integer_getUInt64(maxRequests) <= KSI_ASYNC_SERVER_MAX_REQUESTS) {
+		c->options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT] = (size_t)KSI_Integer_getUInt64(maxRequests);
+	}
+	if (aggrPeriod != NULL && KSI_Integer_getUInt64(aggrPeriod) >= KSI_ASYNC_SERVER_MIN_PERIOD_MS &&
+			KSI_Integer_getUInt64(aggrPeriod) <= KSI_ASYNC_SERVER_MAX_PERIOD_MS) {
+		c->options[KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS] = (size_t)KSI_Integer_getUInt64(aggrPeriod);
+	}
+
+	KSI_LOG_debug(c->ctx, "[%p] Async client server pacing limit: %llu requests per %llu ms.", (void *)c,
+			(unsigned long long)c->options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT],
+			(unsigned long long)c->options[KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS]);
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int asyncClient_handleServerConfig(KSI_AsyncClient *c, KSI_Config *config, KSI_Config_Callback confCallback) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_AsyncHandle *confHandle = NULL;
@@ -1124,6 +1699,13 @@ static int asyncClient_handleServerConfig(KSI_AsyncClient *c, KSI_Config *config
 	}
 	KSI_ERR_clearErrors(c->ctx);
 
+	/* Update the request pacing limits before the config is handed over. */
+	res = asyncClient_updatePacingLimits(c, config);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	if (c->serverConf != NULL) {
 
 		c->serverConf->state = KSI_ASYNC_STATE_PUSH_CONFIG_RECEIVED;
@@ -1239,6 +1821,8 @@ static int processResponseQueue(KSI_AsyncClient *c,
 				goto cleanup;
 			}
 
+			KSI_Metrics_count(c->ctx, &c->metrics, KSI_METRIC_BYTES_IN, len);
+
 			KSI_LOG_logBlob(c->ctx, KSI_LOG_DEBUG, "Parsing response", raw, len);
 
 			/* Get PDU object. */
@@ -1399,12 +1983,14 @@ static bool asyncClient_finalizeRequest(KSI_AsyncClient *c, KSI_AsyncHandle *han
 				handle->state = KSI_ASYNC_STATE_ERROR;
 				handle->err = KSI_NETWORK_RECIEVE_TIMEOUT;
 				c->pending--;
+				KSI_Metrics_error(c->ctx, &c->metrics, handle->err);
 				return true;
 			}
 			return false;
 
 		case KSI_ASYNC_STATE_ERROR:
 			c->pending--;
+			KSI_Metrics_error(c->ctx, &c->metrics, handle->err);
 			return true;
 
 		case KSI_ASYNC_STATE_PUSH_CONFIG_RECEIVED:
@@ -1485,6 +2071,17 @@ static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient
 		goto cleanup;
 	}
 
+	/* Send out the held back requests if the coalescing window has elapsed. */
+	if (KSI_AsyncHandleList_length(c->coalesceQueue) > 0 &&
+			KSI_getMonotonicTimeUs() - c->coalesceStartAt >= c->options[KSI_ASYNC_OPT_COALESCE_WINDOW_US]) {
+		KSI_ERR_clearErrors(c->ctx);
+		res = asyncClient_flushCoalescedRequests(c);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, "Async client failed to send out coalesced requests.");
+			KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+		}
+	}
+
 	KSI_ERR_clearErrors(c->ctx);
 	res = c->dispatch(c->clientImpl);
 	if (res == KSI_ASYNC_CONNECTION_CLOSED) {
@@ -1498,6 +2095,9 @@ static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient
 		asyncClient_setResponseError(c, KSI_ASYNC_STATE_WAITING_FOR_RESPONSE, res, 0L, NULL);
 	}
 
+	/* Update the state of the coalesced requests. */
+	asyncClient_updateCoalescedRequests(c);
+
 	/* Handle responses. */
 	KSI_ERR_clearErrors(c->ctx);
 	res = handleResp(c);
@@ -1544,6 +2144,15 @@ cleanup:
 	return res;
 }
 
+static int asyncClient_getMetrics(KSI_AsyncClient *c, KSI_MetricsSnapshot *snapshot) {
+	if (c == NULL || snapshot == NULL) return KSI_INVALID_ARGUMENT;
+
+	KSI_Metrics_addToSnapshot(&c->metrics, snapshot);
+	snapshot->queueDepth += c->pending;
+
+	return KSI_OK;
+}
+
 static int asyncClient_getReceivedCount(KSI_AsyncClient *c, size_t *count) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -1605,6 +2214,15 @@ static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_OPT_MAX_REQUEST_COUNT:
 		case KSI_ASYNC_OPT_CALLBACK_USERDATA:
 		case KSI_ASYNC_OPT_HMAC_ALGORITHM:
+		case KSI_ASYNC_OPT_COALESCE_WINDOW_US:
+			c->options[opt] = (size_t)param;
+			break;
+
+		case KSI_ASYNC_OPT_COALESCE_MAX_COUNT:
+			if ((size_t)param == 0) {
+				KSI_pushError(c->ctx, res = KSI_INVALID_ARGUMENT, "Coalesce count may not be 0.");
+				goto cleanup;
+			}
 			c->options[opt] = (size_t)param;
 			break;
 
@@ -1617,6 +2235,8 @@ static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_PRIVOPT_ROUND_DURATION:
 		case KSI_ASYNC_PRIVOPT_INVOKE_CONF_RECEIVED_CALLBACK:
 		case KSI_ASYNC_PRIVOPT_ENDPOINT_ID:
+		case KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT:
+		case KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS:
 			c->options[opt] = (size_t)param;
 			break;
 
@@ -1651,6 +2271,8 @@ static int asyncClient_getOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_OPT_MAX_REQUEST_COUNT:
 		case KSI_ASYNC_OPT_CALLBACK_USERDATA:
 		case KSI_ASYNC_OPT_HMAC_ALGORITHM:
+		case KSI_ASYNC_OPT_COALESCE_MAX_COUNT:
+		case KSI_ASYNC_OPT_COALESCE_WINDOW_US:
 			*(size_t*)param = c->options[opt];
 			break;
 		case KSI_ASYNC_OPT_PUSH_CONF_CALLBACK:
@@ -1665,6 +2287,8 @@ static int asyncClient_getOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_PRIVOPT_ROUND_DURATION:
 		case KSI_ASYNC_PRIVOPT_INVOKE_CONF_RECEIVED_CALLBACK:
 		case KSI_ASYNC_PRIVOPT_ENDPOINT_ID:
+		case KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT:
+		case KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS:
 			*(size_t*)param = c->options[opt];
 			break;
 
@@ -1692,9 +2316,13 @@ static int asyncClient_setDefaultOptions(KSI_AsyncClient *c) {
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_CONNECTION_STATE_CALLBACK, (void *)NULL)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)NULL)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_HMAC_ALGORITHM, (void *)KSI_HASHALG_INVALID)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, (void *)KSI_ASYNC_DEFAULT_COALESCE_MAX_COUNT)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_COALESCE_WINDOW_US, (void *)KSI_ASYNC_DEFAULT_COALESCE_WINDOW_US)) != KSI_OK) goto cleanup;
 	/* Private options. */
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_ROUND_DURATION, (void *)KSI_ASYNC_ROUND_DURATION_SEC)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_INVOKE_CONF_RECEIVED_CALLBACK, (void *)true)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT, (void *)0)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS, (void *)0)) != KSI_OK) goto cleanup;
 cleanup:
 	return res;
 }
@@ -1710,6 +2338,8 @@ void KSI_AsyncClient_free(KSI_AsyncClient *c) {
 			KSI_free(c->reqCache);
 		}
 		KSI_AsyncHandle_free(c->serverConf);
+		KSI_AsyncHandleList_free(c->coalesceQueue);
+		KSI_AsyncHandleList_free(c->carriers);
 
 		KSI_free(c);
 	}
@@ -1742,6 +2372,12 @@ int KSI_AbstractAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 	tmp->received = 0;
 	tmp->serverConf = NULL;
 
+	tmp->coalesceQueue = NULL;
+	tmp->coalesceStartAt = 0;
+	tmp->coalesceSize = 0;
+	tmp->carriers = NULL;
+	memset(&tmp->metrics, 0, sizeof(tmp->metrics));
+
 	tmp->addRequest = NULL;
 	tmp->getResponse = NULL;
 	tmp->dispatch = NULL;
@@ -1958,12 +2594,15 @@ cleanup:
 
 void KSI_AsyncService_free(KSI_AsyncService *service) {
 	if (service != NULL) {
+		KSI_ThreadState *state = KSI_CTX_getThreadState(service->ctx, 0);
 		size_t len;
 		/* Release recycled handles. */
-		/* Run garbage collection here, as KSI_CTX can be used for other purposes after using the service. */
-		while (((len = KSI_AsyncHandleList_length(service->ctx->asyncHandleRecycle)) > 0)) {
+		/* Run garbage collection here, as KSI_CTX can be used for other purposes after using the service.
+		 * The handles recycled by the other threads are released with the context. */
+		while (state != NULL && ((len = KSI_AsyncHandleList_length(state->asyncHandleRecycle)) > 0)) {
 			KSI_AsyncHandle *tmp = NULL;
-			if (KSI_AsyncHandleList_remove(service->ctx->asyncHandleRecycle, len - 1, &tmp) != KSI_OK) break;
+			if (KSI_AsyncHandleList_remove(state->asyncHandleRecycle, len - 1, &tmp) != KSI_OK) break;
+			/* The handle is not returned to the list, as its reference count is 0. */
 			KSI_AsyncHandle_free(tmp);
 		}
 
@@ -1994,6 +2633,7 @@ int KSI_SigningAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))asyncClient_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))asyncClient_getReceivedCount;
+	tmp->getMetrics = (int (*)(void *, KSI_MetricsSnapshot *))asyncClient_getMetrics;
 
 	tmp->setOption = (int (*)(void *, int, void *))asyncClient_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))asyncClient_getOption;
@@ -2032,6 +2672,7 @@ int KSI_ExtendingAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))asyncClient_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))asyncClient_getReceivedCount;
+	tmp->getMetrics = (int (*)(void *, KSI_MetricsSnapshot *))asyncClient_getMetrics;
 
 	tmp->setOption = (int (*)(void *, int, void *))asyncClient_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))asyncClient_getOption;
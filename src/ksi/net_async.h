@@ -571,6 +571,26 @@ extern "C" {
 		 */
 		KSI_ASYNC_OPT_HMAC_ALGORITHM,
 
+		/**
+		 * Maximum number of aggregation requests to be coalesced into a single multi-payload request PDU.
+		 * Default setting is 1 (coalescing is disabled).
+		 * \param		count			Paramer of type size_t.
+		 * \note Only applicable to a signing service using #KSI_PDU_VERSION_2. Requests carrying a configuration
+		 * request are always sent out separately.
+		 * \note The responses are matched to the requests by the request id, thus the server may respond to the
+		 * coalesced requests in one or in several PDUs.
+		 * \see #KSI_ASYNC_OPT_COALESCE_WINDOW_US for limiting the time a request is held back.
+		 */
+		KSI_ASYNC_OPT_COALESCE_MAX_COUNT,
+
+		/**
+		 * Maximum time in microseconds a request may be held back for coalescing. The held back requests are
+		 * sent out when either the time window has elapsed or #KSI_ASYNC_OPT_COALESCE_MAX_COUNT has been reached.
+		 * Default setting is 0 (held back requests are sent out on every #KSI_AsyncService_run call).
+		 * \param		timeout			Paramer of type size_t.
+		 */
+		KSI_ASYNC_OPT_COALESCE_WINDOW_US,
+
 		__KSI_ASYNC_OPT_COUNT
 	} KSI_AsyncOption;
 
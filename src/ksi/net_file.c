@@ -258,7 +258,7 @@ static int prepareExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, K
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->ctx->netProvider->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->ctx->netProvider->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_ExtendReq_setRequestId(req, reqId);
@@ -323,7 +323,7 @@ static int prepareAggregationRequest(KSI_NetworkClient *client, KSI_AggregationR
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->ctx->netProvider->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->ctx->netProvider->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_AggregationReq_setRequestId(req, reqId);
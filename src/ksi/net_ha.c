@@ -44,15 +44,21 @@ void KSI_HighAvailabilityRequest_free(KSI_HighAvailabilityRequest *o) {
 		KSI_AsyncHandle_free(o->asyncHandle);
 		o->asyncHandle = NULL;
 
-		if (o->ctx == NULL || KSI_HighAvailabilityRequestList_append(o->ctx->haRequestRecycle, o) != KSI_OK) {
-			KSI_free(o);
+		if (o->ctx != NULL) {
+			/* The request is kept for reuse by the calling thread. */
+			KSI_ThreadState *state = KSI_CTX_getThreadState(o->ctx, 1);
+
+			if (state != NULL && KSI_HighAvailabilityRequestList_append(state->haRequestRecycle, o) == KSI_OK) return;
 		}
+
+		KSI_free(o);
 	}
 }
 
 int KSI_HighAvailabilityRequest_new(KSI_CTX *ctx, KSI_AsyncHandle *asyncHandle, KSI_HighAvailabilityRequest **o) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_HighAvailabilityRequest *tmp = NULL;
+	KSI_ThreadState *state = NULL;
 	size_t len;
 
 	if (ctx == NULL || o == NULL) {
@@ -61,10 +67,12 @@ int KSI_HighAvailabilityRequest_new(KSI_CTX *ctx, KSI_AsyncHandle *asyncHandle,
 	}
 	KSI_ERR_clearErrors(ctx);
 
-	if ((len =  KSI_HighAvailabilityRequestList_length(ctx->haRequestRecycle)) > 0) {
-		res =  KSI_HighAvailabilityRequestList_remove(ctx->haRequestRecycle, len - 1, &tmp);
-		if (res != KSI_OK) goto cleanup;
-	} else {
+	state = KSI_CTX_getThreadState(ctx, 0);
+	if (state != NULL && (len = KSI_HighAvailabilityRequestList_length(state->haRequestRecycle)) > 0) {
+		KSI_HighAvailabilityRequestList_remove(state->haRequestRecycle, len - 1, &tmp);
+	}
+
+	if (tmp == NULL) {
 		tmp = KSI_new(KSI_HighAvailabilityRequest);
 		if (tmp == NULL) {
 			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
@@ -698,6 +706,39 @@ cleanup:
 	return res;
 }
 
+static int KSI_HighAvailabilityService_getMetrics(KSI_HighAvailabilityService *has, KSI_MetricsSnapshot *snapshot) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i = 0;
+
+	if (has == NULL || snapshot == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	for (i = 0; i < KSI_AsyncServiceList_length(has->services); i++) {
+		KSI_AsyncService *as = NULL;
+
+		res = KSI_AsyncServiceList_elementAt(has->services, i, &as);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (as->impl == NULL || as->getMetrics == NULL) continue;
+
+		res = as->getMetrics(as->impl, snapshot);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+	KSI_Metrics_addToSnapshot(&has->metrics, snapshot);
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int KSI_HighAvailabilityService_reportErrorNotice(KSI_HighAvailabilityService *has,
 		KSI_AsyncHandle *reqHndl, size_t origin,
 		int err, long errExt, KSI_Utf8String *errMsg) {
@@ -986,6 +1027,11 @@ static int handleErrorResponse(KSI_HighAvailabilityService *has, KSI_AsyncHandle
 		}
 	}
 
+	/* The failure is covered in case a response has been received or other subservices are still pending. */
+	if (reqState != KSI_ASYNC_STATE_ERROR || haRequest->expectedRespCount > 0) {
+		KSI_Metrics_count(has->ctx, &has->metrics, KSI_METRIC_HA_FAILOVERS, 1);
+	}
+
 	/* In case all of the relevant subservices have returned an error,
 	 * move the request to the response queue. */
 	if (reqState == KSI_ASYNC_STATE_ERROR && haRequest->expectedRespCount == 0) {
@@ -1301,6 +1347,7 @@ static int KSI_AbstractHighAvailabilityService_new(KSI_CTX *ctx, KSI_HighAvailab
 	tmp->consolidatedConfig = NULL;
 	tmp->confCallback = NULL;
 	tmp->confConsolidateCallback = NULL;
+	memset(&tmp->metrics, 0, sizeof(tmp->metrics));
 
 	tmp->subservice_new = NULL;
 
@@ -1459,6 +1506,7 @@ int KSI_SigningHighAvailabilityService_new(KSI_CTX *ctx, KSI_AsyncService **serv
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getReceivedCount;
+	tmp->getMetrics = (int (*)(void *, KSI_MetricsSnapshot *))KSI_HighAvailabilityService_getMetrics;
 
 	tmp->setOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_getOption;
@@ -1510,6 +1558,7 @@ int KSI_ExtendingHighAvailabilityService_new(KSI_CTX *ctx, KSI_AsyncService **se
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getReceivedCount;
+	tmp->getMetrics = (int (*)(void *, KSI_MetricsSnapshot *))KSI_HighAvailabilityService_getMetrics;
 
 	tmp->setOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_getOption;
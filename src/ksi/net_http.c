@@ -154,7 +154,7 @@ static int prepareExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, K
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_ExtendReq_setRequestId(req, reqId);
@@ -220,7 +220,7 @@ static int prepareAggregationRequest(KSI_NetworkClient *client, KSI_AggregationR
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_AggregationReq_setRequestId(req, reqId);
@@ -347,6 +347,7 @@ int KSI_AbstractHttpClient_new(KSI_CTX *ctx, KSI_NetworkClient **http) {
 	c->sendRequest = NULL;
 	c->implCtx = NULL;
 	c->implCtx_free = NULL;
+	c->implCtx_reset = NULL;
 
 	c->connectionTimeoutSeconds = 10; /* FIXME! Magic constants. */
 	c->readTimeoutSeconds = 10;
@@ -451,14 +452,21 @@ KSI_NET_IMPLEMENT_SETTER(ReadTimeoutSeconds, int, readTimeoutSeconds, setIntPara
 static int ksi_HttpClient_setService(KSI_NetworkClient *client, KSI_NetEndpoint *abs_endp, const char *url, const char *user, const char *pass) {
 	int res = KSI_UNKNOWN_ERROR;
 	HttpClient_Endpoint *endp = NULL;
+	KSI_HttpClient *http = NULL;
 
-	if (abs_endp == NULL) {
+	if (client == NULL || abs_endp == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
+	http = client->impl;
 	endp = abs_endp->implCtx;
 	if (url != NULL) {
+		/* Do not reuse the connections to the previous address. */
+		if (endp->url != NULL && strcmp(endp->url, url) != 0 && http->implCtx_reset != NULL) {
+			http->implCtx_reset(http->implCtx);
+		}
+
 		res = client->setStringParam(&endp->url, url);
 		if (res != KSI_OK) goto cleanup;
 	}
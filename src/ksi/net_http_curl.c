@@ -23,24 +23,206 @@
 
 #include <curl/curl.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "impl/net_http_impl.h"
 #include "impl/net_impl.h"
+#include "impl/thread_impl.h"
+
+/* Max nof idle easy handles kept for reuse by a single client. */
+#define KSI_CURL_IDLE_HANDLE_COUNT 4
+
+/**
+ * Connection cache shared by the requests of a single client. Idle easy handles keep their
+ * connections alive and the share object makes the DNS cache and TLS sessions available to all
+ * the easy handles of the client. The connections are owned by the easy handles, thus dropping
+ * the idle handles closes the connections. As the request handles may outlive the client, the
+ * object is reference counted.
+ */
+typedef struct CurlClientCtx_st {
+	/* Guards the reference count and the idle handles, as the client may be shared between threads. */
+	KSI_Mutex lock;
+	/* Locks of the data shared by the share object. */
+	KSI_Mutex shareLock[CURL_LOCK_DATA_LAST];
+	size_t ref;
+	CURLSH *share;
+	CURL *idle[KSI_CURL_IDLE_HANDLE_COUNT];
+	size_t idleCount;
+	/* Incremented when the idle handles are dropped, handles of an older generation are not reused. */
+	size_t generation;
+} CurlClientCtx;
 
 typedef struct CurlNetHandleCtx_st {
 	KSI_CTX *ctx;
+	CurlClientCtx *clientCtx;
 	CURL *curl;
+	/* Generation of the client context the easy handle was acquired from. */
+	size_t generation;
 	unsigned char *raw;
 	size_t len;
 	struct curl_slist *httpHeaders;
 	char curlErr[CURL_ERROR_SIZE];
 } CurlNetHandleCtx;
 
+static void CurlClientCtx_free(CurlClientCtx *clientCtx) {
+	size_t ref;
+	int i;
+
+	if (clientCtx == NULL) return;
+
+	KSI_Mutex_lock(&clientCtx->lock);
+	ref = --clientCtx->ref;
+	KSI_Mutex_unlock(&clientCtx->lock);
+
+	if (ref == 0) {
+		while (clientCtx->idleCount > 0) {
+			curl_easy_cleanup(clientCtx->idle[--clientCtx->idleCount]);
+		}
+		if (clientCtx->share != NULL) curl_share_cleanup(clientCtx->share);
+		for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+			KSI_Mutex_destroy(&clientCtx->shareLock[i]);
+		}
+		KSI_Mutex_destroy(&clientCtx->lock);
+		KSI_free(clientCtx);
+	}
+}
+
+static void curlShareLock(CURL *KSI_UNUSED(handle), curl_lock_data data, curl_lock_access KSI_UNUSED(access), void *userptr) {
+	CurlClientCtx *clientCtx = userptr;
+	KSI_Mutex_lock(&clientCtx->shareLock[data]);
+}
+
+static void curlShareUnlock(CURL *KSI_UNUSED(handle), curl_lock_data data, void *userptr) {
+	CurlClientCtx *clientCtx = userptr;
+	KSI_Mutex_unlock(&clientCtx->shareLock[data]);
+}
+
+static int CurlClientCtx_new(CurlClientCtx **clientCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlClientCtx *tmp = NULL;
+	int i;
+
+	if (clientCtx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = KSI_new(CurlClientCtx);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	/* Init the locks first, they are expected to be valid by the cleanup. */
+	for (i = 0; i <= CURL_LOCK_DATA_LAST; i++) {
+		res = KSI_Mutex_init(i < CURL_LOCK_DATA_LAST ? &tmp->shareLock[i] : &tmp->lock);
+		if (res != KSI_OK) {
+			while (i-- > 0) KSI_Mutex_destroy(&tmp->shareLock[i]);
+			KSI_free(tmp);
+			tmp = NULL;
+			goto cleanup;
+		}
+	}
+
+	tmp->ref = 1;
+	tmp->idleCount = 0;
+	tmp->generation = 0;
+
+	/* The share object is optional, in case it is not available the idle handles still keep their connections. */
+	tmp->share = curl_share_init();
+	if (tmp->share != NULL) {
+		curl_share_setopt(tmp->share, CURLSHOPT_LOCKFUNC, curlShareLock);
+		curl_share_setopt(tmp->share, CURLSHOPT_UNLOCKFUNC, curlShareUnlock);
+		curl_share_setopt(tmp->share, CURLSHOPT_USERDATA, tmp);
+		curl_share_setopt(tmp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(tmp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+
+	*clientCtx = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	CurlClientCtx_free(tmp);
+
+	return res;
+}
+
+static CURL *CurlClientCtx_acquireHandle(CurlClientCtx *clientCtx, size_t *generation) {
+	CURL *curl = NULL;
+
+	KSI_Mutex_lock(&clientCtx->lock);
+	if (clientCtx->idleCount > 0) {
+		curl = clientCtx->idle[--clientCtx->idleCount];
+	}
+	*generation = clientCtx->generation;
+	KSI_Mutex_unlock(&clientCtx->lock);
+
+	if (curl != NULL) {
+		/* Resets the options, but keeps the live connections and caches. */
+		curl_easy_reset(curl);
+	} else {
+		curl = curl_easy_init();
+	}
+
+	if (curl != NULL && clientCtx->share != NULL) {
+		curl_easy_setopt(curl, CURLOPT_SHARE, clientCtx->share);
+	}
+
+	return curl;
+}
+
+static void CurlClientCtx_releaseHandle(CurlClientCtx *clientCtx, CURL *curl, size_t generation) {
+	if (curl == NULL) return;
+
+	if (clientCtx != NULL) {
+		KSI_Mutex_lock(&clientCtx->lock);
+		if (clientCtx->generation == generation && clientCtx->idleCount < KSI_CURL_IDLE_HANDLE_COUNT) {
+			clientCtx->idle[clientCtx->idleCount++] = curl;
+			curl = NULL;
+		}
+		KSI_Mutex_unlock(&clientCtx->lock);
+	}
+
+	if (curl != NULL) curl_easy_cleanup(curl);
+}
+
+/**
+ * Closes the idle connections, called when an endpoint of the client is reconfigured. The handles
+ * of the requests in progress are closed when released.
+ */
+static void CurlClientCtx_reset(CurlClientCtx *clientCtx) {
+	CURL *idle[KSI_CURL_IDLE_HANDLE_COUNT];
+	size_t idleCount = 0;
+
+	if (clientCtx == NULL) return;
+
+	KSI_Mutex_lock(&clientCtx->lock);
+	while (clientCtx->idleCount > 0) {
+		idle[idleCount++] = clientCtx->idle[--clientCtx->idleCount];
+	}
+	clientCtx->generation++;
+	KSI_Mutex_unlock(&clientCtx->lock);
+
+	while (idleCount > 0) {
+		curl_easy_cleanup(idle[--idleCount]);
+	}
+}
+
 static void CurlNetHandleCtx_free(CurlNetHandleCtx *handleCtx) {
 	if (handleCtx != NULL) {
 		KSI_free(handleCtx->raw);
+		/* The header list is referenced by the easy handle, make sure it is not used after being freed. */
+		if (handleCtx->curl != NULL) curl_easy_setopt(handleCtx->curl, CURLOPT_HTTPHEADER, NULL);
 		if (handleCtx->httpHeaders != NULL) curl_slist_free_all(handleCtx->httpHeaders);
-		if (handleCtx->curl != NULL) curl_easy_cleanup(handleCtx->curl);
+		if (handleCtx->clientCtx != NULL) {
+			CurlClientCtx_releaseHandle(handleCtx->clientCtx, handleCtx->curl, handleCtx->generation);
+			CurlClientCtx_free(handleCtx->clientCtx);
+		} else if (handleCtx->curl != NULL) {
+			curl_easy_cleanup(handleCtx->curl);
+		}
 		KSI_free(handleCtx);
 	}
 }
@@ -61,7 +243,9 @@ static int CurlNetHandleCtx_new(KSI_CTX *ctx, CurlNetHandleCtx **handleCtx) {
 	}
 
 	tmp->ctx = ctx;
+	tmp->clientCtx = NULL;
 	tmp->curl = NULL;
+	tmp->generation = 0;
 	tmp->len = 0;
 	tmp->raw = NULL;
 	tmp->curlErr[0] = '\0';
@@ -110,6 +294,89 @@ cleanup:
 	return bytesCount;
 }
 
+static int setHeaderValue(const char *line, size_t len, const char *name, char **value) {
+	size_t nameLen = strlen(name);
+	size_t i;
+	char *tmp = NULL;
+
+	/* Header names are case insensitive. */
+	if (len <= nameLen || line[nameLen] != ':') return KSI_OK;
+	for (i = 0; i < nameLen; i++) {
+		if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) return KSI_OK;
+	}
+
+	line += nameLen + 1;
+	len -= nameLen + 1;
+
+	/* Trim the surrounding whitespace and the line ending. */
+	while (len > 0 && (*line == ' ' || *line == '\t')) {
+		line++;
+		len--;
+	}
+	while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == '\n' || line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+
+	tmp = KSI_calloc(len + 1, 1);
+	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+	memcpy(tmp, line, len);
+
+	KSI_free(*value);
+	*value = tmp;
+
+	return KSI_OK;
+}
+
+static size_t receiveHeaderFromLibCurl(char *ptr, size_t size, size_t nmemb, void *userdata) {
+	KSI_RequestHandle *handle = userdata;
+	size_t len = size * nmemb;
+
+	/* Returning a value other than the length of the header line aborts the transfer. */
+	if (setHeaderValue(ptr, len, "ETag", &handle->etag) != KSI_OK) return 0;
+	if (setHeaderValue(ptr, len, "Last-Modified", &handle->lastModified) != KSI_OK) return 0;
+
+	return len;
+}
+
+static int appendHeader(CurlNetHandleCtx *implCtx, const char *name, const char *value) {
+	char header[1024];
+	struct curl_slist *tmp = NULL;
+
+	KSI_snprintf(header, sizeof(header), "%s: %s", name, value);
+
+	tmp = curl_slist_append(implCtx->httpHeaders, header);
+	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+	implCtx->httpHeaders = tmp;
+
+	return KSI_OK;
+}
+
+static int applyValidators(KSI_RequestHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlNetHandleCtx *implCtx = handle->implCtx;
+
+	if (handle->ifNoneMatch == NULL && handle->ifModifiedSince == NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (handle->ifNoneMatch != NULL) {
+		res = appendHeader(implCtx, "If-None-Match", handle->ifNoneMatch);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (handle->ifModifiedSince != NULL) {
+		res = appendHeader(implCtx, "If-Modified-Since", handle->ifModifiedSince);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	curl_easy_setopt(implCtx->curl, CURLOPT_HTTPHEADER, implCtx->httpHeaders);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 static int updateStatus(KSI_RequestHandle *handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	CurlNetHandleCtx *impl = NULL;
@@ -142,22 +409,11 @@ cleanup:
 	return res;
 }
 
-static int curlReceive(KSI_RequestHandle *handle) {
+static int curlComplete(KSI_RequestHandle *handle, CURLcode cc) {
 	int res = KSI_UNKNOWN_ERROR;
-	CurlNetHandleCtx *implCtx = NULL;
-	long httpCode;
-
-	if (handle == NULL || handle->client == NULL || handle->implCtx == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-	KSI_ERR_clearErrors(handle->ctx);
-
-	implCtx = handle->implCtx;
-
-	KSI_LOG_debug(handle->ctx, "Sending request.");
+	CurlNetHandleCtx *implCtx = handle->implCtx;
+	long httpCode = 0;
 
-	res = curl_easy_perform(implCtx->curl);
 	KSI_LOG_debug(handle->ctx, "Received %llu bytes.", (unsigned long long)implCtx->len);
 
 	if (curl_easy_getinfo(implCtx->curl, CURLINFO_HTTP_CODE, &httpCode) == CURLE_OK) {
@@ -165,8 +421,8 @@ static int curlReceive(KSI_RequestHandle *handle) {
 		KSI_LOG_debug(handle->ctx, "Received HTTP code %ld.", httpCode);
 	}
 
-	if (res != CURLE_OK) {
-		KSI_LOG_debug(handle->ctx, "Curl error: httpCode=%ld, code=%d, message='%s'.", httpCode, res, implCtx->curlErr);
+	if (cc != CURLE_OK) {
+		KSI_LOG_debug(handle->ctx, "Curl error: httpCode=%ld, code=%d, message='%s'.", httpCode, cc, implCtx->curlErr);
 		KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, implCtx->curlErr);
 		goto cleanup;
 	}
@@ -190,6 +446,39 @@ cleanup:
 	return res;
 }
 
+static int curlReceive(KSI_RequestHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlNetHandleCtx *implCtx = NULL;
+
+	if (handle == NULL || handle->client == NULL || handle->implCtx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(handle->ctx);
+
+	implCtx = handle->implCtx;
+
+	KSI_LOG_debug(handle->ctx, "Sending request.");
+
+	res = applyValidators(handle);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = curlComplete(handle, curl_easy_perform(implCtx->curl));
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, char *url) {
 	int res = KSI_UNKNOWN_ERROR;
 	CurlNetHandleCtx *implCtx = NULL;
@@ -212,7 +501,13 @@ static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, cha
 
 	KSI_LOG_debug(handle->ctx, "Curl: Preparing request to: %s", url);
 
-	implCtx->curl = curl_easy_init();
+	/* Reuse the connection cache of the client. */
+	implCtx->clientCtx = http->implCtx;
+	KSI_Mutex_lock(&implCtx->clientCtx->lock);
+	implCtx->clientCtx->ref++;
+	KSI_Mutex_unlock(&implCtx->clientCtx->lock);
+
+	implCtx->curl = CurlClientCtx_acquireHandle(implCtx->clientCtx, &implCtx->generation);
 	if (implCtx->curl == NULL) {
 		KSI_pushError(client->ctx, res = KSI_OUT_OF_MEMORY, "Unable to init CURL.");
 		goto cleanup;
@@ -249,6 +544,9 @@ static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, cha
 
 	curl_easy_setopt(implCtx->curl, CURLOPT_WRITEDATA, implCtx);
 
+	curl_easy_setopt(implCtx->curl, CURLOPT_HEADERFUNCTION, receiveHeaderFromLibCurl);
+	curl_easy_setopt(implCtx->curl, CURLOPT_HEADERDATA, handle);
+
 	curl_easy_setopt(implCtx->curl, CURLOPT_CONNECTTIMEOUT, http->connectionTimeoutSeconds);
 	curl_easy_setopt(implCtx->curl, CURLOPT_TIMEOUT, http->readTimeoutSeconds);
 
@@ -297,6 +595,14 @@ int KSI_HttpClient_new(KSI_CTX *ctx, KSI_NetworkClient **client) {
 		goto cleanup;
 	}
 
+	res = CurlClientCtx_new((CurlClientCtx **)&http->implCtx);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+	http->implCtx_free = (void (*)(void *))CurlClientCtx_free;
+	http->implCtx_reset = (void (*)(void *))CurlClientCtx_reset;
+
 	*client = tmp;
 	tmp = NULL;
 
@@ -74,9 +74,8 @@ struct HttpAsyncCtx_st {
 	char *userAgent;
 	struct curl_slist *httpHeaders;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing. */
+	KSI_AsyncPacer pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -339,18 +338,11 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 	/* Add all requests to the curl multi handle. */
 	while (KSI_AsyncHandleList_length(clientCtx->reqQueue) > 0 &&
 				KSI_AsyncHandleList_elementAt(clientCtx->reqQueue, 0, &req) == KSI_OK && req != NULL) {
-		time_t curTime = 0;
-
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "[%p] Async Curl HTTP: round request count: %u", clientCtx,
-					(unsigned)clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "[%p] Async Curl HTTP: round max request count reached.", clientCtx);
+		time_t curTime = time(NULL);
+
+		/* Check if the pacing limit allows to send more requests. */
+		if (!KSI_AsyncPacer_isReady(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req))) {
+			KSI_LOG_debug(clientCtx->ctx, "[%p] Async Curl HTTP: pacing limit reached.", clientCtx);
 			break;
 		}
 
@@ -424,12 +416,10 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				}
 
 				curlRequest = NULL;
-				clientCtx->roundCount++;
+				KSI_AsyncPacer_consume(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req));
 
-				/* Update state. */
-				req->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
-				/* Start receive timeout. */
-				req->sndTime = curTime;
+				/* Update state and start receive timeout. */
+				KSI_AsyncHandle_setSent(req, curTime);
 				/* The request has been successfully dispatched. Remove it from the request queue. */
 				KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
 			}
@@ -699,8 +689,7 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	tmp->options = NULL;
 	tmp->userAgent = NULL;
 	tmp->httpHeaders = NULL;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	KSI_AsyncPacer_init(&tmp->pacer);
 
 	/* Queues. */
 	tmp->reqQueue = NULL;
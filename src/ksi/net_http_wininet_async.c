@@ -69,9 +69,8 @@ typedef struct {
 	char *userAgent;
 	char *mimeType;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing. */
+	KSI_AsyncPacer pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -750,15 +749,9 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 			continue;
 		}
 
-		/* Check if the request count can be restarted. */
-		if (difftime(curTime, clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "[%p] Async WinINet: round request count: %u", clientCtx, clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinINet: round max request count reached.", clientCtx);
+		/* Check if the pacing limit allows to send more requests. */
+		if (!KSI_AsyncPacer_isReady(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req))) {
+			KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinINet: pacing limit reached.", clientCtx);
 			break;
 		}
 
@@ -777,14 +770,13 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 			continue;
 		}
 
-		/* Update state. */
-		req->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
-		/* Start receive timeout. */
-		req->sndTime = curTime;
+		KSI_AsyncPacer_consume(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req));
+
+		/* Update state and start receive timeout. */
+		KSI_AsyncHandle_setSent(req, curTime);
 
 		/* The request has been successfully dispatched. Remove it from the request queue. */
 		KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
-		clientCtx->roundCount++;
 	}
 
 	/* Handle input. */
@@ -953,8 +945,7 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	tmp->connectHandle = NULL;
 
 	tmp->options = NULL;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	KSI_AsyncPacer_init(&tmp->pacer);
 
 	/* Queues. */
 	tmp->reqQueue = NULL;
@@ -53,7 +53,35 @@ int KSI_TcpClient_setTransferTimeoutSeconds(KSI_NetworkClient *client, int val){
 #include "impl/net_sock_impl.h"
 
 
-typedef struct TcpClient_Endpoint_st TcpClientCtx, TcpClient_Endpoint;
+typedef struct TcpClient_Endpoint_st TcpClient_Endpoint;
+
+/* Avoid SIGPIPE when writing to a connection closed by the peer. */
+#ifdef MSG_NOSIGNAL
+#  define KSI_TCP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#  define KSI_TCP_SEND_FLAGS 0
+#endif
+
+typedef struct TcpClientCtx_st {
+	char *host;
+	unsigned port;
+	/* Endpoint holding the persistent connection. */
+	TcpClient_Endpoint *endp;
+} TcpClientCtx;
+
+static void tcpEndpoint_closeConnection(TcpClient_Endpoint *endp) {
+	if (endp->sockfd != KSI_INVALID_SOCKET) close(endp->sockfd);
+	endp->sockfd = KSI_INVALID_SOCKET;
+	endp->lastUsedAt = 0;
+}
+
+static void tcpEndpoint_reset(TcpClient_Endpoint *endp) {
+	tcpEndpoint_closeConnection(endp);
+	if (endp->addr != NULL) {
+		freeaddrinfo(endp->addr);
+		endp->addr = NULL;
+	}
+}
 
 static int TcpClient_Endpoint_new(TcpClient_Endpoint **t) {
 	TcpClient_Endpoint *tmp = NULL;
@@ -62,57 +90,41 @@ static int TcpClient_Endpoint_new(TcpClient_Endpoint **t) {
 	tmp = KSI_new(TcpClient_Endpoint);
 	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
 
+	if (KSI_Mutex_init(&tmp->lock) != KSI_OK) {
+		KSI_free(tmp);
+		return KSI_OUT_OF_MEMORY;
+	}
+
 	tmp->host = NULL;
 	tmp->port = 0;
+	tmp->sockfd = KSI_INVALID_SOCKET;
+	tmp->lastUsedAt = 0;
+	tmp->addr = NULL;
 
 	*t = tmp;
 	return KSI_OK;
 }
 
-static void TcpClientCtx_free(TcpClientCtx *t) {
+static void TcpClient_Endpoint_free(TcpClient_Endpoint *t) {
 	if (t != NULL) {
+		tcpEndpoint_reset(t);
+		KSI_Mutex_destroy(&t->lock);
 		KSI_free(t->host);
 		KSI_free(t);
 	}
 }
 
-#define TcpClient_Endpoint_free TcpClientCtx_free
+static void TcpClientCtx_free(TcpClientCtx *t) {
+	if (t != NULL) {
+		KSI_free(t->host);
+		KSI_free(t);
+	}
+}
 
-static int readResponse(KSI_RequestHandle *handle) {
+static int resolveAddress(KSI_CTX *ctx, const char *host, unsigned port, struct addrinfo **addr) {
 	int res;
-	TcpClientCtx *tcp = NULL;
-	KSI_TcpClient *client = NULL;
-	int sockfd = -1;
 	struct addrinfo hints;
-	struct addrinfo *result = NULL;
-	struct addrinfo *pr = NULL;
-	size_t count;
-	unsigned char buffer[0xffff + 4];
-	KSI_FTLV ftlv;
-#ifdef _WIN32
-	DWORD transferTimeout = 0;
-#else
-	struct timeval  transferTimeout;
-#endif
 	char portStr[6];
-	int rc;
-
-	if (handle == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-
-	KSI_ERR_clearErrors(handle->ctx);
-
-#ifdef _WIN32
-	if (handle->request_length > INT_MAX) {
-		KSI_pushError(handle->ctx, res = KSI_BUFFER_OVERFLOW, "Unable to send more than MAX_INT bytes.");
-		goto cleanup;
-	}
-#endif
-
-	tcp = handle->implCtx;
-	client = handle->client->impl;
 
 	memset(&hints, 0, sizeof(struct addrinfo));
 	hints.ai_family = AF_UNSPEC;
@@ -120,76 +132,252 @@ static int readResponse(KSI_RequestHandle *handle) {
 	hints.ai_flags = 0;
 	hints.ai_protocol = IPPROTO_TCP;
 
-	KSI_snprintf(portStr, sizeof(portStr), "%u", tcp->port);
-	if ((res = getaddrinfo(tcp->host, portStr, &hints, &result)) != 0) {
-		KSI_ERR_push(handle->ctx, KSI_NETWORK_ERROR, res, __FILE__, __LINE__, gai_strerror(res));
-		res = KSI_NETWORK_ERROR;
-		goto cleanup;
+	KSI_snprintf(portStr, sizeof(portStr), "%u", port);
+	if ((res = getaddrinfo(host, portStr, &hints, addr)) != 0) {
+		KSI_ERR_push(ctx, KSI_NETWORK_ERROR, res, __FILE__, __LINE__, gai_strerror(res));
+		return KSI_NETWORK_ERROR;
 	}
 
-	for (pr = result; pr != NULL; pr = pr->ai_next) {
+	return KSI_OK;
+}
+
+static int openConnection(KSI_CTX *ctx, const struct addrinfo *addr, int transferTimeoutSeconds, int *sockfd) {
+	int res;
+	int fd = KSI_INVALID_SOCKET;
+	const struct addrinfo *pr = NULL;
+#ifdef _WIN32
+	DWORD transferTimeout = 0;
+#else
+	struct timeval  transferTimeout;
+#endif
+	int rc;
+
+	for (pr = addr; pr != NULL; pr = pr->ai_next) {
 		if (pr->ai_protocol != IPPROTO_TCP) continue;
 
-		sockfd = (int)socket(pr->ai_family, pr->ai_socktype, pr->ai_protocol);
-		if (sockfd < 0) {
-			KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, "Unable to open socket.");
+		fd = (int)socket(pr->ai_family, pr->ai_socktype, pr->ai_protocol);
+		if (fd < 0) {
+			KSI_pushError(ctx, res = KSI_NETWORK_ERROR, "Unable to open socket.");
 			goto cleanup;
 		}
 
 #ifdef _WIN32
-		transferTimeout = client->transferTimeoutSeconds * 1000;
+		transferTimeout = transferTimeoutSeconds * 1000;
 #else
-		transferTimeout.tv_sec = client->transferTimeoutSeconds;
+		transferTimeout.tv_sec = transferTimeoutSeconds;
 		transferTimeout.tv_usec = 0;
 #endif
 
 		/* Set socket options. */
-		setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void*)&transferTimeout, sizeof(transferTimeout));
-		setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, (void*)&transferTimeout, sizeof(transferTimeout));
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void*)&transferTimeout, sizeof(transferTimeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void*)&transferTimeout, sizeof(transferTimeout));
 
 #ifdef _WIN32
-		KSI_SCK_TEMP_FAILURE_RETRY(rc, connect(sockfd, pr->ai_addr, (int)pr->ai_addrlen));
+		KSI_SCK_TEMP_FAILURE_RETRY(rc, connect(fd, pr->ai_addr, (int)pr->ai_addrlen));
 #else
-		KSI_SCK_TEMP_FAILURE_RETRY(rc, connect(sockfd, pr->ai_addr, pr->ai_addrlen));
+		KSI_SCK_TEMP_FAILURE_RETRY(rc, connect(fd, pr->ai_addr, pr->ai_addrlen));
 #endif
 		if (rc == KSI_SCK_SOCKET_ERROR) {
-			KSI_ERR_push(handle->ctx, res = KSI_NETWORK_ERROR, KSI_SCK_errno, __FILE__, __LINE__, "Unable to connect.");
+			KSI_ERR_push(ctx, res = KSI_NETWORK_ERROR, KSI_SCK_errno, __FILE__, __LINE__, "Unable to connect.");
 			goto cleanup;
 		}
 		/* Succeedded to connect. */
 		break;
 	}
 	if (pr == NULL) {
-		KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, "Unable to connect, no address succeeded.");
+		KSI_pushError(ctx, res = KSI_NETWORK_ERROR, "Unable to connect, no address succeeded.");
+		goto cleanup;
+	}
+
+	*sockfd = fd;
+	fd = KSI_INVALID_SOCKET;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (fd >= 0) close(fd);
+
+	return res;
+}
+
+/**
+ * Opens a new connection to the endpoint using the cached address resolution. The endpoint is locked
+ * for the time of connecting, so the cached address is not released by a concurrent failure.
+ */
+static int tcpEndpoint_connect(KSI_CTX *ctx, TcpClient_Endpoint *endp, const char *host, unsigned port, int transferTimeoutSeconds, int *sockfd) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	KSI_Mutex_lock(&endp->lock);
+
+	if (endp->addr == NULL) {
+		res = resolveAddress(ctx, host, port, &endp->addr);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = openConnection(ctx, endp->addr, transferTimeoutSeconds, sockfd);
+	if (res != KSI_OK) {
+		/* The address may have changed. */
+		tcpEndpoint_reset(endp);
 		goto cleanup;
 	}
 
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Mutex_unlock(&endp->lock);
+
+	return res;
+}
+
+/**
+ * Checks whether an idle persistent connection is still usable. As the server does not send anything
+ * unsolicited, a readable connection has been closed or reset by the server.
+ */
+static bool isConnectionAlive(int sockfd) {
+	struct pollfd pfd;
+	int rc;
+
+	pfd.fd = sockfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	KSI_SCK_TEMP_FAILURE_RETRY(rc, poll(&pfd, 1, 0));
+	return rc == 0;
+}
+
+static int exchange(KSI_RequestHandle *handle, int sockfd, unsigned char *buffer, size_t buffer_len, size_t *count, bool *requestSent) {
+	int res;
+	size_t sent = 0;
+	KSI_FTLV ftlv;
+
+	*requestSent = false;
+
 	KSI_LOG_logBlob(handle->ctx, KSI_LOG_DEBUG, "Sending request", handle->request, handle->request_length);
-	count = 0;
-	while (count < handle->request_length) {
+	while (sent < handle->request_length) {
 		int c;
 
 #ifdef _WIN32
-		KSI_SCK_TEMP_FAILURE_RETRY(c, send(sockfd, (char *) handle->request + count, (int)(handle->request_length - count), 0));
+		KSI_SCK_TEMP_FAILURE_RETRY(c, send(sockfd, (char *) handle->request + sent, (int)(handle->request_length - sent), KSI_TCP_SEND_FLAGS));
 #else
-		KSI_SCK_TEMP_FAILURE_RETRY(c, send(sockfd, (char *) handle->request + count, handle->request_length - count, 0));
+		KSI_SCK_TEMP_FAILURE_RETRY(c, send(sockfd, (char *) handle->request + sent, handle->request_length - sent, KSI_TCP_SEND_FLAGS));
 #endif
 		if (c == KSI_SCK_SOCKET_ERROR) {
 			KSI_ERR_push(handle->ctx, res = KSI_NETWORK_ERROR, KSI_SCK_errno, __FILE__, __LINE__, "Unable to write to socket.");
 			goto cleanup;
 		}
-		count += c;
+		sent += c;
 	}
+	*requestSent = true;
 
-	res = KSI_FTLV_socketRead(sockfd, buffer, sizeof(buffer), &count, &ftlv);
+	res = KSI_FTLV_socketRead(sockfd, buffer, buffer_len, count, &ftlv);
 	if (res != KSI_OK) {
 		KSI_pushError(handle->ctx, res, "Failed to read TLV from socket.");
 		goto cleanup;
 	}
-	if (count == 0) {
+	if (*count == 0) {
 		KSI_pushError(handle->ctx, res = KSI_INVALID_FORMAT, "Unable to read TLV from socket.");
 		goto cleanup;
-	} else if(count > UINT_MAX){
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int readResponse(KSI_RequestHandle *handle) {
+	int res;
+	TcpClientCtx *tcp = NULL;
+	KSI_TcpClient *client = NULL;
+	TcpClient_Endpoint *endp = NULL;
+	int sockfd = KSI_INVALID_SOCKET;
+	struct addrinfo *result = NULL;
+	size_t count = 0;
+	unsigned char buffer[0xffff + 4];
+	size_t idleTimeout = 0;
+	bool reused = false;
+	bool requestSent = false;
+	time_t now;
+	int rc;
+
+	if (handle == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(handle->ctx);
+
+#ifdef _WIN32
+	if (handle->request_length > INT_MAX) {
+		KSI_pushError(handle->ctx, res = KSI_BUFFER_OVERFLOW, "Unable to send more than MAX_INT bytes.");
+		goto cleanup;
+	}
+#endif
+
+	tcp = handle->implCtx;
+	client = handle->client->impl;
+
+	/* Use the persistent connection only if it is enabled and the endpoint has not been reconfigured. */
+	idleTimeout = handle->ctx->options[KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS];
+	if (idleTimeout > 0 && tcp->endp != NULL) {
+		now = time(NULL);
+
+		KSI_Mutex_lock(&tcp->endp->lock);
+		if (tcp->endp->host != NULL && strcmp(tcp->endp->host, tcp->host) == 0 && tcp->endp->port == tcp->port) {
+			endp = tcp->endp;
+
+			if (endp->sockfd != KSI_INVALID_SOCKET) {
+				if (difftime(now, endp->lastUsedAt) >= idleTimeout) {
+					KSI_LOG_debug(handle->ctx, "Tcp: Closing idle connection to %s:%u.", tcp->host, tcp->port);
+					tcpEndpoint_closeConnection(endp);
+				} else if (!isConnectionAlive(endp->sockfd)) {
+					KSI_LOG_debug(handle->ctx, "Tcp: Connection to %s:%u closed by the server.", tcp->host, tcp->port);
+					tcpEndpoint_closeConnection(endp);
+				} else {
+					/* Take over the connection, it will be returned on success. */
+					sockfd = endp->sockfd;
+					endp->sockfd = KSI_INVALID_SOCKET;
+					reused = true;
+				}
+			}
+		}
+		KSI_Mutex_unlock(&tcp->endp->lock);
+	}
+
+	if (sockfd == KSI_INVALID_SOCKET) {
+		if (endp != NULL) {
+			res = tcpEndpoint_connect(handle->ctx, endp, tcp->host, tcp->port, client->transferTimeoutSeconds, &sockfd);
+			if (res != KSI_OK) goto cleanup;
+		} else {
+			res = resolveAddress(handle->ctx, tcp->host, tcp->port, &result);
+			if (res != KSI_OK) goto cleanup;
+
+			res = openConnection(handle->ctx, result, client->transferTimeoutSeconds, &sockfd);
+			if (res != KSI_OK) goto cleanup;
+		}
+	}
+
+	res = exchange(handle, sockfd, buffer, sizeof(buffer), &count, &requestSent);
+	/* The server may have closed the reused connection in the meanwhile. Reconnect and try once more, if
+	 * sending failed or the connection was closed without any response, but not if the server may still
+	 * be processing the request. */
+	if (res != KSI_OK && reused && (!requestSent || (count == 0 && (res == KSI_NETWORK_ERROR || res == KSI_IO_ERROR)))) {
+		KSI_LOG_debug(handle->ctx, "Tcp: Reconnecting to %s:%u.", tcp->host, tcp->port);
+		KSI_ERR_clearErrors(handle->ctx);
+		close(sockfd);
+		sockfd = KSI_INVALID_SOCKET;
+
+		res = tcpEndpoint_connect(handle->ctx, endp, tcp->host, tcp->port, client->transferTimeoutSeconds, &sockfd);
+		if (res != KSI_OK) goto cleanup;
+
+		res = exchange(handle, sockfd, buffer, sizeof(buffer), &count, &requestSent);
+	}
+	if (res != KSI_OK) goto cleanup;
+
+	if (count > UINT_MAX) {
 		KSI_pushError(handle->ctx, res = KSI_BUFFER_OVERFLOW, "Too much data read from socket.");
 		goto cleanup;
 	}
@@ -204,6 +392,17 @@ static int readResponse(KSI_RequestHandle *handle) {
 
 	handle->completed = true;
 
+	/* Keep the connection open for the next request, unless a concurrent request has already returned one. */
+	if (endp != NULL) {
+		KSI_Mutex_lock(&endp->lock);
+		if (endp->sockfd == KSI_INVALID_SOCKET) {
+			endp->sockfd = sockfd;
+			endp->lastUsedAt = time(NULL);
+			sockfd = KSI_INVALID_SOCKET;
+		}
+		KSI_Mutex_unlock(&endp->lock);
+	}
+
 	res = KSI_OK;
 
 cleanup:
@@ -218,7 +417,7 @@ cleanup:
 	return res;
 }
 
-static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, char *host, unsigned port) {
+static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, TcpClient_Endpoint *endp) {
 	int res;
 	TcpClientCtx *tc = NULL;
 
@@ -229,7 +428,7 @@ static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, cha
 
 	KSI_ERR_clearErrors(handle->ctx);
 
-	if (client == NULL || host == NULL) {
+	if (client == NULL || endp == NULL || endp->host == NULL) {
 		KSI_pushError(handle->ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
@@ -241,15 +440,19 @@ static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, cha
 	}
 	tc->host = NULL;
 	tc->port = 0;
+	tc->endp = endp;
 
-	KSI_LOG_debug(handle->ctx, "Tcp: Sending request to: %s:%u", host, port);
-
-	res = KSI_strdup(host, &tc->host);
+	/* The endpoint may be reconfigured concurrently. */
+	KSI_Mutex_lock(&endp->lock);
+	res = KSI_strdup(endp->host, &tc->host);
+	tc->port = endp->port;
+	KSI_Mutex_unlock(&endp->lock);
 	if (res != KSI_OK) {
 		KSI_pushError(handle->ctx, res, NULL);
 		goto cleanup;
 	}
-	tc->port = port;
+
+	KSI_LOG_debug(handle->ctx, "Tcp: Sending request to: %s:%u", tc->host, tc->port);
 
 
 	handle->readResponse = readResponse;
@@ -277,8 +480,7 @@ static int prepareRequest(
 		void *pdu,
 		int (*serialize)(void *, unsigned char **, size_t *),
 		KSI_RequestHandle **handle,
-		char *host,
-		unsigned port,
+		TcpClient_Endpoint *endp,
 		const char *desc) {
 	int res;
 	KSI_TcpClient *tcp = client->impl;
@@ -317,7 +519,7 @@ static int prepareRequest(
 		goto cleanup;
 	}
 
-	res = tcp->sendRequest(client, tmp, host, port);
+	res = tcp->sendRequest(client, tmp, endp);
 	if (res != KSI_OK) {
 		KSI_pushError(client->ctx, res, NULL);
 		goto cleanup;
@@ -365,7 +567,7 @@ static int prepareExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, K
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_ExtendReq_setRequestId(req, reqId);
@@ -385,8 +587,7 @@ static int prepareExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, K
 			pdu,
 			(int (*)(void *, unsigned char **, size_t *))KSI_ExtendPdu_serialize,
 			handle,
-			endp->host,
-			endp->port,
+			endp,
 			"Extend request");
 	if (res != KSI_OK) goto cleanup;
 
@@ -431,7 +632,7 @@ static int prepareAggregationRequest(KSI_NetworkClient *client, KSI_AggregationR
 	if (res != KSI_OK) goto cleanup;
 
 	if (pReqId == NULL) {
-		res = KSI_Integer_new(client->ctx, ++client->requestCount, &reqId);
+		res = KSI_Integer_new(client->ctx, KSI_ATOMIC_INC64(&client->requestCount), &reqId);
 		if (res != KSI_OK) goto cleanup;
 
 		res = KSI_AggregationReq_setRequestId(req, reqId);
@@ -451,8 +652,7 @@ static int prepareAggregationRequest(KSI_NetworkClient *client, KSI_AggregationR
 			pdu,
 			(int (*)(void *, unsigned char **, size_t *))KSI_AggregationPdu_serialize,
 			handle,
-			endp->host,
-			endp->port,
+			endp,
 			"Aggregation request");
 	if (res != KSI_OK) goto cleanup;
 
@@ -610,11 +810,14 @@ static int ksi_TcpClient_setService(KSI_NetworkClient *client, KSI_NetEndpoint *
 
 	endp = abs_endp->implCtx;
 
+	/* Drop the persistent connection to the previous address. */
+	KSI_Mutex_lock(&endp->lock);
+	tcpEndpoint_reset(endp);
 	res = client->setStringParam(&endp->host, host);
+	if (res == KSI_OK) endp->port = port;
+	KSI_Mutex_unlock(&endp->lock);
 	if (res != KSI_OK) goto cleanup;
 
-	endp->port = port;
-
 	res = client->setStringParam(&abs_endp->ksi_user, user);
 	if (res != KSI_OK) goto cleanup;
 
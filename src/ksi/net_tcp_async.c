@@ -57,13 +57,14 @@ typedef struct TcpClientCtx_st {
 	unsigned char inBuf[KSI_TLV_MAX_SIZE * 2];
 	size_t inLen;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing. */
+	KSI_AsyncPacer pacer;
 
 	/* Connect timeout. */
 	time_t connectedAt;
 	bool socketReady;
+	/* Number of the connections opened. */
+	size_t connectCount;
 
 	/* Poiter to the parent async client. */
 	KSI_AsyncClient *parent;
@@ -231,6 +232,9 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 			res = KSI_OK;
 			goto cleanup;
 		}
+		if (tcpCtx->connectCount++ > 0) {
+			KSI_Metrics_count(tcpCtx->ctx, &tcpCtx->parent->metrics, KSI_METRIC_RECONNECTS, 1);
+		}
 	}
 
 	pfd.fd = tcpCtx->sockfd;
@@ -381,17 +385,11 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 	}
 	while (KSI_AsyncHandleList_length(tcpCtx->reqQueue) > 0 &&
 			KSI_AsyncHandleList_elementAt(tcpCtx->reqQueue, 0, &req) == KSI_OK && req != NULL) {
-		time_t curTime = 0;
+		time_t curTime = time(NULL);
 
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), tcpCtx->roundStartAt) >= tcpCtx->parent->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(tcpCtx->ctx, "[%p] Async TCP round request count: %llu.", tcpCtx, (unsigned long long)tcpCtx->roundCount);
-			tcpCtx->roundCount = 0;
-			tcpCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(tcpCtx->roundCount < tcpCtx->parent->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP round max request count reached.", tcpCtx);
+		/* Check if the pacing limit allows to send more requests. */
+		if (!KSI_AsyncPacer_isReady(&tcpCtx->pacer, tcpCtx->parent->options, KSI_AsyncHandle_getPayloadCount(req))) {
+			KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP pacing limit reached.", tcpCtx);
 			break;
 		}
 
@@ -444,7 +442,10 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 		}
 
 		if (req->sentCount == req->len) {
-			tcpCtx->roundCount++;
+			KSI_AsyncPacer_consume(&tcpCtx->pacer, tcpCtx->parent->options, KSI_AsyncHandle_getPayloadCount(req));
+
+			/* Update state and start receive timeout. */
+			KSI_AsyncHandle_setSent(req, curTime);
 
 			/* Release the serialized payload. */
 			KSI_free(req->raw);
@@ -452,10 +453,6 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 			req->len = 0;
 			req->sentCount = 0;
 
-			/* Update state. */
-			req->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
-			/* Start receive timeout. */
-			req->sndTime = curTime;
 			/* The request has been successfully dispatched. Remove it from the request queue. */
 			KSI_AsyncHandleList_remove(tcpCtx->reqQueue, 0, NULL);
 		}
@@ -589,8 +586,8 @@ static int TcpAsyncCtx_new(KSI_CTX *ctx, TcpAsyncCtx **tcpCtx) {
 
 	tmp->socketReady = false;
 	tmp->connectedAt = 0;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	tmp->connectCount = 0;
+	KSI_AsyncPacer_init(&tmp->pacer);
 
 	tmp->parent = NULL;
 
@@ -22,6 +22,8 @@
 #include "pkitruststore.h"
 #include "tlv.h"
 
+#include "impl/pkitruststore_impl.h"
+
 
 int KSI_PKISignature_fromTlv(KSI_TLV *tlv, KSI_PKISignature **sig) {
 	int res;
@@ -212,3 +214,67 @@ cleanup:
 
 KSI_IMPLEMENT_LIST(KSI_PKICertificate, KSI_PKICertificate_free);
 
+int KSI_PKITruststore_updateIdentity(KSI_CTX *ctx, KSI_DataHash **identity, const char *kind, const char *path, bool hashContent) {
+	int res;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHash *content = NULL;
+	KSI_DataHash *tmp = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	if (identity == NULL || kind == NULL || (hashContent && path == NULL)) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (*identity != NULL) {
+		res = KSI_DataHash_getImprint(*identity, &imprint, &imprint_len);
+		if (res != KSI_OK || (res = KSI_DataHasher_add(hsr, imprint, imprint_len)) != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_DataHasher_add(hsr, kind, strlen(kind) + 1);
+	if (res == KSI_OK && path != NULL) res = KSI_DataHasher_add(hsr, path, strlen(path) + 1);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* A lookup file is loaded at once, thus its content is a part of the configuration. */
+	if (hashContent) {
+		res = KSI_DataHash_fromFile(ctx, path, KSI_HASHALG_SHA2_256, &content);
+		if (res != KSI_OK || (res = KSI_DataHash_getImprint(content, &imprint, &imprint_len)) != KSI_OK ||
+				(res = KSI_DataHasher_add(hsr, imprint, imprint_len)) != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_DataHasher_close(hsr, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	KSI_DataHash_free(*identity);
+	*identity = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(content);
+	KSI_DataHash_free(tmp);
+
+	return res;
+}
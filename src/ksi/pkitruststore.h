@@ -67,6 +67,13 @@ extern "C" {
 	 */
 	void KSI_PKITruststore_free(KSI_PKITruststore *store);
 
+	/**
+	 * Increments the reference count of the truststore. The truststore is not modified by
+	 * the verification functions, so a configured truststore may be shared between threads;
+	 * the reference count is updated atomically.
+	 */
+	KSI_DEFINE_REF(KSI_PKITruststore);
+
 	/**
 	 * PKI Certificate constructor.
 	 * \param[in]	ctx			KSI context.
@@ -187,6 +194,20 @@ extern "C" {
 	 */
 	int KSI_PKITruststore_addLookupDir(const KSI_PKITruststore *store, const char *path);
 
+	/**
+	 * Returns the identity of the trust configuration of the truststore: a hash chain over the default
+	 * paths flag and the added lookup files and directories in the order of adding, including the
+	 * content of the lookup files. Stores with equal identities trust the same certificates, as long as
+	 * the content of the lookup directories and of the system default locations is not modified.
+	 * \param[in]	store		PKI truststore.
+	 * \param[out]	identity	Pointer to the receiving pointer, \c NULL for an empty configuration.
+	 *
+	 * \return status code (\c #KSI_OK, when operation succeeded, otherwise an
+	 * error code).
+	 * \note The output memory belongs to the truststore and may not be freed by the caller.
+	 */
+	int KSI_PKITruststore_getIdentity(const KSI_PKITruststore *store, KSI_DataHash **identity);
+
 	/**
 	 * Creates a string representation of a PKI Certificate.
 	 *
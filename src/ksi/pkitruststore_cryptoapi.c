@@ -31,6 +31,8 @@
 #include "crc32.h"
 
 #include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
+#include "impl/thread_impl.h"
 
 const char* getMSError(DWORD error, char *buf, size_t len){
 	LPVOID lpMsgBuf = NULL;
@@ -65,6 +67,9 @@ static int KSI_PKITruststore_global_initCount = 0;
 struct KSI_PKITruststore_st {
 	KSI_CTX *ctx;
 	HCERTSTORE collectionStore;
+	size_t ref;
+	/** Hash chain over the trust configuration, see #KSI_PKITruststore_getIdentity. */
+	KSI_DataHash *identity;
 };
 
 struct KSI_PKICertificate_st {
@@ -105,19 +110,28 @@ static ALG_ID algIdFromOID(const char *OID){
 }
 
 
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PKITruststore);
+
 void KSI_PKITruststore_free(KSI_PKITruststore *trust) {
 	char buf[1024];
 
-	if (trust != NULL) {
+	if (trust != NULL && KSI_ATOMIC_DEC_REF(&trust->ref) == 0) {
 		if (trust->collectionStore != NULL){
 			if (!CertCloseStore(trust->collectionStore, CERT_CLOSE_STORE_CHECK_FLAG)){
 				KSI_LOG_debug(trust->ctx, "%s", getMSError(GetLastError(), buf, sizeof(buf)));
 			}
 		}
+		KSI_DataHash_free(trust->identity);
 		KSI_free(trust);
 	}
 }
 
+int KSI_PKITruststore_getIdentity(const KSI_PKITruststore *trust, KSI_DataHash **identity) {
+	if (trust == NULL || identity == NULL) return KSI_INVALID_ARGUMENT;
+	*identity = trust->identity;
+	return KSI_OK;
+}
+
 /* TODO: Not supported. */
 int KSI_PKITruststore_addLookupDir(const KSI_PKITruststore *trust, const char *path) {
 	KSI_LOG_debug(trust->ctx, "CryptoAPI: Not implemented.");
@@ -153,6 +167,13 @@ int KSI_PKITruststore_addLookupFile(const KSI_PKITruststore *trust, const char *
 		goto cleanup;
 	}
 
+	/* The identity is bookkeeping of the store, thus updated also through the const pointer. */
+	res = KSI_PKITruststore_updateIdentity(trust->ctx, &((KSI_PKITruststore *)trust)->identity, "file", path, true);
+	if (res != KSI_OK) {
+		KSI_pushError(trust->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	res = KSI_OK;
 
 cleanup:
@@ -200,7 +221,9 @@ int KSI_PKITruststore_new(KSI_CTX *ctx, int setDefaults, KSI_PKITruststore **tru
 	}
 
 	tmp->ctx = ctx;
+	tmp->ref = 1;
 	tmp->collectionStore = collectionStore;
+	tmp->identity = NULL;
 
 	*trust = tmp;
 	tmp = NULL;
@@ -35,6 +35,8 @@
 #include "openssl_compatibility.h"
 
 #include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
+#include "impl/thread_impl.h"
 
 static const char *defaultCaFile =
 #ifdef OPENSSL_CA_FILE
@@ -56,6 +58,9 @@ static int KSI_PKITruststore_global_initCount = 0;
 struct KSI_PKITruststore_st {
 	KSI_CTX *ctx;
 	X509_STORE *store;
+	size_t ref;
+	/** Hash chain over the trust configuration, see #KSI_PKITruststore_getIdentity. */
+	KSI_DataHash *identity;
 };
 
 struct KSI_PKICertificate_st {
@@ -106,13 +111,22 @@ static int KSI_MD2hashAlg(EVP_MD *hash_alg) {
 		return -1;
 }
 
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PKITruststore);
+
 void KSI_PKITruststore_free(KSI_PKITruststore *trust) {
-	if (trust != NULL) {
+	if (trust != NULL && KSI_ATOMIC_DEC_REF(&trust->ref) == 0) {
 		if (trust->store != NULL) X509_STORE_free(trust->store);
+		KSI_DataHash_free(trust->identity);
 		KSI_free(trust);
 	}
 }
 
+int KSI_PKITruststore_getIdentity(const KSI_PKITruststore *trust, KSI_DataHash **identity) {
+	if (trust == NULL || identity == NULL) return KSI_INVALID_ARGUMENT;
+	*identity = trust->identity;
+	return KSI_OK;
+}
+
 int KSI_PKITruststore_addLookupFile(const KSI_PKITruststore *trust, const char *path) {
 	int res;
 	X509_LOOKUP *lookup = NULL;
@@ -142,6 +156,13 @@ int KSI_PKITruststore_addLookupFile(const KSI_PKITruststore *trust, const char *
 		goto cleanup;
 	}
 
+	/* The identity is bookkeeping of the store, thus updated also through the const pointer. */
+	res = KSI_PKITruststore_updateIdentity(trust->ctx, &((KSI_PKITruststore *)trust)->identity, "file", path, true);
+	if (res != KSI_OK) {
+		KSI_pushError(trust->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	res = KSI_OK;
 
 cleanup:
@@ -176,6 +197,12 @@ int KSI_PKITruststore_addLookupDir(const KSI_PKITruststore *trust, const char *p
 		goto cleanup;
 	}
 
+	res = KSI_PKITruststore_updateIdentity(trust->ctx, &((KSI_PKITruststore *)trust)->identity, "dir", path, false);
+	if (res != KSI_OK) {
+		KSI_pushError(trust->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	res = KSI_OK;
 
 cleanup:
@@ -211,7 +238,9 @@ int KSI_PKITruststore_new(KSI_CTX *ctx, int setDefaults, KSI_PKITruststore **tru
 	}
 
 	tmp->ctx = ctx;
+	tmp->ref = 1;
 	tmp->store = NULL;
+	tmp->identity = NULL;
 
 	tmp->store = X509_STORE_new();
 	if (tmp->store == NULL) {
@@ -226,6 +255,12 @@ int KSI_PKITruststore_new(KSI_CTX *ctx, int setDefaults, KSI_PKITruststore **tru
 			goto cleanup;
 		}
 
+		res = KSI_PKITruststore_updateIdentity(ctx, &tmp->identity, "defaults", NULL, false);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
 		/* Set lookup file for trusted CA certificates if specified. */
 		if (defaultCaFile != NULL) {
 			res = KSI_PKITruststore_addLookupFile(tmp, defaultCaFile);
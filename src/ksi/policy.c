@@ -33,7 +33,7 @@ static void KSI_RuleVerificationResult_free(KSI_RuleVerificationResult *result);
 static void VerificationTempData_clear(VerificationTempData *tmp);
 
 KSI_IMPLEMENT_LIST(KSI_RuleVerificationResult, KSI_RuleVerificationResult_free);
-KSI_IMPLEMENT_REF(KSI_PolicyVerificationResult);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PolicyVerificationResult);
 
 static int isDuplicateRuleResult(KSI_RuleVerificationResultList *resultList, KSI_RuleVerificationResult *result) {
 	int return_value = 0;
@@ -808,6 +808,8 @@ int KSI_SignatureVerifier_verify(const KSI_Policy *policy, KSI_VerificationConte
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_CTX *ctx = NULL;
 	KSI_PolicyVerificationResult *tmp = NULL;
+	KSI_Signature *prevFailed = NULL;
+	KSI_PolicyVerificationResult *prevResult = NULL;
 	VerificationTempData tempData;
 
 	memset(&tempData, 0, sizeof(tempData));
@@ -826,12 +828,20 @@ int KSI_SignatureVerifier_verify(const KSI_Policy *policy, KSI_VerificationConte
 	ctx = context->ctx;
 	KSI_ERR_clearErrors(ctx);
 
-	KSI_Signature_free(ctx->lastFailedSignature);
+	/* The signature may be shared between threads, its result slot is only accessed under the
+	 * lock. Release the previous values outside of the lock, as freeing may recycle objects. */
+	KSI_Mutex_lock(&ctx->lock);
+	prevFailed = ctx->lastFailedSignature;
 	ctx->lastFailedSignature = KSI_Signature_ref(context->signature);
-	if (ctx->lastFailedSignature != NULL) {
-		KSI_PolicyVerificationResult_free(ctx->lastFailedSignature->policyVerificationResult);
-		ctx->lastFailedSignature->policyVerificationResult = NULL;
+	if (context->signature != NULL) {
+		prevResult = context->signature->policyVerificationResult;
+		context->signature->policyVerificationResult = NULL;
 	}
+	KSI_Mutex_unlock(&ctx->lock);
+	KSI_Signature_free(prevFailed);
+	KSI_PolicyVerificationResult_free(prevResult);
+	prevFailed = NULL;
+	prevResult = NULL;
 
 	res = PolicyVerificationResult_create(&tmp);
 	if (res != KSI_OK) {
@@ -867,14 +877,20 @@ int KSI_SignatureVerifier_verify(const KSI_Policy *policy, KSI_VerificationConte
 		}
 	}
 
-	if (tmp->finalResult.resultCode != KSI_VER_RES_OK) {
-		if (ctx->lastFailedSignature != NULL) {
+	/* Leave the value intact if another thread has replaced the last failed signature meanwhile. */
+	KSI_Mutex_lock(&ctx->lock);
+	if (ctx->lastFailedSignature != NULL && ctx->lastFailedSignature == context->signature) {
+		if (tmp->finalResult.resultCode != KSI_VER_RES_OK) {
+			prevResult = ctx->lastFailedSignature->policyVerificationResult;
 			ctx->lastFailedSignature->policyVerificationResult = KSI_PolicyVerificationResult_ref(tmp);
+		} else {
+			prevFailed = ctx->lastFailedSignature;
+			ctx->lastFailedSignature = NULL;
 		}
-	} else {
-		KSI_Signature_free(ctx->lastFailedSignature);
-		ctx->lastFailedSignature = NULL;
 	}
+	KSI_Mutex_unlock(&ctx->lock);
+	KSI_Signature_free(prevFailed);
+	KSI_PolicyVerificationResult_free(prevResult);
 
 	*result = tmp;
 	tmp = NULL;
@@ -897,7 +913,7 @@ void KSI_Policy_free(KSI_Policy *policy) {
 }
 
 void KSI_PolicyVerificationResult_free(KSI_PolicyVerificationResult *result) {
-	if (result != NULL && --result->ref == 0) {
+	if (result != NULL && KSI_ATOMIC_DEC_REF(&result->ref) == 0) {
 		KSI_RuleVerificationResultList_free(result->ruleResults);
 		KSI_RuleVerificationResultList_free(result->policyResults);
 		KSI_RuleVerificationResult_clean(&result->finalResult);
@@ -22,6 +22,13 @@
 #include <stdio.h>
 #include <time.h>
 
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
 #include "base32.h"
 #include "crc32.h"
 #include "io.h"
@@ -61,9 +68,11 @@ struct generator_st {
 	size_t offset;
 	size_t sig_offset;
 	bool hasSignature;
+	/* Skip the publication records, as they are looked up from the index of a shared image. */
+	bool skipPublications;
 };
 
-KSI_IMPLEMENT_REF(KSI_PublicationsFile);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PublicationsFile);
 
 static int generateNextTlv(struct generator_st *gen, KSI_TLV **tlv) {
 	int res = KSI_UNKNOWN_ERROR;
@@ -82,6 +91,23 @@ static int generateNextTlv(struct generator_st *gen, KSI_TLV **tlv) {
 		gen->tlv = NULL;
 	}
 
+	while (gen->skipPublications && gen->len > 0) {
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(gen->ptr, gen->len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(gen->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (ftlv.tag != 0x0703) break;
+
+		consumed = ftlv.hdr_len + ftlv.dat_len;
+		gen->ptr += consumed;
+		gen->len -= consumed;
+		gen->offset += consumed;
+	}
+	consumed = 0;
+
 	/* Try to parse only when there is something left to parse. */
 	if (gen->len > 0) {
 		memset(&ftlv, 0, sizeof(ftlv));
@@ -133,232 +159,1082 @@ static int generateNextTlv(struct generator_st *gen, KSI_TLV **tlv) {
 
 	}
 
-	gen->offset += consumed;
-	*tlv = gen->tlv;
+	gen->offset += consumed;
+	*tlv = gen->tlv;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(buf);
+
+	return res;
+}
+
+/*
+ * FIXME! At the moment the users may not create publications files, as there are
+ * missing functions to manipulate its contents.
+ */
+int KSI_PublicationsFile_new(KSI_CTX *ctx, KSI_PublicationsFile **t) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFile *tmp = NULL;
+	tmp = KSI_new(KSI_PublicationsFile);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->ref = 1;
+	tmp->raw = NULL;
+	tmp->raw_len = 0;
+	tmp->header = NULL;
+	tmp->certificates = NULL;
+	tmp->publications = NULL;
+	tmp->signature = NULL;
+	tmp->certConstraints = NULL;
+	tmp->signatureVerified = false;
+	tmp->verifiedTrust[0] = '\0';
+	tmp->image = NULL;
+	*t = tmp;
+	tmp = NULL;
+	res = KSI_OK;
+cleanup:
+	KSI_PublicationsFile_free(tmp);
+	return res;
+}
+
+static int parsePublicationsFile(KSI_CTX *ctx, const void *raw, size_t raw_len, bool skipPublications, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	struct generator_st gen = {ctx, raw, raw_len, NULL, 0, 0, false, skipPublications};
+	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+
+	/* Check the header. */
+	if (gen.len < hdrLen || memcmp(gen.ptr, PUB_FILE_HEADER_ID, hdrLen)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
+		goto cleanup;
+	}
+
+	/* Header verification ok - create the store object. */
+	res = KSI_PublicationsFile_new(ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->signedDataLength = hdrLen;
+
+	/* Initialize generator. */
+	gen.ptr += hdrLen;
+	gen.len -= hdrLen;
+
+	/* Read the payload of the file, and make no assumptions with the ordering. */
+	res = KSI_TlvTemplate_extractGenerator(ctx, tmp, (void *)&gen, KSI_TLV_TEMPLATE(KSI_PublicationsFile), (int (*)(void *, KSI_TLV **))generateNextTlv);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->signedDataLength += gen.sig_offset;
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_TLV_free(gen.tlv);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+int KSI_PublicationsFile_parse(KSI_CTX *ctx, const void *raw, size_t raw_len, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	unsigned char *tmpRaw = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || raw == NULL || raw_len == 0 || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = parsePublicationsFile(ctx, raw, raw_len, false, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Copy the raw value. */
+	tmpRaw = KSI_malloc(raw_len);
+	if (tmpRaw == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	memcpy(tmpRaw, raw, raw_len);
+
+	tmp->raw = tmpRaw;
+	tmp->raw_len = raw_len;
+	tmpRaw = NULL;
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmpRaw);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/* Hex encoded SHA-256 imprint of the truststore identity and the publications file certificate
+ * constraints of the context, i.e. of everything the verification result depends on. */
+static int trustIdentity(KSI_CTX *ctx, char *buf, size_t buf_len) {
+	int res;
+	KSI_PKITruststore *pki = NULL;
+	KSI_DataHash *storeIdentity = NULL;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	size_t i;
+
+	if ((res = KSI_CTX_getPKITruststore(ctx, &pki)) != KSI_OK ||
+			(res = KSI_PKITruststore_getIdentity(pki, &storeIdentity)) != KSI_OK ||
+			(res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr)) != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (storeIdentity != NULL) {
+		if ((res = KSI_DataHash_getImprint(storeIdentity, &imprint, &imprint_len)) != KSI_OK ||
+				(res = KSI_DataHasher_add(hsr, imprint, imprint_len)) != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	for (i = 0; ctx->certConstraints != NULL && ctx->certConstraints[i].oid != NULL; i++) {
+		const char *val = ctx->certConstraints[i].val != NULL ? ctx->certConstraints[i].val : "";
+
+		if ((res = KSI_DataHasher_add(hsr, ctx->certConstraints[i].oid, strlen(ctx->certConstraints[i].oid) + 1)) != KSI_OK ||
+				(res = KSI_DataHasher_add(hsr, val, strlen(val) + 1)) != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (KSI_DataHash_toString(hsh, buf, buf_len) == NULL) {
+		KSI_pushError(ctx, res = KSI_BUFFER_OVERFLOW, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+int KSI_PublicationsFile_setSignatureVerified(KSI_PublicationsFile *pubFile, bool verified) {
+	int res;
+
+	if (pubFile == NULL) return KSI_INVALID_ARGUMENT;
+
+	pubFile->signatureVerified = false;
+	if (!verified) return KSI_OK;
+
+	res = trustIdentity(pubFile->ctx, pubFile->verifiedTrust, sizeof(pubFile->verifiedTrust));
+	if (res != KSI_OK) return res;
+
+	pubFile->signatureVerified = true;
+
+	return KSI_OK;
+}
+
+int KSI_PublicationsFile_verify(const KSI_PublicationsFile *pubFile, KSI_CTX *ctx) {
+	int res;
+	KSI_CTX *useCtx = ctx;
+	KSI_PKITruststore *pki = NULL;
+	char trust[KSI_PUBFILE_TRUST_IDENTITY_LEN];
+
+	if (pubFile == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (useCtx == NULL) {
+		useCtx = pubFile->ctx;
+	}
+
+	KSI_ERR_clearErrors(useCtx);
+
+	/* Make sure the signature exists. */
+	if (pubFile->signature == NULL) {
+		KSI_pushError(useCtx, res = KSI_PUBLICATIONS_FILE_NOT_SIGNED_WITH_PKI, NULL);
+		goto cleanup;
+	}
+
+	/* The signature of a file loaded from the publications file cache has already been verified,
+	 * as long as the trust configuration of the context has not been changed since. */
+	if (pubFile->signatureVerified && useCtx == pubFile->ctx && pubFile->certConstraints == NULL &&
+			trustIdentity(useCtx, trust, sizeof(trust)) == KSI_OK && strcmp(trust, pubFile->verifiedTrust) == 0) {
+		KSI_LOG_debug(useCtx, "Publications file signature verified earlier, skipping PKI verification.");
+		res = KSI_OK;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(useCtx);
+
+	/* Do we need to serialize the publications file? */
+	if (pubFile->raw == NULL) {
+		/* FIXME! At the moment the creation of publications file is not supported,
+		 * thus this error can not occur under normal conditions. */
+		KSI_pushError(useCtx, res = KSI_UNKNOWN_ERROR, "Not implemented.");
+		goto cleanup;
+	}
+
+	res = KSI_CTX_getPKITruststore(useCtx, &pki);
+	if (res != KSI_OK) {
+		KSI_pushError(useCtx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PKITruststore_verifyPKISignature(pki, pubFile->raw, pubFile->signedDataLength, pubFile->signature, pubFile->certConstraints);
+	if (res != KSI_OK) {
+		KSI_pushError(useCtx, res, "Signature not verified.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_nofree(useCtx);
+	KSI_nofree(pki);
+
+	return res;
+}
+
+static int readRawFile(KSI_CTX *ctx, const char *fileName, unsigned char **raw, size_t *raw_len) {
+	int res;
+	unsigned char *tmp = NULL;
+	size_t tmp_len = 0;
+	long raw_size = 0;
+	FILE *f = NULL;
+
+	f = fopen(fileName, "rb");
+	if (f == NULL) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open publications file.");
+		goto cleanup;
+	}
+
+	res = fseek(f, 0, SEEK_END);
+	if (res != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	raw_size = ftell(f);
+	if (raw_size < 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	if (raw_size > UINT_MAX) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file exceeds max size.");
+		goto cleanup;
+	}
+
+	res = fseek(f, 0, SEEK_SET);
+	if (res != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_calloc((unsigned)raw_size, 1);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp_len = fread(tmp, 1, (unsigned)raw_size, f);
+	if (tmp_len != (unsigned)raw_size) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	*raw = tmp;
+	*raw_len = tmp_len;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(tmp);
+
+	return res;
+}
+
+int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || fileName == NULL || pubFile == 0) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = readRawFile(ctx, fileName, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PublicationsFile_parse(ctx, raw, (unsigned)raw_len, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+#define PUB_FILE_INDEX_MAGIC "KSIPIDX1"
+
+typedef struct PublicationsFileIndexHeader_st {
+	char magic[8];
+	KSI_uint64_t raw_len;
+	KSI_uint64_t raw_crc32;
+	KSI_uint64_t count;
+} PublicationsFileIndexHeader;
+
+typedef struct PublicationsFileIndexEntry_st {
+	KSI_uint64_t time;
+	KSI_uint64_t offset;
+	KSI_uint64_t length;
+} PublicationsFileIndexEntry;
+
+struct KSI_PublicationsFileImage_st {
+	/** Read-only mappings of the raw file and its index. */
+	void *raw;
+	size_t raw_len;
+	void *index;
+	size_t index_len;
+	/** Index entries ordered by the publication time. */
+	const PublicationsFileIndexEntry *entries;
+	size_t count;
+};
+
+static int mapFile(KSI_CTX *ctx, const char *path, void **ptr, size_t *len) {
+	int res = KSI_UNKNOWN_ERROR;
+#ifndef _WIN32
+	int fd = -1;
+	struct stat st;
+	void *tmp = NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open shared publications file image.");
+		goto cleanup;
+	}
+
+	if (st.st_size <= 0) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Shared publications file image is empty.");
+		goto cleanup;
+	}
+
+	tmp = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (tmp == MAP_FAILED) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to map shared publications file image.");
+		goto cleanup;
+	}
+
+	*ptr = tmp;
+	*len = (size_t)st.st_size;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (fd >= 0) close(fd);
+#else
+	/* Fall back to a private copy. */
+	res = readRawFile(ctx, path, (unsigned char **)ptr, len);
+#endif
+
+	return res;
+}
+
+#ifndef _WIN32
+static void unmapFile(void *ptr, size_t len) {
+	if (ptr != NULL) munmap(ptr, len);
+}
+#else
+static void unmapFile(void *ptr, size_t KSI_UNUSED(len)) {
+	KSI_free(ptr);
+}
+#endif
+
+static void PublicationsFileImage_free(KSI_PublicationsFileImage *image) {
+	if (image != NULL) {
+		unmapFile(image->raw, image->raw_len);
+		unmapFile(image->index, image->index_len);
+		KSI_free(image);
+	}
+}
+
+static int parsePublicationRecord(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len, KSI_PublicationRecord **rec) {
+	int res;
+	KSI_PublicationRecord *tmp = NULL;
+
+	res = KSI_PublicationRecord_new(ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_TlvTemplate_parse(ctx, raw, raw_len, KSI_TLV_TEMPLATE(KSI_PublicationRecord), tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*rec = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationRecord_free(tmp);
+
+	return res;
+}
+
+/**
+ * Calls \c fn for every publication record of the raw publications file in the order of appearance.
+ */
+static int walkPublicationRecords(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len,
+		int (*fn)(void *, KSI_PublicationRecord *, size_t, size_t), void *fnCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t off = strlen(PUB_FILE_HEADER_ID);
+	KSI_FTLV ftlv;
+	KSI_PublicationRecord *rec = NULL;
+
+	while (off < raw_len) {
+		size_t len;
+
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(raw + off, raw_len - off, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+		len = ftlv.hdr_len + ftlv.dat_len;
+
+		if (ftlv.tag == 0x0703) {
+			res = parsePublicationRecord(ctx, raw + off, len, &rec);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+
+			res = fn(fnCtx, rec, off, len);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+
+			KSI_PublicationRecord_free(rec);
+			rec = NULL;
+		}
+
+		off += len;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationRecord_free(rec);
+
+	return res;
+}
+
+typedef struct IndexBuilder_st {
+	PublicationsFileIndexEntry *entries;
+	size_t count;
+	size_t size;
+} IndexBuilder;
+
+static int indexBuilder_add(IndexBuilder *builder, KSI_PublicationRecord *rec, size_t off, size_t len) {
+	PublicationsFileIndexEntry *entry = NULL;
+
+	if (rec->publishedData == NULL || rec->publishedData->time == NULL) return KSI_INVALID_FORMAT;
+
+	if (builder->count == builder->size) {
+		size_t size = builder->size == 0 ? 64 : builder->size * 2;
+		PublicationsFileIndexEntry *tmp = KSI_calloc(size, sizeof(PublicationsFileIndexEntry));
+		if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+
+		if (builder->entries != NULL) memcpy(tmp, builder->entries, builder->count * sizeof(PublicationsFileIndexEntry));
+		KSI_free(builder->entries);
+		builder->entries = tmp;
+		builder->size = size;
+	}
+
+	entry = &builder->entries[builder->count++];
+	entry->time = KSI_Integer_getUInt64(rec->publishedData->time);
+	entry->offset = off;
+	entry->length = len;
+
+	return KSI_OK;
+}
+
+static int indexEntry_compare(const void *a, const void *b) {
+	const PublicationsFileIndexEntry *ea = a;
+	const PublicationsFileIndexEntry *eb = b;
+
+	if (ea->time != eb->time) return ea->time < eb->time ? -1 : 1;
+	return ea->offset < eb->offset ? -1 : (ea->offset > eb->offset);
+}
+
+static int writeIndexFile(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len, FILE *f) {
+	int res = KSI_UNKNOWN_ERROR;
+	IndexBuilder builder = {NULL, 0, 0};
+	PublicationsFileIndexHeader hdr;
+
+	res = walkPublicationRecords(ctx, raw, raw_len, (int (*)(void *, KSI_PublicationRecord *, size_t, size_t))indexBuilder_add, &builder);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (builder.count > 0) qsort(builder.entries, builder.count, sizeof(PublicationsFileIndexEntry), indexEntry_compare);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PUB_FILE_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.raw_len = raw_len;
+	hdr.raw_crc32 = KSI_crc32(raw, raw_len, 0);
+	hdr.count = builder.count;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+			(builder.count > 0 && fwrite(builder.entries, sizeof(PublicationsFileIndexEntry), builder.count, f) != builder.count)) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write publications file index.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(builder.entries);
+
+	return res;
+}
+
+/* Position of the first index entry not before the given publication time. */
+static size_t image_lowerBound(const KSI_PublicationsFileImage *image, KSI_uint64_t time) {
+	size_t lo = 0;
+	size_t hi = image->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (image->entries[mid].time < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int image_publicationAt(const KSI_PublicationsFile *pubFile, size_t pos, KSI_PublicationRecord **rec) {
+	const PublicationsFileIndexEntry *entry = &pubFile->image->entries[pos];
+	return parsePublicationRecord(pubFile->ctx, pubFile->raw + entry->offset, (size_t)entry->length, rec);
+}
+
+static int appendPublication(KSI_LIST(KSI_PublicationRecord) *list, KSI_PublicationRecord *rec, size_t KSI_UNUSED(off), size_t KSI_UNUSED(len)) {
+	int res;
+
+	res = KSI_PublicationRecordList_append(list, rec);
+	if (res == KSI_OK) KSI_PublicationRecord_ref(rec);
+
+	return res;
+}
+
+/**
+ * Parses the publication records of a shared image for the functions that return references to the
+ * records owned by the publications file. The records are not a part of the observable state of the
+ * file, thus it is safe to populate them on a constant instance.
+ */
+static int materializePublications(const KSI_PublicationsFile *pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_PublicationRecord) *list = NULL;
+	int done;
+
+	if (pubFile->image == NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	/* The file may be shared between threads, the list is built outside the lock and the
+	 * copy of the thread that loses the race is discarded. */
+	KSI_Mutex_lock(&pubFile->ctx->lock);
+	done = pubFile->publications != NULL;
+	KSI_Mutex_unlock(&pubFile->ctx->lock);
+
+	if (done) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = KSI_PublicationRecordList_new(&list);
+	if (res != KSI_OK) {
+		KSI_pushError(pubFile->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = walkPublicationRecords(pubFile->ctx, pubFile->raw, pubFile->raw_len, (int (*)(void *, KSI_PublicationRecord *, size_t, size_t))appendPublication, list);
+	if (res != KSI_OK) {
+		KSI_pushError(pubFile->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	KSI_Mutex_lock(&pubFile->ctx->lock);
+	if (pubFile->publications == NULL) {
+		((KSI_PublicationsFile *)pubFile)->publications = list;
+		list = NULL;
+	}
+	KSI_Mutex_unlock(&pubFile->ctx->lock);
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_free(buf);
+	KSI_PublicationRecordList_free(list);
 
 	return res;
 }
 
-/*
- * FIXME! At the moment the users may not create publications files, as there are
- * missing functions to manipulate its contents.
- */
-int KSI_PublicationsFile_new(KSI_CTX *ctx, KSI_PublicationsFile **t) {
-	int res = KSI_UNKNOWN_ERROR;
-	KSI_PublicationsFile *tmp = NULL;
-	tmp = KSI_new(KSI_PublicationsFile);
-	if (tmp == NULL) {
-		res = KSI_OUT_OF_MEMORY;
-		goto cleanup;
-	}
+#define PUB_FILE_CACHE_RAW "publications.bin"
+#define PUB_FILE_CACHE_META "publications.meta"
+#define PUB_FILE_CACHE_INDEX "publications.idx"
+#define PUB_FILE_CACHE_DIGEST_LEN KSI_PUBFILE_TRUST_IDENTITY_LEN
 
-	tmp->ctx = ctx;
-	tmp->ref = 1;
-	tmp->raw = NULL;
-	tmp->raw_len = 0;
-	tmp->header = NULL;
-	tmp->certificates = NULL;
-	tmp->publications = NULL;
-	tmp->signature = NULL;
-	tmp->certConstraints = NULL;
-	*t = tmp;
-	tmp = NULL;
-	res = KSI_OK;
-cleanup:
-	KSI_PublicationsFile_free(tmp);
-	return res;
+static int cachePath(KSI_CTX *ctx, const char *dir, const char *name, const char *suffix, char *buf, size_t buf_len) {
+	if (strlen(dir) + strlen(name) + strlen(suffix) + 2 > buf_len) {
+		KSI_pushError(ctx, KSI_BUFFER_OVERFLOW, "Publications file cache path too long.");
+		return KSI_BUFFER_OVERFLOW;
+	}
+	KSI_snprintf(buf, buf_len, "%s/%s%s", dir, name, suffix);
+	return KSI_OK;
 }
 
-int KSI_PublicationsFile_parse(KSI_CTX *ctx, const void *raw, size_t raw_len, KSI_PublicationsFile **pubFile) {
-	int res;
-	KSI_PublicationsFile *tmp = NULL;
-	struct generator_st gen = {ctx, raw, raw_len, NULL, 0, 0, false};
-	unsigned char *tmpRaw = NULL;
-	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+static int cacheFileReplace(KSI_CTX *ctx, const char *tmpPath, const char *path) {
+#ifdef _WIN32
+	/* The rename does not replace existing files on Windows. */
+	remove(path);
+#endif
+	if (rename(tmpPath, path) != 0) {
+		remove(tmpPath);
+		KSI_pushError(ctx, KSI_IO_ERROR, "Unable to update publications file cache.");
+		return KSI_IO_ERROR;
+	}
+	return KSI_OK;
+}
 
-	KSI_ERR_clearErrors(ctx);
+/* Creates a uniquely named temporary file next to the given path, so concurrent writers do not share it. */
+static int cacheTempFile(KSI_CTX *ctx, const char *path, const char *mode, char *tmpPath, size_t tmpPath_len, FILE **f) {
+#ifdef _WIN32
+	static KSI_uint64_t counter = 0;
 
-	if (ctx == NULL || raw == NULL || raw_len == 0 || pubFile == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
+	/* The _mktemp_s names are only unique per process, thus a counter is added for the threads. */
+	if (strlen(path) + 29 > tmpPath_len) {
+		KSI_pushError(ctx, KSI_BUFFER_OVERFLOW, "Publications file cache path too long.");
+		return KSI_BUFFER_OVERFLOW;
+	}
+	KSI_snprintf(tmpPath, tmpPath_len, "%s.%llu.XXXXXX", path, (unsigned long long)KSI_ATOMIC_INC64(&counter));
+	if (_mktemp_s(tmpPath, strlen(tmpPath) + 1) != 0 || (*f = fopen(tmpPath, mode)) == NULL) {
+		KSI_pushError(ctx, KSI_IO_ERROR, "Unable to open publications file cache for writing.");
+		return KSI_IO_ERROR;
 	}
+#else
+	int fd;
 
-	/* Check the header. */
-	if (gen.len < hdrLen || memcmp(gen.ptr, PUB_FILE_HEADER_ID, hdrLen)) {
-		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
-		goto cleanup;
+	if (strlen(path) + 8 > tmpPath_len) {
+		KSI_pushError(ctx, KSI_BUFFER_OVERFLOW, "Publications file cache path too long.");
+		return KSI_BUFFER_OVERFLOW;
 	}
+	KSI_snprintf(tmpPath, tmpPath_len, "%s.XXXXXX", path);
 
-	/* Header verification ok - create the store object. */
-	res = KSI_PublicationsFile_new(ctx, &tmp);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
+	fd = mkstemp(tmpPath);
+	if (fd < 0) {
+		KSI_pushError(ctx, KSI_IO_ERROR, "Unable to open publications file cache for writing.");
+		return KSI_IO_ERROR;
 	}
 
-	tmp->signedDataLength = hdrLen;
+	/* The file is created private, but the cache is shared by all the users of the directory. */
+	if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0 || (*f = fdopen(fd, mode)) == NULL) {
+		close(fd);
+		remove(tmpPath);
+		KSI_pushError(ctx, KSI_IO_ERROR, "Unable to open publications file cache for writing.");
+		return KSI_IO_ERROR;
+	}
+#endif
+	return KSI_OK;
+}
 
-	/* Initialize generator. */
-	gen.ptr += hdrLen;
-	gen.len -= hdrLen;
+/* Hex encoded SHA-256 imprint of the raw publications file. */
+static int cacheDigest(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len, char *buf, size_t buf_len) {
+	int res;
+	KSI_DataHash *hsh = NULL;
 
-	/* Read the payload of the file, and make no assumptions with the ordering. */
-	res = KSI_TlvTemplate_extractGenerator(ctx, tmp, (void *)&gen, KSI_TLV_TEMPLATE(KSI_PublicationsFile), (int (*)(void *, KSI_TLV **))generateNextTlv);
+	res = KSI_DataHash_create(ctx, raw, raw_len, KSI_HASHALG_SHA2_256, &hsh);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	tmp->signedDataLength += gen.sig_offset;
-
-	/* Copy the raw value. */
-	tmpRaw = KSI_malloc(raw_len);
-	if (tmpRaw == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+	if (KSI_DataHash_toString(hsh, buf, buf_len) == NULL) {
+		KSI_pushError(ctx, res = KSI_BUFFER_OVERFLOW, NULL);
 		goto cleanup;
 	}
-	memcpy(tmpRaw, raw, raw_len);
-
-	tmp->raw = tmpRaw;
-	tmp->raw_len = raw_len;
-	tmpRaw = NULL;
-
-	*pubFile = tmp;
-	tmp = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-
-	KSI_free(tmpRaw);
-	KSI_TLV_free(gen.tlv);
-	KSI_PublicationsFile_free(tmp);
+	KSI_DataHash_free(hsh);
 
 	return res;
 }
 
-int KSI_PublicationsFile_verify(const KSI_PublicationsFile *pubFile, KSI_CTX *ctx) {
-	int res;
-	KSI_CTX *useCtx = ctx;
-	KSI_PKITruststore *pki = NULL;
+static int cacheMetaValue(const char *line, const char *key, char **value) {
+	size_t keyLen = strlen(key);
+	size_t len;
+	char *tmp = NULL;
 
-	if (pubFile == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
+	if (strncmp(line, key, keyLen) != 0 || line[keyLen] != '=') return KSI_OK;
+
+	line += keyLen + 1;
+	len = strlen(line);
+	while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+
+	tmp = KSI_calloc(len + 1, 1);
+	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+	memcpy(tmp, line, len);
+
+	KSI_free(*value);
+	*value = tmp;
+
+	return KSI_OK;
+}
+
+void KSI_PublicationsFileCacheEntry_clear(KSI_PublicationsFileCacheEntry *entry) {
+	if (entry != NULL) {
+		KSI_free(entry->raw);
+		KSI_free(entry->etag);
+		KSI_free(entry->lastModified);
+		memset(entry, 0, sizeof(*entry));
 	}
+}
 
-	if (useCtx == NULL) {
-		useCtx = pubFile->ctx;
+int KSI_PublicationsFileCache_load(KSI_CTX *ctx, const char *dir, const char *url, KSI_PublicationsFileCacheEntry *entry) {
+	int res = KSI_UNKNOWN_ERROR;
+	char path[1024];
+	char line[2048];
+	FILE *f = NULL;
+	char *cachedUrl = NULL;
+	char *fetchedAt = NULL;
+	char *verified = NULL;
+	char *cachedDigest = NULL;
+	char *cachedTrust = NULL;
+	char digest[PUB_FILE_CACHE_DIGEST_LEN];
+	char trust[PUB_FILE_CACHE_DIGEST_LEN];
+	KSI_PublicationsFileCacheEntry tmp;
+
+	memset(&tmp, 0, sizeof(tmp));
+
+	if (ctx == NULL || dir == NULL || entry == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
 	}
 
-	KSI_ERR_clearErrors(useCtx);
+	res = cachePath(ctx, dir, PUB_FILE_CACHE_META, "", path, sizeof(path));
+	if (res != KSI_OK) goto cleanup;
 
-	/* Make sure the signature exists. */
-	if (pubFile->signature == NULL) {
-		KSI_pushError(useCtx, res = KSI_PUBLICATIONS_FILE_NOT_SIGNED_WITH_PKI, NULL);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		/* Nothing cached yet. */
+		KSI_LOG_debug(ctx, "Publications file cache is empty: %s", dir);
+		res = KSI_OK;
 		goto cleanup;
 	}
 
-	/* Do we need to serialize the publications file? */
-	if (pubFile->raw == NULL) {
-		/* FIXME! At the moment the creation of publications file is not supported,
-		 * thus this error can not occur under normal conditions. */
-		KSI_pushError(useCtx, res = KSI_UNKNOWN_ERROR, "Not implemented.");
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((res = cacheMetaValue(line, "url", &cachedUrl)) != KSI_OK ||
+				(res = cacheMetaValue(line, "etag", &tmp.etag)) != KSI_OK ||
+				(res = cacheMetaValue(line, "last-modified", &tmp.lastModified)) != KSI_OK ||
+				(res = cacheMetaValue(line, "fetched", &fetchedAt)) != KSI_OK ||
+				(res = cacheMetaValue(line, "verified", &verified)) != KSI_OK ||
+				(res = cacheMetaValue(line, "digest", &cachedDigest)) != KSI_OK ||
+				(res = cacheMetaValue(line, "trust", &cachedTrust)) != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (fetchedAt == NULL || strcmp(cachedUrl != NULL ? cachedUrl : "", url != NULL ? url : "") != 0) {
+		KSI_LOG_debug(ctx, "Publications file cache does not match the publications file URL.");
+		res = KSI_OK;
 		goto cleanup;
 	}
 
-	res = KSI_CTX_getPKITruststore(useCtx, &pki);
+	res = cachePath(ctx, dir, PUB_FILE_CACHE_RAW, "", path, sizeof(path));
+	if (res != KSI_OK) goto cleanup;
+
+	res = readRawFile(ctx, path, &tmp.raw, &tmp.raw_len);
 	if (res != KSI_OK) {
-		KSI_pushError(useCtx, res, NULL);
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_PKITruststore_verifyPKISignature(pki, pubFile->raw, pubFile->signedDataLength, pubFile->signature, pubFile->certConstraints);
-	if (res != KSI_OK) {
-		KSI_pushError(useCtx, res, "Signature not verified.");
+	/* The files are not replaced together, make sure the metadata describes this raw file. */
+	res = cacheDigest(ctx, tmp.raw, tmp.raw_len, digest, sizeof(digest));
+	if (res != KSI_OK) goto cleanup;
+
+	if (cachedDigest == NULL || strcmp(cachedDigest, digest) != 0) {
+		KSI_LOG_debug(ctx, "Publications file cache metadata does not match the cached file.");
+		res = KSI_OK;
 		goto cleanup;
 	}
 
+	tmp.fetchedAt = (time_t)strtoll(fetchedAt, NULL, 10);
+
+	/* The verification result only holds for the same trust configuration. */
+	if (verified != NULL && strcmp(verified, "1") == 0) {
+		res = trustIdentity(ctx, trust, sizeof(trust));
+		if (res != KSI_OK) goto cleanup;
+
+		tmp.verified = cachedTrust != NULL && strcmp(cachedTrust, trust) == 0;
+		if (!tmp.verified) KSI_LOG_debug(ctx, "Publications file cache was verified with a different trust configuration.");
+	}
+
+	KSI_PublicationsFileCacheEntry_clear(entry);
+	*entry = tmp;
+	memset(&tmp, 0, sizeof(tmp));
+
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_nofree(useCtx);
-	KSI_nofree(pki);
+	if (f != NULL) fclose(f);
+	KSI_free(cachedUrl);
+	KSI_free(fetchedAt);
+	KSI_free(verified);
+	KSI_free(cachedDigest);
+	KSI_free(cachedTrust);
+	KSI_PublicationsFileCacheEntry_clear(&tmp);
 
 	return res;
 }
 
-int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile) {
-	int res;
-	KSI_PublicationsFile *tmp = NULL;
-	unsigned char *raw = NULL;
-	size_t raw_len = 0;
-	long raw_size = 0;
+int KSI_PublicationsFileCache_store(KSI_CTX *ctx, const char *dir, const char *url, const KSI_PublicationsFileCacheEntry *entry) {
+	int res = KSI_UNKNOWN_ERROR;
+	char path[1024];
+	char tmpPath[1024];
+	char digest[PUB_FILE_CACHE_DIGEST_LEN];
+	char trust[PUB_FILE_CACHE_DIGEST_LEN];
 	FILE *f = NULL;
 
-	KSI_ERR_clearErrors(ctx);
-
-	if (ctx == NULL || fileName == NULL || pubFile == 0) {
+	if (ctx == NULL || dir == NULL || entry == NULL || entry->raw == NULL) {
 		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
+	if ((res = cacheDigest(ctx, entry->raw, entry->raw_len, digest, sizeof(digest))) != KSI_OK ||
+			(res = trustIdentity(ctx, trust, sizeof(trust))) != KSI_OK) {
+		goto cleanup;
+	}
 
-	f = fopen(fileName, "rb");
-	if (f == NULL) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open publications file.");
+	/* Each file is replaced atomically, but the set of files is not: a concurrent reader may see
+	 * the files of different writers. Thus the index is bound to the raw file by its checksum and
+	 * the metadata by the digest of the raw file, and mismatching files are not used. */
+	if ((res = cachePath(ctx, dir, PUB_FILE_CACHE_RAW, "", path, sizeof(path))) != KSI_OK ||
+			(res = cacheTempFile(ctx, path, "wb", tmpPath, sizeof(tmpPath), &f)) != KSI_OK) {
 		goto cleanup;
 	}
 
-	res = fseek(f, 0, SEEK_END);
+	if (fwrite(entry->raw, 1, entry->raw_len, f) != entry->raw_len) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write publications file cache.");
+		goto cleanup;
+	}
+
+	res = fclose(f);
+	f = NULL;
 	if (res != 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		remove(tmpPath);
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write publications file cache.");
 		goto cleanup;
 	}
 
-	raw_size = ftell(f);
-	if (raw_size < 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+	res = cacheFileReplace(ctx, tmpPath, path);
+	if (res != KSI_OK) goto cleanup;
+
+	/* The lookup index for the contexts attaching to the shared image. */
+	if ((res = cachePath(ctx, dir, PUB_FILE_CACHE_INDEX, "", path, sizeof(path))) != KSI_OK ||
+			(res = cacheTempFile(ctx, path, "wb", tmpPath, sizeof(tmpPath), &f)) != KSI_OK) {
 		goto cleanup;
 	}
 
-	if (raw_size > UINT_MAX) {
-		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file exceeds max size.");
+	res = writeIndexFile(ctx, entry->raw, entry->raw_len, f);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = fseek(f, 0, SEEK_SET);
+	res = fclose(f);
+	f = NULL;
 	if (res != 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		remove(tmpPath);
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write publications file index.");
+		goto cleanup;
+	}
+
+	res = cacheFileReplace(ctx, tmpPath, path);
+	if (res != KSI_OK) goto cleanup;
+
+	if ((res = cachePath(ctx, dir, PUB_FILE_CACHE_META, "", path, sizeof(path))) != KSI_OK ||
+			(res = cacheTempFile(ctx, path, "w", tmpPath, sizeof(tmpPath), &f)) != KSI_OK) {
+		goto cleanup;
+	}
+
+	fprintf(f, "url=%s\n", url != NULL ? url : "");
+	if (entry->etag != NULL) fprintf(f, "etag=%s\n", entry->etag);
+	if (entry->lastModified != NULL) fprintf(f, "last-modified=%s\n", entry->lastModified);
+	fprintf(f, "fetched=%lld\n", (long long)entry->fetchedAt);
+	fprintf(f, "digest=%s\n", digest);
+	fprintf(f, "verified=%d\n", entry->verified ? 1 : 0);
+	fprintf(f, "trust=%s\n", trust);
+
+	res = ferror(f);
+	res |= fclose(f);
+	f = NULL;
+	if (res != 0) {
+		remove(tmpPath);
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write publications file cache.");
+		goto cleanup;
+	}
+
+	res = cacheFileReplace(ctx, tmpPath, path);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) {
+		fclose(f);
+		remove(tmpPath);
+	}
+
+	return res;
+}
+
+int KSI_PublicationsFileCache_attach(KSI_CTX *ctx, const char *dir, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	char path[1024];
+	KSI_PublicationsFileImage *image = NULL;
+	const PublicationsFileIndexHeader *hdr = NULL;
+	KSI_PublicationsFile *tmp = NULL;
+	size_t i;
+
+	if (ctx == NULL || dir == NULL || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	raw = KSI_calloc((unsigned)raw_size, 1);
-	if (raw == NULL) {
+	image = KSI_new(KSI_PublicationsFileImage);
+	if (image == NULL) {
 		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
 		goto cleanup;
 	}
+	memset(image, 0, sizeof(*image));
 
-	raw_len = fread(raw, 1, (unsigned)raw_size, f);
-	if (raw_len != (unsigned)raw_size) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+	if ((res = cachePath(ctx, dir, PUB_FILE_CACHE_RAW, "", path, sizeof(path))) != KSI_OK ||
+			(res = mapFile(ctx, path, &image->raw, &image->raw_len)) != KSI_OK ||
+			(res = cachePath(ctx, dir, PUB_FILE_CACHE_INDEX, "", path, sizeof(path))) != KSI_OK ||
+			(res = mapFile(ctx, path, &image->index, &image->index_len)) != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_PublicationsFile_parse(ctx, raw, (unsigned)raw_len, &tmp);
+	/* Make sure the index belongs to the raw file. */
+	hdr = image->index;
+	if (image->index_len < sizeof(*hdr) || memcmp(hdr->magic, PUB_FILE_INDEX_MAGIC, sizeof(hdr->magic)) != 0 ||
+			hdr->raw_len != image->raw_len || hdr->count > (image->index_len - sizeof(*hdr)) / sizeof(PublicationsFileIndexEntry) ||
+			image->index_len != sizeof(*hdr) + hdr->count * sizeof(PublicationsFileIndexEntry) ||
+			hdr->raw_crc32 != KSI_crc32(image->raw, image->raw_len, 0)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file index does not match the publications file.");
+		goto cleanup;
+	}
+
+	image->entries = (const PublicationsFileIndexEntry *)(hdr + 1);
+	image->count = (size_t)hdr->count;
+
+	for (i = 0; i < image->count; i++) {
+		if (image->entries[i].offset > image->raw_len || image->entries[i].length > image->raw_len - image->entries[i].offset) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file index entry out of bounds.");
+			goto cleanup;
+		}
+	}
+
+	/* The publication records are looked up from the index on demand. */
+	res = parsePublicationsFile(ctx, image->raw, image->raw_len, true, &tmp);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
+	tmp->raw = image->raw;
+	tmp->raw_len = image->raw_len;
+	tmp->image = image;
+	image = NULL;
+
 	*pubFile = tmp;
 	tmp = NULL;
 
@@ -366,8 +1242,7 @@ int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_Public
 
 cleanup:
 
-	if (f != NULL) fclose(f);
-	KSI_free(raw);
+	PublicationsFileImage_free(image);
 	KSI_PublicationsFile_free(tmp);
 
 	return res;
@@ -512,12 +1387,17 @@ cleanup:
 }
 
 void KSI_PublicationsFile_free(KSI_PublicationsFile *t) {
-	if (t != NULL && --t->ref == 0) {
+	if (t != NULL && KSI_ATOMIC_DEC_REF(&t->ref) == 0) {
 		KSI_PublicationsHeader_free(t->header);
 		KSI_CertificateRecordList_free(t->certificates);
 		KSI_PublicationRecordList_free(t->publications);
 		KSI_PKISignature_free(t->signature);
-		KSI_free(t->raw);
+		/* The raw value of an attached file belongs to the shared image. */
+		if (t->image != NULL) {
+			PublicationsFileImage_free(t->image);
+		} else {
+			KSI_free(t->raw);
+		}
 		if(t->ctx->freeCertConstraintsArray != NULL) {
 			t->ctx->freeCertConstraintsArray(t->certConstraints);
 		}
@@ -527,7 +1407,21 @@ void KSI_PublicationsFile_free(KSI_PublicationsFile *t) {
 
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_PublicationsHeader*, header, Header);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_LIST(KSI_CertificateRecord)*, certificates, Certificates);
-KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_LIST(KSI_PublicationRecord)*, publications, Publications);
+KSI_DEFINE_GETTER(KSI_PublicationsFile, KSI_LIST(KSI_PublicationRecord)*, publications, Publications) {
+	int res = KSI_UNKNOWN_ERROR;
+	if (o == NULL || publications == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = materializePublications(o);
+	if (res != KSI_OK) goto cleanup;
+
+	*publications = o->publications;
+	res = KSI_OK;
+cleanup:
+	return res;
+}
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_PKISignature *, signature, Signature);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, size_t, signedDataLength, SignedDataLength);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_CertConstraint*, certConstraints, CertConstraints);
@@ -607,6 +1501,13 @@ int KSI_PublicationsFile_getPublicationDataByTime(const KSI_PublicationsFile *tr
 		goto cleanup;
 	}
 
+	/* The returned record is owned by the publications file. */
+	res = materializePublications(trust);
+	if (res != KSI_OK) {
+		KSI_pushError(trust->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
 		KSI_PublicationData *pd = NULL;
@@ -757,6 +1658,23 @@ int KSI_PublicationsFile_getNearestPublication(const KSI_PublicationsFile *trust
 		goto cleanup;
 	}
 
+	/* Look up only the needed record from the shared image. */
+	if (trust->image != NULL && trust->publications == NULL) {
+		size_t pos = image_lowerBound(trust->image, KSI_Integer_getUInt64(pubTime));
+
+		*pubRec = NULL;
+		if (pos < trust->image->count) {
+			res = image_publicationAt(trust, pos, pubRec);
+			if (res != KSI_OK) {
+				KSI_pushError(trust->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
 
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
@@ -824,6 +1742,13 @@ int KSI_PublicationsFile_getLatestPublication(const KSI_PublicationsFile *trust,
 		goto cleanup;
 	}
 
+	/* The returned record is owned by the publications file. */
+	res = materializePublications(trust);
+	if (res != KSI_OK) {
+		KSI_pushError(trust->ctx, res, NULL);
+		goto cleanup;
+	}
+
 
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
@@ -889,6 +1814,31 @@ static int findPublication(const KSI_PublicationsFile *trust, const KSI_Integer
 		goto cleanup;
 	}
 
+	if (trust->image != NULL && trust->publications == NULL) {
+		KSI_uint64_t tm = KSI_Integer_getUInt64(time);
+
+		for (i = image_lowerBound(trust->image, tm); i < trust->image->count && trust->image->entries[i].time == tm; i++) {
+			KSI_PublicationRecord *pr = NULL;
+
+			res = image_publicationAt(trust, i, &pr);
+			if (res != KSI_OK) {
+				KSI_pushError(trust->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			if (pr->publishedData == NULL || (imprint != NULL && !KSI_DataHash_equals(pr->publishedData->imprint, imprint))) {
+				KSI_PublicationRecord_free(pr);
+				continue;
+			}
+
+			*outRec = pr;
+			break;
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
 
@@ -1227,7 +2177,7 @@ cleanup:
  * KSI_PublicationData
  */
 void KSI_PublicationData_free(KSI_PublicationData *t) {
-	if (t != NULL && --t->ref == 0) {
+	if (t != NULL && KSI_ATOMIC_DEC_REF(&t->ref) == 0) {
 		KSI_Integer_free(t->time);
 		KSI_DataHash_free(t->imprint);
 		KSI_TLV_free(t->baseTlv);
@@ -1327,7 +2277,7 @@ KSI_IMPLEMENT_TOTLV(KSI_PublicationData);
  * KSI_PublicationRecord
  */
 void KSI_PublicationRecord_free(KSI_PublicationRecord *t) {
-	if (t != NULL && --t->ref == 0) {
+	if (t != NULL && KSI_ATOMIC_DEC_REF(&t->ref) == 0) {
 		KSI_PublicationData_free(t->publishedData);
 		KSI_Utf8StringList_free(t->publicationRef);
 		KSI_Utf8StringList_free(t->repositoryUriList);
@@ -1361,7 +2311,7 @@ cleanup:
 	return res;
 }
 
-KSI_IMPLEMENT_REF(KSI_PublicationRecord);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PublicationRecord);
 KSI_IMPLEMENT_WRITE_BYTES(KSI_PublicationRecord, 0x0803, 0, 0);
 
 
@@ -1443,4 +2393,4 @@ KSI_IMPLEMENT_SETTER(KSI_PublicationRecord, KSI_PublicationData*, publishedData,
 KSI_IMPLEMENT_SETTER(KSI_PublicationRecord, KSI_LIST(KSI_Utf8String)*, publicationRef, PublicationRefList);
 KSI_IMPLEMENT_SETTER(KSI_PublicationRecord, KSI_LIST(KSI_Utf8String)*, repositoryUriList, RepositoryUriList);
 
-KSI_IMPLEMENT_REF(KSI_PublicationData);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_PublicationData);
@@ -273,6 +273,7 @@ extern "C" {
 	/**
 	 * Function for freeing publicationsfile object.
 	 * \param[in]	pubFile		Publicationsfile to be freed.
+	 * \note The reference count is updated atomically, thus a publications file may be shared between threads.
 	 */
 	void KSI_PublicationsFile_free(KSI_PublicationsFile *pubFile);
 
@@ -0,0 +1,492 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "impl/sha_impl.h"
+
+/* The SHA extensions are used on x86 with the compilers supporting the intrinsics. */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#  define SHA2_X86
+#  define SHA2_TARGET_SHANI __attribute__((target("sha,sse4.1,ssse3")))
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER) && _MSC_VER >= 1900
+#  define SHA2_X86
+#  define SHA2_TARGET_SHANI
+#  include <intrin.h>
+#  include <immintrin.h>
+#endif
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define SHA256_S0(x) (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define SHA256_S1(x) (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define SHA256_s0(x) (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+
+#define SHA512_S0(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define SHA512_S1(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define SHA512_s0(x) (ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define SHA512_s1(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+/* A round renames the working variables instead of moving them, 8 rounds bring them back in place. */
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i)								\
+	t = h + SHA256_S1(e) + CH(e, f, g) + K256[i] + w[i];					\
+	d += t;																	\
+	h = t + SHA256_S0(a) + MAJ(a, b, c);
+
+#define SHA512_ROUND(a, b, c, d, e, f, g, h, i)								\
+	t = h + SHA512_S1(e) + CH(e, f, g) + K512[i] + w[i];					\
+	d += t;																	\
+	h = t + SHA512_S0(a) + MAJ(a, b, c);
+
+static const uint32_t K256[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint64_t K512[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint32_t IV1[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static const uint32_t IV256[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint64_t IV384[8] = {
+	0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+	0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+static const uint64_t IV512[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static uint32_t load32(const unsigned char *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t load64(const unsigned char *p) {
+	return ((uint64_t)load32(p) << 32) | (uint64_t)load32(p + 4);
+}
+
+static void store32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static void store64(unsigned char *p, uint64_t v) {
+	store32(p, (uint32_t)(v >> 32));
+	store32(p + 4, (uint32_t)v);
+}
+
+static void sha1Blocks(uint32_t *state, const unsigned char *data, size_t blocks) {
+	uint32_t w[80];
+	uint32_t a, b, c, d, e;
+	uint32_t f, k, t;
+	size_t i;
+
+	while (blocks-- > 0) {
+		for (i = 0; i < 16; i++) w[i] = load32(data + 4 * i);
+		for (i = 16; i < 80; i++) w[i] = ROTL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+
+		for (i = 0; i < 80; i++) {
+			if (i < 20) {
+				f = CH(b, c, d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = MAJ(b, c, d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			t = ROTL32(a, 5) + f + e + k + w[i];
+			e = d; d = c; c = ROTL32(b, 30); b = a; a = t;
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+
+		data += 64;
+	}
+}
+
+static void sha256BlocksPortable(uint32_t *state, const unsigned char *data, size_t blocks) {
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t t;
+	size_t i;
+
+	while (blocks-- > 0) {
+		for (i = 0; i < 16; i++) w[i] = load32(data + 4 * i);
+		for (i = 16; i < 64; i++) w[i] = SHA256_s1(w[i - 2]) + w[i - 7] + SHA256_s0(w[i - 15]) + w[i - 16];
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+		for (i = 0; i < 64; i += 8) {
+			SHA256_ROUND(a, b, c, d, e, f, g, h, i);
+			SHA256_ROUND(h, a, b, c, d, e, f, g, i + 1);
+			SHA256_ROUND(g, h, a, b, c, d, e, f, i + 2);
+			SHA256_ROUND(f, g, h, a, b, c, d, e, i + 3);
+			SHA256_ROUND(e, f, g, h, a, b, c, d, i + 4);
+			SHA256_ROUND(d, e, f, g, h, a, b, c, i + 5);
+			SHA256_ROUND(c, d, e, f, g, h, a, b, i + 6);
+			SHA256_ROUND(b, c, d, e, f, g, h, a, i + 7);
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+		data += 64;
+	}
+}
+
+static void sha512BlocksPortable(uint64_t *state, const unsigned char *data, size_t blocks) {
+	uint64_t w[80];
+	uint64_t a, b, c, d, e, f, g, h;
+	uint64_t t;
+	size_t i;
+
+	while (blocks-- > 0) {
+		for (i = 0; i < 16; i++) w[i] = load64(data + 8 * i);
+		for (i = 16; i < 80; i++) w[i] = SHA512_s1(w[i - 2]) + w[i - 7] + SHA512_s0(w[i - 15]) + w[i - 16];
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+		for (i = 0; i < 80; i += 8) {
+			SHA512_ROUND(a, b, c, d, e, f, g, h, i);
+			SHA512_ROUND(h, a, b, c, d, e, f, g, i + 1);
+			SHA512_ROUND(g, h, a, b, c, d, e, f, i + 2);
+			SHA512_ROUND(f, g, h, a, b, c, d, e, i + 3);
+			SHA512_ROUND(e, f, g, h, a, b, c, d, i + 4);
+			SHA512_ROUND(d, e, f, g, h, a, b, c, i + 5);
+			SHA512_ROUND(c, d, e, f, g, h, a, b, i + 6);
+			SHA512_ROUND(b, c, d, e, f, g, h, a, i + 7);
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+		data += 128;
+	}
+}
+
+#ifdef SHA2_X86
+/* 4 rounds of SHA-256 with the Intel SHA extensions, consuming the message words \c w. */
+#define SHANI_ROUNDS(w, k)																	\
+	msg = _mm_add_epi32(w, _mm_loadu_si128((const __m128i *)&K256[4 * (k)]));			\
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);								\
+	state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E))
+
+/* The message schedule: \c next is completed from the following words \c cur and the preceding \c prev,
+ * \c prev is prepared with the following words \c cur. */
+#define SHANI_MSG2(next, cur, prev) next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur)
+#define SHANI_MSG1(prev, cur) prev = _mm_sha256msg1_epu32(prev, cur)
+
+/* SHA-256 with the Intel SHA extensions. Each group of 4 rounds consumes 4 message words, the message
+ * schedule for the later groups is computed with sha256msg1/sha256msg2 meanwhile. */
+static SHA2_TARGET_SHANI void sha256BlocksShaNi(uint32_t *state, const unsigned char *data, size_t blocks) {
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1;
+	__m128i abef, cdgh;
+	__m128i msg, tmp;
+	__m128i w0, w1, w2, w3;
+
+	/* Reorder the state into ABEF and CDGH as expected by sha256rnds2. */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while (blocks-- > 0) {
+		abef = state0;
+		cdgh = state1;
+
+		w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+		SHANI_ROUNDS(w0, 0);
+		SHANI_ROUNDS(w1, 1);	SHANI_MSG1(w0, w1);
+		SHANI_ROUNDS(w2, 2);	SHANI_MSG1(w1, w2);
+		SHANI_ROUNDS(w3, 3);	SHANI_MSG2(w0, w3, w2);	SHANI_MSG1(w2, w3);
+		SHANI_ROUNDS(w0, 4);	SHANI_MSG2(w1, w0, w3);	SHANI_MSG1(w3, w0);
+		SHANI_ROUNDS(w1, 5);	SHANI_MSG2(w2, w1, w0);	SHANI_MSG1(w0, w1);
+		SHANI_ROUNDS(w2, 6);	SHANI_MSG2(w3, w2, w1);	SHANI_MSG1(w1, w2);
+		SHANI_ROUNDS(w3, 7);	SHANI_MSG2(w0, w3, w2);	SHANI_MSG1(w2, w3);
+		SHANI_ROUNDS(w0, 8);	SHANI_MSG2(w1, w0, w3);	SHANI_MSG1(w3, w0);
+		SHANI_ROUNDS(w1, 9);	SHANI_MSG2(w2, w1, w0);	SHANI_MSG1(w0, w1);
+		SHANI_ROUNDS(w2, 10);	SHANI_MSG2(w3, w2, w1);	SHANI_MSG1(w1, w2);
+		SHANI_ROUNDS(w3, 11);	SHANI_MSG2(w0, w3, w2);	SHANI_MSG1(w2, w3);
+		SHANI_ROUNDS(w0, 12);	SHANI_MSG2(w1, w0, w3);	SHANI_MSG1(w3, w0);
+		SHANI_ROUNDS(w1, 13);	SHANI_MSG2(w2, w1, w0);
+		SHANI_ROUNDS(w2, 14);	SHANI_MSG2(w3, w2, w1);
+		SHANI_ROUNDS(w3, 15);
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+
+		data += 64;
+	}
+
+	/* Restore the ABCDEFGH order. */
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static int cpuHasShaNi(void) {
+	unsigned ecx1;
+	unsigned ebx7;
+#ifdef _MSC_VER
+	int r[4];
+
+	__cpuid(r, 0);
+	if (r[0] < 7) return 0;
+	__cpuid(r, 1);
+	ecx1 = (unsigned)r[2];
+	__cpuidex(r, 7, 0);
+	ebx7 = (unsigned)r[1];
+#else
+	unsigned a, b, c, d;
+
+	if (__get_cpuid_max(0, NULL) < 7) return 0;
+	__cpuid(1, a, b, c, d);
+	ecx1 = c;
+	__cpuid_count(7, 0, a, b, c, d);
+	ebx7 = b;
+#endif
+
+	/* SSSE3 (leaf 1 ECX bit 9), SSE4.1 (leaf 1 ECX bit 19) and SHA (leaf 7 EBX bit 29). */
+	return (ecx1 & (1u << 9)) != 0 && (ecx1 & (1u << 19)) != 0 && (ebx7 & (1u << 29)) != 0;
+}
+#endif
+
+static void sha256BlocksDetect(uint32_t *state, const unsigned char *data, size_t blocks);
+
+/* The implementation is selected on the first use. Concurrent first uses store the same value. */
+static void (*sha256Blocks)(uint32_t *, const unsigned char *, size_t) = sha256BlocksDetect;
+static const char *sha256Name = "portable";
+static int accelerated = 1;
+
+static void selectImplementation(void) {
+	sha256Blocks = sha256BlocksPortable;
+	sha256Name = "portable";
+
+#ifdef SHA2_X86
+	if (accelerated && cpuHasShaNi()) {
+		sha256Blocks = sha256BlocksShaNi;
+		sha256Name = "sha-ni";
+	}
+#endif
+}
+
+static void sha256BlocksDetect(uint32_t *state, const unsigned char *data, size_t blocks) {
+	selectImplementation();
+	sha256Blocks(state, data, blocks);
+}
+
+void KSI_Sha2_setAccelerated(int enable) {
+	accelerated = enable;
+	selectImplementation();
+}
+
+const char *KSI_Sha2_getImplementation(void) {
+	if (sha256Blocks == sha256BlocksDetect) selectImplementation();
+	return sha256Name;
+}
+
+/* Adds data to a hash computation with 64 byte blocks. */
+static void update64(uint32_t *state, uint64_t *length, unsigned char *buf, const void *data, size_t len,
+		void (*blocksFn)(uint32_t *, const unsigned char *, size_t)) {
+	const unsigned char *ptr = data;
+	size_t used = (size_t)(*length % 64);
+
+	*length += len;
+
+	if (used > 0) {
+		size_t n = 64 - used < len ? 64 - used : len;
+
+		memcpy(buf + used, ptr, n);
+		ptr += n;
+		len -= n;
+		if (used + n < 64) return;
+
+		blocksFn(state, buf, 1);
+	}
+
+	/* The full blocks are hashed directly from the input. */
+	if (len >= 64) {
+		blocksFn(state, ptr, len / 64);
+		ptr += len - len % 64;
+		len %= 64;
+	}
+
+	if (len > 0) memcpy(buf, ptr, len);
+}
+
+/* Pads the last block of a hash computation with 64 byte blocks. */
+static void final64(uint32_t *state, uint64_t length, unsigned char *buf,
+		void (*blocksFn)(uint32_t *, const unsigned char *, size_t)) {
+	size_t used = (size_t)(length % 64);
+
+	buf[used++] = 0x80;
+	if (used > 56) {
+		memset(buf + used, 0, 64 - used);
+		blocksFn(state, buf, 1);
+		used = 0;
+	}
+	memset(buf + used, 0, 56 - used);
+	store64(buf + 56, length << 3);
+	blocksFn(state, buf, 1);
+}
+
+void KSI_Sha1_init(KSI_Sha1 *sha) {
+	memcpy(sha->state, IV1, sizeof(IV1));
+	sha->length = 0;
+}
+
+void KSI_Sha1_update(KSI_Sha1 *sha, const void *data, size_t len) {
+	update64(sha->state, &sha->length, sha->buf, data, len, sha1Blocks);
+}
+
+void KSI_Sha1_final(KSI_Sha1 *sha, unsigned char *digest) {
+	size_t i;
+
+	final64(sha->state, sha->length, sha->buf, sha1Blocks);
+	for (i = 0; i < 5; i++) store32(digest + 4 * i, sha->state[i]);
+}
+
+void KSI_Sha256_init(KSI_Sha256 *sha) {
+	memcpy(sha->state, IV256, sizeof(IV256));
+	sha->length = 0;
+}
+
+void KSI_Sha256_update(KSI_Sha256 *sha, const void *data, size_t len) {
+	update64(sha->state, &sha->length, sha->buf, data, len, sha256Blocks);
+}
+
+void KSI_Sha256_final(KSI_Sha256 *sha, unsigned char *digest) {
+	size_t i;
+
+	final64(sha->state, sha->length, sha->buf, sha256Blocks);
+	for (i = 0; i < 8; i++) store32(digest + 4 * i, sha->state[i]);
+}
+
+void KSI_Sha512_init(KSI_Sha512 *sha, size_t digest_length) {
+	memcpy(sha->state, digest_length == 48 ? IV384 : IV512, sizeof(IV512));
+	sha->length = 0;
+	sha->digest_length = digest_length == 48 ? 48 : 64;
+}
+
+void KSI_Sha512_update(KSI_Sha512 *sha, const void *data, size_t len) {
+	const unsigned char *ptr = data;
+	size_t used = (size_t)(sha->length % 128);
+
+	sha->length += len;
+
+	if (used > 0) {
+		size_t n = 128 - used < len ? 128 - used : len;
+
+		memcpy(sha->buf + used, ptr, n);
+		ptr += n;
+		len -= n;
+		if (used + n < 128) return;
+
+		sha512BlocksPortable(sha->state, sha->buf, 1);
+	}
+
+	if (len >= 128) {
+		sha512BlocksPortable(sha->state, ptr, len / 128);
+		ptr += len - len % 128;
+		len %= 128;
+	}
+
+	if (len > 0) memcpy(sha->buf, ptr, len);
+}
+
+void KSI_Sha512_final(KSI_Sha512 *sha, unsigned char *digest) {
+	size_t used = (size_t)(sha->length % 128);
+	size_t i;
+
+	sha->buf[used++] = 0x80;
+	if (used > 112) {
+		memset(sha->buf + used, 0, 128 - used);
+		sha512BlocksPortable(sha->state, sha->buf, 1);
+		used = 0;
+	}
+	/* The length is a 128-bit value, the input is never longer than 2^64 bytes. */
+	memset(sha->buf + used, 0, 112 - used);
+	store64(sha->buf + 112, sha->length >> 61);
+	store64(sha->buf + 120, sha->length << 3);
+	sha512BlocksPortable(sha->state, sha->buf, 1);
+
+	for (i = 0; i < sha->digest_length / 8; i++) store64(digest + 8 * i, sha->state[i]);
+}
@@ -34,6 +34,7 @@
 #include "impl/signature_builder_impl.h"
 #include "impl/signature_impl.h"
 #include "impl/verification_impl.h"
+#include "executor.h"
 
 typedef struct headerRec_st HeaderRec;
 
@@ -43,7 +44,7 @@ KSI_IMPORT_TLV_TEMPLATE(KSI_AggregationAuthRec);
 KSI_IMPORT_TLV_TEMPLATE(KSI_CalendarAuthRec);
 KSI_IMPORT_TLV_TEMPLATE(KSI_RFC3161);
 
-KSI_IMPLEMENT_REF(KSI_Signature);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_Signature);
 
 /**
  * KSI_AggregationHashChain
@@ -899,7 +900,7 @@ cleanup:
 }
 
 void KSI_Signature_free(KSI_Signature *sig) {
-	if (sig != NULL && --sig->ref == 0) {
+	if (sig != NULL && KSI_ATOMIC_DEC_REF(&sig->ref) == 0) {
 		KSI_TLV_free(sig->baseTlv);
 		KSI_CalendarHashChain_free(sig->calendarChain);
 		KSI_AggregationHashChainList_free(sig->aggregationChainList);
@@ -1081,6 +1082,56 @@ cleanup:
 	return res;
 }
 
+typedef struct SignatureParseBatch_st {
+	KSI_CTX *ctx;
+	const unsigned char * const *raw;
+	const size_t *raw_len;
+	KSI_Signature **sig;
+	int *results;
+} SignatureParseBatch;
+
+static int parseBatchElement(void *c, size_t i) {
+	SignatureParseBatch *batch = c;
+	int res;
+
+	res = KSI_Signature_parse(batch->ctx, batch->raw[i], batch->raw_len[i], &batch->sig[i]);
+	if (batch->results != NULL) batch->results[i] = res;
+
+	return res;
+}
+
+int KSI_Signature_parseBatch(KSI_CTX *ctx, const unsigned char * const *raw, const size_t *raw_len, size_t count, KSI_Signature **sig, int *results) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureParseBatch batch;
+	size_t i;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || (count > 0 && (raw == NULL || raw_len == NULL || sig == NULL))) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) sig[i] = NULL;
+
+	batch.ctx = ctx;
+	batch.raw = raw;
+	batch.raw_len = raw_len;
+	batch.sig = sig;
+	batch.results = results;
+
+	res = KSI_Executor_forEach(ctx->executor, count, parseBatchElement, &batch);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 
 int KSI_Signature_serialize(const KSI_Signature *sig, unsigned char **raw, size_t *raw_len) {
 	int res;
@@ -39,6 +39,8 @@ extern "C" {
 	/**
 	 * Free the signature object.
 	 * \param[in]	signature		Signature object.
+	 * \note The reference count is updated atomically, thus a signature may be shared between threads
+	 * for verification.
 	 */
 	void KSI_Signature_free(KSI_Signature *signature);
 
@@ -70,6 +72,22 @@ extern "C" {
 
 #define KSI_Signature_parse(ctx, raw, raw_len, sig) KSI_Signature_parseWithPolicy(ctx, raw, raw_len, KSI_VERIFICATION_POLICY_INTERNAL, NULL, sig)
 
+	/**
+	 * Parses a batch of KSI signatures as #KSI_Signature_parse does. The signatures are parsed
+	 * in parallel by the executor of the context (see #KSI_CTX_setExecutor).
+	 *
+	 * \param[in]		ctx			KSI context.
+	 * \param[in]		raw			Array of pointers to the raw signatures.
+	 * \param[in]		raw_len		Array of the lengths of the raw signatures.
+	 * \param[in]		count		Number of the signatures.
+	 * \param[out]		sig			Array of \c count pointers receiving the signatures, \c NULL for the failed ones.
+	 * \param[out]		results		Array of \c count status codes of the signatures (can be \c NULL).
+	 *
+	 * \return #KSI_OK if all the signatures were parsed, otherwise an error code of a failed signature.
+	 * \note The successfully parsed signatures are returned also on failure and have to be freed by the caller.
+	 */
+	int KSI_Signature_parseBatch(KSI_CTX *ctx, const unsigned char * const *raw, const size_t *raw_len, size_t count, KSI_Signature **sig, int *results);
+
 	/**
 	 * This function serializes the signature object into raw data. To deserialize it again
 	 * use #KSI_Signature_parse.
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include "internal.h"
+#include "impl/thread_impl.h"
+
+#ifndef _WIN32
+#  include <unistd.h>
+#  include <time.h>
+#endif
+
+#ifdef _WIN32
+
+int KSI_Mutex_init(KSI_Mutex *m) {
+	if (m == NULL) return KSI_INVALID_ARGUMENT;
+	InitializeCriticalSection(&m->cs);
+	return KSI_OK;
+}
+
+void KSI_Mutex_destroy(KSI_Mutex *m) {
+	if (m != NULL) DeleteCriticalSection(&m->cs);
+}
+
+void KSI_Mutex_lock(KSI_Mutex *m) {
+	EnterCriticalSection(&m->cs);
+}
+
+void KSI_Mutex_unlock(KSI_Mutex *m) {
+	LeaveCriticalSection(&m->cs);
+}
+
+int KSI_Cond_init(KSI_Cond *c) {
+	if (c == NULL) return KSI_INVALID_ARGUMENT;
+	InitializeConditionVariable(&c->cv);
+	return KSI_OK;
+}
+
+void KSI_Cond_destroy(KSI_Cond *KSI_UNUSED(c)) {
+	/* Windows condition variables do not need to be deleted. */
+}
+
+void KSI_Cond_wait(KSI_Cond *c, KSI_Mutex *m) {
+	SleepConditionVariableCS(&c->cv, &m->cs, INFINITE);
+}
+
+void KSI_Cond_timedWait(KSI_Cond *c, KSI_Mutex *m, unsigned ms) {
+	SleepConditionVariableCS(&c->cv, &m->cs, ms);
+}
+
+void KSI_Cond_signal(KSI_Cond *c) {
+	WakeConditionVariable(&c->cv);
+}
+
+void KSI_Cond_broadcast(KSI_Cond *c) {
+	WakeAllConditionVariable(&c->cv);
+}
+
+int KSI_ThreadKey_init(KSI_ThreadKey *key, void (*KSI_UNUSED(dtor))(void *)) {
+	if (key == NULL) return KSI_INVALID_ARGUMENT;
+	key->index = TlsAlloc();
+	return key->index == TLS_OUT_OF_INDEXES ? KSI_OUT_OF_MEMORY : KSI_OK;
+}
+
+void KSI_ThreadKey_destroy(KSI_ThreadKey *key) {
+	if (key != NULL && key->index != TLS_OUT_OF_INDEXES) {
+		TlsFree(key->index);
+		key->index = TLS_OUT_OF_INDEXES;
+	}
+}
+
+void *KSI_ThreadKey_get(KSI_ThreadKey *key) {
+	return TlsGetValue(key->index);
+}
+
+int KSI_ThreadKey_set(KSI_ThreadKey *key, void *value) {
+	return TlsSetValue(key->index, value) ? KSI_OK : KSI_UNKNOWN_ERROR;
+}
+
+static DWORD WINAPI threadMain(LPVOID arg) {
+	KSI_Thread *thread = arg;
+	thread->fn(thread->arg);
+	return 0;
+}
+
+int KSI_Thread_start(KSI_Thread *thread, void (*fn)(void *), void *arg) {
+	if (thread == NULL || fn == NULL) return KSI_INVALID_ARGUMENT;
+
+	thread->fn = fn;
+	thread->arg = arg;
+	thread->thread = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+
+	return thread->thread == NULL ? KSI_OUT_OF_MEMORY : KSI_OK;
+}
+
+void KSI_Thread_join(KSI_Thread *thread) {
+	if (thread != NULL && thread->thread != NULL) {
+		WaitForSingleObject(thread->thread, INFINITE);
+		CloseHandle(thread->thread);
+		thread->thread = NULL;
+	}
+}
+
+size_t KSI_Thread_getCpuCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+int KSI_Mutex_init(KSI_Mutex *m) {
+	if (m == NULL) return KSI_INVALID_ARGUMENT;
+	return pthread_mutex_init(&m->mutex, NULL) == 0 ? KSI_OK : KSI_OUT_OF_MEMORY;
+}
+
+void KSI_Mutex_destroy(KSI_Mutex *m) {
+	if (m != NULL) pthread_mutex_destroy(&m->mutex);
+}
+
+void KSI_Mutex_lock(KSI_Mutex *m) {
+	pthread_mutex_lock(&m->mutex);
+}
+
+void KSI_Mutex_unlock(KSI_Mutex *m) {
+	pthread_mutex_unlock(&m->mutex);
+}
+
+int KSI_Cond_init(KSI_Cond *c) {
+	if (c == NULL) return KSI_INVALID_ARGUMENT;
+	return pthread_cond_init(&c->cond, NULL) == 0 ? KSI_OK : KSI_OUT_OF_MEMORY;
+}
+
+void KSI_Cond_destroy(KSI_Cond *c) {
+	if (c != NULL) pthread_cond_destroy(&c->cond);
+}
+
+void KSI_Cond_wait(KSI_Cond *c, KSI_Mutex *m) {
+	pthread_cond_wait(&c->cond, &m->mutex);
+}
+
+void KSI_Cond_timedWait(KSI_Cond *c, KSI_Mutex *m, unsigned ms) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	pthread_cond_timedwait(&c->cond, &m->mutex, &ts);
+}
+
+void KSI_Cond_signal(KSI_Cond *c) {
+	pthread_cond_signal(&c->cond);
+}
+
+void KSI_Cond_broadcast(KSI_Cond *c) {
+	pthread_cond_broadcast(&c->cond);
+}
+
+int KSI_ThreadKey_init(KSI_ThreadKey *key, void (*dtor)(void *)) {
+	if (key == NULL) return KSI_INVALID_ARGUMENT;
+	return pthread_key_create(&key->key, dtor) == 0 ? KSI_OK : KSI_OUT_OF_MEMORY;
+}
+
+void KSI_ThreadKey_destroy(KSI_ThreadKey *key) {
+	if (key != NULL) pthread_key_delete(key->key);
+}
+
+void *KSI_ThreadKey_get(KSI_ThreadKey *key) {
+	return pthread_getspecific(key->key);
+}
+
+int KSI_ThreadKey_set(KSI_ThreadKey *key, void *value) {
+	return pthread_setspecific(key->key, value) == 0 ? KSI_OK : KSI_OUT_OF_MEMORY;
+}
+
+static void *threadMain(void *arg) {
+	KSI_Thread *thread = arg;
+	thread->fn(thread->arg);
+	return NULL;
+}
+
+int KSI_Thread_start(KSI_Thread *thread, void (*fn)(void *), void *arg) {
+	if (thread == NULL || fn == NULL) return KSI_INVALID_ARGUMENT;
+
+	thread->fn = fn;
+	thread->arg = arg;
+
+	return pthread_create(&thread->thread, NULL, threadMain, thread) == 0 ? KSI_OK : KSI_OUT_OF_MEMORY;
+}
+
+void KSI_Thread_join(KSI_Thread *thread) {
+	if (thread != NULL) pthread_join(thread->thread, NULL);
+}
+
+size_t KSI_Thread_getCpuCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (size_t)count : 1;
+}
+
+#endif
@@ -246,6 +246,7 @@ KSI_END_TLV_TEMPLATE
 
 KSI_DEFINE_TLV_TEMPLATE(KSI_AggregationReqPdu)
 	KSI_TLV_OBJECT(0x01, KSI_TLV_TMPL_FLG_FIRST, KSI_AggregationPdu_getHeader, KSI_AggregationPdu_setHeader, KSI_Header_fromTlv, KSI_Header_toTlv, KSI_Header_free, "header")
+	KSI_TLV_OBJECT_LIST(0x02, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getRequestList, KSI_AggregationPdu_setRequestList, KSI_AggregationReq, "aggr_req")
 	KSI_TLV_OBJECT(0x02, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getRequest, KSI_AggregationPdu_setRequest, KSI_AggregationReq_fromTlv, KSI_AggregationReq_toTlv, KSI_AggregationReq_free, "aggr_req")
 	KSI_TLV_COMPOSITE(0x04, KSI_TLV_TMPL_FLG_LEAST_ONE_G0 | KSI_TLV_TMPL_FLG_NO_VALUE, KSI_AggregationPdu_getConfRequest, KSI_AggregationPdu_setConfRequest, KSI_AggregationConf, "aggr_conf_req")
 	KSI_TLV_COMPOSITE(0x05, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getAckRequest, KSI_AggregationPdu_setAckRequest, KSI_AggregationAckReq, "aggr_ack_req")
@@ -254,6 +255,7 @@ KSI_END_TLV_TEMPLATE
 
 KSI_DEFINE_TLV_TEMPLATE(KSI_AggregationRespPdu)
 	KSI_TLV_OBJECT(0x01, KSI_TLV_TMPL_FLG_FIRST, KSI_AggregationPdu_getHeader, KSI_AggregationPdu_setHeader, KSI_Header_fromTlv, KSI_Header_toTlv, KSI_Header_free, "header")
+	KSI_TLV_OBJECT_LIST(0x02, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getResponseList, KSI_AggregationPdu_setResponseList, KSI_AggregationResp, "aggr_resp")
 	KSI_TLV_OBJECT(0x02, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getResponse, KSI_AggregationPdu_setResponse, KSI_AggregationResp_fromTlv, KSI_AggregationResp_toTlv, KSI_AggregationResp_free, "aggr_resp")
 	KSI_TLV_COMPOSITE(0x03, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getError, KSI_AggregationPdu_setError, KSI_ErrorPdu, "aggr_err")
 	KSI_TLV_COMPOSITE(0x04, KSI_TLV_TMPL_FLG_LEAST_ONE_G0, KSI_AggregationPdu_getConfResponse, KSI_AggregationPdu_setConfResponse, KSI_AggregationConf, "aggr_conf")
@@ -23,6 +23,48 @@
 #include "tree_builder.h"
 #include "hashchain.h"
 #include "impl/meta_data_impl.h"
+#include "impl/ctx_impl.h"
+#include "impl/thread_impl.h"
+#include "executor.h"
+
+/** The leaves of a batch are joined into complete subtrees of 2^KSI_TREE_BATCH_LEVELS leaves in parallel. */
+#define KSI_TREE_BATCH_LEVELS 6
+#define KSI_TREE_BATCH_LEAVES ((size_t)1 << KSI_TREE_BATCH_LEVELS)
+
+/** Capacity of the pipeline queue, must be a power of two. */
+#define KSI_TREE_PIPELINE_QUEUE_LEN 1024
+/** Number of polls of an empty or full pipeline queue before the thread blocks. */
+#define KSI_TREE_PIPELINE_SPIN 4096
+/** Padding keeping the fields written by different threads on different cache lines. */
+#define KSI_TREE_PIPELINE_PAD 64
+
+struct KSI_TreeBuilderPipeline_st {
+	KSI_TreeBuilder *builder;
+	KSI_Thread thread;
+	/** Hasher of the leaf processors in the calling thread, the builder hasher belongs to the aggregation thread. */
+	KSI_DataHasher *hsr;
+	/** Levels of the stack as seen by the calling thread, -1 for an empty slot. Used to enforce the maximum tree height. */
+	int levels[KSI_TREE_BUILDER_STACK_LEN];
+	/** Ring buffer of the processed leaves. */
+	KSI_TreeNode *queue[KSI_TREE_PIPELINE_QUEUE_LEN];
+	char pad0[KSI_TREE_PIPELINE_PAD];
+	/** Position of the next node to be inserted, advanced by the aggregation thread only. */
+	KSI_uint64_t head;
+	char pad1[KSI_TREE_PIPELINE_PAD];
+	/** Position of the next free slot, advanced by the calling thread only. */
+	KSI_uint64_t tail;
+	char pad2[KSI_TREE_PIPELINE_PAD];
+	/** Set by the calling thread when no more nodes are queued. */
+	KSI_uint64_t closed;
+	/** Status of the aggregation thread, the first failure stops the insertion. */
+	KSI_uint64_t res;
+	/** Set while the corresponding thread is about to block. */
+	KSI_uint64_t consumerWaiting;
+	KSI_uint64_t producerWaiting;
+	/** The lock and the condition are only used for blocking, never for accessing the queue. */
+	KSI_Mutex lock;
+	KSI_Cond cond;
+};
 
 KSI_IMPLEMENT_LIST(KSI_TreeBuilderLeafProcessor, NULL)
 
@@ -66,17 +108,66 @@ int KSI_TreeNode_new(KSI_CTX *ctx, KSI_DataHash *hash, KSI_MetaData *metaData, i
 	}
 
 	tmp->ctx = ctx;
+	tmp->hash = NULL;
+	tmp->metaData = NULL;
+	tmp->level = level;
+	tmp->parent = NULL;
+	tmp->leftChild = NULL;
+	tmp->rightChild = NULL;
+
+	if (hash != NULL) {
+		res = KSI_DataHashValue_fromDataHash(&tmp->value, hash);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
 	tmp->hash = KSI_DataHash_ref(hash);
 	tmp->metaData = KSI_MetaData_ref(metaData);
+
+	*node = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+cleanup:
+
+	KSI_TreeNode_free(tmp);
+
+	return res;
+}
+
+int KSI_TreeNode_fromValue(KSI_CTX *ctx, const KSI_DataHashValue *value, int level, KSI_TreeNode **node) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TreeNode *tmp = NULL;
+
+	if (ctx == NULL || value == NULL || !KSI_IS_VALID_TREE_LEVEL(level) || node == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	tmp = KSI_new(KSI_TreeNode);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->hash = NULL;
+	tmp->metaData = NULL;
 	tmp->level = level;
 	tmp->parent = NULL;
 	tmp->leftChild = NULL;
 	tmp->rightChild = NULL;
+	tmp->value = *value;
 
 	*node = tmp;
 	tmp = NULL;
 
 	res = KSI_OK;
+
 cleanup:
 
 	KSI_TreeNode_free(tmp);
@@ -84,6 +175,17 @@ cleanup:
 	return res;
 }
 
+int KSI_TreeNode_getHash(const KSI_TreeNode *node, KSI_DataHash **hash) {
+	if (node == NULL || node->metaData != NULL || hash == NULL) return KSI_INVALID_ARGUMENT;
+
+	if (node->hash != NULL) {
+		*hash = KSI_DataHash_ref(node->hash);
+		return KSI_OK;
+	}
+
+	return KSI_DataHash_fromValue(node->ctx, &node->value, hash);
+}
+
 static int KSI_DataHasher_addTreeNode(KSI_DataHasher *hsr, const KSI_TreeNode *node) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -92,10 +194,10 @@ static int KSI_DataHasher_addTreeNode(KSI_DataHasher *hsr, const KSI_TreeNode *n
 		goto cleanup;
 	}
 
-	if (node->hash != NULL) {
-		res = KSI_DataHasher_addImprint(hsr, node->hash);
+	if (node->metaData == NULL) {
+		res = KSI_DataHasher_addValue(hsr, &node->value);
 		if (res != KSI_OK) goto cleanup;
-	} else if (node->metaData != NULL) {
+	} else {
 		unsigned char buf[0xffff + 4];
 		size_t len;
 
@@ -113,9 +215,8 @@ cleanup:
 	return res;
 }
 
-static int joinHashes(KSI_CTX *ctx, KSI_DataHasher *hsr, const KSI_TreeNode *left, const KSI_TreeNode *right, int level, KSI_DataHash **root) {
+static int joinHashes(KSI_CTX *ctx, KSI_DataHasher *hsr, const KSI_TreeNode *left, const KSI_TreeNode *right, int level, KSI_DataHashValue *root) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_DataHash *tmp = NULL;
 	unsigned char l = (unsigned char)level;
 
 	if (left == NULL || right == NULL || !KSI_IS_VALID_TREE_LEVEL(level) || root == NULL) {
@@ -145,21 +246,16 @@ static int joinHashes(KSI_CTX *ctx, KSI_DataHasher *hsr, const KSI_TreeNode *lef
 		goto cleanup;
 	}
 
-	res = KSI_DataHasher_close(hsr, &tmp);
+	res = KSI_DataHasher_closeValue(hsr, root);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	*root = tmp;
-	tmp = NULL;
-
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_DataHash_free(tmp);
-
 	return res;
 }
 
@@ -168,7 +264,7 @@ static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr,
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_TreeNode *tmp = NULL;
 	int level;
-	KSI_DataHash *hsh = NULL;
+	KSI_DataHashValue hsh;
 
 	if (ctx == NULL || leftSibling == NULL || rightSibling == NULL || root == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -198,7 +294,7 @@ static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr,
 	}
 
 	/* Create a new tree node. */
-	res = KSI_TreeNode_new(ctx, hsh, NULL, level, &tmp);
+	res = KSI_TreeNode_fromValue(ctx, &hsh, level, &tmp);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
@@ -218,7 +314,6 @@ static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr,
 
 cleanup:
 
-	KSI_DataHash_free(hsh);
 	KSI_TreeNode_free(tmp);
 
 	return res;
@@ -254,6 +349,7 @@ int KSI_TreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, KSI_TreeBuilder **
 	tmp->algo = algo;
 	tmp->cbList = NULL;
 	tmp->hsr = NULL;
+	tmp->pipeline = NULL;
 	memset(tmp->stack, 0, sizeof(tmp->stack));
 
 	tmp->maxTreeLevel = 0;
@@ -282,9 +378,15 @@ cleanup:
 	return res;
 }
 
+static int pipelineStop(KSI_TreeBuilder *builder);
+
 void KSI_TreeBuilder_free(KSI_TreeBuilder *builder) {
 	if (builder != NULL && --builder->ref == 0) {
 		size_t i;
+
+		/* The aggregation thread owns the stack until it has been stopped. */
+		pipelineStop(builder);
+
 		KSI_TreeNode_free(builder->rootNode);
 
 		/* If the tree was not closed propperly, we have to check the stack. */
@@ -349,6 +451,224 @@ cleanup:
 	return res;
 }
 
+/* Wakes up the other thread, if it has announced to block. */
+static void pipelineWake(KSI_TreeBuilderPipeline *p, KSI_uint64_t *waiting) {
+	/* Pairs with the fence in pipelineWait: either the waiter sees the update of the queue
+	 * or this thread sees the waiting flag. */
+	KSI_ATOMIC_FENCE();
+	if (KSI_ATOMIC_LOAD64(waiting)) {
+		KSI_Mutex_lock(&p->lock);
+		KSI_Cond_broadcast(&p->cond);
+		KSI_Mutex_unlock(&p->lock);
+	}
+}
+
+/* Blocks the calling thread while the queue is empty (consumer) or full (producer). */
+static void pipelineWait(KSI_TreeBuilderPipeline *p, KSI_uint64_t *waiting, KSI_uint64_t pos, int consumer) {
+	KSI_Mutex_lock(&p->lock);
+	KSI_ATOMIC_STORE64(waiting, 1);
+	KSI_ATOMIC_FENCE();
+	if (consumer) {
+		if (pos == KSI_ATOMIC_LOAD64(&p->tail) && !KSI_ATOMIC_LOAD64(&p->closed)) KSI_Cond_wait(&p->cond, &p->lock);
+	} else {
+		if (pos - KSI_ATOMIC_LOAD64(&p->head) >= KSI_TREE_PIPELINE_QUEUE_LEN && KSI_ATOMIC_LOAD64(&p->res) == KSI_OK) KSI_Cond_wait(&p->cond, &p->lock);
+	}
+	KSI_ATOMIC_STORE64(waiting, 0);
+	KSI_Mutex_unlock(&p->lock);
+}
+
+/* The aggregation thread: inserts the queued nodes into the stack in the order of adding. */
+static void pipelineRun(void *arg) {
+	KSI_TreeBuilderPipeline *p = arg;
+	KSI_uint64_t head = KSI_ATOMIC_LOAD64(&p->head);
+	size_t spin = 0;
+
+	for (;;) {
+		KSI_uint64_t tail = KSI_ATOMIC_LOAD64(&p->tail);
+
+		if (head == tail) {
+			/* The nodes queued before closing are visible after seeing the flag. */
+			if (KSI_ATOMIC_LOAD64(&p->closed)) {
+				if (head == KSI_ATOMIC_LOAD64(&p->tail)) break;
+			} else if (++spin >= KSI_TREE_PIPELINE_SPIN) {
+				pipelineWait(p, &p->consumerWaiting, head, 1);
+				spin = 0;
+			}
+			continue;
+		}
+		spin = 0;
+
+		while (head != tail) {
+			int res = insertNode(p->builder, p->queue[head & (KSI_TREE_PIPELINE_QUEUE_LEN - 1)], 0);
+
+			p->queue[head & (KSI_TREE_PIPELINE_QUEUE_LEN - 1)] = NULL;
+			KSI_ATOMIC_STORE64(&p->head, ++head);
+
+			if (res != KSI_OK) {
+				/* The rest of the queue is released by the calling thread. */
+				KSI_ATOMIC_STORE64(&p->res, (KSI_uint64_t)res);
+				pipelineWake(p, &p->producerWaiting);
+				return;
+			}
+		}
+
+		pipelineWake(p, &p->producerWaiting);
+	}
+}
+
+/* Queues a processed leaf for the aggregation thread. */
+static int pipelinePush(KSI_TreeBuilderPipeline *p, KSI_TreeNode *node) {
+	KSI_uint64_t tail = KSI_ATOMIC_LOAD64(&p->tail);
+	unsigned level = node->level;
+	size_t spin = 0;
+	size_t i;
+
+	for (;;) {
+		int res = (int)KSI_ATOMIC_LOAD64(&p->res);
+		if (res != KSI_OK) return res;
+
+		if (tail - KSI_ATOMIC_LOAD64(&p->head) < KSI_TREE_PIPELINE_QUEUE_LEN) break;
+
+		if (++spin >= KSI_TREE_PIPELINE_SPIN) {
+			pipelineWait(p, &p->producerWaiting, tail, 0);
+			spin = 0;
+		}
+	}
+
+	/* Track the shape of the stack the way insertNode changes it. */
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		if (p->levels[i] < 0) {
+			p->levels[i] = (int)level;
+			break;
+		}
+		level = ((unsigned)p->levels[i] > level ? (unsigned)p->levels[i] : level) + 1;
+		p->levels[i] = -1;
+	}
+
+	p->queue[tail & (KSI_TREE_PIPELINE_QUEUE_LEN - 1)] = node;
+	KSI_ATOMIC_STORE64(&p->tail, tail + 1);
+
+	pipelineWake(p, &p->consumerWaiting);
+
+	return KSI_OK;
+}
+
+/* Waits for the aggregation thread to insert the queued nodes and releases the pipeline. */
+static int pipelineStop(KSI_TreeBuilder *builder) {
+	int res = KSI_OK;
+	KSI_TreeBuilderPipeline *p = NULL;
+	KSI_uint64_t i;
+
+	if (builder == NULL || builder->pipeline == NULL) return KSI_OK;
+
+	p = builder->pipeline;
+	builder->pipeline = NULL;
+
+	KSI_ATOMIC_STORE64(&p->closed, 1);
+	pipelineWake(p, &p->consumerWaiting);
+	KSI_Thread_join(&p->thread);
+
+	res = (int)p->res;
+
+	/* Nodes left behind by a failed insertion. */
+	for (i = p->head; i != p->tail; i++) {
+		KSI_TreeNode_free(p->queue[i & (KSI_TREE_PIPELINE_QUEUE_LEN - 1)]);
+	}
+
+	KSI_DataHasher_free(p->hsr);
+	KSI_Cond_destroy(&p->cond);
+	KSI_Mutex_destroy(&p->lock);
+	KSI_free(p);
+
+	return res;
+}
+
+int KSI_TreeBuilder_setPipelined(KSI_TreeBuilder *builder, int enable) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TreeBuilderPipeline *tmp = NULL;
+	size_t i;
+	bool mutexInit = false;
+	bool condInit = false;
+
+	if (builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->rootNode != NULL) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has been finished.");
+		goto cleanup;
+	}
+
+	if (!enable) {
+		res = pipelineStop(builder);
+		if (res != KSI_OK) KSI_pushError(builder->ctx, res, "Unable to insert a leaf into the tree.");
+		goto cleanup;
+	}
+
+	if (builder->pipeline != NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_TreeBuilderPipeline);
+	if (tmp == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	memset(tmp, 0, sizeof(*tmp));
+
+	tmp->builder = builder;
+	tmp->res = KSI_OK;
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		tmp->levels[i] = builder->stack[i] != NULL ? (int)builder->stack[i]->level : -1;
+	}
+
+	res = KSI_DataHasher_open(builder->ctx, builder->algo, &tmp->hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Mutex_init(&tmp->lock);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+	mutexInit = true;
+
+	res = KSI_Cond_init(&tmp->cond);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+	condInit = true;
+
+	res = KSI_Thread_start(&tmp->thread, pipelineRun, tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, "Unable to start the aggregation thread.");
+		goto cleanup;
+	}
+
+	builder->pipeline = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (tmp != NULL) {
+		if (condInit) KSI_Cond_destroy(&tmp->cond);
+		if (mutexInit) KSI_Mutex_destroy(&tmp->lock);
+		KSI_DataHasher_free(tmp->hsr);
+		KSI_free(tmp);
+	}
+
+	return res;
+}
+
 static int processAndInsertNode(KSI_TreeBuilder *builder, KSI_TreeNode *node) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_TreeNode *localRoot = NULL;
@@ -376,16 +696,27 @@ static int processAndInsertNode(KSI_TreeBuilder *builder, KSI_TreeNode *node) {
 			goto cleanup;
 		}
 
+		/* The processors may rely on the hash object of the input node, the joined nodes only carry the value. */
+		if (localRoot != NULL && localRoot->hash == NULL && localRoot->metaData == NULL) {
+			res = KSI_DataHash_fromValue(builder->ctx, &localRoot->value, &localRoot->hash);
+			if (res != KSI_OK) goto cleanup;
+		}
+
 		res = cb->fn((localRoot == NULL ? node : localRoot), cb->c, &tmp);
 		if (res != KSI_OK) goto cleanup;
 
 		if (tmp != NULL) {
-			res = KSI_TreeNode_join(builder->ctx, builder->hsr, tmp, localRoot == NULL ? node : localRoot, &localRoot);
+			res = KSI_TreeNode_join(builder->ctx, builder->pipeline != NULL ? builder->pipeline->hsr : builder->hsr,
+					tmp, localRoot == NULL ? node : localRoot, &localRoot);
 			if (res != KSI_OK) goto cleanup;
 		}
 	}
 
-	res = insertNode(builder, localRoot == NULL ? node : localRoot, 0);
+	if (builder->pipeline != NULL) {
+		res = pipelinePush(builder->pipeline, localRoot == NULL ? node : localRoot);
+	} else {
+		res = insertNode(builder, localRoot == NULL ? node : localRoot, 0);
+	}
 	if (res != KSI_OK) goto cleanup;
 
 	tmp = NULL;
@@ -448,7 +779,12 @@ static unsigned calculateHighestLevel(KSI_TreeBuilder *builder, unsigned level)
 	if (builder == NULL) return 0;
 
 	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
-		if (builder->stack[i] != NULL) {
+		/* The stack of a pipelined builder belongs to the aggregation thread. */
+		if (builder->pipeline != NULL) {
+			if (builder->pipeline->levels[i] >= 0) {
+				level = ((unsigned)builder->pipeline->levels[i] > level ? (unsigned)builder->pipeline->levels[i] : level) + 1;
+			}
+		} else if (builder->stack[i] != NULL) {
 			level = (builder->stack[i]->level > level ? builder->stack[i]->level : level) + 1;
 		}
 	}
@@ -538,6 +874,228 @@ int KSI_TreeBuilder_addDataHash(KSI_TreeBuilder *builder, KSI_DataHash *hsh, int
 	return addLeaf(builder, hsh,  NULL, level, leaf);
 }
 
+typedef struct SubtreeBatch_st {
+	KSI_TreeBuilder *builder;
+	KSI_DataHash * const *hsh;
+	int level;
+	/** Roots of the subtrees. */
+	KSI_TreeNode **roots;
+	/** Leaf nodes for the handles, can be NULL. */
+	KSI_TreeNode **leaves;
+} SubtreeBatch;
+
+/**
+ * Builds the complete subtree of the leaves in the same shape as inserting them one by one
+ * into an empty stack does. Every subtree has a hasher of its own.
+ */
+static int buildSubtree(void *c, size_t index) {
+	int res = KSI_UNKNOWN_ERROR;
+	SubtreeBatch *batch = c;
+	KSI_CTX *ctx = batch->builder->ctx;
+	KSI_DataHasher *hsr = NULL;
+	KSI_TreeNode *nodes[KSI_TREE_BATCH_LEAVES];
+	size_t width;
+	size_t i;
+
+	memset(nodes, 0, sizeof(nodes));
+
+	res = KSI_DataHasher_open(ctx, batch->builder->algo, &hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < KSI_TREE_BATCH_LEAVES; i++) {
+		res = KSI_TreeNode_new(ctx, batch->hsh[index * KSI_TREE_BATCH_LEAVES + i], NULL, batch->level, &nodes[i]);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (batch->leaves != NULL) {
+		memcpy(batch->leaves + index * KSI_TREE_BATCH_LEAVES, nodes, sizeof(nodes));
+	}
+
+	for (width = KSI_TREE_BATCH_LEAVES; width > 1; width /= 2) {
+		for (i = 0; i < width / 2; i++) {
+			KSI_TreeNode *left = nodes[2 * i];
+			KSI_TreeNode *right = nodes[2 * i + 1];
+
+			nodes[2 * i] = NULL;
+			nodes[2 * i + 1] = NULL;
+
+			res = KSI_TreeNode_join(ctx, hsr, left, right, &nodes[i]);
+			if (res != KSI_OK) {
+				KSI_TreeNode_free(left);
+				KSI_TreeNode_free(right);
+				goto cleanup;
+			}
+		}
+	}
+
+	batch->roots[index] = nodes[0];
+	nodes[0] = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	for (i = 0; i < KSI_TREE_BATCH_LEAVES; i++) {
+		KSI_TreeNode_free(nodes[i]);
+	}
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+/**
+ * Adds the aligned part of the batch as complete subtrees. The stack must have no nodes below
+ * the level of the subtree roots, then inserting the roots gives the same tree as inserting the
+ * leaves one by one.
+ */
+static int addSubtrees(KSI_TreeBuilder *builder, KSI_DataHash * const *hsh, size_t subtrees, int level, KSI_TreeNode **leaves) {
+	int res = KSI_UNKNOWN_ERROR;
+	SubtreeBatch batch;
+	KSI_TreeNode **roots = NULL;
+	size_t i = 0;
+
+	roots = KSI_calloc(subtrees, sizeof(KSI_TreeNode *));
+	if (roots == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	batch.builder = builder;
+	batch.hsh = hsh;
+	batch.level = level;
+	batch.roots = roots;
+	batch.leaves = leaves;
+
+	res = KSI_Executor_forEach(builder->ctx->executor, subtrees, buildSubtree, &batch);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < subtrees; i++) {
+		res = insertNode(builder, roots[i], KSI_TREE_BATCH_LEVELS);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (roots != NULL) {
+		for (; i < subtrees; i++) {
+			KSI_TreeNode_free(roots[i]);
+		}
+		KSI_free(roots);
+	}
+
+	return res;
+}
+
+static int lowerStackEmpty(const KSI_TreeBuilder *builder) {
+	size_t i;
+
+	for (i = 0; i < KSI_TREE_BATCH_LEVELS; i++) {
+		if (builder->stack[i] != NULL) return 0;
+	}
+
+	return 1;
+}
+
+int KSI_TreeBuilder_addDataHashes(KSI_TreeBuilder *builder, KSI_DataHash * const *hsh, size_t count, int level, KSI_TreeLeafHandle **leaves) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TreeNode **nodes = NULL;
+	int parallel;
+	size_t i;
+
+	if (builder == NULL || (count > 0 && hsh == NULL) || !KSI_IS_VALID_TREE_LEVEL(level)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->rootNode != NULL) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has been finished, new leafs may not be added.");
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (hsh[i] == NULL) {
+			KSI_pushError(builder->ctx, res = KSI_INVALID_ARGUMENT, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (leaves != NULL) {
+		for (i = 0; i < count; i++) leaves[i] = NULL;
+
+		nodes = KSI_calloc(count > 0 ? count : 1, sizeof(KSI_TreeNode *));
+		if (nodes == NULL) {
+			KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* The leaf processors and the height limit are applied leaf by leaf, the leaves of a pipelined builder
+	 * are queued for the aggregation thread. */
+	parallel = builder->ctx->executor != NULL && KSI_TreeBuilderLeafProcessorList_length(builder->cbList) == 0 &&
+			builder->maxTreeLevel == 0 && builder->pipeline == NULL && KSI_IS_VALID_TREE_LEVEL(level + KSI_TREE_BATCH_LEVELS);
+
+	i = 0;
+	while (i < count) {
+		if (parallel && count - i >= KSI_TREE_BATCH_LEAVES && lowerStackEmpty(builder)) {
+			size_t subtrees = (count - i) / KSI_TREE_BATCH_LEAVES;
+
+			res = addSubtrees(builder, hsh + i, subtrees, level, nodes != NULL ? nodes + i : NULL);
+			if (res != KSI_OK) goto cleanup;
+
+			i += subtrees * KSI_TREE_BATCH_LEAVES;
+		} else {
+			KSI_TreeLeafHandle *handle = NULL;
+
+			res = addLeaf(builder, hsh[i], NULL, level, leaves != NULL ? &handle : NULL);
+			if (res != KSI_OK) goto cleanup;
+
+			if (handle != NULL) {
+				nodes[i] = handle->leafNode;
+				KSI_TreeLeafHandle_free(handle);
+			}
+
+			i++;
+		}
+	}
+
+	if (leaves != NULL) {
+		for (i = 0; i < count; i++) {
+			leaves[i] = KSI_new(KSI_TreeLeafHandle);
+			if (leaves[i] == NULL) {
+				KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+				goto cleanup;
+			}
+
+			leaves[i]->pBuilder = builder;
+			leaves[i]->leafNode = nodes[i];
+			leaves[i]->ref = 1;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (res != KSI_OK && leaves != NULL) {
+		for (i = 0; i < count; i++) {
+			KSI_TreeLeafHandle_free(leaves[i]);
+			leaves[i] = NULL;
+		}
+	}
+	KSI_free(nodes);
+
+	return res;
+}
+
 int KSI_TreeBuilder_addMetaData(KSI_TreeBuilder *builder, KSI_MetaData *metaData, int level, KSI_TreeLeafHandle **leaf) {
 	return addLeaf(builder, NULL, metaData, level, leaf);
 }
@@ -554,6 +1112,13 @@ int KSI_TreeBuilder_close(KSI_TreeBuilder *builder) {
 
 	KSI_ERR_clearErrors(builder->ctx);
 
+	/* Wait for the queued leaves to be inserted. */
+	res = pipelineStop(builder);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, "Unable to insert a leaf into the tree.");
+		goto cleanup;
+	}
+
 	if (builder->rootNode == NULL) {
 		size_t i;
 
@@ -585,12 +1150,23 @@ int KSI_TreeBuilder_close(KSI_TreeBuilder *builder) {
 		goto cleanup;
 	}
 
+	/* Only the root of the internal nodes gets a hash object. */
+	if (root->hash == NULL && root->metaData == NULL) {
+		res = KSI_DataHash_fromValue(builder->ctx, &root->value, &root->hash);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
 	builder->rootNode = root;
+	root = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
+	KSI_TreeNode_free(root);
 	KSI_TreeNode_free(tmp);
 
 	return res;
@@ -650,16 +1226,19 @@ static int getHashChainLinks(const KSI_TreeNode *node, KSI_LIST(KSI_HashChainLin
 		}
 
 		/* Sanity check. */
-		if ((pSibling->hash == NULL && pSibling->metaData == NULL) || (pSibling->hash != NULL && pSibling->metaData != NULL)) {
+		if (pSibling->hash != NULL && pSibling->metaData != NULL) {
 			res = KSI_INVALID_STATE;
 			goto cleanup;
 		}
 
 		/* Add the hash value. */
-		{
+		if (pSibling->metaData == NULL) {
 			KSI_DataHash *ref = NULL;
 
-			res = KSI_HashChainLink_setImprint(link, ref = KSI_DataHash_ref(pSibling->hash));
+			res = KSI_TreeNode_getHash(pSibling, &ref);
+			if (res != KSI_OK) goto cleanup;
+
+			res = KSI_HashChainLink_setImprint(link, ref);
 			if (res != KSI_OK) {
 				/* Cleanup the reference. */
 				KSI_DataHash_free(ref);
@@ -771,7 +1350,13 @@ int KSI_TreeLeafHandle_getAggregationChain(const KSI_TreeLeafHandle *handle, KSI
 	{
 		KSI_DataHash *ref = NULL;
 
-		res = KSI_AggregationHashChain_setInputHash(tmp, ref = KSI_DataHash_ref(handle->leafNode->hash));
+		res = KSI_TreeNode_getHash(handle->leafNode, &ref);
+		if (res != KSI_OK) {
+			KSI_pushError(handle->pBuilder->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_AggregationHashChain_setInputHash(tmp, ref);
 		if (res != KSI_OK) {
 			/* Cleanup the reference. */
 			KSI_DataHash_free(ref);
@@ -49,10 +49,18 @@ typedef struct KSI_TreeNode_st KSI_TreeNode;
  */
 typedef struct KSI_TreeBuilderLeafProcessor_st KSI_TreeBuilderLeafProcessor;
 
+/**
+ * State of the aggregation thread of a pipelined tree builder, see #KSI_TreeBuilder_setPipelined.
+ */
+typedef struct KSI_TreeBuilderPipeline_st KSI_TreeBuilderPipeline;
+
 struct KSI_TreeNode_st {
 	/** KSI context. */
 	KSI_CTX *ctx;
-	/** Hash value of the node, may not be not NULL when metaData is not NULL. */
+	/** Hash object of the node, may not be not NULL when metaData is not NULL. It is set for the leaves, for the
+	 * nodes handed to a #KSI_TreeBuilderLeafProcessor and for the root node, for which the object is created
+	 * when the tree is closed. The other internal nodes only have the #KSI_TreeNode::value, use
+	 * #KSI_TreeNode_getHash to get the hash of any node. */
 	KSI_DataHash *hash;
 	/** Metadata value of the node, may not be not NULL when hash is not NULL. */
 	KSI_MetaData *metaData;
@@ -64,6 +72,8 @@ struct KSI_TreeNode_st {
 	KSI_TreeNode *leftChild;
 	/** The right child node. */
 	KSI_TreeNode *rightChild;
+	/** Hash value of the node, valid when metaData is NULL. */
+	KSI_DataHashValue value;
 };
 
 struct KSI_TreeBuilderLeafProcessor_st {
@@ -115,6 +125,9 @@ struct KSI_TreeBuilder_st {
 	/** Maximum level of the root hash. If adding a leaf would make the level of the root hash greater than this
 	 * parameter, an error is returned. If the value is less or equal to 0 it is ignored. */
 	short maxTreeLevel;
+	/** The aggregation thread of a pipelined builder, \c NULL if the leaves are inserted by the calling thread.
+	 * While it is running, the #stack belongs to the aggregation thread. */
+	KSI_TreeBuilderPipeline *pipeline;
 };
 
 /**
@@ -150,6 +163,25 @@ KSI_DEFINE_REF(KSI_TreeLeafHandle);
  */
 int KSI_TreeNode_new(KSI_CTX *ctx, KSI_DataHash *hash, KSI_MetaData *metaData, int level, KSI_TreeNode **node);
 
+/**
+ * Constructor for a #KSI_TreeNode holding only a hash value, no hash object is created for the node.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	value		Hash value of the node.
+ * \param[in]	level		The level of the tree node.
+ * \param[out]	node		Pointer to the receiving ponter.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_TreeNode_fromValue(KSI_CTX *ctx, const KSI_DataHashValue *value, int level, KSI_TreeNode **node);
+
+/**
+ * Getter for the hash of a tree node holding a hash value. If the node does not have a hash object,
+ * a new one is created from #KSI_TreeNode::value.
+ * \param[in]	node		The tree node.
+ * \param[out]	hash		Pointer to the receiving pointer, the caller must free the object.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_TreeNode_getHash(const KSI_TreeNode *node, KSI_DataHash **hash);
+
 /**
  * Destructor method for #KSI_TreeNode.
  * \param[in]	node		Pointer to the object.
@@ -208,6 +240,21 @@ void KSI_TreeBuilder_free(KSI_TreeBuilder *builder);
  */
 int KSI_TreeBuilder_addDataHash(KSI_TreeBuilder *builder, KSI_DataHash *hsh, int level, KSI_TreeLeafHandle **leaf);
 
+/**
+ * Adds a batch of leaves to the tree, the result is the same as adding the leaves one by one with
+ * #KSI_TreeBuilder_addDataHash. If the builder has no leaf processors nor a maximum tree height,
+ * the complete subtrees of the batch are built in parallel by the executor of the context
+ * (see #KSI_CTX_setExecutor).
+ * \param[in]	builder		The builder.
+ * \param[in]	hsh			Array of the data hashes of the leaves.
+ * \param[in]	count		Number of the leaves.
+ * \param[in]	level		The level of the leaves.
+ * \param[out]	leaves		Array of \c count pointers receiving the handles (can be \c NULL).
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \see #KSI_TreeLeafHandle_free
+ */
+int KSI_TreeBuilder_addDataHashes(KSI_TreeBuilder *builder, KSI_DataHash * const *hsh, size_t count, int level, KSI_TreeLeafHandle **leaves);
+
 /**
  * Adds a new leaf to the tree containing a meta-data value instead of the data hash as in #KSI_TreeBuilder_addDataHash.
  * \param[in]	builder		The builder.
@@ -219,6 +266,22 @@ int KSI_TreeBuilder_addDataHash(KSI_TreeBuilder *builder, KSI_DataHash *hsh, int
  */
 int KSI_TreeBuilder_addMetaData(KSI_TreeBuilder *builder, KSI_MetaData *metaData, int level, KSI_TreeLeafHandle **leaf);
 
+/**
+ * Enables or disables the pipelined mode of the builder. In the pipelined mode the leaf processors
+ * (e.g. the masking of the block signer) run in the calling thread, while a dedicated aggregation
+ * thread inserts the processed leaves into the tree. The threads are connected by a bounded lock-free
+ * single producer, single consumer queue; the calling thread only blocks when the queue is full.
+ * The resulting tree is the same as without the pipeline.
+ * \param[in]	builder		The builder.
+ * \param[in]	enable		Non-zero to start the aggregation thread, zero to wait for the queued leaves
+ * 							to be inserted and stop it.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The internal nodes of the tree may only be accessed after the pipeline has been stopped,
+ * which #KSI_TreeBuilder_close also does. If inserting a leaf fails, the following calls adding
+ * leaves and #KSI_TreeBuilder_close return the error and the builder must be discarded.
+ */
+int KSI_TreeBuilder_setPipelined(KSI_TreeBuilder *builder, int enable);
+
 /**
  * This function finalizes the building of the tree. After calling this function no more leafs
  * may be added to the computation and doing so would result in an error.
@@ -74,6 +74,9 @@ struct KSI_AggregationPdu_st {
 	KSI_Header *header;
 	KSI_AggregationReq *request;
 	KSI_AggregationResp *response;
+	/* Multi-payload (PDU v2) requests and responses. */
+	KSI_LIST(KSI_AggregationReq) *requestList;
+	KSI_LIST(KSI_AggregationResp) *responseList;
 	KSI_Config *confRequest;
 	KSI_Config *confResponse;
 	KSI_RequestAck *ackRequest;
@@ -1374,6 +1377,8 @@ void KSI_AggregationPdu_free(KSI_AggregationPdu *t) {
 		KSI_Header_free(t->header);
 		KSI_AggregationReq_free(t->request);
 		KSI_AggregationResp_free(t->response);
+		KSI_AggregationReqList_free(t->requestList);
+		KSI_AggregationRespList_free(t->responseList);
 		KSI_ErrorPdu_free(t->error);
 		KSI_AggregationConf_free(t->confRequest);
 		KSI_AggregationConf_free(t->confResponse);
@@ -1398,6 +1403,8 @@ int KSI_AggregationPdu_new(KSI_CTX *ctx, KSI_AggregationPdu **t) {
 	tmp->ctx = ctx;
 	tmp->request = NULL;
 	tmp->response = NULL;
+	tmp->requestList = NULL;
+	tmp->responseList = NULL;
 	tmp->error = NULL;
 	tmp->confRequest = NULL;
 	tmp->confResponse = NULL;
@@ -1480,6 +1487,19 @@ cleanup:
 	return res;
 }
 
+/* Payload presence getters for the HMAC calculation. A multi-payload PDU carries its payloads in a list. */
+static int aggregationPdu_getPayloadRequest(const KSI_AggregationPdu *t, void **payload) {
+	if (t == NULL || payload == NULL) return KSI_INVALID_ARGUMENT;
+	*payload = (t->request != NULL) ? (void *)t->request : (void *)t->requestList;
+	return KSI_OK;
+}
+
+static int aggregationPdu_getPayloadResponse(const KSI_AggregationPdu *t, void **payload) {
+	if (t == NULL || payload == NULL) return KSI_INVALID_ARGUMENT;
+	*payload = (t->response != NULL) ? (void *)t->response : (void *)t->responseList;
+	return KSI_OK;
+}
+
 int KSI_AggregationPdu_calculateHmac(const KSI_AggregationPdu *t, KSI_HashAlgorithm algo_id, const char *key, KSI_DataHash **hmac){
 	int res = KSI_OK;
 	if (t == NULL || t->ctx == NULL)
@@ -1503,16 +1523,16 @@ int KSI_AggregationPdu_calculateHmac(const KSI_AggregationPdu *t, KSI_HashAlgori
 					(int (*)(const void*, KSI_OctetString**))KSI_AggregationPdu_getRaw,
 					(int (*)(const void*, void**))KSI_AggregationPdu_getConfRequest,
 					(int (*)(const void*, KSI_OctetString**))KSI_AggregationPdu_getRaw,
-					0x220,0x221, KSI_TLV_TEMPLATE(KSI_AggregationReqPdu), KSI_TLV_TEMPLATE(KSI_AggregationReqPdu),
+					0x220,0x221, KSI_TLV_TEMPLATE(KSI_AggregationReqPdu), KSI_TLV_TEMPLATE(KSI_AggregationRespPdu),
 					algo_id, key, hmac);
 		} else {
 			res = pdu_calculateHmac_v2(t->ctx, (const void*)t,
 					(int (*)(const void*, KSI_Header**))KSI_AggregationPdu_getHeader,
-					(int (*)(const void*, void**))KSI_AggregationPdu_getResponse,
+					(int (*)(const void*, void**))aggregationPdu_getPayloadResponse,
 					(int (*)(const void*, KSI_OctetString**))KSI_AggregationPdu_getRaw,
-					(int (*)(const void*, void**))KSI_AggregationPdu_getRequest,
+					(int (*)(const void*, void**))aggregationPdu_getPayloadRequest,
 					(int (*)(const void*, KSI_OctetString**))KSI_AggregationPdu_getRaw,
-					0x220,0x221, KSI_TLV_TEMPLATE(KSI_AggregationReqPdu), KSI_TLV_TEMPLATE(KSI_AggregationReqPdu),
+					0x220,0x221, KSI_TLV_TEMPLATE(KSI_AggregationReqPdu), KSI_TLV_TEMPLATE(KSI_AggregationRespPdu),
 					algo_id, key, hmac);
 		}
 	} else {
@@ -1720,6 +1740,20 @@ int KSI_AggregationPdu_parse(KSI_CTX *ctx, const unsigned char *raw, size_t len,
 	}
 	if (res != KSI_OK) goto cleanup;
 
+	/* The v2 payloads are parsed into lists. Keep the single payload PDU accessible as before. */
+	if (KSI_AggregationReqList_length(tmp->requestList) == 1) {
+		res = KSI_AggregationReqList_remove(tmp->requestList, 0, &tmp->request);
+		if (res != KSI_OK) goto cleanup;
+		KSI_AggregationReqList_free(tmp->requestList);
+		tmp->requestList = NULL;
+	}
+	if (KSI_AggregationRespList_length(tmp->responseList) == 1) {
+		res = KSI_AggregationRespList_remove(tmp->responseList, 0, &tmp->response);
+		if (res != KSI_OK) goto cleanup;
+		KSI_AggregationRespList_free(tmp->responseList);
+		tmp->responseList = NULL;
+	}
+
 	res = KSI_OctetString_new(ctx, raw, len, &tmpRaw);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
@@ -1751,9 +1785,9 @@ int KSI_AggregationPdu_serialize(const KSI_AggregationPdu *t, unsigned char **ra
 		KSI_LOG_warn(t->ctx, "PDU v1 is deprecated!");
 		res = KSI_TlvTemplate_serializeObject(t->ctx, t, 0x200, 0, 0, KSI_TLV_TEMPLATE(KSI_AggregationPdu), raw, len);
 	} else if (t->ctx->options[KSI_OPT_AGGR_PDU_VER] == KSI_PDU_VERSION_2) {
-		if (t->request != NULL || t->confRequest != NULL || t->ackRequest != NULL) {
+		if (t->request != NULL || t->requestList != NULL || t->confRequest != NULL || t->ackRequest != NULL) {
 			res = KSI_TlvTemplate_serializeObject(t->ctx, t, 0x220, 0, 0, KSI_TLV_TEMPLATE(KSI_AggregationReqPdu), raw, len);
-		} else if (t->response != NULL || t->confResponse != NULL || t->ackResponse != NULL) {
+		} else if (t->response != NULL || t->responseList != NULL || t->confResponse != NULL || t->ackResponse != NULL) {
 			res = KSI_TlvTemplate_serializeObject(t->ctx, t, 0x221, 0, 0, KSI_TLV_TEMPLATE(KSI_AggregationRespPdu), raw, len);
 		} else {
 			res = KSI_INVALID_FORMAT;
@@ -1774,6 +1808,8 @@ cleanup:
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_Header*, header, Header);
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_AggregationReq*, request, Request);
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_AggregationResp*, response, Response);
+KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_LIST(KSI_AggregationReq)*, requestList, RequestList);
+KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_LIST(KSI_AggregationResp)*, responseList, ResponseList);
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_DataHash*, hmac, Hmac);
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_ErrorPdu*, error, Error);
 KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_Config*, confRequest, ConfRequest);
@@ -1784,6 +1820,8 @@ KSI_IMPLEMENT_GETTER(KSI_AggregationPdu, KSI_RequestAck*, ackResponse, AckRespon
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_Header*, header, Header);
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_AggregationReq*, request, Request);
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_AggregationResp*, response, Response);
+KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_LIST(KSI_AggregationReq)*, requestList, RequestList);
+KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_LIST(KSI_AggregationResp)*, responseList, ResponseList);
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_DataHash*, hmac, Hmac);
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_ErrorPdu*, error, Error);
 KSI_IMPLEMENT_SETTER(KSI_AggregationPdu, KSI_Config*, confRequest, ConfRequest);
@@ -75,6 +75,12 @@ extern "C" {
 	/** Typedef for the verification result. */
 	typedef struct KSI_PolicyVerificationResult_st KSI_PolicyVerificationResult;
 
+	/** Typedef for the executor running the batch operations in parallel. */
+	typedef struct KSI_Executor_st KSI_Executor;
+
+	/** Typedef for the ring buffer of log records. */
+	typedef struct KSI_LOG_RingBuffer_st KSI_LOG_RingBuffer;
+
 	/**
 	 * Callback for request header.
 	 * \param[in]	hdr		Pointer to the header.
@@ -681,6 +687,8 @@ int KSI_AggregationPdu_updateHmac(KSI_AggregationPdu *pdu, KSI_HashAlgorithm alg
 int KSI_AggregationPdu_getHeader(const KSI_AggregationPdu *t, KSI_Header **header);
 int KSI_AggregationPdu_getRequest(const KSI_AggregationPdu *t, KSI_AggregationReq **request);
 int KSI_AggregationPdu_getResponse(const KSI_AggregationPdu *t, KSI_AggregationResp **response);
+int KSI_AggregationPdu_getRequestList(const KSI_AggregationPdu *t, KSI_LIST(KSI_AggregationReq) **requestList);
+int KSI_AggregationPdu_getResponseList(const KSI_AggregationPdu *t, KSI_LIST(KSI_AggregationResp) **responseList);
 int KSI_AggregationPdu_getConfRequest(const KSI_AggregationPdu *t, KSI_Config **confRequest);
 int KSI_AggregationPdu_getConfResponse(const KSI_AggregationPdu *t, KSI_Config **confResponse);
 int KSI_AggregationPdu_getAckRequest(const KSI_AggregationPdu *t, KSI_RequestAck **ackRequest);
@@ -690,6 +698,8 @@ int KSI_AggregationPdu_getError (const KSI_AggregationPdu *t, KSI_ErrorPdu **err
 int KSI_AggregationPdu_setHeader(KSI_AggregationPdu *t, KSI_Header *header);
 int KSI_AggregationPdu_setRequest(KSI_AggregationPdu *t, KSI_AggregationReq *request);
 int KSI_AggregationPdu_setResponse(KSI_AggregationPdu *t, KSI_AggregationResp *response);
+int KSI_AggregationPdu_setRequestList(KSI_AggregationPdu *t, KSI_LIST(KSI_AggregationReq) *requestList);
+int KSI_AggregationPdu_setResponseList(KSI_AggregationPdu *t, KSI_LIST(KSI_AggregationResp) *responseList);
 int KSI_AggregationPdu_setConfRequest(KSI_AggregationPdu *t, KSI_Config *confRequest);
 int KSI_AggregationPdu_setConfResponse(KSI_AggregationPdu *t, KSI_Config *confResponse);
 int KSI_AggregationPdu_setAckRequest(KSI_AggregationPdu *t, KSI_RequestAck *ackRequest);
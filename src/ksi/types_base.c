@@ -22,6 +22,7 @@
 
 #include "internal.h"
 #include "tlv.h"
+#include "impl/thread_impl.h"
 
 struct KSI_OctetString_st {
 	KSI_CTX *ctx;
@@ -91,7 +92,7 @@ KSI_IMPLEMENT_LIST(KSI_OctetString, KSI_OctetString_free);
  * KSI_OctetString
  */
 void KSI_OctetString_free(KSI_OctetString *o) {
-	if (o != NULL && --o->ref == 0) {
+	if (o != NULL && KSI_ATOMIC_DEC_REF(&o->ref) == 0) {
 		KSI_free(o->data);
 		KSI_free(o);
 	}
@@ -138,7 +139,7 @@ cleanup:
 	return res;
 }
 
-KSI_IMPLEMENT_REF(KSI_OctetString);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_OctetString);
 
 int KSI_OctetString_extract(const KSI_OctetString *o, const unsigned char **data, size_t *data_len) {
 	int res = KSI_UNKNOWN_ERROR;
@@ -351,7 +352,7 @@ cleanup:
  * Utf8String
  */
 void KSI_Utf8String_free(KSI_Utf8String *o) {
-	if (o != NULL && --o->ref == 0) {
+	if (o != NULL && KSI_ATOMIC_DEC_REF(&o->ref) == 0) {
 		KSI_free(o->value);
 		KSI_free(o);
 	}
@@ -411,7 +412,7 @@ cleanup:
 	return res;
 }
 
-KSI_IMPLEMENT_REF(KSI_Utf8String);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_Utf8String);
 
 size_t KSI_Utf8String_size(const KSI_Utf8String *o) {
 	return o != NULL ? o->len : 0;
@@ -571,12 +572,12 @@ cleanup:
 }
 
 void KSI_Integer_free(KSI_Integer *o) {
-	if (o != NULL && o->value >= integerPoolSize && --o->ref == 0) {
+	if (o != NULL && o->value >= integerPoolSize && KSI_ATOMIC_DEC_REF(&o->ref) == 0) {
 		KSI_free(o);
 	}
 }
 
-KSI_IMPLEMENT_REF(KSI_Integer);
+KSI_IMPLEMENT_ATOMIC_REF(KSI_Integer);
 
 char *KSI_Integer_toDateString(const KSI_Integer *o, char *buf, size_t buf_len) {
 	char *ret = NULL;
@@ -124,6 +124,7 @@ static CuSuite* initSuite(void) {
 	addSuite(suite, KSITest_Flags_getSuite);
 	addSuite(suite, KSITest_SignatureBuilder_getSuite);
 	addSuite(suite, KSITest_List_getSuite);
+	addSuite(suite, KSITest_Executor_getSuite);
 
 	return suite;
 }
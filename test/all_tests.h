@@ -83,6 +83,7 @@ CuSuite* KSITest_Blocksigner_getSuite(void);
 CuSuite* KSITest_Flags_getSuite(void);
 CuSuite* KSITest_SignatureBuilder_getSuite(void);
 CuSuite* KSITest_List_getSuite(void);
+CuSuite* KSITest_Executor_getSuite(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,1185 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+/*
+ * Benchmark suite of the SDK operations. Every case is warmed up first, then timed in samples
+ * of a calibrated number of operations with a monotonic nanosecond clock. The results are
+ * written to the standard output as JSON lines, one line per case in a fixed order, so that
+ * the output of two runs can be compared line by line.
+ *
+ * Usage: benchmark [-t <ms>] [-w <ms>] [-f <filter>] [-l] <test-dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <errno.h>
+#  include <signal.h>
+#  include <time.h>
+#  include <unistd.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <arpa/inet.h>
+#  include <sys/socket.h>
+#endif
+
+#include <ksi/ksi.h>
+#include <ksi/blocksigner.h>
+#include <ksi/executor.h>
+#include <ksi/hashchain.h>
+#include <ksi/net_async.h>
+#include <ksi/policy.h>
+#include <ksi/tree_builder.h>
+
+#include "../src/ksi/impl/ctx_impl.h"
+#include "../src/ksi/impl/net_impl.h"
+#include "../src/ksi/impl/signature_impl.h"
+#include "../src/ksi/impl/thread_impl.h"
+
+#if KSI_AGGREGATION_PDU_VERSION == KSI_PDU_VERSION_2
+#	define	TEST_RESOURCE_AGGR_VER "v2"
+#else
+#	error	"Failed to set up test resources. Invalid PDU version."
+#endif
+
+#define TEST_USER "anon"
+#define TEST_PASS "anon"
+
+#define TEST_SIGNATURE_FILE           "resource/tlv/ok-sig-2014-04-30.1.ksig"
+#define TEST_EXT_SIGNATURE_FILE       "resource/tlv/ok-sig-2014-04-30.1-extended.ksig"
+#define TEST_PUBLICATIONS_FILE        "resource/tlv/publications.tlv"
+#define TEST_AGGR_RESPONSE_FILE       "resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv"
+#define TEST_BLOCK_RESPONSE_FILE      "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+#define TEST_BLOCK_LEAF               "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2"
+
+/** The samples are at least this long, shorter operations are timed in batches. */
+#define MIN_SAMPLE_NS 20000ull
+/** Upper limit of the number of samples per case. */
+#define MAX_SAMPLES 100000
+/** Lower limit of the number of samples per case, regardless of the time limit. */
+#define MIN_SAMPLES 10
+
+#define TLV_MAX_SIZE (0xffff + 4)
+
+typedef struct LoopbackServer_st LoopbackServer;
+
+/** Resources of a benchmark case, the unused fields are left \c NULL. */
+typedef struct BenchState_st {
+	KSI_CTX *ksi;
+	unsigned char *data;
+	size_t data_len;
+	const void **inputs;
+	size_t *input_lens;
+	KSI_DataHash **hashes;
+	size_t count;
+	KSI_Signature *sig;
+	KSI_PublicationsFile *pubFile;
+	KSI_Integer **times;
+	KSI_AggregationPdu *pdu;
+	KSI_DataHash *prev;
+	KSI_OctetString *iv;
+	KSI_AsyncService *as;
+	LoopbackServer *server;
+	size_t cursor;
+} BenchState;
+
+typedef struct Benchmark_st Benchmark;
+
+struct Benchmark_st {
+	const char *name;
+	/** Case specific parameter, e.g. the input size or the number of leaves. */
+	size_t param;
+	KSI_HashAlgorithm algo;
+	/** Number of operations performed by a single call of \c run, 0 is treated as 1. */
+	size_t opsPerRun;
+	/** The \c param is the number of bytes processed by an operation. */
+	int reportBytes;
+	int (*setup)(const Benchmark *bench, BenchState *st);
+	int (*run)(const Benchmark *bench, BenchState *st);
+};
+
+typedef struct BenchResult_st {
+	size_t batch;
+	size_t samples;
+	KSI_uint64_t ops;
+	double min;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double opsPerSec;
+} BenchResult;
+
+static const char *testDir = ".";
+
+static const char *resourcePath(const char *resource) {
+	static char buf[1024];
+	KSI_snprintf(buf, sizeof(buf), "%s/%s", testDir, resource);
+	return buf;
+}
+
+static const char *resourceUri(const char *resource) {
+	static char buf[1024];
+	KSI_snprintf(buf, sizeof(buf), "file://%s/%s", testDir, resource);
+	return buf;
+}
+
+static KSI_uint64_t nowNs(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER cnt;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+
+	return (KSI_uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000ull +
+			(KSI_uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000ull / (KSI_uint64_t)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (KSI_uint64_t)ts.tv_sec * 1000000000ull + (KSI_uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int readFile(const char *path, unsigned char **data, size_t *data_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	FILE *f = NULL;
+	unsigned char *tmp = NULL;
+	size_t len;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open '%s'.\n", path);
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+
+	tmp = malloc(TLV_MAX_SIZE);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	len = fread(tmp, 1, TLV_MAX_SIZE, f);
+	if (len == 0 || !feof(f)) {
+		fprintf(stderr, "Unable to read '%s'.\n", path);
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+
+	*data = tmp;
+	*data_len = len;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	free(tmp);
+
+	return res;
+}
+
+/* Hashing. */
+
+static int setupHash(const Benchmark *bench, BenchState *st) {
+	size_t i;
+
+	st->data = malloc(bench->param);
+	if (st->data == NULL) return KSI_OUT_OF_MEMORY;
+	st->data_len = bench->param;
+
+	for (i = 0; i < st->data_len; i++) st->data[i] = (unsigned char)(i * 31 + 7);
+
+	return KSI_OK;
+}
+
+static int setupNativeHash(const Benchmark *bench, BenchState *st) {
+	int res;
+
+	res = KSI_CTX_setOption(st->ksi, KSI_OPT_NATIVE_SHA2, (void *)1);
+	if (res != KSI_OK) return res;
+
+	return setupHash(bench, st);
+}
+
+static int runHash(const Benchmark *bench, BenchState *st) {
+	int res;
+	KSI_DataHash *hsh = NULL;
+
+	res = KSI_DataHash_create(st->ksi, st->data, st->data_len, bench->algo, &hsh);
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+static int setupHashBatch(const Benchmark *bench, BenchState *st) {
+	int res;
+	KSI_Executor *exec = NULL;
+	size_t i;
+
+	res = KSI_Executor_new(st->ksi, 0, &exec);
+	if (res != KSI_OK) return res;
+
+	res = KSI_CTX_setExecutor(st->ksi, exec);
+	if (res != KSI_OK) {
+		KSI_Executor_free(exec);
+		return res;
+	}
+
+	res = setupHash(bench, st);
+	if (res != KSI_OK) return res;
+
+	st->count = bench->opsPerRun;
+	st->inputs = calloc(st->count, sizeof(*st->inputs));
+	st->input_lens = calloc(st->count, sizeof(*st->input_lens));
+	st->hashes = calloc(st->count, sizeof(*st->hashes));
+	if (st->inputs == NULL || st->input_lens == NULL || st->hashes == NULL) return KSI_OUT_OF_MEMORY;
+
+	for (i = 0; i < st->count; i++) {
+		st->inputs[i] = st->data;
+		st->input_lens[i] = st->data_len;
+	}
+
+	return KSI_OK;
+}
+
+static int runHashBatch(const Benchmark *bench, BenchState *st) {
+	int res;
+	size_t i;
+
+	res = KSI_DataHash_createBatch(st->ksi, st->inputs, st->input_lens, st->count, bench->algo, st->hashes);
+	if (res != KSI_OK) return res;
+
+	for (i = 0; i < st->count; i++) {
+		KSI_DataHash_free(st->hashes[i]);
+		st->hashes[i] = NULL;
+	}
+
+	return KSI_OK;
+}
+
+/* Tree building. */
+
+static int setupLeaves(const Benchmark *bench, BenchState *st) {
+	int res;
+	size_t i;
+
+	st->count = bench->param;
+	st->hashes = calloc(st->count, sizeof(*st->hashes));
+	if (st->hashes == NULL) return KSI_OUT_OF_MEMORY;
+
+	for (i = 0; i < st->count; i++) {
+		res = KSI_DataHash_create(st->ksi, &i, sizeof(i), KSI_HASHALG_SHA2_256, &st->hashes[i]);
+		if (res != KSI_OK) return res;
+	}
+
+	return KSI_OK;
+}
+
+static int runTree(const Benchmark *bench, BenchState *st) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	size_t i;
+
+	res = KSI_TreeBuilder_new(st->ksi, bench->algo, &builder);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < st->count; i++) {
+		res = KSI_TreeBuilder_addDataHash(builder, st->hashes[i], 0, NULL);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_TreeBuilder_close(builder);
+
+cleanup:
+
+	KSI_TreeBuilder_free(builder);
+
+	return res;
+}
+
+/* Block signing with the aggregator response read from a file. */
+
+static int setupBlockSigner(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	unsigned char imprint[sizeof(TEST_BLOCK_LEAF) / 2];
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+	size_t i;
+
+	res = KSI_CTX_setAggregator(st->ksi, resourceUri(TEST_BLOCK_RESPONSE_FILE), TEST_USER, TEST_PASS);
+	if (res != KSI_OK) return res;
+
+	for (i = 0; i < sizeof(imprint); i++) {
+		unsigned hex;
+		if (sscanf(TEST_BLOCK_LEAF + 2 * i, "%2x", &hex) != 1) return KSI_INVALID_FORMAT;
+		imprint[i] = (unsigned char)hex;
+	}
+
+	st->count = 1;
+	st->hashes = calloc(st->count, sizeof(*st->hashes));
+	if (st->hashes == NULL) return KSI_OUT_OF_MEMORY;
+
+	res = KSI_DataHash_fromImprint(st->ksi, imprint, sizeof(imprint), &st->hashes[0]);
+	if (res != KSI_OK) return res;
+
+	res = KSI_DataHash_createZero(st->ksi, KSI_HASHALG_SHA2_256, &st->prev);
+	if (res != KSI_OK) return res;
+
+	return KSI_OctetString_new(st->ksi, ivDat, sizeof(ivDat), &st->iv);
+}
+
+static int runBlockSigner(const Benchmark *bench, BenchState *st) {
+	int res;
+	KSI_BlockSigner *bs = NULL;
+	size_t i;
+
+	/* The response is read from the beginning of the file and it has a fixed request id. */
+	res = KSI_CTX_setAggregator(st->ksi, resourceUri(TEST_BLOCK_RESPONSE_FILE), TEST_USER, TEST_PASS);
+	if (res != KSI_OK) goto cleanup;
+	st->ksi->netProvider->requestCount = 0;
+
+	res = KSI_BlockSigner_new(st->ksi, bench->algo, st->prev, st->iv, &bs);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < bench->param; i++) {
+		res = KSI_BlockSigner_addLeaf(bs, st->hashes[0], 0, NULL, NULL);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_BlockSigner_closeAndSign(bs);
+
+cleanup:
+
+	KSI_BlockSigner_free(bs);
+
+	return res;
+}
+
+/* Signature parsing and serialization. */
+
+static int setupSignatureRaw(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return readFile(resourcePath(TEST_SIGNATURE_FILE), &st->data, &st->data_len);
+}
+
+static int runSignatureParse(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_Signature *sig = NULL;
+
+	res = KSI_Signature_parse(st->ksi, st->data, st->data_len, &sig);
+	KSI_Signature_free(sig);
+
+	return res;
+}
+
+static int setupSignature(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return KSI_Signature_fromFile(st->ksi, resourcePath(TEST_SIGNATURE_FILE), &st->sig);
+}
+
+static int runSignatureSerialize(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_Signature_serialize(st->sig, &raw, &raw_len);
+	KSI_free(raw);
+
+	return res;
+}
+
+static int setupAggregationPdu(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+
+	res = readFile(resourcePath(TEST_AGGR_RESPONSE_FILE), &st->data, &st->data_len);
+	if (res != KSI_OK) return res;
+
+	return KSI_AggregationPdu_parse(st->ksi, st->data, st->data_len, &st->pdu);
+}
+
+static int runPduParse(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_AggregationPdu *pdu = NULL;
+
+	res = KSI_AggregationPdu_parse(st->ksi, st->data, st->data_len, &pdu);
+	KSI_AggregationPdu_free(pdu);
+
+	return res;
+}
+
+static int runPduSerialize(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_AggregationPdu_serialize(st->pdu, &raw, &raw_len);
+	KSI_free(raw);
+
+	return res;
+}
+
+/* Hash chain aggregation. */
+
+static int runAggregationChains(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_DataHash *root = NULL;
+
+	res = KSI_AggregationHashChainList_aggregate(st->sig->aggregationChainList, st->ksi, 0, &root);
+	KSI_DataHash_free(root);
+
+	return res;
+}
+
+static int runCalendarChain(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_DataHash *root = NULL;
+
+	res = KSI_CalendarHashChain_aggregate(st->sig->calendarChain, &root);
+	KSI_DataHash_free(root);
+
+	return res;
+}
+
+/* Policy verification. */
+
+static int setupPublicationsFile(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return KSI_PublicationsFile_fromFile(st->ksi, resourcePath(TEST_PUBLICATIONS_FILE), &st->pubFile);
+}
+
+static int setupExtendedSignature(const Benchmark *bench, BenchState *st) {
+	int res;
+
+	res = setupPublicationsFile(bench, st);
+	if (res != KSI_OK) return res;
+
+	return KSI_Signature_fromFile(st->ksi, resourcePath(TEST_EXT_SIGNATURE_FILE), &st->sig);
+}
+
+static int verifyWithPolicy(const KSI_Policy *policy, BenchState *st) {
+	int res;
+	KSI_VerificationContext context;
+	KSI_PolicyVerificationResult *result = NULL;
+
+	res = KSI_VerificationContext_init(&context, st->ksi);
+	if (res != KSI_OK) return res;
+
+	context.signature = st->sig;
+	context.userPublicationsFile = st->pubFile;
+
+	res = KSI_SignatureVerifier_verify(policy, &context, &result);
+	if (res == KSI_OK && result->finalResult.resultCode != KSI_VER_RES_OK) res = KSI_VERIFICATION_FAILURE;
+
+	KSI_PolicyVerificationResult_free(result);
+	KSI_VerificationContext_clean(&context);
+
+	return res;
+}
+
+static int runVerifyInternal(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return verifyWithPolicy(KSI_VERIFICATION_POLICY_INTERNAL, st);
+}
+
+static int runVerifyPublicationsFile(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return verifyWithPolicy(KSI_VERIFICATION_POLICY_PUBLICATIONS_FILE_BASED, st);
+}
+
+/* Publications file. */
+
+static int setupPublicationsFileRaw(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	return readFile(resourcePath(TEST_PUBLICATIONS_FILE), &st->data, &st->data_len);
+}
+
+static int runPublicationsFileParse(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+
+	res = KSI_PublicationsFile_parse(st->ksi, st->data, st->data_len, &pubFile);
+	KSI_PublicationsFile_free(pubFile);
+
+	return res;
+}
+
+static int getPublicationTime(const KSI_PublicationsFile *pubFile, size_t index, KSI_uint64_t *time) {
+	int res;
+	KSI_LIST(KSI_PublicationRecord) *list = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_PublicationData *pubData = NULL;
+	KSI_Integer *pubTime = NULL;
+
+	res = KSI_PublicationsFile_getPublications(pubFile, &list);
+	if (res != KSI_OK) return res;
+
+	res = KSI_PublicationRecordList_elementAt(list, index, &pubRec);
+	if (res != KSI_OK) return res;
+
+	res = KSI_PublicationRecord_getPublishedData(pubRec, &pubData);
+	if (res != KSI_OK) return res;
+
+	res = KSI_PublicationData_getTime(pubData, &pubTime);
+	if (res != KSI_OK) return res;
+
+	*time = KSI_Integer_getUInt64(pubTime);
+
+	return KSI_OK;
+}
+
+static int setupPublicationLookup(const Benchmark *bench, BenchState *st) {
+	int res;
+	KSI_LIST(KSI_PublicationRecord) *list = NULL;
+	KSI_uint64_t from = 0;
+	KSI_uint64_t to = 0;
+	size_t i;
+
+	res = setupPublicationsFile(bench, st);
+	if (res != KSI_OK) return res;
+
+	/* Spread the lookups over the time span of the publications. */
+	res = KSI_PublicationsFile_getPublications(st->pubFile, &list);
+	if (res != KSI_OK) return res;
+
+	res = getPublicationTime(st->pubFile, 0, &from);
+	if (res != KSI_OK) return res;
+
+	res = getPublicationTime(st->pubFile, KSI_PublicationRecordList_length(list) - 1, &to);
+	if (res != KSI_OK) return res;
+
+	st->count = bench->param;
+	st->times = calloc(st->count, sizeof(*st->times));
+	if (st->times == NULL) return KSI_OUT_OF_MEMORY;
+
+	for (i = 0; i < st->count; i++) {
+		res = KSI_Integer_new(st->ksi, from + (to - from) / st->count * i, &st->times[i]);
+		if (res != KSI_OK) return res;
+	}
+
+	return KSI_OK;
+}
+
+static int runPublicationLookup(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res;
+	KSI_PublicationRecord *pubRec = NULL;
+
+	res = KSI_PublicationsFile_getNearestPublication(st->pubFile, st->times[st->cursor], &pubRec);
+	if (res == KSI_OK && pubRec == NULL) res = KSI_VERIFICATION_FAILURE;
+	KSI_PublicationRecord_free(pubRec);
+
+	st->cursor = (st->cursor + 1) % st->count;
+
+	return res;
+}
+
+#ifndef _WIN32
+/* Async signing over a loopback TCP connection. */
+
+struct LoopbackServer_st {
+	KSI_CTX *ksi;
+	int listenFd;
+	unsigned short port;
+	/** Response returned to every request, only the request id is changed. */
+	KSI_AggregationPdu *pdu;
+	KSI_AggregationResp *resp;
+	KSI_Thread thread;
+	int started;
+};
+
+static int readFully(int fd, unsigned char *buf, size_t len) {
+	size_t count = 0;
+
+	while (count < len) {
+		ssize_t n = recv(fd, buf + count, len - count, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return 0;
+		count += (size_t)n;
+	}
+
+	return 1;
+}
+
+static int writeFully(int fd, const unsigned char *buf, size_t len) {
+	size_t count = 0;
+
+	while (count < len) {
+		ssize_t n = send(fd, buf + count, len - count, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return 0;
+		count += (size_t)n;
+	}
+
+	return 1;
+}
+
+static int respond(LoopbackServer *srv, int fd, const KSI_AggregationReq *req) {
+	int res;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_Utf8String *loginId = NULL;
+	KSI_Integer *reqId = NULL;
+	KSI_Integer *prevId = NULL;
+	KSI_DataHash *hmac = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_AggregationReq_getRequestId(req, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationResp_getRequestId(srv->resp, &prevId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationResp_setRequestId(srv->resp, KSI_Integer_ref(reqId));
+	if (res != KSI_OK) goto cleanup;
+	KSI_Integer_free(prevId);
+
+	/* A parsed PDU keeps its raw value for the HMAC, thus a new one is composed. */
+	res = KSI_Header_new(srv->ksi, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Utf8String_new(srv->ksi, TEST_USER, sizeof(TEST_USER), &loginId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_setLoginId(hdr, loginId);
+	if (res != KSI_OK) goto cleanup;
+	loginId = NULL;
+
+	res = KSI_AggregationPdu_new(srv->ksi, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_AggregationPdu_setResponse(pdu, KSI_AggregationResp_ref(srv->resp));
+	if (res != KSI_OK) goto cleanup;
+
+	/* The HMAC is calculated over the PDU with an empty HMAC value. */
+	res = KSI_DataHash_createZero(srv->ksi, KSI_HASHALG_SHA2_256, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_AggregationPdu_updateHmac(pdu, KSI_HASHALG_SHA2_256, TEST_PASS);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_serialize(pdu, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (!writeFully(fd, raw, raw_len)) res = KSI_NETWORK_ERROR;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_AggregationPdu_free(pdu);
+	KSI_Header_free(hdr);
+	KSI_Utf8String_free(loginId);
+	KSI_DataHash_free(hmac);
+
+	return res;
+}
+
+static int handlePdu(LoopbackServer *srv, int fd, const unsigned char *raw, size_t raw_len) {
+	int res;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_AggregationReq *req = NULL;
+	KSI_LIST(KSI_AggregationReq) *reqList = NULL;
+	size_t i;
+
+	res = KSI_AggregationPdu_parse(srv->ksi, raw, raw_len, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_getRequest(pdu, &req);
+	if (res != KSI_OK) goto cleanup;
+
+	if (req != NULL) {
+		res = respond(srv, fd, req);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* Coalesced requests. */
+	res = KSI_AggregationPdu_getRequestList(pdu, &reqList);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < KSI_AggregationReqList_length(reqList); i++) {
+		res = KSI_AggregationReqList_elementAt(reqList, i, &req);
+		if (res != KSI_OK) goto cleanup;
+
+		res = respond(srv, fd, req);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+cleanup:
+
+	KSI_AggregationPdu_free(pdu);
+
+	return res;
+}
+
+static void serverThread(void *arg) {
+	LoopbackServer *srv = arg;
+	unsigned char buf[TLV_MAX_SIZE];
+	int one = 1;
+	int fd;
+
+	fd = accept(srv->listenFd, NULL, NULL);
+	if (fd < 0) return;
+
+	/* Do not let the small responses wait for the acknowledgements. */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	for (;;) {
+		size_t hdr = 2;
+		size_t len;
+
+		if (!readFully(fd, buf, 2)) break;
+		if (buf[0] & 0x80) {
+			/* 16-bit length. */
+			hdr = 4;
+			if (!readFully(fd, buf + 2, 2)) break;
+			len = ((size_t)buf[2] << 8) | buf[3];
+		} else {
+			len = buf[1];
+		}
+
+		if (!readFully(fd, buf + hdr, len)) break;
+		if (handlePdu(srv, fd, buf, hdr + len) != KSI_OK) break;
+	}
+
+	close(fd);
+}
+
+static void LoopbackServer_free(LoopbackServer *srv) {
+	if (srv != NULL) {
+		if (srv->listenFd >= 0) {
+			/* Wakes up the server, if the client never connected. */
+			shutdown(srv->listenFd, SHUT_RDWR);
+			if (srv->started) KSI_Thread_join(&srv->thread);
+			close(srv->listenFd);
+		}
+		KSI_AggregationPdu_free(srv->pdu);
+		KSI_CTX_free(srv->ksi);
+		free(srv);
+	}
+}
+
+static int LoopbackServer_new(LoopbackServer **server) {
+	int res = KSI_UNKNOWN_ERROR;
+	LoopbackServer *tmp = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	KSI_LIST(KSI_AggregationResp) *respList = NULL;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	tmp = calloc(1, sizeof(LoopbackServer));
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	tmp->listenFd = -1;
+
+	res = KSI_CTX_new(&tmp->ksi);
+	if (res != KSI_OK) goto cleanup;
+
+	res = readFile(resourcePath(TEST_AGGR_RESPONSE_FILE), &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_parse(tmp->ksi, raw, raw_len, &tmp->pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_getResponse(tmp->pdu, &tmp->resp);
+	if (res != KSI_OK) goto cleanup;
+
+	if (tmp->resp == NULL) {
+		res = KSI_AggregationPdu_getResponseList(tmp->pdu, &respList);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationRespList_elementAt(respList, 0, &tmp->resp);
+		if (res != KSI_OK || tmp->resp == NULL) {
+			res = KSI_INVALID_FORMAT;
+			goto cleanup;
+		}
+	}
+
+	tmp->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	if (tmp->listenFd < 0) {
+		res = KSI_NETWORK_ERROR;
+		goto cleanup;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if (bind(tmp->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(tmp->listenFd, 1) != 0 ||
+			getsockname(tmp->listenFd, (struct sockaddr *)&addr, &addr_len) != 0) {
+		res = KSI_NETWORK_ERROR;
+		goto cleanup;
+	}
+	tmp->port = ntohs(addr.sin_port);
+
+	res = KSI_Thread_start(&tmp->thread, serverThread, tmp);
+	if (res != KSI_OK) goto cleanup;
+	tmp->started = 1;
+
+	*server = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	free(raw);
+	LoopbackServer_free(tmp);
+
+	return res;
+}
+
+static int setupAsync(const Benchmark *bench, BenchState *st) {
+	int res;
+	char uri[64];
+	size_t i;
+
+	res = LoopbackServer_new(&st->server);
+	if (res != KSI_OK) return res;
+
+	res = KSI_SigningAsyncService_new(st->ksi, &st->as);
+	if (res != KSI_OK) return res;
+
+	KSI_snprintf(uri, sizeof(uri), "ksi+tcp://127.0.0.1:%u", (unsigned)st->server->port);
+	res = KSI_AsyncService_setEndpoint(st->as, uri, TEST_USER, TEST_PASS);
+	if (res != KSI_OK) return res;
+
+	res = KSI_AsyncService_setOption(st->as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)(2 * bench->opsPerRun));
+	if (res != KSI_OK) return res;
+
+	res = KSI_AsyncService_setOption(st->as, KSI_ASYNC_OPT_MAX_REQUEST_COUNT, (void *)(1 << 20));
+	if (res != KSI_OK) return res;
+
+	st->count = bench->opsPerRun;
+	st->hashes = calloc(st->count, sizeof(*st->hashes));
+	if (st->hashes == NULL) return KSI_OUT_OF_MEMORY;
+
+	for (i = 0; i < st->count; i++) {
+		res = KSI_DataHash_create(st->ksi, &i, sizeof(i), KSI_HASHALG_SHA2_256, &st->hashes[i]);
+		if (res != KSI_OK) return res;
+	}
+
+	return KSI_OK;
+}
+
+/* Sends a window of requests and waits for all the responses. */
+static int runAsync(const Benchmark *KSI_UNUSED(bench), BenchState *st) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationReq *req = NULL;
+	KSI_AsyncHandle *handle = NULL;
+	size_t received = 0;
+	size_t i;
+
+	for (i = 0; i < st->count; i++) {
+		res = KSI_AggregationReq_new(st->ksi, &req);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationReq_setRequestHash(req, KSI_DataHash_ref(st->hashes[i]));
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AsyncAggregationHandle_new(st->ksi, req, &handle);
+		if (res != KSI_OK) goto cleanup;
+		req = NULL;
+
+		res = KSI_AsyncService_addRequest(st->as, handle);
+		if (res != KSI_OK) goto cleanup;
+		handle = NULL;
+	}
+
+	while (received < st->count) {
+		size_t pending = 0;
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+
+		res = KSI_AsyncService_run(st->as, &handle, &pending);
+		if (res != KSI_OK) goto cleanup;
+
+		if (handle == NULL) {
+			if (pending == 0) {
+				res = KSI_INVALID_STATE;
+				goto cleanup;
+			}
+			continue;
+		}
+
+		res = KSI_AsyncHandle_getState(handle, &state);
+		if (res != KSI_OK) goto cleanup;
+
+		if (state != KSI_ASYNC_STATE_RESPONSE_RECEIVED) {
+			KSI_AsyncHandle_getError(handle, &res);
+			goto cleanup;
+		}
+
+		KSI_AsyncHandle_free(handle);
+		handle = NULL;
+		received++;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AsyncHandle_free(handle);
+	KSI_AggregationReq_free(req);
+
+	return res;
+}
+#endif
+
+static const Benchmark benchmarks[] = {
+	{"hash/sha-256/64",                64, KSI_HASHALG_SHA2_256,       0, 1, setupHash, runHash},
+	{"hash/sha-256/1024",            1024, KSI_HASHALG_SHA2_256,       0, 1, setupHash, runHash},
+	{"hash/sha-256/65536",          65536, KSI_HASHALG_SHA2_256,       0, 1, setupHash, runHash},
+	{"hash/sha-512/65536",          65536, KSI_HASHALG_SHA2_512,       0, 1, setupHash, runHash},
+	{"hash/sha-1/65536",            65536, KSI_HASHALG_SHA1,           0, 1, setupHash, runHash},
+	{"hash/native-sha-256/64",         64, KSI_HASHALG_SHA2_256,       0, 1, setupNativeHash, runHash},
+	{"hash/native-sha-256/65536",   65536, KSI_HASHALG_SHA2_256,       0, 1, setupNativeHash, runHash},
+	{"hash/batch-sha-256/1024",      1024, KSI_HASHALG_SHA2_256,       4096, 1, setupHashBatch, runHashBatch},
+	{"tree/16",                        16, KSI_HASHALG_SHA2_256,       0, 0, setupLeaves, runTree},
+	{"tree/256",                      256, KSI_HASHALG_SHA2_256,       0, 0, setupLeaves, runTree},
+	{"tree/4096",                    4096, KSI_HASHALG_SHA2_256,       0, 0, setupLeaves, runTree},
+	{"blocksigner/101",               101, KSI_HASHALG_SHA2_256,       0, 0, setupBlockSigner, runBlockSigner},
+	{"signature/parse",                 0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupSignatureRaw, runSignatureParse},
+	{"signature/serialize",             0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupSignature, runSignatureSerialize},
+	{"pdu/parse",                       0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupAggregationPdu, runPduParse},
+	{"pdu/serialize",                   0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupAggregationPdu, runPduSerialize},
+	{"chain/aggregation",               0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupSignature, runAggregationChains},
+	{"chain/calendar",                  0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupSignature, runCalendarChain},
+	{"verify/internal",                 0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupSignature, runVerifyInternal},
+	{"verify/publications-file",        0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupExtendedSignature, runVerifyPublicationsFile},
+	{"pubfile/parse",                   0, KSI_HASHALG_INVALID_VALUE,  0, 0, setupPublicationsFileRaw, runPublicationsFileParse},
+	{"pubfile/lookup",                997, KSI_HASHALG_INVALID_VALUE,  0, 0, setupPublicationLookup, runPublicationLookup},
+#ifndef _WIN32
+	{"async/tcp-loopback/256",          0, KSI_HASHALG_INVALID_VALUE,  256, 0, setupAsync, runAsync},
+#endif
+	{NULL, 0, KSI_HASHALG_INVALID_VALUE, 0, 0, NULL, NULL}
+};
+
+static void BenchState_clean(BenchState *st) {
+	size_t i;
+
+#ifndef _WIN32
+	/* The client has to disconnect before the server can be stopped. */
+	KSI_AsyncService_free(st->as);
+	LoopbackServer_free(st->server);
+#endif
+	if (st->hashes != NULL) {
+		for (i = 0; i < st->count; i++) KSI_DataHash_free(st->hashes[i]);
+	}
+	if (st->times != NULL) {
+		for (i = 0; i < st->count; i++) KSI_Integer_free(st->times[i]);
+	}
+	free(st->hashes);
+	free(st->times);
+	free(st->inputs);
+	free(st->input_lens);
+	free(st->data);
+	KSI_Signature_free(st->sig);
+	KSI_PublicationsFile_free(st->pubFile);
+	KSI_AggregationPdu_free(st->pdu);
+	KSI_DataHash_free(st->prev);
+	KSI_OctetString_free(st->iv);
+	KSI_CTX_free(st->ksi);
+
+	memset(st, 0, sizeof(*st));
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the sorted samples. */
+static double percentile(const double *sorted, size_t count, unsigned p) {
+	size_t rank = (count * p + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Runs the benchmark \c batch times and returns the elapsed nanoseconds. */
+static int timeBatch(const Benchmark *bench, BenchState *st, size_t batch, KSI_uint64_t *ns) {
+	int res;
+	KSI_uint64_t start;
+	size_t i;
+
+	start = nowNs();
+	for (i = 0; i < batch; i++) {
+		res = bench->run(bench, st);
+		if (res != KSI_OK) return res;
+	}
+	*ns = nowNs() - start;
+
+	return KSI_OK;
+}
+
+static int measure(const Benchmark *bench, BenchState *st, KSI_uint64_t warmupNs, KSI_uint64_t timeNs, BenchResult *out) {
+	int res;
+	size_t opsPerRun = bench->opsPerRun > 0 ? bench->opsPerRun : 1;
+	size_t batch = 1;
+	double *samples = NULL;
+	size_t count = 0;
+	KSI_uint64_t ns = 0;
+	KSI_uint64_t start;
+	KSI_uint64_t total = 0;
+	size_t i;
+
+	/* Warm up the caches and find the batch size giving long enough samples. */
+	start = nowNs();
+	do {
+		res = timeBatch(bench, st, batch, &ns);
+		if (res != KSI_OK) goto cleanup;
+		if (ns < MIN_SAMPLE_NS) batch *= 2;
+	} while (ns < MIN_SAMPLE_NS || nowNs() - start < warmupNs);
+
+	samples = malloc(MAX_SAMPLES * sizeof(*samples));
+	if (samples == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	start = nowNs();
+	while (count < MAX_SAMPLES && (count < MIN_SAMPLES || nowNs() - start < timeNs)) {
+		res = timeBatch(bench, st, batch, &ns);
+		if (res != KSI_OK) goto cleanup;
+
+		samples[count++] = (double)ns / (double)(batch * opsPerRun);
+		total += ns;
+	}
+
+	qsort(samples, count, sizeof(*samples), compareDouble);
+
+	memset(out, 0, sizeof(*out));
+	out->batch = batch;
+	out->samples = count;
+	out->ops = (KSI_uint64_t)count * batch * opsPerRun;
+	out->min = samples[0];
+	out->max = samples[count - 1];
+	for (i = 0; i < count; i++) out->mean += samples[i];
+	out->mean /= (double)count;
+	out->p50 = percentile(samples, count, 50);
+	out->p90 = percentile(samples, count, 90);
+	out->p99 = percentile(samples, count, 99);
+	out->opsPerSec = (double)out->ops * 1e9 / (double)total;
+
+	res = KSI_OK;
+
+cleanup:
+
+	free(samples);
+
+	return res;
+}
+
+static void printResult(const Benchmark *bench, const BenchResult *r) {
+	printf("{\"name\":\"%s\",\"batch\":%llu,\"samples\":%llu,\"ops\":%llu,"
+			"\"min_ns\":%.1f,\"mean_ns\":%.1f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f,"
+			"\"ops_per_s\":%.1f",
+			bench->name, (unsigned long long)r->batch, (unsigned long long)r->samples, (unsigned long long)r->ops,
+			r->min, r->mean, r->p50, r->p90, r->p99, r->max, r->opsPerSec);
+	if (bench->reportBytes) {
+		printf(",\"bytes_per_s\":%.1f", r->opsPerSec * (double)bench->param);
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+static void printUsage(const char *prog) {
+	fprintf(stderr,
+			"Usage: %s [-t <ms>] [-w <ms>] [-f <filter>] [-l] <test-dir>\n"
+			"  -t <ms>     Measuring time per case (default 1000).\n"
+			"  -w <ms>     Warm-up time per case (default 200).\n"
+			"  -f <filter> Run only the cases with the filter in the name.\n"
+			"  -l          List the cases.\n", prog);
+}
+
+int main(int argc, char **argv) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned long timeMs = 1000;
+	unsigned long warmupMs = 200;
+	const char *filter = NULL;
+	int list = 0;
+	int failed = 0;
+	const Benchmark *bench;
+	BenchState st;
+	int i;
+
+	memset(&st, 0, sizeof(st));
+
+#ifndef _WIN32
+	/* The loopback server may write to a connection already closed by the client. */
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			timeMs = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			warmupMs = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "-l") == 0) {
+			list = 1;
+		} else if (argv[i][0] != '-') {
+			testDir = argv[i];
+		} else {
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (bench = benchmarks; bench->name != NULL; bench++) {
+		BenchResult result;
+
+		if (filter != NULL && strstr(bench->name, filter) == NULL) continue;
+		if (list) {
+			printf("%s\n", bench->name);
+			continue;
+		}
+
+		res = KSI_CTX_new(&st.ksi);
+		if (res == KSI_OK) res = bench->setup(bench, &st);
+		if (res == KSI_OK) res = measure(bench, &st, (KSI_uint64_t)warmupMs * 1000000, (KSI_uint64_t)timeMs * 1000000, &result);
+
+		if (res == KSI_OK) {
+			printResult(bench, &result);
+		} else {
+			fprintf(stderr, "Benchmark '%s' failed: %s (0x%x).\n", bench->name, KSI_getErrorString(res), res);
+			if (st.ksi != NULL) KSI_ERR_statusDump(st.ksi, stderr);
+			failed++;
+		}
+
+		BenchState_clean(&st);
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -166,6 +166,38 @@ static void Test_OKExtendSignatureDefProvider_tcp(CuTest* tc) {
 	okExtendSignatureDefProvider(tc, TEST_SCHEME_TCP);
 }
 
+static void Test_OKExtendSignaturePersistentConnection_tcp(CuTest* tc) {
+	int res;
+	size_t i;
+	KSI_Signature *sig = NULL;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS, (void *)10);
+	CuAssert(tc, "Unable to set TCP idle timeout.", res == KSI_OK);
+
+	/* Configure once, reconfiguring the extender drops the persistent connection. */
+	res = KSI_CTX_setExtender(ctx, KSITest_composeUri(TEST_SCHEME_TCP, &conf.extender), conf.extender.user, conf.extender.pass);
+	CuAssert(tc, "Unable to set configure aggregator as extender.", res == KSI_OK);
+
+	res = KSI_Signature_fromFile(ctx, getFullResourcePath("resource/tlv/ok-sig-2014-07-01.1.ksig"), &sig);
+	CuAssert(tc, "Unable to read signature frome file.", res == KSI_OK && sig != NULL);
+
+	/* Consecutive requests are sent over the same connection. */
+	for (i = 0; i < 3; i++) {
+		KSI_Signature *ext = NULL;
+
+		res = KSI_Signature_extend(sig, ctx, NULL, &ext);
+		CuAssert(tc, "Unable to extend signature.", res == KSI_OK && ext != NULL);
+
+		KSI_Signature_free(ext);
+	}
+
+	KSI_Signature_free(sig);
+	KSI_CTX_setOption(ctx, KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS, (void *)0);
+}
+
 static void nokExtendRequestToTheFuture(CuTest* tc, const char *scheme) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_ExtendResp *response = NULL;
@@ -399,6 +431,7 @@ CuSuite* ExtIntegrationTests_getSuite(void) {
 	SUITE_ADD_TEST(suite, Test_NOKExtendRequestToPast_tcp);
 	SUITE_ADD_TEST(suite, Test_OKExtendSignatureDefProvider_http);
 	SUITE_ADD_TEST(suite, Test_OKExtendSignatureDefProvider_tcp);
+	SUITE_ADD_TEST(suite, Test_OKExtendSignaturePersistentConnection_tcp);
 	SUITE_ADD_TEST(suite, Test_ExtendSignatureUsingAggregator_http);
 	SUITE_ADD_TEST(suite, Test_ExtendSignatureUsingAggregator_tcp);
 	SUITE_ADD_TEST(suite, Test_ExtendSignatureDifferentNetProviders_http);
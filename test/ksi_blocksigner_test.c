@@ -20,12 +20,15 @@
 #include <string.h>
 #include <ksi/ksi.h>
 #include <ksi/blocksigner.h>
+#include <ksi/local_aggregator.h>
 
 #include "cutest/CuTest.h"
 #include "all_tests.h"
+#include "test_mock_async.h"
 
 #include "../src/ksi/impl/ctx_impl.h"
 #include "../src/ksi/impl/net_http_impl.h"
+#include "../src/ksi/impl/thread_impl.h"
 
 extern KSI_CTX *ctx;
 
@@ -240,6 +243,165 @@ static void testMasking(CuTest *tc) {
 #undef TEST_AGGR_RESPONSE_FILE
 }
 
+static void testMaskingPrevLeaf(CuTest *tc) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_DataHash *mask = NULL;
+	KSI_DataHash *expected = NULL;
+	KSI_DataHash *leaf = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+	const unsigned char lvl = 1;
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create data hash with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, NULL);
+	CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+
+	/* Masked leaf value: h(h(prev || iv) || hsh || 1). */
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	CuAssert(tc, "Unable to open hasher.", res == KSI_OK && hsr != NULL);
+	KSI_DataHasher_addImprint(hsr, prev);
+	KSI_DataHasher_addOctetString(hsr, iv);
+	res = KSI_DataHasher_close(hsr, &mask);
+	CuAssert(tc, "Unable to calculate mask.", res == KSI_OK && mask != NULL);
+
+	KSI_DataHasher_reset(hsr);
+	KSI_DataHasher_addImprint(hsr, mask);
+	KSI_DataHasher_addImprint(hsr, hsh);
+	KSI_DataHasher_add(hsr, &lvl, 1);
+	res = KSI_DataHasher_close(hsr, &expected);
+	CuAssert(tc, "Unable to calculate masked leaf.", res == KSI_OK && expected != NULL);
+
+	res = KSI_BlockSigner_getPrevLeaf(bs, &leaf);
+	CuAssert(tc, "Unable to get previous leaf.", res == KSI_OK && leaf != NULL);
+	CuAssert(tc, "Previous leaf mismatch.", KSI_DataHash_equals(leaf, expected));
+
+	KSI_DataHash_free(leaf);
+	KSI_DataHash_free(expected);
+	KSI_DataHash_free(mask);
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+}
+
+static void testMaskingPipelined(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create data hash with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_BlockSigner_setPipelined(bs, 1);
+	CuAssert(tc, "Unable to enable the pipelined mode.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, NULL);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+	}
+
+	res = KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Failed to set aggregator.", res == KSI_OK);
+
+	/* The response has been recorded for the same tree built without the pipeline. */
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+static void testMaskingPipelinedReset(CuTest *tc) {
+#define TEST_LEAF_COUNT 2500
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *seq = NULL;
+	KSI_BlockSigner *pip = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_DataHash *seqLeaf = NULL;
+	KSI_DataHash *pipLeaf = NULL;
+	KSI_DataHash *seqRoot = NULL;
+	KSI_DataHash *pipRoot = NULL;
+	KSI_uint64_t seqLevel = 0;
+	KSI_uint64_t pipLevel = 0;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+	size_t i;
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &seq);
+	CuAssert(tc, "Unable to create block signer.", res == KSI_OK && seq != NULL);
+
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &pip);
+	CuAssert(tc, "Unable to create block signer.", res == KSI_OK && pip != NULL);
+
+	res = KSI_BlockSigner_setPipelined(pip, 1);
+	CuAssert(tc, "Unable to enable the pipelined mode.", res == KSI_OK);
+
+	/* The pipelined mode has to survive the reset. */
+	res = KSI_BlockSigner_reset(pip);
+	CuAssert(tc, "Unable to reset the block signer.", res == KSI_OK);
+
+	for (i = 0; i < TEST_LEAF_COUNT; ++i) {
+		res = KSI_BlockSigner_addLeaf(seq, hsh, 0, NULL, NULL);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+
+		res = KSI_BlockSigner_addLeaf(pip, hsh, 0, NULL, NULL);
+		CuAssert(tc, "Unable to add leaf hash to the pipelined block signer.", res == KSI_OK);
+	}
+
+	res = KSI_BlockSigner_getPrevLeaf(seq, &seqLeaf);
+	CuAssert(tc, "Unable to get previous leaf.", res == KSI_OK && seqLeaf != NULL);
+
+	res = KSI_BlockSigner_getPrevLeaf(pip, &pipLeaf);
+	CuAssert(tc, "Unable to get previous leaf.", res == KSI_OK && pipLeaf != NULL);
+	CuAssert(tc, "Previous leaf mismatch.", KSI_DataHash_equals(seqLeaf, pipLeaf));
+
+	res = KSI_BlockSigner_closeTree(seq, &seqRoot, &seqLevel);
+	CuAssert(tc, "Unable to close the tree.", res == KSI_OK && seqRoot != NULL);
+
+	res = KSI_BlockSigner_closeTree(pip, &pipRoot, &pipLevel);
+	CuAssert(tc, "Unable to close the pipelined tree.", res == KSI_OK && pipRoot != NULL);
+
+	CuAssert(tc, "Root hash mismatch.", KSI_DataHash_equals(seqRoot, pipRoot));
+	CuAssert(tc, "Root level mismatch.", seqLevel == pipLevel);
+
+	KSI_DataHash_free(seqRoot);
+	KSI_DataHash_free(pipRoot);
+	KSI_DataHash_free(seqLeaf);
+	KSI_DataHash_free(pipLeaf);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(seq);
+	KSI_BlockSigner_free(pip);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_LEAF_COUNT
+}
+
 static void testMaskingWithMetaDataAndLevel(CuTest *tc) {
 #define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test-masking-lvl-metadata-root-sig-lvl-12-hash-1e1587ca82-response.tlv"
 	int res = KSI_UNKNOWN_ERROR;
@@ -432,6 +594,336 @@ static void testSingle(CuTest *tc) {
 #undef TEST_AGGR_RESPONSE_FILE
 }
 
+static void testLocalAggregatorSingle(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_LocalAggregator *la = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_LocalAggregatorHandle *h = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_DataHash *docHash = NULL;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	size_t waiting = 0;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, 1, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSITest_DataHash_fromStr(ctx, "0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", &hsh);
+	CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+	res = KSI_LocalAggregator_new(ctx, as, KSI_HASHALG_SHA2_256, &la);
+	CuAssert(tc, "Unable to create local aggregator instance.", res == KSI_OK && la != NULL);
+
+	res = KSI_LocalAggregator_add(la, hsh, &h);
+	CuAssert(tc, "Unable to add hash to the local aggregator.", res == KSI_OK && h != NULL);
+
+	res = KSI_LocalAggregatorHandle_getSignature(h, &sig);
+	CuAssert(tc, "Signature must not be available before the tree is signed.", res == KSI_INVALID_STATE && sig == NULL);
+
+	do {
+		res = KSI_LocalAggregator_run(la, &waiting);
+		CuAssert(tc, "Failed to run local aggregator.", res == KSI_OK);
+	} while (waiting > 0);
+
+	res = KSI_LocalAggregatorHandle_getState(h, &state);
+	CuAssert(tc, "Unable to get handle state.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+	res = KSI_LocalAggregatorHandle_getSignature(h, &sig);
+	CuAssert(tc, "Unable to extract signature from the local aggregator.", res == KSI_OK && sig != NULL);
+
+	res = KSI_Signature_getDocumentHash(sig, &docHash);
+	CuAssert(tc, "Document hash mismatch.", res == KSI_OK && KSI_DataHash_equals(docHash, hsh));
+
+	KSI_LocalAggregatorHandle_free(h);
+	KSI_LocalAggregator_free(la);
+	KSI_AsyncService_free(as);
+	KSI_Signature_free(sig);
+	KSI_DataHash_free(hsh);
+}
+
+static void testLocalAggregatorMultiLeaf(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-local_aggr-test1-test7_resp.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_LocalAggregator *la = NULL;
+	KSI_LocalAggregatorHandle *h[7];
+	size_t waiting = 0;
+	size_t i;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, 1, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_LocalAggregator_new(ctx, as, KSI_HASHALG_SHA2_256, &la);
+	CuAssert(tc, "Unable to create local aggregator instance.", res == KSI_OK && la != NULL);
+
+	/* All the leafs are aggregated into a single tree. */
+	for (i = 0; input_data[i] != NULL; i++) {
+		KSI_DataHash *hsh = NULL;
+
+		res = KSI_DataHash_create(ctx, input_data[i], strlen(input_data[i]), KSI_HASHALG_SHA2_256, &hsh);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+		res = KSI_LocalAggregator_add(la, hsh, &h[i]);
+		CuAssert(tc, "Unable to add hash to the local aggregator.", res == KSI_OK && h[i] != NULL);
+
+		KSI_DataHash_free(hsh);
+	}
+
+	do {
+		res = KSI_LocalAggregator_run(la, &waiting);
+		CuAssert(tc, "Failed to run local aggregator.", res == KSI_OK);
+	} while (waiting > 0);
+
+	for (i = 0; input_data[i] != NULL; i++) {
+		KSI_DataHash *hsh = NULL;
+		KSI_DataHash *docHash = NULL;
+		KSI_Signature *sig = NULL;
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+
+		res = KSI_LocalAggregatorHandle_getState(h[i], &state);
+		CuAssert(tc, "Unable to get handle state.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_LocalAggregatorHandle_getSignature(h[i], &sig);
+		CuAssert(tc, "Unable to extract signature from the local aggregator.", res == KSI_OK && sig != NULL);
+
+		res = KSI_DataHash_create(ctx, input_data[i], strlen(input_data[i]), KSI_HASHALG_SHA2_256, &hsh);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+		res = KSI_Signature_getDocumentHash(sig, &docHash);
+		CuAssert(tc, "Document hash mismatch.", res == KSI_OK && KSI_DataHash_equals(docHash, hsh));
+
+		KSI_DataHash_free(hsh);
+		KSI_Signature_free(sig);
+		KSI_LocalAggregatorHandle_free(h[i]);
+	}
+
+	KSI_LocalAggregator_free(la);
+	KSI_AsyncService_free(as);
+}
+
+static void testLocalAggregatorMultiBlock(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_01h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_02h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_03h.tlv",
+	};
+	static const char *TEST_DATA[] = { "Guardtime", "KSI", "Blockchain", NULL };
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_LocalAggregator *la = NULL;
+	KSI_LocalAggregatorHandle *h[3];
+	size_t i;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, 3, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)3);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_LocalAggregator_new(ctx, as, KSI_HASHALG_SHA2_256, &la);
+	CuAssert(tc, "Unable to create local aggregator instance.", res == KSI_OK && la != NULL);
+
+	/* Every leaf is signed in a separate tree. */
+	res = KSI_LocalAggregator_setMaxLeafCount(la, 1);
+	CuAssert(tc, "Unable to set maximum leaf count.", res == KSI_OK);
+
+	for (i = 0; TEST_DATA[i] != NULL; i++) {
+		KSI_DataHash *hsh = NULL;
+
+		res = KSI_DataHash_create(ctx, TEST_DATA[i], strlen(TEST_DATA[i]), KSI_HASHALG_SHA2_256, &hsh);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+		res = KSI_LocalAggregator_add(la, hsh, &h[i]);
+		CuAssert(tc, "Unable to add hash to the local aggregator.", res == KSI_OK && h[i] != NULL);
+
+		KSI_DataHash_free(hsh);
+	}
+
+	for (i = 0; TEST_DATA[i] != NULL; i++) {
+		KSI_Signature *sig = NULL;
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+
+		res = KSI_LocalAggregator_wait(la, h[i], &state);
+		CuAssert(tc, "Unable to wait for the signature.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_LocalAggregatorHandle_getSignature(h[i], &sig);
+		CuAssert(tc, "Unable to extract signature from the local aggregator.", res == KSI_OK && sig != NULL);
+
+		KSI_Signature_free(sig);
+	}
+
+	/* Releasing the aggregator must not affect the handles that have already been signed. */
+	KSI_LocalAggregator_free(la);
+
+	for (i = 0; TEST_DATA[i] != NULL; i++) {
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+
+		res = KSI_LocalAggregatorHandle_getState(h[i], &state);
+		CuAssert(tc, "Signed handle state changed.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		KSI_LocalAggregatorHandle_free(h[i]);
+	}
+
+	KSI_AsyncService_free(as);
+}
+
+static void testLocalAggregatorErrors(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		/* The response does not match the root hash value of the tree. */
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_01h.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_LocalAggregator *la = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_LocalAggregatorHandle *failed = NULL;
+	KSI_LocalAggregatorHandle *pending = NULL;
+	KSI_Signature *sig = NULL;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	int err = KSI_OK;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, 1, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_LocalAggregator_new(ctx, as, KSI_HASHALG_SHA2_256, &la);
+	CuAssert(tc, "Unable to create local aggregator instance.", res == KSI_OK && la != NULL);
+
+	res = KSI_DataHash_create(ctx, input_data[0], strlen(input_data[0]), KSI_HASHALG_SHA2_256, &hsh);
+	CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+	res = KSI_LocalAggregator_add(la, hsh, &failed);
+	CuAssert(tc, "Unable to add hash to the local aggregator.", res == KSI_OK && failed != NULL);
+
+	res = KSI_LocalAggregator_wait(la, failed, &state);
+	CuAssert(tc, "Unable to wait for the signature.", res == KSI_OK && state == KSI_ASYNC_STATE_ERROR);
+
+	res = KSI_LocalAggregatorHandle_getError(failed, &err);
+	CuAssert(tc, "Handle error should be set.", res == KSI_OK && err != KSI_OK);
+
+	res = KSI_LocalAggregatorHandle_getSignature(failed, &sig);
+	CuAssert(tc, "Signature must not be available for a failed handle.", res == KSI_INVALID_STATE && sig == NULL);
+
+	/* A handle still waiting for a signature is failed when the aggregator is released. */
+	res = KSI_LocalAggregator_add(la, hsh, &pending);
+	CuAssert(tc, "Unable to add hash to the local aggregator.", res == KSI_OK && pending != NULL);
+
+	KSI_LocalAggregator_free(la);
+
+	res = KSI_LocalAggregatorHandle_getState(pending, &state);
+	CuAssert(tc, "Pending handle should be failed.", res == KSI_OK && state == KSI_ASYNC_STATE_ERROR);
+
+	res = KSI_LocalAggregatorHandle_getError(pending, &err);
+	CuAssert(tc, "Pending handle error mismatch.", res == KSI_OK && err == KSI_INVALID_STATE);
+
+	res = KSI_LocalAggregatorHandle_getError(failed, &err);
+	CuAssert(tc, "Failed handle error changed.", res == KSI_OK && err != KSI_INVALID_STATE);
+
+	KSI_LocalAggregatorHandle_free(failed);
+	KSI_LocalAggregatorHandle_free(pending);
+	KSI_AsyncService_free(as);
+	KSI_DataHash_free(hsh);
+}
+
+typedef struct {
+	KSI_LocalAggregator *la;
+	const char *data;
+	int res;
+	int state;
+	KSI_Signature *sig;
+} LocalAggregatorSigner;
+
+static void localAggregatorSigner(void *arg) {
+	LocalAggregatorSigner *s = arg;
+	KSI_DataHash *hsh = NULL;
+	KSI_LocalAggregatorHandle *h = NULL;
+
+	s->res = KSI_DataHash_create(ctx, s->data, strlen(s->data), KSI_HASHALG_SHA2_256, &hsh);
+	if (s->res != KSI_OK) goto cleanup;
+
+	s->res = KSI_LocalAggregator_add(s->la, hsh, &h);
+	if (s->res != KSI_OK) goto cleanup;
+
+	s->res = KSI_LocalAggregator_wait(s->la, h, &s->state);
+	if (s->res != KSI_OK) goto cleanup;
+
+	if (s->state == KSI_ASYNC_STATE_RESPONSE_RECEIVED) s->res = KSI_LocalAggregatorHandle_getSignature(h, &s->sig);
+
+cleanup:
+
+	KSI_LocalAggregatorHandle_free(h);
+	KSI_DataHash_free(hsh);
+}
+
+static void testLocalAggregatorConcurrentSigners(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		/* All the signers add the same document hash, thus the root hash does not depend on the order of the threads. */
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-local_aggr-7xtest1_resp.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_LocalAggregator *la = NULL;
+	LocalAggregatorSigner signers[7];
+	KSI_Thread threads[7];
+	size_t i;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, 1, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_LocalAggregator_new(ctx, as, KSI_HASHALG_SHA2_256, &la);
+	CuAssert(tc, "Unable to create local aggregator instance.", res == KSI_OK && la != NULL);
+
+	/* The tree is closed when the last signer has added its leaf. */
+	res = KSI_LocalAggregator_setMaxLeafCount(la, 7);
+	CuAssert(tc, "Unable to set maximum leaf count.", res == KSI_OK);
+
+	res = KSI_LocalAggregator_setFlushWindow(la, 3600000000UL);
+	CuAssert(tc, "Unable to set flush window.", res == KSI_OK);
+
+	for (i = 0; i < 7; i++) {
+		signers[i].la = la;
+		signers[i].data = input_data[0];
+		signers[i].res = KSI_UNKNOWN_ERROR;
+		signers[i].state = KSI_ASYNC_STATE_UNDEFINED;
+		signers[i].sig = NULL;
+
+		res = KSI_Thread_start(&threads[i], localAggregatorSigner, &signers[i]);
+		CuAssert(tc, "Unable to start signer thread.", res == KSI_OK);
+	}
+
+	for (i = 0; i < 7; i++) {
+		KSI_Thread_join(&threads[i]);
+	}
+
+	for (i = 0; i < 7; i++) {
+		CuAssert(tc, "Signer failed.", signers[i].res == KSI_OK && signers[i].state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+		CuAssert(tc, "Signature missing.", signers[i].sig != NULL);
+		KSI_Signature_free(signers[i].sig);
+	}
+
+	KSI_LocalAggregator_free(la);
+	KSI_AsyncService_free(as);
+}
+
 static void testReset(CuTest *tc) {
 #define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv"
 	int res = KSI_UNKNOWN_ERROR;
@@ -648,10 +1140,18 @@ CuSuite* KSITest_Blocksigner_getSuite(void) {
 
 	SUITE_ADD_TEST(suite, testFreeBeforeClose);
 	SUITE_ADD_TEST(suite, testMasking);
+	SUITE_ADD_TEST(suite, testMaskingPrevLeaf);
+	SUITE_ADD_TEST(suite, testMaskingPipelined);
+	SUITE_ADD_TEST(suite, testMaskingPipelinedReset);
 	SUITE_ADD_TEST(suite, testMaskingWithMetaDataAndLevel);
 	SUITE_ADD_TEST(suite, testMedaData);
 	SUITE_ADD_TEST(suite, testIdentityMedaData);
 	SUITE_ADD_TEST(suite, testSingle);
+	SUITE_ADD_TEST(suite, testLocalAggregatorSingle);
+	SUITE_ADD_TEST(suite, testLocalAggregatorMultiLeaf);
+	SUITE_ADD_TEST(suite, testLocalAggregatorMultiBlock);
+	SUITE_ADD_TEST(suite, testLocalAggregatorErrors);
+	SUITE_ADD_TEST(suite, testLocalAggregatorConcurrentSigners);
 	SUITE_ADD_TEST(suite, testReset);
 	SUITE_ADD_TEST(suite, testCreateBlockSigner);
 	SUITE_ADD_TEST(suite, testAddDeprecatedLeaf);
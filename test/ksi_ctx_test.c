@@ -18,12 +18,14 @@
  */
 
 #include "cutest/CuTest.h"
+#include <stdlib.h>
 #include <string.h>
 
 #include "all_tests.h"
 
 #include "../src/ksi/internal.h"
 #include "../src/ksi/impl/ctx_impl.h"
+#include "../src/ksi/impl/thread_impl.h"
 
 static int mockInitCount = 0;
 
@@ -201,6 +203,147 @@ static void TestCtxOptions_hmacAlgorithm(CuTest *tc) {
 	KSI_CTX_free(ctx);
 }
 
+#define TEST_THREAD_COUNT 4
+
+typedef struct SharedCtxWorker_st {
+	KSI_CTX *ctx;
+	long id;
+	int failed;
+} SharedCtxWorker;
+
+static void sharedCtxWorker(void *arg) {
+	SharedCtxWorker *w = arg;
+	KSI_DataHash *hsh = NULL;
+	char buf[1024];
+	char expected[64];
+	int ext = -1;
+	int i;
+
+	KSI_snprintf(expected, sizeof(expected), "Error in thread %ld.", w->id);
+
+	for (i = 0; i < 1000 && !w->failed; i++) {
+		/* Exercise the shared data hash recycle list. */
+		if (KSI_DataHash_create(w->ctx, expected, strlen(expected), KSI_HASHALG_SHA2_256, &hsh) != KSI_OK) w->failed = 1;
+		KSI_DataHash_free(hsh);
+		hsh = NULL;
+
+		KSI_ERR_clearErrors(w->ctx);
+		KSI_ERR_push(w->ctx, KSI_INVALID_ARGUMENT, w->id, __FILE__, __LINE__, expected);
+
+		if (KSI_ERR_getBaseErrorMessage(w->ctx, buf, sizeof(buf), NULL, &ext) != KSI_OK ||
+				strcmp(buf, expected) != 0 || ext != w->id) {
+			w->failed = 1;
+		}
+	}
+}
+
+static void TestSharedCtxThreadErrors(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx = NULL;
+	KSI_Thread threads[TEST_THREAD_COUNT];
+	SharedCtxWorker workers[TEST_THREAD_COUNT];
+	char buf[1024];
+	int ksi_error = -1;
+	size_t i;
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx != NULL);
+
+	KSI_ERR_push(ctx, KSI_UNKNOWN_ERROR, 0, __FILE__, __LINE__, "Error in main thread.");
+
+	for (i = 0; i < TEST_THREAD_COUNT; i++) {
+		workers[i].ctx = ctx;
+		workers[i].id = (long)i + 1;
+		workers[i].failed = 0;
+
+		res = KSI_Thread_start(&threads[i], sharedCtxWorker, &workers[i]);
+		CuAssert(tc, "Unable to start thread.", res == KSI_OK);
+	}
+
+	for (i = 0; i < TEST_THREAD_COUNT; i++) {
+		KSI_Thread_join(&threads[i]);
+		CuAssert(tc, "Thread saw errors of another thread.", !workers[i].failed);
+	}
+
+	/* The errors of the worker threads must not leak into the main thread. */
+	res = KSI_ERR_getBaseErrorMessage(ctx, buf, sizeof(buf), &ksi_error, NULL);
+	CuAssert(tc, "Unexpected main thread error.", res == KSI_OK && strcmp(buf, "Error in main thread.") == 0 && ksi_error == KSI_UNKNOWN_ERROR);
+
+	KSI_CTX_free(ctx);
+}
+
+#undef TEST_THREAD_COUNT
+
+typedef struct CountingAllocator_st {
+	size_t mallocs;
+	size_t frees;
+} CountingAllocator;
+
+static void *countingMalloc(void *c, size_t size) {
+	((CountingAllocator *)c)->mallocs++;
+	return malloc(size);
+}
+
+static void countingFree(void *c, void *ptr) {
+	((CountingAllocator *)c)->frees++;
+	free(ptr);
+}
+
+static KSI_uint64_t allocationCalls(const char *type) {
+	KSI_AllocationStat stats[64];
+	size_t count = 0;
+	size_t i;
+
+	if (KSI_getAllocationStats(stats, 64, &count, NULL) != KSI_OK) return 0;
+
+	for (i = 0; i < count && i < 64; i++) {
+		if (strcmp(stats[i].type, type) == 0) return stats[i].calls;
+	}
+	return 0;
+}
+
+static void TestAllocatorAndStats(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx = NULL;
+	CountingAllocator counter = { 0, 0 };
+	KSI_Allocator alloc = { countingMalloc, NULL, countingFree, NULL };
+	KSI_OctetString *oct = NULL;
+	KSI_uint64_t frees = 0;
+	size_t count = 0;
+	unsigned char buf[] = { 0x01, 0x02, 0x03 };
+
+	alloc.allocCtx = &counter;
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx != NULL);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_setAllocator(&alloc);
+	CuAssert(tc, "Unable to set allocator.", res == KSI_OK);
+
+	KSI_resetAllocationStats();
+	KSI_setAllocationStats(1);
+
+	res = KSI_OctetString_new(ctx, buf, sizeof(buf), &oct);
+	KSI_OctetString_free(oct);
+
+	KSI_setAllocationStats(0);
+	KSI_setAllocator(NULL);
+
+	CuAssert(tc, "Unable to create octet string.", res == KSI_OK && oct != NULL);
+	CuAssert(tc, "Allocator not used.", counter.mallocs >= 2 && counter.frees == counter.mallocs);
+	CuAssert(tc, "Typed allocation not counted.", allocationCalls("KSI_OctetString") == 1);
+	CuAssert(tc, "Untyped allocation not counted.", allocationCalls("other") >= 1);
+
+	res = KSI_getAllocationStats(NULL, 0, &count, &frees);
+	CuAssert(tc, "Unable to get allocation stats.", res == KSI_OK && count >= 2 && frees == counter.frees);
+
+	KSI_resetAllocationStats();
+	CuAssert(tc, "Stats not reset.", allocationCalls("KSI_OctetString") == 0);
+
+	KSI_CTX_free(ctx);
+}
+
 CuSuite* KSITest_CTX_getSuite(void)
 {
 	CuSuite* suite = CuSuiteNew();
@@ -211,6 +354,8 @@ CuSuite* KSITest_CTX_getSuite(void)
 	SUITE_ADD_TEST(suite, TestGetBaseError);
 	SUITE_ADD_TEST(suite, TestCtxOptions_pduVersion);
 	SUITE_ADD_TEST(suite, TestCtxOptions_hmacAlgorithm);
+	SUITE_ADD_TEST(suite, TestSharedCtxThreadErrors);
+	SUITE_ADD_TEST(suite, TestAllocatorAndStats);
 
 	return suite;
 }
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+#include "all_tests.h"
+#include "../src/ksi/ksi.h"
+#include "../src/ksi/executor.h"
+#include "../src/ksi/internal.h"
+#include "../src/ksi/impl/thread_impl.h"
+
+extern KSI_CTX *ctx;
+
+#define TEST_ELEMENT_COUNT 1000
+
+typedef struct CountingTask_st {
+	KSI_Executor *exec;
+	unsigned char visited[TEST_ELEMENT_COUNT];
+	size_t failAt;
+} CountingTask;
+
+static int countingTask(void *c, size_t i) {
+	CountingTask *t = c;
+	t->visited[i]++;
+	return i == t->failAt ? KSI_INVALID_FORMAT : KSI_OK;
+}
+
+static int allVisitedOnce(const CountingTask *t) {
+	size_t i;
+	for (i = 0; i < TEST_ELEMENT_COUNT; i++) {
+		if (t->visited[i] != 1) return 0;
+	}
+	return 1;
+}
+
+static void testForEachVisitsAll(CuTest *tc) {
+	int res;
+	KSI_Executor *exec = NULL;
+	CountingTask task;
+
+	res = KSI_Executor_new(ctx, 4, &exec);
+	CuAssert(tc, "Unable to create executor.", res == KSI_OK && exec != NULL);
+	CuAssert(tc, "Unexpected worker count.", KSI_Executor_getWorkerCount(exec) == 4);
+
+	memset(&task, 0, sizeof(task));
+	task.failAt = TEST_ELEMENT_COUNT;
+
+	res = KSI_Executor_forEach(exec, TEST_ELEMENT_COUNT, countingTask, &task);
+	CuAssert(tc, "Batch failed.", res == KSI_OK);
+	CuAssert(tc, "Every element must be processed exactly once.", allVisitedOnce(&task));
+
+	/* A failed element does not stop the batch. */
+	memset(&task, 0, sizeof(task));
+	task.failAt = 123;
+
+	res = KSI_Executor_forEach(exec, TEST_ELEMENT_COUNT, countingTask, &task);
+	CuAssert(tc, "Batch should have failed.", res == KSI_INVALID_FORMAT);
+	CuAssert(tc, "Every element must be processed exactly once.", allVisitedOnce(&task));
+
+	KSI_Executor_free(exec);
+}
+
+static void testForEachWithoutExecutor(CuTest *tc) {
+	int res;
+	CountingTask task;
+
+	memset(&task, 0, sizeof(task));
+	task.failAt = TEST_ELEMENT_COUNT;
+
+	res = KSI_Executor_forEach(NULL, TEST_ELEMENT_COUNT, countingTask, &task);
+	CuAssert(tc, "Batch failed.", res == KSI_OK);
+	CuAssert(tc, "Every element must be processed exactly once.", allVisitedOnce(&task));
+}
+
+typedef struct NestedTask_st {
+	KSI_Executor *exec;
+	CountingTask inner[8];
+} NestedTask;
+
+static int nestedTask(void *c, size_t i) {
+	NestedTask *t = c;
+	return KSI_Executor_forEach(t->exec, TEST_ELEMENT_COUNT, countingTask, &t->inner[i]);
+}
+
+static void testForEachNested(CuTest *tc) {
+	int res;
+	NestedTask task;
+	size_t i;
+
+	memset(&task, 0, sizeof(task));
+	for (i = 0; i < 8; i++) task.inner[i].failAt = TEST_ELEMENT_COUNT;
+
+	/* The tasks waiting for the inner batches must keep the workers busy instead of blocking them. */
+	res = KSI_Executor_new(ctx, 2, &task.exec);
+	CuAssert(tc, "Unable to create executor.", res == KSI_OK && task.exec != NULL);
+
+	res = KSI_Executor_forEach(task.exec, 8, nestedTask, &task);
+	CuAssert(tc, "Batch failed.", res == KSI_OK);
+
+	for (i = 0; i < 8; i++) {
+		CuAssert(tc, "Every element must be processed exactly once.", allVisitedOnce(&task.inner[i]));
+	}
+
+	KSI_Executor_free(task.exec);
+}
+
+typedef struct TestSubmitter_st {
+	KSI_Thread threads[3];
+	size_t count;
+} TestSubmitter;
+
+static int testSubmit(void *c, void (*worker)(void *), void *workerArg) {
+	TestSubmitter *s = c;
+	return KSI_Thread_start(&s->threads[s->count++], worker, workerArg);
+}
+
+static void testUserSubmitter(CuTest *tc) {
+	int res;
+	KSI_Executor *exec = NULL;
+	TestSubmitter submitter;
+	CountingTask task;
+	size_t i;
+
+	submitter.count = 0;
+
+	res = KSI_Executor_newWithSubmitter(ctx, 3, testSubmit, &submitter, &exec);
+	CuAssert(tc, "Unable to create executor.", res == KSI_OK && exec != NULL);
+	CuAssert(tc, "All the workers must be submitted.", submitter.count == 3);
+
+	memset(&task, 0, sizeof(task));
+	task.failAt = TEST_ELEMENT_COUNT;
+
+	res = KSI_Executor_forEach(exec, TEST_ELEMENT_COUNT, countingTask, &task);
+	CuAssert(tc, "Batch failed.", res == KSI_OK);
+	CuAssert(tc, "Every element must be processed exactly once.", allVisitedOnce(&task));
+
+	/* The workers return to the submitted threads when the executor is freed. */
+	KSI_Executor_free(exec);
+	for (i = 0; i < submitter.count; i++) {
+		KSI_Thread_join(&submitter.threads[i]);
+	}
+}
+
+static void testHashBatch(CuTest *tc) {
+	int res;
+	KSI_CTX *pctx = NULL;
+	KSI_Executor *exec = NULL;
+	char buf[TEST_ELEMENT_COUNT][16];
+	const void *data[TEST_ELEMENT_COUNT];
+	size_t len[TEST_ELEMENT_COUNT];
+	KSI_DataHash *hsh[TEST_ELEMENT_COUNT];
+	KSI_DataHash *ref = NULL;
+	size_t i;
+
+	res = KSITest_CTX_clone(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	res = KSI_Executor_new(pctx, 0, &exec);
+	CuAssert(tc, "Unable to create executor.", res == KSI_OK && exec != NULL);
+
+	res = KSI_CTX_setExecutor(pctx, exec);
+	CuAssert(tc, "Unable to set executor.", res == KSI_OK);
+
+	for (i = 0; i < TEST_ELEMENT_COUNT; i++) {
+		KSI_snprintf(buf[i], sizeof(buf[i]), "data %u", (unsigned)i);
+		data[i] = buf[i];
+		len[i] = strlen(buf[i]);
+	}
+
+	res = KSI_DataHash_createBatch(pctx, data, len, TEST_ELEMENT_COUNT, KSI_HASHALG_SHA2_256, hsh);
+	CuAssert(tc, "Unable to hash the batch.", res == KSI_OK);
+
+	for (i = 0; i < TEST_ELEMENT_COUNT; i++) {
+		res = KSI_DataHash_create(pctx, data[i], len[i], KSI_HASHALG_SHA2_256, &ref);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && ref != NULL);
+		CuAssert(tc, "Batch hash mismatch.", KSI_DataHash_equals(ref, hsh[i]));
+
+		KSI_DataHash_free(ref);
+		ref = NULL;
+		KSI_DataHash_free(hsh[i]);
+	}
+
+	/* The executor is freed together with the context. */
+	KSI_CTX_free(pctx);
+}
+
+#undef TEST_ELEMENT_COUNT
+
+CuSuite* KSITest_Executor_getSuite(void) {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, testForEachVisitsAll);
+	SUITE_ADD_TEST(suite, testForEachWithoutExecutor);
+	SUITE_ADD_TEST(suite, testForEachNested);
+	SUITE_ADD_TEST(suite, testUserSubmitter);
+	SUITE_ADD_TEST(suite, testHashBatch);
+
+	return suite;
+}
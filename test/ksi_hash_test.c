@@ -20,8 +20,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
 #include "cutest/CuTest.h"
 #include "all_tests.h"
+#include "../src/ksi/impl/thread_impl.h"
+#include "../src/ksi/impl/sha_impl.h"
 
 extern KSI_CTX *ctx;
 
@@ -610,7 +617,7 @@ static void testUnavailableFunctionsFromImprint(CuTest *tc) {
 static void testUnavailableFunctionsFromDigest(CuTest *tc) {
 	int res;
 	KSI_DataHash *h = NULL;
-	unsigned char buf[1];
+	unsigned char buf[1] = {0};
 
 	/* Note: the array is actually shorter than the given length - the function should not read any further after it detects
 	 * the hash function is not available. */
@@ -729,6 +736,446 @@ void testOpenCloseNoContext(CuTest *tc) {
 	KSI_DataHash_free(hsh);
 }
 
+static void testPooledHasherReset(CuTest *tc) {
+	int res;
+	KSI_CTX *pctx = NULL;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHasher *pooled = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *exp = NULL;
+
+	res = KSITest_CTX_clone(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	KSITest_DataHash_fromStr(pctx, "0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", &exp);
+
+	/* Release a hasher in the middle of a computation. */
+	res = KSI_DataHasher_open(pctx, KSI_HASHALG_SHA2_256, &pooled);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, pooled);
+
+	res = KSI_DataHasher_add(pooled, "garbage", 7);
+	CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+	KSI_DataHasher_free(pooled);
+
+	res = KSI_DataHasher_open(pctx, KSI_HASHALG_SHA2_256, &hsr);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, hsr);
+	CuAssert(tc, "The released hasher should have been reused.", hsr == pooled);
+
+	res = KSI_DataHasher_add(hsr, "LAPTOP", 6);
+	CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to close hasher.", res, hsh);
+	CuAssert(tc, "The reused hasher must start from a clean state.", KSI_DataHash_equals(hsh, exp));
+
+	/* The pool is per algorithm. */
+	KSI_DataHasher_free(hsr);
+	hsr = NULL;
+
+	res = KSI_DataHasher_open(pctx, KSI_HASHALG_SHA2_512, &hsr);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, hsr);
+	CuAssert(tc, "A hasher of another algorithm should not be reused.", hsr != pooled);
+
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(hsh);
+
+	/* The pooled hashers are released together with the context. */
+	KSI_CTX_free(pctx);
+}
+
+static void testDataHashValue(CuTest *tc) {
+	int res;
+	KSI_DataHashValue value;
+	KSI_DataHashValue copy;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *unset = NULL;
+	KSI_DataHasher *hsr = NULL;
+	char buf[KSI_MAX_IMPRINT_LEN * 2 + 1];
+	const char *expStr = "0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d";
+
+	KSITest_DataHash_fromStr(ctx, expStr, &exp);
+
+	res = KSI_DataHashValue_create(ctx, "LAPTOP", 6, KSI_HASHALG_SHA2_256, &value);
+	CuAssert(tc, "Unable to create hash value.", res == KSI_OK);
+	CuAssert(tc, "Unexpected imprint length.", KSI_DataHashValue_getImprintLength(&value) == 33);
+	CuAssert(tc, "Unexpected string value.", KSI_DataHashValue_toString(&value, buf, sizeof(buf)) != NULL && !strcmp(buf, expStr));
+
+	/* Values are copied by assignment. */
+	copy = value;
+	CuAssert(tc, "Copied values do not match.", KSI_DataHashValue_equals(&value, &copy));
+
+	copy.imprint[5] ^= 1;
+	CuAssert(tc, "Different values must not match.", !KSI_DataHashValue_equals(&value, &copy));
+
+	res = KSI_DataHash_fromValue(ctx, &value, &hsh);
+	CuAssert(tc, "Unable to create data hash from value.", res == KSI_OK && hsh != NULL);
+	CuAssert(tc, "Hash values do not match.", KSI_DataHash_equals(hsh, exp));
+
+	res = KSI_DataHashValue_fromDataHash(&copy, exp);
+	CuAssert(tc, "Unable to create value from data hash.", res == KSI_OK && KSI_DataHashValue_equals(&value, &copy));
+
+	res = KSI_DataHashValue_fromImprint(&copy, value.imprint, 32);
+	CuAssert(tc, "Imprint with an invalid length must fail.", res == KSI_INVALID_FORMAT);
+
+	/* A zero-initialized value is not set, although its algorithm id reads as SHA-1. */
+	memset(&copy, 0, sizeof(copy));
+	CuAssert(tc, "Value that is not set must have no imprint.", KSI_DataHashValue_getImprintLength(&copy) == 0);
+	CuAssert(tc, "Value that is not set must not match.", !KSI_DataHashValue_equals(&copy, &copy));
+	CuAssert(tc, "Value that is not set must not be formatted.", KSI_DataHashValue_toString(&copy, buf, sizeof(buf)) == NULL);
+	res = KSI_DataHash_fromValue(ctx, &copy, &unset);
+	CuAssert(tc, "Data hash must not be created from a value that is not set.", res == KSI_INVALID_ARGUMENT && unset == NULL);
+
+	/* Adding the value is the same as adding the imprint of the data hash. */
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, hsr);
+
+	res = KSI_DataHasher_addValue(hsr, &value);
+	CuAssert(tc, "Failed to add value.", res == KSI_OK);
+
+	res = KSI_DataHasher_closeValue(hsr, &copy);
+	CuAssert(tc, "Failed to close hasher.", res == KSI_OK);
+
+	KSI_DataHash_free(hsh);
+	hsh = NULL;
+
+	res = KSI_DataHasher_reset(hsr);
+	CuAssert(tc, "Failed to reset hasher.", res == KSI_OK);
+
+	res = KSI_DataHasher_addImprint(hsr, exp);
+	CuAssert(tc, "Failed to add imprint.", res == KSI_OK);
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to close hasher.", res, hsh);
+
+	res = KSI_DataHashValue_fromDataHash(&value, hsh);
+	CuAssert(tc, "Hash values do not match.", res == KSI_OK && KSI_DataHashValue_equals(&value, &copy));
+
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(hsh);
+}
+
+#define TEST_FILE_NAME "hash_file_test.tmp"
+#define TEST_FILE_SIZE (3 * 1024 * 1024 + 123)
+#define TEST_FILE_OFFSET 5000
+
+static unsigned char *createTestFileData(void) {
+	unsigned char *data = KSI_malloc(TEST_FILE_SIZE);
+	size_t i;
+
+	if (data != NULL) {
+		for (i = 0; i < TEST_FILE_SIZE; i++) data[i] = (unsigned char)(i * 31 + (i >> 11));
+	}
+	return data;
+}
+
+static void testHashFile(CuTest* tc) {
+	int res;
+	unsigned char *data = NULL;
+	FILE *f = NULL;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHasher *hsr = NULL;
+#ifndef _WIN32
+	int fd;
+	size_t mmapOpt;
+#endif
+
+	KSI_ERR_clearErrors(ctx);
+
+	data = createTestFileData();
+	CuAssert(tc, "Out of memory.", data != NULL);
+
+	f = fopen(TEST_FILE_NAME, "wb");
+	CuAssert(tc, "Unable to create test file.", f != NULL);
+	CuAssert(tc, "Unable to write test file.", fwrite(data, 1, TEST_FILE_SIZE, f) == TEST_FILE_SIZE);
+	fclose(f);
+
+	res = KSI_DataHash_create(ctx, data, TEST_FILE_SIZE, KSI_HASHALG_SHA2_256, &exp);
+	KSITest_assertCreateCall(tc, "Failed to hash data", res, exp);
+
+	res = KSI_DataHash_fromFile(ctx, TEST_FILE_NAME, KSI_HASHALG_SHA2_256, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to hash file", res, hsh);
+	CuAssert(tc, "File hash mismatch.", KSI_DataHash_equals(exp, hsh));
+
+	KSI_DataHash_free(exp);
+	exp = NULL;
+	KSI_DataHash_free(hsh);
+	hsh = NULL;
+
+#ifndef _WIN32
+	/* Hashing starts from the current position, which is not at a page boundary. */
+	res = KSI_DataHash_create(ctx, data + TEST_FILE_OFFSET, TEST_FILE_SIZE - TEST_FILE_OFFSET, KSI_HASHALG_SHA2_256, &exp);
+	KSITest_assertCreateCall(tc, "Failed to hash data", res, exp);
+
+	/* Both read and memory mapped. */
+	for (mmapOpt = 0; mmapOpt < 2; mmapOpt++) {
+		res = KSI_CTX_setOption(ctx, KSI_OPT_HASH_FILE_MMAP, (void *)mmapOpt);
+		CuAssert(tc, "Unable to set file mapping option.", res == KSI_OK);
+
+		fd = open(TEST_FILE_NAME, O_RDONLY);
+		CuAssert(tc, "Unable to open test file.", fd >= 0 && lseek(fd, TEST_FILE_OFFSET, SEEK_SET) == TEST_FILE_OFFSET);
+
+		res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+		KSITest_assertCreateCall(tc, "Failed to open hasher", res, hsr);
+
+		res = KSI_DataHasher_addFd(hsr, fd);
+		CuAssert(tc, "Failed to hash file descriptor.", res == KSI_OK);
+		CuAssert(tc, "File position is not at the end.", lseek(fd, 0, SEEK_CUR) == TEST_FILE_SIZE);
+		close(fd);
+
+		res = KSI_DataHasher_close(hsr, &hsh);
+		KSITest_assertCreateCall(tc, "Failed to close hasher", res, hsh);
+		CuAssert(tc, "File hash mismatch.", KSI_DataHash_equals(exp, hsh));
+
+		KSI_DataHasher_free(hsr);
+		hsr = NULL;
+		KSI_DataHash_free(hsh);
+		hsh = NULL;
+	}
+	KSI_CTX_setOption(ctx, KSI_OPT_HASH_FILE_MMAP, (void *)0);
+#endif
+
+	res = KSI_DataHash_fromFile(ctx, TEST_FILE_NAME ".missing", KSI_HASHALG_SHA2_256, &hsh);
+	CuAssert(tc, "Hashing a missing file should fail.", res == KSI_IO_ERROR);
+
+	remove(TEST_FILE_NAME);
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(hsh);
+	KSI_free(data);
+}
+
+#ifndef _WIN32
+typedef struct PipeWriter_st {
+	int fd;
+	const unsigned char *data;
+} PipeWriter;
+
+static void pipeWriter(void *arg) {
+	PipeWriter *w = arg;
+	size_t off = 0;
+
+	/* Write in odd sized pieces, so the reader gets short reads. */
+	while (off < TEST_FILE_SIZE) {
+		size_t len = TEST_FILE_SIZE - off < 7777 ? TEST_FILE_SIZE - off : 7777;
+		ssize_t n = write(w->fd, w->data + off, len);
+		if (n <= 0) break;
+		off += (size_t)n;
+	}
+	close(w->fd);
+}
+
+static void testHashPipe(CuTest* tc) {
+	int res;
+	unsigned char *data = NULL;
+	int fds[2];
+	PipeWriter writer;
+	KSI_Thread thread;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHasher *hsr = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	data = createTestFileData();
+	CuAssert(tc, "Out of memory.", data != NULL);
+
+	res = KSI_DataHash_create(ctx, data, TEST_FILE_SIZE, KSI_HASHALG_SHA2_256, &exp);
+	KSITest_assertCreateCall(tc, "Failed to hash data", res, exp);
+
+	CuAssert(tc, "Unable to create pipe.", pipe(fds) == 0);
+
+	writer.fd = fds[1];
+	writer.data = data;
+	res = KSI_Thread_start(&thread, pipeWriter, &writer);
+	CuAssert(tc, "Unable to start writer thread.", res == KSI_OK);
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	KSITest_assertCreateCall(tc, "Failed to open hasher", res, hsr);
+
+	res = KSI_DataHasher_addFd(hsr, fds[0]);
+	CuAssert(tc, "Failed to hash pipe.", res == KSI_OK);
+
+	KSI_Thread_join(&thread);
+	close(fds[0]);
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to close hasher", res, hsh);
+	CuAssert(tc, "Pipe hash mismatch.", KSI_DataHash_equals(exp, hsh));
+
+	KSI_DataHasher_free(hsr);
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(hsh);
+	KSI_free(data);
+}
+
+static void testHashZeroSizeFile(CuTest* tc) {
+	int res;
+	FILE *f = NULL;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *hsh = NULL;
+#ifdef __linux__
+	unsigned char buf[4096];
+	ssize_t len;
+	int fd;
+#endif
+
+	KSI_ERR_clearErrors(ctx);
+
+	f = fopen(TEST_FILE_NAME, "wb");
+	CuAssert(tc, "Unable to create test file.", f != NULL);
+	fclose(f);
+
+	res = KSI_DataHash_create(ctx, NULL, 0, KSI_HASHALG_SHA2_256, &exp);
+	KSITest_assertCreateCall(tc, "Failed to hash data", res, exp);
+
+	res = KSI_DataHash_fromFile(ctx, TEST_FILE_NAME, KSI_HASHALG_SHA2_256, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to hash empty file", res, hsh);
+	CuAssert(tc, "Empty file hash mismatch.", KSI_DataHash_equals(exp, hsh));
+
+	remove(TEST_FILE_NAME);
+	KSI_DataHash_free(exp);
+	exp = NULL;
+	KSI_DataHash_free(hsh);
+	hsh = NULL;
+
+#ifdef __linux__
+	/* A procfs file reports a zero size, but has contents. */
+	fd = open("/proc/self/cmdline", O_RDONLY);
+	CuAssert(tc, "Unable to open procfs file.", fd >= 0);
+	len = read(fd, buf, sizeof(buf));
+	close(fd);
+	CuAssert(tc, "Unable to read procfs file.", len > 0 && (size_t)len < sizeof(buf));
+
+	res = KSI_DataHash_create(ctx, buf, (size_t)len, KSI_HASHALG_SHA2_256, &exp);
+	KSITest_assertCreateCall(tc, "Failed to hash data", res, exp);
+
+	res = KSI_DataHash_fromFile(ctx, "/proc/self/cmdline", KSI_HASHALG_SHA2_256, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to hash procfs file", res, hsh);
+	CuAssert(tc, "Procfs file hash mismatch.", KSI_DataHash_equals(exp, hsh));
+#endif
+
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(hsh);
+}
+#endif
+
+#undef TEST_FILE_NAME
+#undef TEST_FILE_SIZE
+#undef TEST_FILE_OFFSET
+
+static void testNativeSha2(CuTest* tc) {
+	static const KSI_HashAlgorithm algs[] = {KSI_HASHALG_SHA2_256, KSI_HASHALG_SHA2_384, KSI_HASHALG_SHA2_512};
+	/* Lengths around the padding boundaries of both block sizes. */
+	static const size_t lens[] = {0, 1, 55, 56, 63, 64, 65, 111, 112, 119, 127, 128, 129, 1000};
+	int res;
+	KSI_CTX *pctx = NULL;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHasher *pooled = NULL;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *hsh = NULL;
+	unsigned char data[1000];
+	size_t a, i, j;
+	int accelerated;
+
+	for (i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 7 + 3);
+
+	res = KSITest_CTX_clone(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	/* A hasher of the hash provider released before enabling the option must not be reused. */
+	res = KSI_DataHasher_open(pctx, KSI_HASHALG_SHA2_256, &pooled);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, pooled);
+	KSI_DataHasher_free(pooled);
+
+	res = KSI_CTX_setOption(pctx, KSI_OPT_NATIVE_SHA2, (void*)1);
+	CuAssert(tc, "Unable to enable the built-in SHA-2.", res == KSI_OK);
+
+	KSITest_DataHash_fromStr(pctx, "01ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", &exp);
+
+	res = KSI_DataHasher_open(pctx, KSI_HASHALG_SHA2_256, &hsr);
+	KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, hsr);
+
+	res = KSI_DataHasher_add(hsr, "abc", 3);
+	CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	KSITest_assertCreateCall(tc, "Failed to close hasher.", res, hsh);
+	CuAssert(tc, "Digest mismatch.", KSI_DataHash_equals(hsh, exp));
+
+	KSI_DataHasher_free(hsr);
+	hsr = NULL;
+	KSI_DataHash_free(exp);
+	exp = NULL;
+	KSI_DataHash_free(hsh);
+	hsh = NULL;
+
+	/* Compare both the CPU specific and the portable implementation to the hash provider. */
+	for (accelerated = 1; accelerated >= 0; accelerated--) {
+		KSI_Sha2_setAccelerated(accelerated);
+
+		for (a = 0; a < sizeof(algs) / sizeof(algs[0]); a++) {
+			for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+				res = KSI_DataHash_create(ctx, data, lens[i], algs[a], &exp);
+				KSITest_assertCreateCall(tc, "Failed to create data hash", res, exp);
+
+				/* Add the data in uneven parts. */
+				res = KSI_DataHasher_open(pctx, algs[a], &hsr);
+				KSITest_assertCreateCall(tc, "Failed to open DataHasher", res, hsr);
+
+				for (j = 0; j < lens[i]; j += 37) {
+					res = KSI_DataHasher_add(hsr, data + j, lens[i] - j < 37 ? lens[i] - j : 37);
+					CuAssert(tc, "Failed to add data.", res == KSI_OK);
+				}
+
+				res = KSI_DataHasher_close(hsr, &hsh);
+				KSITest_assertCreateCall(tc, "Failed to close hasher.", res, hsh);
+				CuAssert(tc, "Digest mismatch with the hash provider.", KSI_DataHash_equals(hsh, exp));
+
+				KSI_DataHasher_free(hsr);
+				hsr = NULL;
+				KSI_DataHash_free(exp);
+				exp = NULL;
+				KSI_DataHash_free(hsh);
+				hsh = NULL;
+			}
+		}
+	}
+
+	KSI_Sha2_setAccelerated(1);
+
+	/* SHA-1 is only used by the built-in hash provider, compare it directly. */
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		KSI_Sha1 sha1;
+		unsigned char digest[20];
+		const unsigned char *expDigest = NULL;
+		size_t expDigest_len = 0;
+
+		res = KSI_DataHash_create(ctx, data, lens[i], KSI_HASHALG_SHA1, &exp);
+		if (res == KSI_UNAVAILABLE_HASH_ALGORITHM) break;
+		KSITest_assertCreateCall(tc, "Failed to create data hash", res, exp);
+
+		res = KSI_DataHash_extract(exp, NULL, &expDigest, &expDigest_len);
+		CuAssert(tc, "Unable to extract digest.", res == KSI_OK && expDigest_len == sizeof(digest));
+
+		KSI_Sha1_init(&sha1);
+		for (j = 0; j < lens[i]; j += 37) {
+			KSI_Sha1_update(&sha1, data + j, lens[i] - j < 37 ? lens[i] - j : 37);
+		}
+		KSI_Sha1_final(&sha1, digest);
+		CuAssert(tc, "SHA-1 digest mismatch with the hash provider.", !memcmp(digest, expDigest, sizeof(digest)));
+
+		KSI_DataHash_free(exp);
+		exp = NULL;
+	}
+
+	KSI_CTX_free(pctx);
+}
+
 
 CuSuite* KSITest_Hash_getSuite(void) {
 	CuSuite* suite = CuSuiteNew();
@@ -759,6 +1206,14 @@ CuSuite* KSITest_Hash_getSuite(void) {
 	SUITE_ADD_TEST(suite, testAddToCloseAndReset);
 	SUITE_ADD_TEST(suite, testCreateHashNoContext);
 	SUITE_ADD_TEST(suite, testOpenCloseNoContext);
+	SUITE_ADD_TEST(suite, testPooledHasherReset);
+	SUITE_ADD_TEST(suite, testDataHashValue);
+	SUITE_ADD_TEST(suite, testHashFile);
+#ifndef _WIN32
+	SUITE_ADD_TEST(suite, testHashPipe);
+	SUITE_ADD_TEST(suite, testHashZeroSizeFile);
+#endif
+	SUITE_ADD_TEST(suite, testNativeSha2);
 
 	return suite;
 }
@@ -268,6 +268,83 @@ static void testAggrChainBuilt(CuTest *tc) {
 	KSI_AggregationHashChain_free(ac);
 }
 
+static void buildAggrChain(CuTest *tc, KSI_LIST(KSI_HashChainLink) *chn, KSI_DataHash *in, KSI_HashAlgorithm algo_id, KSI_AggregationHashChain **ac) {
+	int res;
+	KSI_Integer *algo = NULL;
+
+	res = KSI_AggregationHashChain_new(ctx, ac);
+	CuAssert(tc, "Unable to create aggregation hash chain object.", res == KSI_OK && *ac != NULL);
+
+	res = KSI_AggregationHashChain_setChain(*ac, chn);
+	CuAssert(tc, "Unable to add chain list to object.", res == KSI_OK);
+
+	res = KSI_AggregationHashChain_setInputHash(*ac, in);
+	CuAssert(tc, "Unable to set input hash.", res == KSI_OK);
+
+	res = KSI_Integer_new(ctx, algo_id, &algo);
+	CuAssert(tc, "Unable to create hash algo.", res == KSI_OK);
+
+	res = KSI_AggregationHashChain_setAggrHashId(*ac, algo);
+	CuAssert(tc, "Unable to set hash algorithm.", res == KSI_OK);
+}
+
+static void testAggrChainListAggregate(CuTest *tc) {
+	int res;
+	unsigned char buf[1024];
+	size_t buf_len;
+	KSI_LIST(KSI_HashChainLink) *chn = NULL;
+	KSI_DataHash *in = NULL;
+	KSI_DataHash *mid = NULL;
+	KSI_DataHash *exp = NULL;
+	KSI_DataHash *out = NULL;
+	KSI_AggregationHashChain *ac = NULL;
+	KSI_AggregationHashChainList *list = NULL;
+	int level = 0;
+
+	res = KSITest_decodeHexStr("0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", buf, sizeof(buf), &buf_len);
+	CuAssert(tc, "Unable to decode input hash.", res == KSI_OK);
+
+	res = KSI_DataHash_fromImprint(ctx, buf, buf_len, &in);
+	CuAssert(tc, "Unable to create input data hash.", res == KSI_OK && in != NULL);
+
+	/* Calculate the expected root with the single chain functions. */
+	buildHashChain(tc, "0103ce8a99d60a808deb9872ec92846f5a56c816ad446824923f53c03691c88b8c", 1, 0, &chn);
+	buildHashChain(tc, "011d6a55ab55eb586e6b4cf355825026deaa2b015c9dd271a6300f91044f2bcc78", 0, 7, &chn);
+	res = KSI_HashChain_aggregate(ctx, chn, in, 0, KSI_HASHALG_SHA2_256, &level, &mid);
+	CuAssert(tc, "Unable to aggregate the first chain.", res == KSI_OK && mid != NULL && level == 9);
+
+	res = KSI_AggregationHashChainList_new(&list);
+	CuAssert(tc, "Unable to create aggregation hash chain list.", res == KSI_OK && list != NULL);
+
+	buildAggrChain(tc, chn, KSI_DataHash_ref(in), KSI_HASHALG_SHA2_256, &ac);
+	chn = NULL;
+	res = KSI_AggregationHashChainList_append(list, ac);
+	CuAssert(tc, "Unable to append aggregation hash chain.", res == KSI_OK);
+	ac = NULL;
+
+	/* The second chain uses a different algorithm. */
+	buildHashChain(tc, "010abe6ec096b46a9015c6644d3fadd55d4124b49260d1d86fb77eb495e0c9b9fc", 0, 0, &chn);
+	buildHashChain(tc, "018f59acda513c536ed30101d54bbb98c04ce8962b4144763a9c8dc7814f85ee15", 1, 3, &chn);
+	res = KSI_HashChain_aggregate(ctx, chn, mid, level, KSI_HASHALG_SHA2_512, &level, &exp);
+	CuAssert(tc, "Unable to aggregate the second chain.", res == KSI_OK && exp != NULL && level == 14);
+
+	buildAggrChain(tc, chn, KSI_DataHash_ref(mid), KSI_HASHALG_SHA2_512, &ac);
+	chn = NULL;
+	res = KSI_AggregationHashChainList_append(list, ac);
+	CuAssert(tc, "Unable to append aggregation hash chain.", res == KSI_OK);
+	ac = NULL;
+
+	res = KSI_AggregationHashChainList_aggregate(list, ctx, 0, &out);
+	CuAssert(tc, "Unable to aggregate the chain list.", res == KSI_OK && out != NULL);
+	CuAssert(tc, "Aggregation hash chain list root mismatch.", KSI_DataHash_equals(out, exp));
+
+	KSI_DataHash_free(exp);
+	KSI_DataHash_free(mid);
+	KSI_DataHash_free(in);
+	KSI_DataHash_free(out);
+	KSI_AggregationHashChainList_free(list);
+}
+
 static void testAggrChainBuiltWithMetaData(CuTest *tc) {
 	int res;
 	unsigned char buf[1024];
@@ -423,6 +500,7 @@ CuSuite* KSITest_HashChain_getSuite(void) {
 
 	SUITE_ADD_TEST(suite, testCalChainBuild);
 	SUITE_ADD_TEST(suite, testAggrChainBuilt);
+	SUITE_ADD_TEST(suite, testAggrChainListAggregate);
 	SUITE_ADD_TEST(suite, testAggrChainBuiltWithMetaData);
 	SUITE_ADD_TEST(suite, testAggrChain_LegacyId_siblingContainsLegacyId_verifyErrorResult);
 	SUITE_ADD_TEST(suite, testAggrChain_LegacyId_invalidHeader_verifyErrorResult);
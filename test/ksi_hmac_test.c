@@ -162,6 +162,80 @@ static void TestSHA256Reset(CuTest* tc) {
 	KSI_DataHash_free(hmac);
 }
 
+static void TestSHA256Clone(CuTest* tc) {
+	int res;
+	KSI_HmacHasher *hasher = NULL;
+	KSI_HmacHasher *clone = NULL;
+	KSI_DataHash *hmac = NULL;
+	char *data = MESSAGE;
+	const char *expected = SHA256_MESSAGE_HMAC;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_HmacHasher_open(ctx, KSI_HASHALG_SHA2_256, KEY, &hasher);
+	CuAssert(tc, "Failed to open HMAC hasher.", res == KSI_OK && hasher != NULL);
+
+	res = KSI_HmacHasher_add(hasher, "TEST", strlen("TEST"));
+	CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+	/* The clone starts from the keyed state, not from the data added to the original. */
+	res = KSI_HmacHasher_clone(hasher, &clone);
+	CuAssert(tc, "Failed to clone HMAC hasher.", res == KSI_OK && clone != NULL);
+
+	res = KSI_HmacHasher_add(clone, (unsigned char *)data, strlen(data));
+	CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+	res = KSI_HmacHasher_close(clone, &hmac);
+	CuAssert(tc, "Failed to close HMAC hasher.", res == KSI_OK && hmac != NULL);
+
+	res = CompareHmac(hmac, expected);
+	CuAssert(tc, "HMAC mismatch.", res == KSI_OK);
+
+	KSI_HmacHasher_free(hasher);
+	KSI_HmacHasher_free(clone);
+	KSI_DataHash_free(hmac);
+}
+
+static void TestKeyCache(CuTest* tc) {
+	int res;
+	KSI_HmacHasher *hasher = NULL;
+	KSI_DataHash *hmac = NULL;
+	KSI_DataHash *ref = NULL;
+	char key[32];
+	size_t round;
+	size_t i;
+
+	KSI_ERR_clearErrors(ctx);
+
+	/* More keys than the context keeps, so the cached states are also replaced. */
+	for (round = 0; round < 2; round++) {
+		for (i = 0; i < 20; i++) {
+			KSI_snprintf(key, sizeof(key), "key-%u", (unsigned)(i % 12));
+
+			res = KSI_HMAC_create(ctx, KSI_HASHALG_SHA2_256, key, (unsigned char *)MESSAGE, strlen(MESSAGE), &hmac);
+			CuAssert(tc, "Failed to create HMAC.", res == KSI_OK && hmac != NULL);
+
+			res = KSI_HmacHasher_open(ctx, KSI_HASHALG_SHA2_256, key, &hasher);
+			CuAssert(tc, "Failed to open HMAC hasher.", res == KSI_OK && hasher != NULL);
+
+			res = KSI_HmacHasher_add(hasher, MESSAGE, strlen(MESSAGE));
+			CuAssert(tc, "Failed to add data.", res == KSI_OK);
+
+			res = KSI_HmacHasher_close(hasher, &ref);
+			CuAssert(tc, "Failed to close HMAC hasher.", res == KSI_OK && ref != NULL);
+
+			CuAssert(tc, "HMAC mismatch.", KSI_DataHash_equals(hmac, ref));
+
+			KSI_HmacHasher_free(hasher);
+			hasher = NULL;
+			KSI_DataHash_free(hmac);
+			hmac = NULL;
+			KSI_DataHash_free(ref);
+			ref = NULL;
+		}
+	}
+}
+
 static void TestSHA256NoData(CuTest* tc) {
 	int res;
 	KSI_HmacHasher *hasher = NULL;
@@ -391,6 +465,8 @@ CuSuite* KSITest_HMAC_getSuite(void) {
 	SUITE_ADD_TEST(suite, TestSHA256AddEmptyData);
 	SUITE_ADD_TEST(suite, TestSHA256AddMany);
 	SUITE_ADD_TEST(suite, TestSHA256Reset);
+	SUITE_ADD_TEST(suite, TestSHA256Clone);
+	SUITE_ADD_TEST(suite, TestKeyCache);
 	SUITE_ADD_TEST(suite, TestSHA256NoData);
 	SUITE_ADD_TEST(suite, TestAllAlgorithms);
 	SUITE_ADD_TEST(suite, TestSHA512LongKey);
@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include <ksi/hash.h>
+#include <ksi/metrics.h>
 #include <ksi/net.h>
 #include <ksi/net_async.h>
 #include <ksi/net_ha.h>
@@ -29,6 +30,8 @@
 #include "all_tests.h"
 #include "test_mock_async.h"
 
+#include "../src/ksi/impl/net_async_impl.h"
+
 
 extern KSI_CTX *ctx;
 
@@ -154,6 +157,8 @@ void Test_AsyncSingningService_verifyOptions(CuTest* tc) {
 	verifyOption(tc, as, KSI_ASYNC_OPT_SND_TIMEOUT, 10, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, 1, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_MAX_REQUEST_COUNT, 1, 15);
+	verifyOption(tc, as, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, 1, 15);
+	verifyOption(tc, as, KSI_ASYNC_OPT_COALESCE_WINDOW_US, 0, 15);
 
 	KSI_AsyncService_free(as);
 }
@@ -508,6 +513,84 @@ static void Test_AsyncSign_oneRequest_verifySignature(CuTest* tc) {
 #undef TEST_SIGNATURE_FILE
 }
 
+static void KSITest_MetricsCallback(void *cbCtx, const KSI_MetricsSnapshot *snapshot) {
+	if (snapshot != NULL) (*(size_t *)cbCtx)++;
+}
+
+static void Test_AsyncSign_oneRequest_metrics(CuTest* tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	KSI_MetricsSnapshot before;
+	KSI_MetricsSnapshot after;
+	KSI_MetricsSnapshot snapshot;
+	KSI_uint64_t latencyCount = 0;
+	size_t reports = 0;
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	res = KSI_CTX_getMetrics(ctx, &before);
+	CuAssert(tc, "Unable to get context metrics.", res == KSI_OK);
+
+	res = KSI_CTX_setMetricsCallback(ctx, KSITest_MetricsCallback, &reports, 0);
+	CuAssert(tc, "Unable to set metrics callback.", res == KSI_OK);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSI_AsyncService_getMetrics(as, &snapshot);
+	CuAssert(tc, "Unable to get service metrics.", res == KSI_OK && snapshot.counters[KSI_METRIC_REQUESTS_SENT] == 0);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncService_getMetrics(as, &snapshot);
+	CuAssert(tc, "Unable to get service metrics.", res == KSI_OK && snapshot.queueDepth == 1);
+
+	res = KSI_AsyncService_run(as, &respHandle, NULL);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK && respHandle == reqHandle);
+
+	res = KSI_AsyncService_getMetrics(as, &snapshot);
+	CuAssert(tc, "Unable to get service metrics.", res == KSI_OK);
+	CuAssert(tc, "Sent requests not counted.", snapshot.counters[KSI_METRIC_REQUESTS_SENT] == 1);
+	CuAssert(tc, "Received responses not counted.", snapshot.counters[KSI_METRIC_RESPONSES_RECEIVED] == 1);
+	CuAssert(tc, "Bytes not counted.", snapshot.counters[KSI_METRIC_BYTES_OUT] > 0 && snapshot.counters[KSI_METRIC_BYTES_IN] > 0);
+	CuAssert(tc, "Unexpected errors.", snapshot.counters[KSI_METRIC_ERRORS] == 0 && snapshot.errors_count == 0);
+	CuAssert(tc, "Unexpected queue depth.", snapshot.queueDepth == 0);
+
+	for (i = 0; i < KSI_METRIC_LATENCY_BUCKETS; i++) {
+		latencyCount += snapshot.latency[KSI_METRIC_AGGREGATION_LATENCY][i];
+		CuAssert(tc, "Unexpected extending latency.", snapshot.latency[KSI_METRIC_EXTENDING_LATENCY][i] == 0);
+	}
+	CuAssert(tc, "Latency not measured.", latencyCount == 1);
+
+	/* The context metrics include the requests of all the services. */
+	res = KSI_CTX_getMetrics(ctx, &after);
+	CuAssert(tc, "Unable to get context metrics.", res == KSI_OK);
+	CuAssert(tc, "Context metrics not updated.",
+			after.counters[KSI_METRIC_REQUESTS_SENT] == before.counters[KSI_METRIC_REQUESTS_SENT] + 1 &&
+			after.counters[KSI_METRIC_RESPONSES_RECEIVED] == before.counters[KSI_METRIC_RESPONSES_RECEIVED] + 1);
+	CuAssert(tc, "Metrics callback not invoked.", reports > 0);
+
+	res = KSI_CTX_setMetricsCallback(ctx, NULL, NULL, 0);
+	CuAssert(tc, "Unable to reset metrics callback.", res == KSI_OK);
+
+	KSI_AsyncHandle_free(respHandle);
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSign_oneRequest_multipleResponses_verifySignature(CuTest* tc) {
 #define TEST_SIGNATURE_FILE     "resource/tlv/ok-sig-2014-07-01.1.ksig"
 	static const char *TEST_AGGR_RESPONSE_FILES[] = {
@@ -1548,6 +1631,335 @@ static void Test_AsyncSign_multipleRequests_collect(CuTest* tc) {
 	KSI_AsyncService_free(as);
 }
 
+static void Test_AsyncSign_multipleRequests_collect_coalesced(CuTest* tc) {
+	static const char *TEST_REQ_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_01h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_02h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_03h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_04h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_05h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_06h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_07h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_08h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_09h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Ah.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Bh.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Ch.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Dh.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Eh.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_0Fh.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_10h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_11h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_12h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_13h.tlv",
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-req_id_14h.tlv",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	const char **p_req = NULL;
+	size_t added = 0;
+	size_t receivedCount = 0;
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_REQ_AGGR_RESPONSE_FILES, TEST_REQ_DATA_COUNT, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)(TEST_REQ_DATA_COUNT));
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, (void*)7);
+	CuAssert(tc, "Unable to set coalesce count.", res == KSI_OK);
+
+	p_req = TEST_REQ_DATA;
+	while (*p_req != NULL) {
+		size_t pendingCount = 0;
+		KSI_AsyncHandle *reqHandle = NULL;
+
+		res = KSITest_createAggrAsyncHandle(ctx, 0, (unsigned char *)*p_req, strlen(*p_req), KSI_HASHALG_SHA2_256, NULL, 0, 0, &reqHandle);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+		res = KSI_AsyncService_addRequest(as, reqHandle);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+		p_req++;
+
+		res = KSI_AsyncService_getPendingCount(as, &pendingCount);
+		CuAssert(tc, "Unable to get pending count.", res == KSI_OK);
+		CuAssert(tc, "Pending count mitmatch.", pendingCount == ++added);
+	}
+
+	do {
+		res = KSI_AsyncService_run(as, NULL, NULL);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+
+		res = KSI_AsyncService_getReceivedCount(as, &receivedCount);
+		CuAssert(tc, "Unable to get received count.", res == KSI_OK);
+	} while (added--);
+	CuAssert(tc, "Response count mismatch.", TEST_REQ_DATA_COUNT == receivedCount);
+
+	for (i = 0; i < receivedCount; i++) {
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+		KSI_AsyncHandle *handle = NULL;
+		KSI_Signature *signature = NULL;
+
+		res = KSI_AsyncService_run(as, &handle, NULL);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+
+		res = KSI_AsyncHandle_getState(handle, &state);
+		CuAssert(tc, "Unable to get request state.", res == KSI_OK && state != KSI_ASYNC_STATE_UNDEFINED);
+
+		CuAssert(tc, "State should be RESPONSE_RECEIVED.", state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_AsyncHandle_getSignature(handle, &signature);
+		CuAssert(tc, "Unable to extract signature.", res == KSI_OK && signature != NULL);
+
+		KSI_Signature_free(signature);
+		KSI_AsyncHandle_free(handle);
+	}
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_multipleRequests_coalesced_multiPayloadResponse(CuTest* tc) {
+	static const char *TEST_REQ_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-aggr_resp-multi_payload-req_id_01h-07h.tlv",
+	};
+	static const size_t TEST_REQ_COUNT = 7;
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	size_t i;
+	size_t receivedCount = 0;
+	size_t pendingCount = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_REQ_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_REQ_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)(TEST_REQ_COUNT));
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, (void*)(TEST_REQ_COUNT));
+	CuAssert(tc, "Unable to set coalesce count.", res == KSI_OK);
+
+	for (i = 0; i < TEST_REQ_COUNT; i++) {
+		KSI_AsyncHandle *reqHandle = NULL;
+
+		res = KSITest_createAggrAsyncHandle(ctx, 0, (unsigned char *)TEST_REQ_DATA[i], strlen(TEST_REQ_DATA[i]), KSI_HASHALG_SHA2_256, NULL, 0, 0, &reqHandle);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+		res = KSI_AsyncService_addRequest(as, reqHandle);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+	}
+
+	/* All requests are sent in a single PDU and all the responses are received in a single PDU. */
+	res = KSI_AsyncService_run(as, NULL, NULL);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+
+	res = KSI_AsyncService_getReceivedCount(as, &receivedCount);
+	CuAssert(tc, "Unable to get received count.", res == KSI_OK);
+	CuAssert(tc, "Response count mismatch.", receivedCount == TEST_REQ_COUNT);
+
+	for (i = 0; i < TEST_REQ_COUNT; i++) {
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+		KSI_AsyncHandle *handle = NULL;
+		KSI_Signature *signature = NULL;
+
+		res = KSI_AsyncService_run(as, &handle, NULL);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK && handle != NULL);
+
+		res = KSI_AsyncHandle_getState(handle, &state);
+		CuAssert(tc, "State should be RESPONSE_RECEIVED.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_AsyncHandle_getSignature(handle, &signature);
+		CuAssert(tc, "Unable to extract signature.", res == KSI_OK && signature != NULL);
+
+		KSI_Signature_free(signature);
+		KSI_AsyncHandle_free(handle);
+	}
+
+	res = KSI_AsyncService_getPendingCount(as, &pendingCount);
+	CuAssert(tc, "Unable to get pending count.", res == KSI_OK && pendingCount == 0);
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_coalesced_maxPduSize(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncClient *client = NULL;
+	size_t i;
+	size_t carriers = 0;
+	static const size_t TEST_REQ_COUNT = 2000;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)(TEST_REQ_COUNT));
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, (void*)(TEST_REQ_COUNT));
+	CuAssert(tc, "Unable to set coalesce count.", res == KSI_OK);
+
+	client = (KSI_AsyncClient *)as->impl;
+
+	/* The requests do not fit into a single PDU, thus the coalesced requests must be sent out in several PDUs. */
+	for (i = 0; i < TEST_REQ_COUNT; i++) {
+		KSI_AsyncHandle *reqHandle = NULL;
+
+		res = KSITest_createAggrAsyncHandle(ctx, 0, (unsigned char *)&i, sizeof(i), KSI_HASHALG_SHA2_512, NULL, 0, 0, &reqHandle);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+		res = KSI_AsyncService_addRequest(as, reqHandle);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+	}
+
+	carriers = KSI_AsyncHandleList_length(client->carriers);
+	CuAssert(tc, "Coalesced requests should have been split.", carriers > 0);
+
+	for (i = 0; i < carriers; i++) {
+		KSI_AsyncHandle *carrier = NULL;
+
+		res = KSI_AsyncHandleList_elementAt(client->carriers, i, &carrier);
+		CuAssert(tc, "Unable to get carrier.", res == KSI_OK && carrier != NULL);
+		CuAssert(tc, "Carrier PDU exceeds the maximum size.", carrier->len <= 0xffff + 4);
+	}
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncPacer_limits(CuTest* tc) {
+	size_t options[__NOF_KSI_ASYNC_OPT];
+	KSI_AsyncPacer pacer;
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	memset(options, 0, sizeof(options));
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 3;
+	options[KSI_ASYNC_PRIVOPT_ROUND_DURATION] = 60;
+
+	/* The bucket is initially full. */
+	KSI_AsyncPacer_init(&pacer);
+	for (i = 0; i < 3; i++) {
+		CuAssert(tc, "Pacer must allow a burst of a full round.", KSI_AsyncPacer_isReady(&pacer, options, 1));
+		KSI_AsyncPacer_consume(&pacer, options, 1);
+	}
+	CuAssert(tc, "Pacer must hold back requests exceeding the round limit.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+
+	/* More restrictive server limits take precedence. */
+	options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT] = 1;
+	options[KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS] = 60000;
+	KSI_AsyncPacer_init(&pacer);
+	CuAssert(tc, "Pacer must allow the first request.", KSI_AsyncPacer_isReady(&pacer, options, 1));
+	KSI_AsyncPacer_consume(&pacer, options, 1);
+	CuAssert(tc, "Pacer must apply the server limit.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+
+	/* Less restrictive server limits are ignored. */
+	options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT] = 1000;
+	options[KSI_ASYNC_PRIVOPT_SERVER_ROUND_DURATION_MS] = 1000;
+	KSI_AsyncPacer_init(&pacer);
+	for (i = 0; i < 3; i++) {
+		CuAssert(tc, "Pacer must allow a burst of a full round.", KSI_AsyncPacer_isReady(&pacer, options, 1));
+		KSI_AsyncPacer_consume(&pacer, options, 1);
+	}
+	CuAssert(tc, "Pacer must apply the client limit.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+
+	/* Zero request count blocks all requests. */
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 0;
+	options[KSI_ASYNC_PRIVOPT_SERVER_MAX_REQUEST_COUNT] = 0;
+	KSI_AsyncPacer_init(&pacer);
+	CuAssert(tc, "Pacer must not allow any requests.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+}
+
+static void Test_AsyncPacer_coalescedPayloads(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncClient *client = NULL;
+	KSI_AsyncHandle *carrier = NULL;
+	KSI_AsyncPacer pacer;
+	size_t options[__NOF_KSI_ASYNC_OPT];
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)5);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_COALESCE_MAX_COUNT, (void*)5);
+	CuAssert(tc, "Unable to set coalesce count.", res == KSI_OK);
+
+	client = (KSI_AsyncClient *)as->impl;
+
+	for (i = 0; i < 5; i++) {
+		KSI_AsyncHandle *reqHandle = NULL;
+
+		res = KSITest_createAggrAsyncHandle(ctx, 0, (unsigned char *)TEST_REQ_DATA[i], strlen(TEST_REQ_DATA[i]), KSI_HASHALG_SHA2_256, NULL, 0, 0, &reqHandle);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+		res = KSI_AsyncService_addRequest(as, reqHandle);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+		CuAssert(tc, "A single request is carried by itself.", KSI_AsyncHandle_getPayloadCount(reqHandle) == 1);
+	}
+
+	/* The requests are carried by a single multi-payload PDU. */
+	CuAssert(tc, "Requests should have been coalesced.", KSI_AsyncHandleList_length(client->carriers) == 1);
+	res = KSI_AsyncHandleList_elementAt(client->carriers, 0, &carrier);
+	CuAssert(tc, "Unable to get carrier.", res == KSI_OK && carrier != NULL);
+	CuAssert(tc, "Carrier payload count mismatch.", KSI_AsyncHandle_getPayloadCount(carrier) == 5);
+
+	memset(options, 0, sizeof(options));
+	options[KSI_ASYNC_PRIVOPT_ROUND_DURATION] = 60;
+
+	/* The carrier costs as much as the requests it carries. */
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 6;
+	KSI_AsyncPacer_init(&pacer);
+	CuAssert(tc, "Pacer must allow the carrier.", KSI_AsyncPacer_isReady(&pacer, options, KSI_AsyncHandle_getPayloadCount(carrier)));
+	KSI_AsyncPacer_consume(&pacer, options, KSI_AsyncHandle_getPayloadCount(carrier));
+	CuAssert(tc, "Pacer must allow a single request.", KSI_AsyncPacer_isReady(&pacer, options, 1));
+	KSI_AsyncPacer_consume(&pacer, options, 1);
+	CuAssert(tc, "Pacer must hold back requests exceeding the round limit.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+
+	/* A carrier exceeding the round limit is let through with a full bucket, but the excess has to be paid back. */
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 3;
+	KSI_AsyncPacer_init(&pacer);
+	CuAssert(tc, "Pacer must allow a single request.", KSI_AsyncPacer_isReady(&pacer, options, 1));
+	KSI_AsyncPacer_consume(&pacer, options, 1);
+	CuAssert(tc, "Pacer must hold back a carrier with a partial bucket.", !KSI_AsyncPacer_isReady(&pacer, options, KSI_AsyncHandle_getPayloadCount(carrier)));
+	KSI_AsyncPacer_init(&pacer);
+	CuAssert(tc, "Pacer must allow a carrier with a full bucket.", KSI_AsyncPacer_isReady(&pacer, options, KSI_AsyncHandle_getPayloadCount(carrier)));
+	KSI_AsyncPacer_consume(&pacer, options, KSI_AsyncHandle_getPayloadCount(carrier));
+	CuAssert(tc, "Pacer must be in debt.", pacer.credit < 0);
+	CuAssert(tc, "Pacer must hold back requests until the debt is paid back.", !KSI_AsyncPacer_isReady(&pacer, options, 1));
+
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSign_multipleRequests_collect_aggrResp301(CuTest* tc) {
 	static const char *TEST_REQ_AGGR_RESPONSE_FILES[] = {
 		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok_aggr_error_response_301.tlv"
@@ -1817,6 +2229,7 @@ CuSuite* KSITest_NetAsync_getSuite(void) {
 
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifyReqCtx);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifySignature);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_metrics);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_multipleResponses_verifySignature);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifyNoError);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_responseWithPushConf_viaServiceCallback);
@@ -1836,7 +2249,12 @@ CuSuite* KSITest_NetAsync_getSuite(void) {
 	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_loop);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_loop_cacheSize5);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_collect);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_collect_coalesced);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_coalesced_multiPayloadResponse);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_coalesced_maxPduSize);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_collect_aggrResp301);
+	SUITE_ADD_TEST(suite, Test_AsyncPacer_limits);
+	SUITE_ADD_TEST(suite, Test_AsyncPacer_coalescedPayloads);
 
 	SUITE_ADD_TEST(suite, Test_HASign_confRequest_responseConfDefaultConsolidate);
 	SUITE_ADD_TEST(suite, Test_HASign_confRequest_responseConfConsolidateCallback);
@@ -17,10 +17,12 @@
  * reserves and retains all trademark rights.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <ksi/hashchain.h>
 #include <ksi/net.h>
+#include <ksi/net_tcp.h>
 #include <ksi/net_uri.h>
 #include <ksi/pkitruststore.h>
 #include <ksi/tree_builder.h>
@@ -31,7 +33,9 @@
 #include "../src/ksi/impl/net_http_impl.h"
 #include "../src/ksi/impl/net_tcp_impl.h"
 #include "../src/ksi/impl/net_uri_impl.h"
+#include "../src/ksi/impl/net_sock_impl.h"
 #include "../src/ksi/impl/signature_impl.h"
+#include "../src/ksi/impl/thread_impl.h"
 
 extern KSI_CTX *ctx;
 
@@ -46,11 +50,246 @@ static unsigned char mockImprint[] ={0x01,
 									 0xad, 0xb2, 0x38, 0x55, 0x2d, 0x86, 0xc6, 0x59,
 									 0x34, 0x2d, 0x1d, 0x7e, 0x87, 0xb8, 0x77, 0x2d};
 
+#ifndef _WIN32
+
+/* Max nof connections served simultaneously by the test server. */
+#define TEST_SERVER_MAX_CONN 8
+
+/* Response returned to every request, an aggregation PDU with an opaque payload. */
+static const unsigned char testServerResponse[] = {0x82, 0x21, 0x00, 0x04, 0x01, 0x02, 0x03, 0x04};
+
+/**
+ * Minimal loopback server counting the connections of the network clients. Every request is
+ * answered with #testServerResponse, either wrapped into a HTTP response or as a raw TLV.
+ */
+typedef struct TestServer_st {
+	int listenFd;
+	unsigned port;
+	bool http;
+	/* Close the connection after every response, as an idle connection dropped by a server. */
+	bool closeAfterResponse;
+	bool running;
+	KSI_Mutex lock;
+	bool stop;
+	size_t accepted;
+	KSI_Thread thread;
+	struct {
+		int fd;
+		unsigned char buf[0x1000];
+		size_t len;
+	} conn[TEST_SERVER_MAX_CONN];
+} TestServer;
+
+/* The server is stopped by #postTest, also when a test fails. */
+static TestServer testServer;
+
+static size_t TestServer_requestLength(TestServer *srv, const unsigned char *buf, size_t len) {
+	size_t i;
+
+	if (!srv->http) {
+		if (len < 4) return 0;
+		return (len < 4 + ((size_t)buf[2] << 8 | buf[3])) ? 0 : 4 + ((size_t)buf[2] << 8 | buf[3]);
+	}
+
+	for (i = 0; i + 4 <= len; i++) {
+		if (memcmp(buf + i, "\r\n\r\n", 4) == 0) {
+			const char *cl = NULL;
+			size_t body = 0;
+			char hdr[0x1000];
+
+			memcpy(hdr, buf, i);
+			hdr[i] = '\0';
+			cl = strstr(hdr, "Content-Length:");
+			if (cl != NULL) body = (size_t)strtoul(cl + 15, NULL, 10);
+			return (len < i + 4 + body) ? 0 : i + 4 + body;
+		}
+	}
+	return 0;
+}
+
+static void TestServer_respond(TestServer *srv, int fd) {
+	char hdr[128];
+
+	if (srv->http) {
+		KSI_snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: application/ksi-response\r\nContent-Length: %u\r\n\r\n",
+				(unsigned)sizeof(testServerResponse));
+		send(fd, hdr, strlen(hdr), MSG_NOSIGNAL);
+	}
+	send(fd, testServerResponse, sizeof(testServerResponse), MSG_NOSIGNAL);
+}
+
+static void TestServer_run(void *arg) {
+	TestServer *srv = arg;
+	struct pollfd pfd[TEST_SERVER_MAX_CONN + 1];
+	size_t i;
+
+	for (;;) {
+		bool stop;
+
+		KSI_Mutex_lock(&srv->lock);
+		stop = srv->stop;
+		KSI_Mutex_unlock(&srv->lock);
+		if (stop) break;
+
+		pfd[0].fd = srv->listenFd;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < TEST_SERVER_MAX_CONN; i++) {
+			pfd[i + 1].fd = srv->conn[i].fd;
+			pfd[i + 1].events = POLLIN;
+		}
+		if (poll(pfd, TEST_SERVER_MAX_CONN + 1, 10) <= 0) continue;
+
+		if (pfd[0].revents & POLLIN) {
+			int fd = (int)accept(srv->listenFd, NULL, NULL);
+			for (i = 0; fd >= 0 && i < TEST_SERVER_MAX_CONN && srv->conn[i].fd >= 0; i++);
+			if (i < TEST_SERVER_MAX_CONN) {
+				srv->conn[i].fd = fd;
+				srv->conn[i].len = 0;
+				KSI_Mutex_lock(&srv->lock);
+				srv->accepted++;
+				KSI_Mutex_unlock(&srv->lock);
+			} else if (fd >= 0) {
+				close(fd);
+			}
+		}
+
+		for (i = 0; i < TEST_SERVER_MAX_CONN; i++) {
+			ssize_t c;
+			size_t reqLen;
+
+			if (srv->conn[i].fd < 0 || !(pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+			c = recv(srv->conn[i].fd, srv->conn[i].buf + srv->conn[i].len, sizeof(srv->conn[i].buf) - srv->conn[i].len, 0);
+			if (c <= 0) {
+				close(srv->conn[i].fd);
+				srv->conn[i].fd = -1;
+				continue;
+			}
+			srv->conn[i].len += (size_t)c;
+
+			while ((reqLen = TestServer_requestLength(srv, srv->conn[i].buf, srv->conn[i].len)) > 0) {
+				TestServer_respond(srv, srv->conn[i].fd);
+				memmove(srv->conn[i].buf, srv->conn[i].buf + reqLen, srv->conn[i].len - reqLen);
+				srv->conn[i].len -= reqLen;
+			}
+
+			if (srv->closeAfterResponse && srv->conn[i].len == 0) {
+				close(srv->conn[i].fd);
+				srv->conn[i].fd = -1;
+			}
+		}
+	}
+}
+
+static void TestServer_start(CuTest *tc, TestServer *srv, bool http, bool closeAfterResponse) {
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	size_t i;
+
+	memset(srv, 0, sizeof(TestServer));
+	srv->http = http;
+	srv->closeAfterResponse = closeAfterResponse;
+	for (i = 0; i < TEST_SERVER_MAX_CONN; i++) srv->conn[i].fd = -1;
+
+	srv->listenFd = (int)socket(AF_INET, SOCK_STREAM, 0);
+	CuAssert(tc, "Unable to open socket.", srv->listenFd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	CuAssert(tc, "Unable to bind socket.", bind(srv->listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	CuAssert(tc, "Unable to listen.", listen(srv->listenFd, TEST_SERVER_MAX_CONN) == 0);
+	CuAssert(tc, "Unable to get port.", getsockname(srv->listenFd, (struct sockaddr *)&addr, &addrLen) == 0);
+	srv->port = ntohs(addr.sin_port);
+
+	CuAssert(tc, "Unable to init mutex.", KSI_Mutex_init(&srv->lock) == KSI_OK);
+	CuAssert(tc, "Unable to start server thread.", KSI_Thread_start(&srv->thread, TestServer_run, srv) == KSI_OK);
+	srv->running = true;
+}
+
+static void TestServer_stop(TestServer *srv) {
+	size_t i;
+
+	if (!srv->running) return;
+	srv->running = false;
+
+	KSI_Mutex_lock(&srv->lock);
+	srv->stop = true;
+	KSI_Mutex_unlock(&srv->lock);
+	KSI_Thread_join(&srv->thread);
+
+	for (i = 0; i < TEST_SERVER_MAX_CONN; i++) {
+		if (srv->conn[i].fd >= 0) close(srv->conn[i].fd);
+	}
+	close(srv->listenFd);
+	KSI_Mutex_destroy(&srv->lock);
+}
+
+static size_t TestServer_getAccepted(TestServer *srv) {
+	size_t accepted;
+
+	KSI_Mutex_lock(&srv->lock);
+	accepted = srv->accepted;
+	KSI_Mutex_unlock(&srv->lock);
+
+	return accepted;
+}
+
+static int sendTestRequest(KSI_NetworkClient *net) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationReq *req = NULL;
+	KSI_DataHash *hash = NULL;
+	KSI_RequestHandle *handle = NULL;
+	const unsigned char *resp = NULL;
+	size_t resp_len = 0;
+
+	res = KSI_AggregationReq_new(ctx, &req);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_fromImprint(ctx, mockImprint, sizeof(mockImprint), &hash);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationReq_setRequestHash(req, hash);
+	if (res != KSI_OK) goto cleanup;
+	hash = NULL;
+
+	res = KSI_NetworkClient_sendSignRequest(net, req, &handle);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_RequestHandle_perform(handle);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_RequestHandle_getResponse(handle, &resp, &resp_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (resp_len != sizeof(testServerResponse) || memcmp(resp, testServerResponse, resp_len) != 0) {
+		res = KSI_INVALID_FORMAT;
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_RequestHandle_free(handle);
+	KSI_DataHash_free(hash);
+	KSI_AggregationReq_free(req);
+
+	return res;
+}
+
+#endif /* _WIN32 */
+
 static void preTest(void) {
 	ctx->netProvider->requestCount = 0;
 }
 
 static void postTest(void) {
+#ifndef _WIN32
+	TestServer_stop(&testServer);
+#endif
+	ctx->options[KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS] = 0;
 	/* Restore default HMAC algorithm. */
 	ctx->options[KSI_OPT_AGGR_HMAC_ALGORITHM] = TEST_DEFAULT_AGGR_HMAC_ALGORITHM;
 	ctx->options[KSI_OPT_EXT_HMAC_ALGORITHM] = TEST_DEFAULT_EXT_HMAC_ALGORITHM;
@@ -316,6 +555,93 @@ static void testAggregatorHmac(CuTest *tc) {
 	}
 }
 
+static void testAggregationResponseHmac(CuTest *tc) {
+	int res;
+	KSI_AggregationResp *resp = NULL;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_AggregationPdu *parsed = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_Utf8String *loginId = NULL;
+	KSI_Integer *intVal = NULL;
+	KSI_DataHash *hmac = NULL;
+	KSI_DataHash *composed = NULL;
+	KSI_DataHash *received = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_CTX_setAggregatorHmacAlgorithm(ctx, (void*)KSI_HASHALG_SHA2_256);
+	CuAssert(tc, "Unable to set hmac algorithm.", res == KSI_OK);
+
+	/* Compose the response the way an aggregator does. */
+	res = KSI_AggregationResp_new(ctx, &resp);
+	CuAssert(tc, "Unable to create aggregation response.", res == KSI_OK && resp != NULL);
+
+	res = KSI_Integer_new(ctx, 17, &intVal);
+	CuAssert(tc, "Unable to create reqId.", res == KSI_OK && intVal != NULL);
+	res = KSI_AggregationResp_setRequestId(resp, intVal);
+	CuAssert(tc, "Unable to set request id.", res == KSI_OK);
+	intVal = NULL;
+
+	res = KSI_Integer_new(ctx, 0, &intVal);
+	CuAssert(tc, "Unable to create status.", res == KSI_OK && intVal != NULL);
+	res = KSI_AggregationResp_setStatus(resp, intVal);
+	CuAssert(tc, "Unable to set status.", res == KSI_OK);
+	intVal = NULL;
+
+	res = KSI_AggregationPdu_new(ctx, &pdu);
+	CuAssert(tc, "Unable to create aggregation pdu.", res == KSI_OK && pdu != NULL);
+
+	res = KSI_Header_new(ctx, &hdr);
+	CuAssert(tc, "Unable to create header.", res == KSI_OK && hdr != NULL);
+	res = KSI_Utf8String_new(ctx, TEST_USER, strlen(TEST_USER) + 1, &loginId);
+	CuAssert(tc, "Unable to create login id.", res == KSI_OK && loginId != NULL);
+	res = KSI_Header_setLoginId(hdr, loginId);
+	CuAssert(tc, "Unable to set login id.", res == KSI_OK);
+	loginId = NULL;
+
+	res = KSI_AggregationPdu_setHeader(pdu, hdr);
+	CuAssert(tc, "Unable to set header.", res == KSI_OK);
+	hdr = NULL;
+
+	res = KSI_AggregationPdu_setResponse(pdu, resp);
+	CuAssert(tc, "Unable to set response.", res == KSI_OK);
+	resp = NULL;
+
+	/* The HMAC is calculated over the PDU with an empty HMAC value. */
+	res = KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &hmac);
+	CuAssert(tc, "Unable to create empty hmac.", res == KSI_OK && hmac != NULL);
+	res = KSI_AggregationPdu_setHmac(pdu, hmac);
+	CuAssert(tc, "Unable to set hmac.", res == KSI_OK);
+	hmac = NULL;
+
+	res = KSI_AggregationPdu_updateHmac(pdu, KSI_HASHALG_SHA2_256, TEST_PASS);
+	CuAssert(tc, "Unable to calculate the hmac of a composed response.", res == KSI_OK);
+
+	res = KSI_AggregationPdu_getHmac(pdu, &composed);
+	CuAssert(tc, "Unable to get hmac from pdu.", res == KSI_OK && composed != NULL);
+
+	res = KSI_AggregationPdu_serialize(pdu, &raw, &raw_len);
+	CuAssert(tc, "Unable to serialize aggregation pdu.", res == KSI_OK && raw != NULL);
+
+	/* The receiver calculates the HMAC over the raw response. */
+	res = KSI_AggregationPdu_parse(ctx, raw, raw_len, &parsed);
+	CuAssert(tc, "Unable to parse aggregation pdu.", res == KSI_OK && parsed != NULL);
+
+	res = KSI_AggregationPdu_calculateHmac(parsed, KSI_HASHALG_SHA2_256, TEST_PASS, &received);
+	CuAssert(tc, "Unable to calculate the hmac of a received response.", res == KSI_OK && received != NULL);
+	CuAssert(tc, "HMAC mismatch.", KSI_DataHash_equals(composed, received));
+
+	res = KSI_AggregationPdu_verifyHmac(parsed, TEST_PASS);
+	CuAssert(tc, "Unable to verify the hmac of a received response.", res == KSI_OK);
+
+	KSI_free(raw);
+	KSI_DataHash_free(received);
+	KSI_AggregationPdu_free(parsed);
+	KSI_AggregationPdu_free(pdu);
+}
+
 static void extReqPduHmacVerify(CuTest* tc, KSI_HashAlgorithm hmacAlg) {
 	int res;
 	KSI_ExtendReq *req = NULL;
@@ -503,6 +829,133 @@ static void testUriSpiltAndCompose(CuTest* tc) {
 	KSI_NetworkClient_free(tmp);
 }
 
+#ifndef _WIN32
+
+#if KSI_NET_HTTP_IMPL==KSI_IMPL_CURL
+static void testHttpConnectionReuse(CuTest *tc) {
+	int res;
+	KSI_NetworkClient *net = NULL;
+	char url[64];
+	int i;
+
+	TestServer_start(tc, &testServer, true, false);
+
+	res = KSI_HttpClient_new(ctx, &net);
+	CuAssert(tc, "Unable to create HTTP client.", res == KSI_OK && net != NULL);
+
+	KSI_snprintf(url, sizeof(url), "http://127.0.0.1:%u/", testServer.port);
+	res = KSI_HttpClient_setAggregator(net, url, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set aggregator.", res == KSI_OK);
+
+	for (i = 0; i < 3; i++) {
+		res = sendTestRequest(net);
+		CuAssert(tc, "Request failed.", res == KSI_OK);
+	}
+	CuAssert(tc, "Connection was not reused.", TestServer_getAccepted(&testServer) == 1);
+
+	/* Setting the same URL keeps the connection. */
+	res = KSI_HttpClient_setAggregator(net, url, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set aggregator.", res == KSI_OK);
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Connection was not reused.", TestServer_getAccepted(&testServer) == 1);
+
+	/* A reconfigured endpoint must not reuse the pooled connections. */
+	KSI_snprintf(url, sizeof(url), "http://127.0.0.1:%u/other", testServer.port);
+	res = KSI_HttpClient_setAggregator(net, url, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set aggregator.", res == KSI_OK);
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Pooled connection was reused after reconfiguration.", TestServer_getAccepted(&testServer) == 2);
+
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Connection was not reused.", TestServer_getAccepted(&testServer) == 2);
+
+	KSI_NetworkClient_free(net);
+}
+#endif
+
+static void newTcpTestClient(CuTest *tc, size_t idleTimeout, KSI_NetworkClient **net) {
+	int res;
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_TCP_IDLE_TIMEOUT_SECONDS, (void *)idleTimeout);
+	CuAssert(tc, "Unable to set TCP idle timeout.", res == KSI_OK);
+
+	res = KSI_TcpClient_new(ctx, net);
+	CuAssert(tc, "Unable to create TCP client.", res == KSI_OK && *net != NULL);
+
+	res = KSI_TcpClient_setAggregator(*net, "127.0.0.1", testServer.port, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set aggregator.", res == KSI_OK);
+}
+
+static void testTcpConnectionReuse(CuTest *tc) {
+	int res;
+	KSI_NetworkClient *net = NULL;
+	int i;
+
+	TestServer_start(tc, &testServer, false, false);
+	newTcpTestClient(tc, 10, &net);
+
+	for (i = 0; i < 3; i++) {
+		res = sendTestRequest(net);
+		CuAssert(tc, "Request failed.", res == KSI_OK);
+	}
+	CuAssert(tc, "Connection was not reused.", TestServer_getAccepted(&testServer) == 1);
+
+	/* A reconfigured endpoint opens a new connection. */
+	res = KSI_TcpClient_setAggregator(net, "127.0.0.1", testServer.port, TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set aggregator.", res == KSI_OK);
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Connection was reused after reconfiguration.", TestServer_getAccepted(&testServer) == 2);
+
+	KSI_NetworkClient_free(net);
+}
+
+static void testTcpConnectionIdleTimeout(CuTest *tc) {
+	int res;
+	KSI_NetworkClient *net = NULL;
+
+	TestServer_start(tc, &testServer, false, false);
+	newTcpTestClient(tc, 1, &net);
+
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+
+	/* The idle connection is closed and a new one is opened. */
+	sleep(2);
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Idle connection was reused.", TestServer_getAccepted(&testServer) == 2);
+
+	res = sendTestRequest(net);
+	CuAssert(tc, "Request failed.", res == KSI_OK);
+	CuAssert(tc, "Connection was not reused.", TestServer_getAccepted(&testServer) == 2);
+
+	KSI_NetworkClient_free(net);
+}
+
+static void testTcpConnectionClosedByServer(CuTest *tc) {
+	int res;
+	KSI_NetworkClient *net = NULL;
+	int i;
+
+	/* The server closes the connection after every response, the client has to reconnect. */
+	TestServer_start(tc, &testServer, false, true);
+	newTcpTestClient(tc, 10, &net);
+
+	for (i = 0; i < 3; i++) {
+		res = sendTestRequest(net);
+		CuAssert(tc, "Request failed.", res == KSI_OK);
+	}
+	CuAssert(tc, "Unexpected number of connections.", TestServer_getAccepted(&testServer) == 3);
+
+	KSI_NetworkClient_free(net);
+}
+
+#endif /* _WIN32 */
+
 CuSuite* KSITest_NetCommon_getSuite(void) {
 	CuSuite* suite = CuSuiteNew();
 
@@ -512,9 +965,18 @@ CuSuite* KSITest_NetCommon_getSuite(void) {
 	SUITE_ADD_TEST(suite, testAggregationHeader);
 	SUITE_ADD_TEST(suite, testExtendingHeader);
 	SUITE_ADD_TEST(suite, testAggregatorHmac);
+	SUITE_ADD_TEST(suite, testAggregationResponseHmac);
 	SUITE_ADD_TEST(suite, testExtenderHmac);
 	SUITE_ADD_TEST(suite, testUrlSplit);
 	SUITE_ADD_TEST(suite, testUriSpiltAndCompose);
+#ifndef _WIN32
+#if KSI_NET_HTTP_IMPL==KSI_IMPL_CURL
+	SUITE_ADD_TEST(suite, testHttpConnectionReuse);
+#endif
+	SUITE_ADD_TEST(suite, testTcpConnectionReuse);
+	SUITE_ADD_TEST(suite, testTcpConnectionIdleTimeout);
+	SUITE_ADD_TEST(suite, testTcpConnectionClosedByServer);
+#endif
 
 	return suite;
 }
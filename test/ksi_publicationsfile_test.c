@@ -18,6 +18,13 @@
  */
 
 #include <string.h>
+#ifdef _WIN32
+#  include <windows.h>
+#  define sleep_ms(x) Sleep((x))
+#else
+#  include <unistd.h>
+#  define sleep_ms(x) usleep((x)*1000)
+#endif
 
 #include <ksi/publicationsfile.h>
 #include <ksi/pkitruststore.h>
@@ -26,8 +33,12 @@
 
 #include "../src/ksi/internal.h"
 
+#include "../src/ksi/impl/ctx_impl.h"
 #include "../src/ksi/impl/publicationsfile_impl.h"
 
+/* Max nof 10 ms rounds to wait for the background refresh. */
+#define REFRESH_WAIT_MAX_ROUNDS 1000
+
 extern KSI_CTX *ctx;
 
 #define TEST_PUBLICATIONS_FILE "resource/tlv/publications.tlv"
@@ -250,6 +261,371 @@ static void testReceivePublicationsFileInvalidConstraints(CuTest *tc) {
 	KSI_CTX_free(ctx);
 }
 
+static void testReceivePublicationsFileBackgroundRefresh(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *cached = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKITruststore *pki = NULL;
+	KSI_CertConstraint arr[] = {
+			{KSI_CERT_EMAIL, "publications@guardtime.com"},
+			{NULL, NULL}
+	};
+	KSI_CTX *ctx = NULL;
+	unsigned failures = 0;
+	bool running = false;
+	int i;
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_PKITruststore_new(ctx, 0, &pki);
+	CuAssert(tc, "Unable to get PKI truststore from context.", res == KSI_OK && pki != NULL);
+
+	res = KSI_CTX_setPKITruststore(ctx, pki);
+	CuAssert(tc, "Unable to set new pki truststrore for ksi context.", res == KSI_OK);
+
+	res = KSI_PKITruststore_addLookupFile(pki, getFullResourcePath("resource/crt/mock.crt"));
+	CuAssert(tc, "Unable to read certificate.", res == KSI_OK);
+
+	res = KSI_CTX_setDefaultPubFileCertConstraints(ctx, arr);
+	CuAssert(tc, "Unable to set OID '2.5.4.10'.", res == KSI_OK);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_BACKGROUND_REFRESH, (void*)1);
+	CuAssert(tc, "Unable to enable background refresh.", res == KSI_OK);
+
+	/* The refreshed file does not verify, thus the expired cached file must be kept. */
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE_INVALID_PKI));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &cached);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && cached != NULL);
+
+	res = KSI_CTX_setPublicationsFile(ctx, KSI_PublicationsFile_ref(cached));
+	CuAssert(tc, "Unable to set publications file.", res == KSI_OK);
+
+	/* Wait for the refresh thread to fail and to be released. */
+	for (i = 0; i < REFRESH_WAIT_MAX_ROUNDS; i++) {
+		res = KSI_receivePublicationsFile(ctx, &pubFile);
+		CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+		CuAssert(tc, "Cached publications file should have been returned.", pubFile == cached);
+
+		KSI_PublicationsFile_free(pubFile);
+		pubFile = NULL;
+
+		KSI_Mutex_lock(&ctx->publicationsFileLock);
+		failures = ctx->publicationsFileRefreshFailures;
+		running = ctx->publicationsFileRefresh != NULL;
+		KSI_Mutex_unlock(&ctx->publicationsFileLock);
+		if (failures > 0 && !running) break;
+
+		sleep_ms(10);
+	}
+	CuAssert(tc, "Refresh should have failed.", failures == 1);
+
+	/* The failed refresh is not retried before the backoff delay. */
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile == cached);
+	CuAssert(tc, "Refresh should not have been retried.", ctx->publicationsFileRefresh == NULL && ctx->publicationsFileRefreshRetryAt > time(NULL));
+
+	KSI_PublicationsFile_free(pubFile);
+	pubFile = NULL;
+
+	/* The refreshed file verifies, thus it must replace the expired cached file. Changing the URL clears the backoff. */
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFile(ctx, KSI_PublicationsFile_ref(cached));
+	CuAssert(tc, "Unable to set publications file.", res == KSI_OK);
+
+	for (i = 0; i < REFRESH_WAIT_MAX_ROUNDS; i++) {
+		res = KSI_receivePublicationsFile(ctx, &pubFile);
+		CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+		if (pubFile != cached) break;
+
+		KSI_PublicationsFile_free(pubFile);
+		pubFile = NULL;
+		sleep_ms(10);
+	}
+	CuAssert(tc, "Refreshed publications file should have been returned.", pubFile != NULL && pubFile != cached);
+
+	res = KSI_verifyPublicationsFile(ctx, pubFile);
+	CuAssert(tc, "Refreshed publications file should verify.", res == KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_PublicationsFile_free(cached);
+	KSI_CTX_free(ctx);
+}
+
+static void setMockTrust(CuTest *tc, KSI_CTX *ctx) {
+	int res;
+	KSI_PKITruststore *pki = NULL;
+	KSI_CertConstraint arr[] = {
+			{KSI_CERT_EMAIL, "publications@guardtime.com"},
+			{NULL, NULL}
+	};
+
+	res = KSI_PKITruststore_new(ctx, 0, &pki);
+	CuAssert(tc, "Unable to get PKI truststore from context.", res == KSI_OK && pki != NULL);
+
+	res = KSI_CTX_setPKITruststore(ctx, pki);
+	CuAssert(tc, "Unable to set new pki truststrore for ksi context.", res == KSI_OK);
+
+	res = KSI_PKITruststore_addLookupFile(pki, getFullResourcePath("resource/crt/mock.crt"));
+	CuAssert(tc, "Unable to read certificate.", res == KSI_OK);
+
+	res = KSI_CTX_setDefaultPubFileCertConstraints(ctx, arr);
+	CuAssert(tc, "Unable to set OID '2.5.4.10'.", res == KSI_OK);
+}
+
+static void populatePublicationsFileCache(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_CTX *ctx = NULL;
+
+	remove("publications.bin");
+	remove("publications.idx");
+	remove("publications.meta");
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	setMockTrust(tc, ctx);
+
+	res = KSI_CTX_setPublicationsFileCacheDir(ctx, ".");
+	CuAssert(tc, "Unable to set publications file cache directory.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Publications file should have been verified.", pubFile->signatureVerified);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx);
+}
+
+static void clearPublicationsFileCache(void) {
+	remove("publications.bin");
+	remove("publications.idx");
+	remove("publications.meta");
+}
+
+static void testReceivePublicationsFileFromCache(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKITruststore *pki = NULL;
+	KSI_CTX *ctx = NULL;
+
+	populatePublicationsFileCache(tc);
+
+	/* The same trust configuration in another context may reuse the cached verification state. */
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	setMockTrust(tc, ctx);
+
+	res = KSI_CTX_setPublicationsFileCacheDir(ctx, ".");
+	CuAssert(tc, "Unable to set publications file cache directory.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file from cache.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Cached verification state should have been reused.", pubFile->signatureVerified);
+
+	res = KSI_verifyPublicationsFile(ctx, pubFile);
+	CuAssert(tc, "Cached publications file should verify.", res == KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile);
+	pubFile = NULL;
+
+	/* The downloaded file is unchanged, thus the verification state must be kept. */
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void*)0);
+	CuAssert(tc, "Unable to set cache timeout.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_verifyPublicationsFile(ctx, pubFile);
+	CuAssert(tc, "Unchanged publications file should not be verified again.", res == KSI_OK);
+
+	/* Changing the trust configuration invalidates the earlier verification. */
+	res = KSI_PKITruststore_new(ctx, 0, &pki);
+	CuAssert(tc, "Unable to get PKI truststore from context.", res == KSI_OK && pki != NULL);
+
+	res = KSI_CTX_setPKITruststore(ctx, pki);
+	CuAssert(tc, "Unable to set new pki truststrore for ksi context.", res == KSI_OK);
+
+	res = KSI_verifyPublicationsFile(ctx, pubFile);
+	CuAssert(tc, "Publications file should not verify without the certificate.", res != KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx);
+
+	clearPublicationsFileCache();
+}
+
+static void testReceivePublicationsFileFromCacheOtherTrust(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKITruststore *pki = NULL;
+	KSI_CTX *ctx = NULL;
+
+	populatePublicationsFileCache(tc);
+
+	/* Without the mock certificate the cached verification state must not be trusted. */
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	res = KSI_PKITruststore_new(ctx, 0, &pki);
+	CuAssert(tc, "Unable to get PKI truststore from context.", res == KSI_OK && pki != NULL);
+
+	res = KSI_CTX_setPKITruststore(ctx, pki);
+	CuAssert(tc, "Unable to set new pki truststrore for ksi context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFileCacheDir(ctx, ".");
+	CuAssert(tc, "Unable to set publications file cache directory.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file from cache.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Cached verification state should not have been reused.", !pubFile->signatureVerified);
+
+	res = KSI_verifyPublicationsFile(ctx, pubFile);
+	CuAssert(tc, "Publications file should not verify without the certificate.", res != KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx);
+
+	clearPublicationsFileCache();
+}
+
+static void testReceivePublicationsFileFromCacheTampered(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationsFile *origFile = NULL;
+	KSI_CTX *ctx = NULL;
+	FILE *in = NULL;
+	FILE *out = NULL;
+	unsigned char buf[1024];
+	size_t len;
+
+	populatePublicationsFileCache(tc);
+
+	/* Replace the cached file, but keep the metadata claiming it to be verified. */
+	in = fopen(getFullResourcePath(TAMPERED_PUBLICATIONS_FILE), "rb");
+	CuAssert(tc, "Unable to open tampered publications file.", in != NULL);
+	out = fopen("publications.bin", "wb");
+	CuAssert(tc, "Unable to open cached publications file.", out != NULL);
+	while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+		CuAssert(tc, "Unable to write cached publications file.", fwrite(buf, 1, len, out) == len);
+	}
+	fclose(in);
+	fclose(out);
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	setMockTrust(tc, ctx);
+
+	res = KSI_CTX_setPublicationsFileCacheDir(ctx, ".");
+	CuAssert(tc, "Unable to set publications file cache directory.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	/* The cache entry does not match its digest, thus the file must be downloaded again. */
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &origFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && origFile != NULL);
+	CuAssert(tc, "Tampered cache entry should not have been used.",
+			pubFile->raw_len == origFile->raw_len && memcmp(pubFile->raw, origFile->raw, origFile->raw_len) == 0);
+
+	KSI_PublicationsFile_free(origFile);
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx);
+
+	clearPublicationsFileCache();
+}
+
+static void testReceivePublicationsFileSharedImage(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationsFile *privFile = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_PublicationRecord *privRec = NULL;
+	KSI_PublicationRecord *latest = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_CTX *ctx = NULL;
+	char expected[1024];
+	char actual[1024];
+
+	populatePublicationsFileCache(tc);
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create new context.", res == KSI_OK && ctx != NULL);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_SHARED_IMAGE, (void*)1);
+	CuAssert(tc, "Unable to enable shared image.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFileCacheDir(ctx, ".");
+	CuAssert(tc, "Unable to set publications file cache directory.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Publications file should be attached to the shared image.", pubFile->image != NULL && pubFile->publications == NULL);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &privFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && privFile != NULL);
+
+	res = KSI_Integer_new(ctx, 1300000000, &pubTime);
+	CuAssert(tc, "Unable to create integer.", res == KSI_OK && pubTime != NULL);
+
+	/* The lookup from the index must match the lookup from the parsed file. */
+	res = KSI_PublicationsFile_getNearestPublication(pubFile, pubTime, &pubRec);
+	CuAssert(tc, "Unable to get nearest publication from the shared image.", res == KSI_OK && pubRec != NULL);
+	CuAssert(tc, "Publication records should not be parsed.", pubFile->publications == NULL);
+
+	res = KSI_PublicationsFile_getNearestPublication(privFile, pubTime, &privRec);
+	CuAssert(tc, "Unable to get nearest publication.", res == KSI_OK && privRec != NULL);
+
+	CuAssert(tc, "Nearest publications differ.", strcmp(
+			KSI_PublicationRecord_toString(pubRec, actual, sizeof(actual)),
+			KSI_PublicationRecord_toString(privRec, expected, sizeof(expected))) == 0);
+
+	KSI_PublicationRecord_free(privRec);
+	privRec = NULL;
+
+	res = KSI_PublicationsFile_findPublication(pubFile, pubRec, &privRec);
+	CuAssert(tc, "Unable to find publication from the shared image.", res == KSI_OK && privRec != NULL);
+
+	/* Functions returning records owned by the file parse all of them. */
+	res = KSI_PublicationsFile_getLatestPublication(pubFile, NULL, &latest);
+	CuAssert(tc, "Unable to get latest publication from the shared image.", res == KSI_OK && latest != NULL);
+	CuAssert(tc, "Publication records should be parsed.",
+			KSI_PublicationRecordList_length(pubFile->publications) == KSI_PublicationRecordList_length(privFile->publications));
+
+	KSI_PublicationRecord_free(privRec);
+	KSI_PublicationRecord_free(pubRec);
+	KSI_Integer_free(pubTime);
+	KSI_PublicationsFile_free(privFile);
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx);
+
+	clearPublicationsFileCache();
+}
+
 static void testReceivePublicationsFileInvalidPki(CuTest *tc) {
 	int res;
 	KSI_PublicationsFile *pubFile = NULL;
@@ -1038,6 +1414,11 @@ CuSuite* KSITest_Publicationsfile_getSuite(void) {
 	SUITE_ADD_TEST(suite, testGetLatestPublicationOfFuture);
 	SUITE_ADD_TEST(suite, testReceivePublicationsFileInvalidConstraints);
 	SUITE_ADD_TEST(suite, testReceivePublicationsFileInvalidPki);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileBackgroundRefresh);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileFromCache);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileFromCacheOtherTrust);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileFromCacheTampered);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileSharedImage);
 	SUITE_ADD_TEST(suite, testPublicationStringWithSupportedHashAlgs);
 
 	return suite;
@@ -27,6 +27,7 @@
 #include "../src/ksi/impl/ctx_impl.h"
 #include "../src/ksi/impl/net_impl.h"
 #include "../src/ksi/impl/signature_impl.h"
+#include "../src/ksi/impl/thread_impl.h"
 
 extern KSI_CTX *ctx;
 
@@ -279,6 +280,89 @@ static void testVerifySignatureWithUserPublication(CuTest *tc) {
 #undef TEST_SIGNATURE_FILE
 }
 
+#define TEST_THREAD_COUNT 4
+
+typedef struct SharedSignatureWorker_st {
+	KSI_Signature *sig;
+	KSI_PublicationData *pubData;
+	int expectOk;
+	int failed;
+} SharedSignatureWorker;
+
+static void sharedSignatureWorker(void *arg) {
+	SharedSignatureWorker *w = arg;
+	KSI_VerificationContext verifier;
+	KSI_PolicyVerificationResult *result = NULL;
+	int i;
+
+	for (i = 0; i < 50 && !w->failed; i++) {
+		KSI_VerificationContext_init(&verifier, ctx);
+		verifier.signature = KSI_Signature_ref(w->sig);
+		verifier.userPublication = w->pubData;
+
+		if (KSI_SignatureVerifier_verify(KSI_VERIFICATION_POLICY_GENERAL, &verifier, &result) != KSI_OK ||
+				(result->resultCode == KSI_VER_RES_OK) != w->expectOk) {
+			w->failed = 1;
+		}
+
+		KSI_PolicyVerificationResult_free(result);
+		result = NULL;
+		KSI_Signature_free(verifier.signature);
+		KSI_VerificationContext_clean(&verifier);
+	}
+}
+
+static void testVerifySharedSignatureThreads(CuTest *tc) {
+#define TEST_SIGNATURE_FILE "resource/tlv/ok-sig-2014-04-30.1-extended.ksig"
+
+	int res;
+	KSI_Signature *sig = NULL;
+	const char pubStr[] = "AAAAAA-CTOQBY-AAMJYH-XZPM6T-UO6U6V-2WJMHQ-EJMVXR-JEAGID-2OY7P5-XFFKYI-QIF2LG-YOV7SO";
+	const char pubStr_bad[] = "AAAAAA-CT5VGY-AAPUCF-L3EKCC-NRSX56-AXIDFL-VZJQK4-WDCPOE-3KIWGB-XGPPM3-O5BIMW-REOVR4";
+	KSI_PublicationData *pubData = NULL;
+	KSI_PublicationData *pubData_bad = NULL;
+	KSI_Thread threads[TEST_THREAD_COUNT];
+	SharedSignatureWorker workers[TEST_THREAD_COUNT];
+	size_t i;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_PublicationData_fromBase32(ctx, pubStr, &pubData);
+	CuAssert(tc, "Unable to parse publication string.", res == KSI_OK && pubData != NULL);
+
+	res = KSI_PublicationData_fromBase32(ctx, pubStr_bad, &pubData_bad);
+	CuAssert(tc, "Unable to parse publication string.", res == KSI_OK && pubData_bad != NULL);
+
+	res = KSI_Signature_fromFile(ctx, getFullResourcePath(TEST_SIGNATURE_FILE), &sig);
+	CuAssert(tc, "Unable to read signature from file.", res == KSI_OK && sig != NULL);
+
+	/* Half of the threads fail the verification to exercise the last failed signature of the context. */
+	for (i = 0; i < TEST_THREAD_COUNT; i++) {
+		workers[i].sig = sig;
+		workers[i].expectOk = (i % 2 == 0);
+		workers[i].pubData = workers[i].expectOk ? pubData : pubData_bad;
+		workers[i].failed = 0;
+
+		res = KSI_Thread_start(&threads[i], sharedSignatureWorker, &workers[i]);
+		CuAssert(tc, "Unable to start thread.", res == KSI_OK);
+	}
+
+	for (i = 0; i < TEST_THREAD_COUNT; i++) {
+		KSI_Thread_join(&threads[i]);
+		CuAssert(tc, "Unexpected verification result in thread.", !workers[i].failed);
+	}
+
+	CuAssert(tc, "Signature references not released.", sig->ref == 1 || sig->ref == 2);
+
+	KSI_PublicationData_free(pubData);
+	KSI_PublicationData_free(pubData_bad);
+	KSI_Signature_free(sig);
+
+#undef TEST_SIGNATURE_FILE
+}
+
+#undef TEST_THREAD_COUNT
+
 static void testVerifySignatureExtendedToHead(CuTest *tc) {
 #define TEST_SIGNATURE_FILE "resource/tlv/ok-sig-2014-04-30.1-head.ksig"
 #define TEST_EXT_RESPONSE_FILE "resource/tlv/" TEST_RESOURCE_EXT_VER "/ok-sig-2014-04-30.1-head-extend_response.tlv"
@@ -1036,6 +1120,7 @@ CuSuite* KSITest_Signature_getSuite(void) {
 	SUITE_ADD_TEST(suite, testVerifySignatureNew);
 	SUITE_ADD_TEST(suite, testVerifySignatureWithPublication);
 	SUITE_ADD_TEST(suite, testVerifySignatureWithUserPublication);
+	SUITE_ADD_TEST(suite, testVerifySharedSignatureThreads);
 	SUITE_ADD_TEST(suite, testVerifySignatureExtendedToHead);
 	SUITE_ADD_TEST(suite, testVerifyLegacySignatureAndDoc);
 	SUITE_ADD_TEST(suite, testVerifyLegacyExtendedSignatureAndDoc);
@@ -320,6 +320,51 @@ static void aggregationPduVer2Test(CuTest *tc) {
 	ctx->options[KSI_OPT_AGGR_PDU_VER] = KSI_AGGREGATION_PDU_VERSION;
 }
 
+static void aggregationPduVer2MultiPayloadTest(CuTest *tc) {
+	int res;
+	unsigned char in[0xffff + 4];
+	size_t in_len = 0;
+	unsigned char *out = NULL;
+	size_t out_len = 0;
+	FILE *f = NULL;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_AggregationPdu *tmp = NULL;
+	KSI_AggregationResp *resp = NULL;
+	KSI_LIST(KSI_AggregationResp) *respList = NULL;
+
+	ctx->options[KSI_OPT_AGGR_PDU_VER] = KSI_PDU_VERSION_2;
+
+	f = fopen(getFullResourcePath("resource/tlv/v2/ok-sig-2014-07-01.1-aggr_response-multi-payload.tlv"), "rb");
+	CuAssert(tc, "Unable to open pdu file.", f != NULL);
+
+	in_len = fread(in, 1, sizeof(in), f);
+	fclose(f);
+	CuAssert(tc, "Unable to read pdu file.", in_len > 0);
+
+	res = KSI_AggregationPdu_parse(ctx, in, in_len, &pdu);
+	CuAssert(tc, "Unable to parse pdu.", res == KSI_OK && pdu != NULL);
+
+	res = KSI_AggregationPdu_getResponse(pdu, &resp);
+	CuAssert(tc, "Multi-payload pdu should not have a single response.", res == KSI_OK && resp == NULL);
+
+	res = KSI_AggregationPdu_getResponseList(pdu, &respList);
+	CuAssert(tc, "Multi-payload pdu response count mismatch.", res == KSI_OK && KSI_AggregationRespList_length(respList) == 2);
+
+	res = KSI_AggregationPdu_serialize(pdu, &out, &out_len);
+	CuAssert(tc, "Unable to serialize pdu.", res == KSI_OK && out != NULL && out_len == in_len);
+
+	res = KSI_AggregationPdu_parse(ctx, out, out_len, &tmp);
+	CuAssert(tc, "Unable to parse serialized pdu.", res == KSI_OK && tmp != NULL);
+
+	res = KSI_AggregationPdu_getResponseList(tmp, &respList);
+	CuAssert(tc, "Serialized pdu response count mismatch.", res == KSI_OK && KSI_AggregationRespList_length(respList) == 2);
+
+	KSI_free(out);
+	KSI_AggregationPdu_free(pdu);
+	KSI_AggregationPdu_free(tmp);
+	ctx->options[KSI_OPT_AGGR_PDU_VER] = KSI_AGGREGATION_PDU_VERSION;
+}
+
 static void extendPduVer2Test(CuTest *tc) {
 	ctx->options[KSI_OPT_EXT_PDU_VER] = KSI_PDU_VERSION_2;
 	testObjectSerialization(tc, getFullResourcePath("resource/tlv/v2/extend_request.tlv"),
@@ -395,6 +440,7 @@ CuSuite* KSITest_TLV_Sample_getSuite(void)
 	SUITE_ADD_TEST(suite, TestSerialize);
 	SUITE_ADD_TEST(suite, TestClone);
 	SUITE_ADD_TEST(suite, aggregationPduVer2Test);
+	SUITE_ADD_TEST(suite, aggregationPduVer2MultiPayloadTest);
 	SUITE_ADD_TEST(suite, extendPduVer2Test);
 	SUITE_ADD_TEST(suite, testUnknownCriticalTagErrorPduVer2);
 	SUITE_ADD_TEST(suite, testMissingMandatoryTagErrorPduVer2);
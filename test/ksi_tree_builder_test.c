@@ -25,6 +25,7 @@
 
 #include <ksi/tree_builder.h>
 #include <ksi/hashchain.h>
+#include <ksi/executor.h>
 
 extern KSI_CTX *ctx;
 
@@ -127,6 +128,272 @@ static void testGetAggregationChain(CuTest* tc) {
 	KSI_TreeBuilder_free(builder);
 }
 
+static void testAddDataHashesParallel(CuTest *tc) {
+#define TEST_LEAF_COUNT 300
+	int res;
+	KSI_CTX *pctx = NULL;
+	KSI_Executor *exec = NULL;
+	KSI_TreeBuilder *seq = NULL;
+	KSI_TreeBuilder *par = NULL;
+	KSI_DataHash *hsh[TEST_LEAF_COUNT];
+	KSI_TreeLeafHandle *handles[TEST_LEAF_COUNT];
+	KSI_AggregationHashChain *chn = NULL;
+	KSI_DataHash *tmp = NULL;
+	char buf[32];
+	size_t i;
+
+	res = KSITest_CTX_clone(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	res = KSI_Executor_new(pctx, 3, &exec);
+	CuAssert(tc, "Unable to create executor.", res == KSI_OK && exec != NULL);
+
+	res = KSI_CTX_setExecutor(pctx, exec);
+	CuAssert(tc, "Unable to set executor.", res == KSI_OK);
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		KSI_snprintf(buf, sizeof(buf), "leaf %u", (unsigned)i);
+		res = KSI_DataHash_create(pctx, buf, strlen(buf), KSI_HASHALG_SHA2_256, &hsh[i]);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh[i] != NULL);
+	}
+
+	res = KSI_TreeBuilder_new(pctx, KSI_HASHALG_SHA2_256, &seq);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && seq != NULL);
+
+	res = KSI_TreeBuilder_new(pctx, KSI_HASHALG_SHA2_256, &par);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && par != NULL);
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		res = KSI_TreeBuilder_addDataHash(seq, hsh[i], 0, NULL);
+		CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+	}
+
+	/* Start with an unaligned stack, the batch has to fill it up leaf by leaf. */
+	res = KSI_TreeBuilder_addDataHashes(par, hsh, 3, 0, handles);
+	CuAssert(tc, "Unable to add data hashes to the tree builder.", res == KSI_OK);
+
+	res = KSI_TreeBuilder_addDataHashes(par, hsh + 3, TEST_LEAF_COUNT - 3, 0, handles + 3);
+	CuAssert(tc, "Unable to add data hashes to the tree builder.", res == KSI_OK);
+
+	res = KSI_TreeBuilder_close(seq);
+	CuAssert(tc, "Unable to close a valid builder.", res == KSI_OK);
+
+	res = KSI_TreeBuilder_close(par);
+	CuAssert(tc, "Unable to close a valid builder.", res == KSI_OK);
+
+	CuAssert(tc, "Root hashes mismatch.", KSI_DataHash_equals(seq->rootNode->hash, par->rootNode->hash));
+	CuAssert(tc, "Root levels mismatch.", seq->rootNode->level == par->rootNode->level);
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		res = KSI_TreeLeafHandle_getAggregationChain(handles[i], &chn);
+		CuAssert(tc, "Unable to extract aggregation chain.", res == KSI_OK && chn != NULL);
+
+		res = KSI_AggregationHashChain_aggregate(chn, 0, NULL, &tmp);
+		CuAssert(tc, "Unable to aggregate the aggregation hash chain.", res == KSI_OK && tmp != NULL);
+		CuAssert(tc, "Leaf does not aggregate to the root hash.", KSI_DataHash_equals(seq->rootNode->hash, tmp));
+
+		KSI_DataHash_free(tmp);
+		tmp = NULL;
+		KSI_AggregationHashChain_free(chn);
+		chn = NULL;
+		KSI_TreeLeafHandle_free(handles[i]);
+	}
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		KSI_DataHash_free(hsh[i]);
+	}
+	KSI_TreeBuilder_free(seq);
+	KSI_TreeBuilder_free(par);
+	KSI_CTX_free(pctx);
+#undef TEST_LEAF_COUNT
+}
+
+static void testPipelined(CuTest *tc) {
+#define TEST_LEAF_COUNT 3000
+	int res;
+	KSI_TreeBuilder *seq = NULL;
+	KSI_TreeBuilder *pip = NULL;
+	KSI_DataHash *hsh[TEST_LEAF_COUNT];
+	KSI_TreeLeafHandle *handles[TEST_LEAF_COUNT];
+	KSI_AggregationHashChain *chn = NULL;
+	KSI_DataHash *tmp = NULL;
+	char buf[32];
+	size_t i;
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		KSI_snprintf(buf, sizeof(buf), "leaf %u", (unsigned)i);
+		res = KSI_DataHash_create(ctx, buf, strlen(buf), KSI_HASHALG_SHA2_256, &hsh[i]);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh[i] != NULL);
+	}
+
+	res = KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &seq);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && seq != NULL);
+
+	res = KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &pip);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && pip != NULL);
+
+	/* Start the pipeline with a non-empty stack. */
+	for (i = 0; i < 3; i++) {
+		res = KSI_TreeBuilder_addDataHash(seq, hsh[i], (int)(i % 3), NULL);
+		CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+
+		res = KSI_TreeBuilder_addDataHash(pip, hsh[i], (int)(i % 3), &handles[i]);
+		CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+	}
+
+	res = KSI_TreeBuilder_setPipelined(pip, 1);
+	CuAssert(tc, "Unable to enable the pipeline.", res == KSI_OK && pip->pipeline != NULL);
+
+	/* More leaves than the queue holds. */
+	for (i = 3; i < TEST_LEAF_COUNT; i++) {
+		res = KSI_TreeBuilder_addDataHash(seq, hsh[i], (int)(i % 3), NULL);
+		CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+
+		res = KSI_TreeBuilder_addDataHash(pip, hsh[i], (int)(i % 3), &handles[i]);
+		CuAssert(tc, "Unable to add data hash to the pipelined tree builder.", res == KSI_OK);
+	}
+
+	res = KSI_TreeBuilder_close(seq);
+	CuAssert(tc, "Unable to close a valid builder.", res == KSI_OK);
+
+	res = KSI_TreeBuilder_close(pip);
+	CuAssert(tc, "Unable to close a pipelined builder.", res == KSI_OK && pip->pipeline == NULL);
+
+	CuAssert(tc, "Root hashes mismatch.", KSI_DataHash_equals(seq->rootNode->hash, pip->rootNode->hash));
+	CuAssert(tc, "Root levels mismatch.", seq->rootNode->level == pip->rootNode->level);
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		res = KSI_TreeLeafHandle_getAggregationChain(handles[i], &chn);
+		CuAssert(tc, "Unable to extract aggregation chain.", res == KSI_OK && chn != NULL);
+
+		res = KSI_AggregationHashChain_aggregate(chn, (int)(i % 3), NULL, &tmp);
+		CuAssert(tc, "Unable to aggregate the aggregation hash chain.", res == KSI_OK && tmp != NULL);
+		CuAssert(tc, "Leaf does not aggregate to the root hash.", KSI_DataHash_equals(seq->rootNode->hash, tmp));
+
+		KSI_DataHash_free(tmp);
+		tmp = NULL;
+		KSI_AggregationHashChain_free(chn);
+		chn = NULL;
+		KSI_TreeLeafHandle_free(handles[i]);
+	}
+
+	for (i = 0; i < TEST_LEAF_COUNT; i++) {
+		KSI_DataHash_free(hsh[i]);
+	}
+	KSI_TreeBuilder_free(seq);
+	KSI_TreeBuilder_free(pip);
+#undef TEST_LEAF_COUNT
+}
+
+static void testPipelinedMaxTreeLevel(CuTest *tc) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	KSI_DataHash *hsh = NULL;
+	int i;
+
+	KSITest_DataHash_fromStr(ctx, "0168a0d7327ae5d25da38fbb903b73903e9db33cf52345a940a467134f3e81128e", &hsh);
+	KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &builder);
+
+	builder->maxTreeLevel = 3;
+	res = KSI_TreeBuilder_setPipelined(builder, 1);
+	CuAssert(tc, "Unable to enable the pipeline.", res == KSI_OK);
+
+	for (i = 0; i < 8; i++) {
+		res = KSI_TreeBuilder_addDataHash(builder, hsh, 0, NULL);
+		CuAssert(tc, "Unable to add data hash.", res == KSI_OK);
+	}
+
+	/* The limit is checked before the queued leaves have been inserted. */
+	res = KSI_TreeBuilder_addDataHash(builder, hsh, 0, NULL);
+	CuAssert(tc, "Adding yet another hash should not succeed.", res == KSI_BUFFER_OVERFLOW);
+
+	res = KSI_TreeBuilder_close(builder);
+	CuAssert(tc, "Closing the builder should not fail", res == KSI_OK);
+
+	CuAssert(tc, "The root hash node must have a level value equal to the max level.", (short)builder->rootNode->level == builder->maxTreeLevel);
+
+	KSI_TreeBuilder_free(builder);
+	KSI_DataHash_free(hsh);
+}
+
+static void testPipelinedFreeBeforeClose(CuTest *tc) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	KSI_DataHash *hsh = NULL;
+	int i;
+
+	KSITest_DataHash_fromStr(ctx, "0168a0d7327ae5d25da38fbb903b73903e9db33cf52345a940a467134f3e81128e", &hsh);
+	KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &builder);
+
+	res = KSI_TreeBuilder_setPipelined(builder, 1);
+	CuAssert(tc, "Unable to enable the pipeline.", res == KSI_OK);
+
+	for (i = 0; i < 100; i++) {
+		res = KSI_TreeBuilder_addDataHash(builder, hsh, 0, NULL);
+		CuAssert(tc, "Unable to add data hash.", res == KSI_OK);
+	}
+
+	/* Stops the aggregation thread. */
+	KSI_TreeBuilder_free(builder);
+	KSI_DataHash_free(hsh);
+}
+
+static int prependNode(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
+	(void)in;
+	return KSI_TreeNode_new(ctx, (KSI_DataHash *)c, NULL, 0, out);
+}
+
+static int checkNodeHash(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
+	int res;
+	KSI_DataHash *hsh = NULL;
+
+	*out = NULL;
+
+	res = KSI_TreeNode_getHash(in, &hsh);
+	if (res != KSI_OK) return res;
+
+	if (in->hash != NULL && KSI_DataHash_equals(in->hash, hsh)) ++*(size_t *)c;
+
+	KSI_DataHash_free(hsh);
+	return KSI_OK;
+}
+
+static void testLeafProcessorNodeHash(CuTest *tc) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_TreeBuilderLeafProcessor prepend;
+	KSI_TreeBuilderLeafProcessor check;
+	size_t count = 0;
+	int i;
+
+	KSITest_DataHash_fromStr(ctx, "0168a0d7327ae5d25da38fbb903b73903e9db33cf52345a940a467134f3e81128e", &hsh);
+
+	res = KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &builder);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && builder != NULL);
+
+	prepend.fn = prependNode;
+	prepend.c = hsh;
+	check.fn = checkNodeHash;
+	check.c = &count;
+
+	/* The second processor gets the node joined after the first one. */
+	res = KSI_TreeBuilderLeafProcessorList_append(builder->cbList, &prepend);
+	CuAssert(tc, "Unable to add leaf processor.", res == KSI_OK);
+	res = KSI_TreeBuilderLeafProcessorList_append(builder->cbList, &check);
+	CuAssert(tc, "Unable to add leaf processor.", res == KSI_OK);
+
+	for (i = 0; i < 4; i++) {
+		res = KSI_TreeBuilder_addDataHash(builder, hsh, 0, NULL);
+		CuAssert(tc, "Unable to add data hash.", res == KSI_OK);
+	}
+
+	CuAssert(tc, "Joined node handed to a leaf processor has no hash object.", count == 4);
+
+	KSI_TreeBuilder_free(builder);
+	KSI_DataHash_free(hsh);
+}
+
 static void testMaxTreeLevelt1(CuTest *tc) {
 	int res;
 	KSI_TreeBuilder *builder = NULL;
@@ -325,6 +592,11 @@ CuSuite* KSITest_TreeBuilder_getSuite(void)
 	SUITE_ADD_TEST(suite, testCreateTreeBuilder);
 	SUITE_ADD_TEST(suite, testTreeBuilderAddLeafs);
 	SUITE_ADD_TEST(suite, testGetAggregationChain);
+	SUITE_ADD_TEST(suite, testAddDataHashesParallel);
+	SUITE_ADD_TEST(suite, testPipelined);
+	SUITE_ADD_TEST(suite, testPipelinedMaxTreeLevel);
+	SUITE_ADD_TEST(suite, testPipelinedFreeBeforeClose);
+	SUITE_ADD_TEST(suite, testLeafProcessorNodeHash);
 	SUITE_ADD_TEST(suite, testMaxTreeLevelt1);
 	SUITE_ADD_TEST(suite, testMaxTreeLevelWithAbove0Level);
 	SUITE_ADD_TEST(suite, testMaxTreeLevelWithFullTree);
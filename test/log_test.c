@@ -21,6 +21,7 @@
 #include "cutest/CuTest.h"
 #include "all_tests.h"
 
+#include <string.h>
 #include <ksi/tlv.h>
 
 extern KSI_CTX *ctx;
@@ -545,6 +546,102 @@ static void TestLogCtxErrorWithErrorLevelAndCtxNull(CuTest *tc) {
 	CuAssert(tc, "CTX Error logging should be successful with error level.", res == KSI_OK);
 }
 
+static void TestLogIsEnabled(CuTest *tc) {
+	int res;
+	KSI_CTX *pctx = NULL;
+
+	res = KSI_CTX_new(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	CuAssert(tc, "Logging must be disabled for null context.", !KSI_LOG_isEnabled(NULL, KSI_LOG_ERROR));
+
+	res = KSI_CTX_setLoggerCallback(pctx, NULL, NULL);
+	CuAssert(tc, "Unable to clear logger callback.", res == KSI_OK);
+	KSI_CTX_setLogLevel(pctx, KSI_LOG_DEBUG);
+	CuAssert(tc, "Logging must be disabled without a callback.", !KSI_LOG_isEnabled(pctx, KSI_LOG_ERROR));
+
+	res = KSI_CTX_setLoggerCallback(pctx, KSI_LOG_StreamLogger, NULL);
+	CuAssert(tc, "Unable to set logger callback.", res == KSI_OK);
+	KSI_CTX_setLogLevel(pctx, KSI_LOG_NOTICE);
+	CuAssert(tc, "Notice level must be enabled.", KSI_LOG_isEnabled(pctx, KSI_LOG_NOTICE));
+	CuAssert(tc, "Info level must be disabled.", !KSI_LOG_isEnabled(pctx, KSI_LOG_INFO));
+
+	KSI_CTX_free(pctx);
+}
+
+typedef struct RingReadCtx_st {
+	KSI_uint64_t lastSeq;
+	size_t count;
+	int ordered;
+	int lastLevel;
+	char lastMessage[KSI_LOG_RING_MESSAGE_LEN];
+} RingReadCtx;
+
+static int ringReader(void *c, KSI_uint64_t seq, KSI_uint64_t KSI_UNUSED(time), int level, const char *message) {
+	RingReadCtx *r = c;
+
+	if (seq <= r->lastSeq) r->ordered = 0;
+	r->lastSeq = seq;
+	r->count++;
+	r->lastLevel = level;
+	strncpy(r->lastMessage, message, sizeof(r->lastMessage) - 1);
+
+	return KSI_OK;
+}
+
+static void TestLogRingBuffer(CuTest *tc) {
+	int res;
+	KSI_CTX *pctx = NULL;
+	KSI_LOG_RingBuffer *ring = NULL;
+	RingReadCtx readCtx;
+	char longMessage[1024];
+	int i;
+
+	res = KSI_CTX_new(&pctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && pctx != NULL);
+
+	/* Rounded up to 8 records. */
+	res = KSI_LOG_RingBuffer_new(pctx, 5, &ring);
+	CuAssert(tc, "Unable to create ring buffer.", res == KSI_OK && ring != NULL);
+
+	res = KSI_CTX_setLoggerCallback(pctx, KSI_LOG_RingBufferLogger, ring);
+	CuAssert(tc, "Unable to set logger callback.", res == KSI_OK);
+	KSI_CTX_setLogLevel(pctx, KSI_LOG_INFO);
+
+	for (i = 0; i < 20; i++) {
+		res = KSI_LOG_info(pctx, "Message %d", i);
+		CuAssert(tc, "Unable to log message.", res == KSI_OK);
+	}
+
+	/* Disabled level must not reach the ring buffer. */
+	res = KSI_LOG_debug(pctx, "Debug message");
+	CuAssert(tc, "Unable to log message.", res == KSI_OK);
+
+	memset(&readCtx, 0, sizeof(readCtx));
+	readCtx.ordered = 1;
+
+	res = KSI_LOG_RingBuffer_read(ring, ringReader, &readCtx);
+	CuAssert(tc, "Unable to read ring buffer.", res == KSI_OK);
+	CuAssert(tc, "Only the newest records must be kept.", readCtx.count == 8 && readCtx.lastSeq == 20);
+	CuAssert(tc, "Records must be read oldest first.", readCtx.ordered);
+	CuAssert(tc, "Unexpected last record.", readCtx.lastLevel == KSI_LOG_INFO && strcmp(readCtx.lastMessage, "Message 19") == 0);
+	CuAssert(tc, "No messages should be dropped.", KSI_LOG_RingBuffer_getDropped(ring) == 0);
+
+	/* Long messages are truncated. */
+	memset(longMessage, 'a', sizeof(longMessage) - 1);
+	longMessage[sizeof(longMessage) - 1] = '\0';
+	res = KSI_LOG_error(pctx, "%s", longMessage);
+	CuAssert(tc, "Unable to log message.", res == KSI_OK);
+
+	memset(&readCtx, 0, sizeof(readCtx));
+	res = KSI_LOG_RingBuffer_read(ring, ringReader, &readCtx);
+	CuAssert(tc, "Unable to read ring buffer.", res == KSI_OK);
+	CuAssert(tc, "Long message not truncated.", readCtx.lastLevel == KSI_LOG_ERROR && strlen(readCtx.lastMessage) == KSI_LOG_RING_MESSAGE_LEN - 1);
+
+	KSI_CTX_free(pctx);
+	KSI_LOG_RingBuffer_free(ring);
+}
+
 CuSuite* KSITest_Log_getSuite(void)
 {
 	CuSuite* suite = CuSuiteNew();
@@ -599,6 +696,8 @@ CuSuite* KSITest_Log_getSuite(void)
 	SUITE_ADD_TEST(suite, TestLogCtxErrorWithNoticeLevelAndCtxNull);
 	SUITE_ADD_TEST(suite, TestLogCtxErrorWithWarnLevelAndCtxNull);
 	SUITE_ADD_TEST(suite, TestLogCtxErrorWithErrorLevelAndCtxNull);
+	SUITE_ADD_TEST(suite, TestLogIsEnabled);
+	SUITE_ADD_TEST(suite, TestLogRingBuffer);
 
 	return suite;
 }
@@ -0,0 +1,1802 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+/**
+ * A stand-in for the aggregator and the extender, for load testing the network clients on one host.
+ *
+ * Usage: loopback-server [-t <port>] [-h <port>] [-u <user>] [-k <key>] [-r <ms>] [-l <ms>] [-e <percent>] [-c <ms>] [-q <count>]
+ *
+ * The aggregation and extension PDUs (v2) are accepted both over plain TCP and as HTTP POST bodies, the
+ * service is chosen by the type of the PDU. The aggregation requests are collected into rounds, the tree
+ * of every round is built with #KSI_TreeBuilder and its root is appended to an in-memory calendar. The
+ * extension requests are answered from the same calendar, thus the signatures created by the server can
+ * also be extended by it. The calendar leaves before the first round are zero hashes.
+ *
+ * The endpoint URIs are printed to the standard output when the server is ready.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <ksi/ksi.h>
+#include <ksi/hashchain.h>
+#include <ksi/tree_builder.h>
+
+#define DEFAULT_USER "anon"
+#define DEFAULT_KEY "anon"
+
+/** Length of a SHA-256 imprint. */
+#define IMPRINT_LEN 33
+
+/** Number of the subtree heights kept by the calendar. */
+#define CAL_HEIGHTS 64
+
+/** Largest HTTP request header accepted. */
+#define HTTP_MAX_HEADER 0x4000
+
+/** Status codes of the responses. */
+#define STATUS_OK 0x0000
+#define STATUS_INVALID_REQUEST 0x0101
+#define STATUS_AUTHENTICATION_FAILURE 0x0102
+#define STATUS_TIME_TOO_OLD 0x0105
+#define STATUS_TIME_TOO_NEW 0x0106
+#define STATUS_TIME_IN_FUTURE 0x0107
+#define STATUS_INTERNAL_ERROR 0x0200
+#define STATUS_UPSTREAM_ERROR 0x0300
+
+enum {
+	SERVICE_UNKNOWN = 0,
+	SERVICE_AGGREGATOR,
+	SERVICE_EXTENDER
+};
+
+enum {
+	LISTENER_TCP = 0,
+	LISTENER_HTTP,
+	NUMBER_OF_LISTENERS
+};
+
+typedef struct CalendarNode_st {
+	unsigned char imprint[IMPRINT_LEN];
+} CalendarNode;
+
+/**
+ * Append-only calendar with one leaf per second. Only the roots of the complete aligned subtrees
+ * containing the leaves since the first one are stored, all the other subtrees consist of zero leaves.
+ */
+typedef struct Calendar_st {
+	KSI_CTX *ksi;
+	/** Time of the first leaf. */
+	KSI_uint64_t first;
+	/** Number of the leaves since the first one. */
+	KSI_uint64_t count;
+	/** Roots of the complete subtrees by height, starting from the one containing the first leaf. */
+	CalendarNode *nodes[CAL_HEIGHTS];
+	size_t len[CAL_HEIGHTS];
+	size_t size[CAL_HEIGHTS];
+	/** Roots of the complete subtrees of zero leaves by height. */
+	CalendarNode empty[CAL_HEIGHTS];
+} Calendar;
+
+typedef struct Connection_st Connection;
+
+struct Connection_st {
+	int fd;
+	int http;
+	int service;
+	KSI_HashAlgorithm hmacAlgo;
+	unsigned char *in;
+	size_t inLen;
+	size_t inSize;
+	unsigned char *out;
+	size_t outLen;
+	size_t outSize;
+	size_t outPos;
+	/** Number of the requests of the current HTTP request not answered yet. */
+	size_t waiting;
+	/** Answers to the current HTTP request. */
+	KSI_LIST(KSI_AggregationResp) *aggrResp;
+	KSI_ExtendResp *extResp;
+	/** The configuration is sent with the next HTTP response. */
+	int confDue;
+	Connection *next;
+};
+
+/** Aggregation request waiting for the end of the round. */
+typedef struct Pending_st {
+	Connection *conn;
+	KSI_Integer *reqId;
+	KSI_DataHash *hash;
+	int level;
+} Pending;
+
+/** Response waiting for the configured latency. */
+typedef struct Outgoing_st Outgoing;
+
+struct Outgoing_st {
+	Connection *conn;
+	KSI_uint64_t due;
+	KSI_AggregationResp *aggrResp;
+	KSI_ExtendResp *extResp;
+	Outgoing *next;
+};
+
+typedef struct Server_st {
+	KSI_CTX *ksi;
+	const char *user;
+	const char *key;
+	unsigned roundMs;
+	unsigned latencyMs;
+	unsigned confMs;
+	unsigned maxRequests;
+	double errorRate;
+	int listenFd[NUMBER_OF_LISTENERS];
+	Connection *conns;
+	Pending *pending;
+	size_t pendingCount;
+	size_t pendingSize;
+	Outgoing *outHead;
+	Outgoing *outTail;
+	/** Monotonic time of the end of the current round, valid if there are pending requests. */
+	KSI_uint64_t roundAt;
+	/** Monotonic time of the next configuration push. */
+	KSI_uint64_t confAt;
+	Calendar cal;
+	unsigned long long aggrCount;
+	unsigned long long extCount;
+	unsigned long long roundCount;
+	unsigned long long errorCount;
+} Server;
+
+static volatile sig_atomic_t stopped = 0;
+
+static void onSignal(int sig) {
+	(void)sig;
+	stopped = 1;
+}
+
+static KSI_uint64_t nowMs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (KSI_uint64_t)ts.tv_sec * 1000 + (KSI_uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int ensureSize(unsigned char **buf, size_t *size, size_t need) {
+	unsigned char *tmp;
+	size_t newSize = *size != 0 ? *size : 0x1000;
+
+	if (need <= *size) return KSI_OK;
+	while (newSize < need) newSize *= 2;
+
+	tmp = realloc(*buf, newSize);
+	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+
+	*buf = tmp;
+	*size = newSize;
+
+	return KSI_OK;
+}
+
+/* Calendar. */
+
+static int Calendar_hash(Calendar *cal, const CalendarNode *left, const CalendarNode *right, CalendarNode *out) {
+	int res;
+	unsigned char buf[2 * IMPRINT_LEN + 1];
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	memcpy(buf, left->imprint, IMPRINT_LEN);
+	memcpy(buf + IMPRINT_LEN, right->imprint, IMPRINT_LEN);
+	buf[2 * IMPRINT_LEN] = 0xff;
+
+	res = KSI_DataHash_create(cal->ksi, buf, sizeof(buf), KSI_HASHALG_SHA2_256, &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	memcpy(out->imprint, imprint, IMPRINT_LEN);
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+static int Calendar_init(Calendar *cal, KSI_CTX *ksi) {
+	int res = KSI_OK;
+	size_t k;
+
+	memset(cal, 0, sizeof(*cal));
+	cal->ksi = ksi;
+
+	cal->empty[0].imprint[0] = KSI_HASHALG_SHA2_256;
+	for (k = 1; k < CAL_HEIGHTS && res == KSI_OK; k++) {
+		res = Calendar_hash(cal, &cal->empty[k - 1], &cal->empty[k - 1], &cal->empty[k]);
+	}
+
+	return res;
+}
+
+static void Calendar_clean(Calendar *cal) {
+	size_t k;
+
+	for (k = 0; k < CAL_HEIGHTS; k++) free(cal->nodes[k]);
+}
+
+static KSI_uint64_t Calendar_last(const Calendar *cal) {
+	return cal->first + cal->count - 1;
+}
+
+/* Root of the aligned complete subtree of height k with the index j. */
+static const CalendarNode *Calendar_node(const Calendar *cal, size_t k, KSI_uint64_t j) {
+	KSI_uint64_t start = j << k;
+
+	if (cal->count == 0 || start + (((KSI_uint64_t)1 << k) - 1) < cal->first) return &cal->empty[k];
+	return &cal->nodes[k][j - (cal->first >> k)];
+}
+
+static int Calendar_push(Calendar *cal, size_t k, const CalendarNode *node) {
+	if (cal->len[k] == cal->size[k]) {
+		size_t size = cal->size[k] != 0 ? 2 * cal->size[k] : 64;
+		CalendarNode *tmp = realloc(cal->nodes[k], size * sizeof(CalendarNode));
+
+		if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+		cal->nodes[k] = tmp;
+		cal->size[k] = size;
+	}
+	cal->nodes[k][cal->len[k]++] = *node;
+
+	return KSI_OK;
+}
+
+/* Appends the next leaf and the roots of the subtrees completed by it. */
+static int Calendar_append(Calendar *cal, const CalendarNode *leaf) {
+	int res;
+	KSI_uint64_t t = cal->first + cal->count;
+	size_t k;
+
+	res = Calendar_push(cal, 0, leaf);
+	if (res != KSI_OK) return res;
+	cal->count++;
+
+	for (k = 1; k < CAL_HEIGHTS && ((t + 1) & (((KSI_uint64_t)1 << k) - 1)) == 0; k++) {
+		KSI_uint64_t j = t >> k;
+		CalendarNode node;
+
+		res = Calendar_hash(cal, Calendar_node(cal, k - 1, 2 * j), Calendar_node(cal, k - 1, 2 * j + 1), &node);
+		if (res != KSI_OK) return res;
+
+		res = Calendar_push(cal, k, &node);
+		if (res != KSI_OK) return res;
+	}
+
+	return KSI_OK;
+}
+
+/* Appends the leaf at the given time, the seconds without a round get zero leaves. */
+static int Calendar_add(Calendar *cal, KSI_uint64_t t, const CalendarNode *leaf) {
+	int res;
+
+	if (cal->count == 0) cal->first = t;
+
+	while (cal->first + cal->count < t) {
+		res = Calendar_append(cal, &cal->empty[0]);
+		if (res != KSI_OK) return res;
+	}
+
+	return Calendar_append(cal, leaf);
+}
+
+static KSI_uint64_t highBit(KSI_uint64_t n) {
+	n |= (n >> 1);
+	n |= (n >> 2);
+	n |= (n >> 4);
+	n |= (n >> 8);
+	n |= (n >> 16);
+	n |= (n >> 32);
+	return n - (n >> 1);
+}
+
+static size_t heightOf(KSI_uint64_t pow2) {
+	size_t k = 0;
+
+	while (pow2 > 1) {
+		pow2 >>= 1;
+		k++;
+	}
+
+	return k;
+}
+
+/* Root of the subtree of the leaves from off to off + r, the calendar tree shape is the one assumed by the
+ * aggregation time calculation: the left subtree is complete and as large as possible. */
+static int Calendar_root(Calendar *cal, KSI_uint64_t off, KSI_uint64_t r, CalendarNode *out) {
+	int res;
+	KSI_uint64_t hb;
+	size_t k;
+	CalendarNode right;
+
+	if (((r + 1) & r) == 0) {
+		k = heightOf(r + 1);
+		*out = *Calendar_node(cal, k, off >> k);
+		return KSI_OK;
+	}
+
+	hb = highBit(r);
+	k = heightOf(hb);
+
+	res = Calendar_root(cal, off + hb, r - hb, &right);
+	if (res != KSI_OK) return res;
+
+	return Calendar_hash(cal, Calendar_node(cal, k, off >> k), &right, out);
+}
+
+static int newImprintHash(KSI_CTX *ksi, const CalendarNode *node, KSI_DataHash **hsh) {
+	return KSI_DataHash_fromImprint(ksi, node->imprint, IMPRINT_LEN, hsh);
+}
+
+/* Hash chain from the leaf at the aggregation time to the root of the calendar at the publication time. */
+static int Calendar_getChain(Calendar *cal, KSI_uint64_t aggrTime, KSI_uint64_t pubTime, KSI_CalendarHashChain **chain) {
+	int res;
+	CalendarNode siblings[CAL_HEIGHTS];
+	int isLeft[CAL_HEIGHTS];
+	size_t count = 0;
+	KSI_uint64_t off = 0;
+	KSI_uint64_t r = pubTime;
+	KSI_CalendarHashChain *tmp = NULL;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+	KSI_HashChainLink *link = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_Integer *time = NULL;
+
+	/* Collect the links from the root downwards. */
+	while (r > 0) {
+		KSI_uint64_t hb = highBit(r);
+		size_t k = heightOf(hb);
+
+		if (aggrTime < off + hb) {
+			res = Calendar_root(cal, off + hb, r - hb, &siblings[count]);
+			if (res != KSI_OK) goto cleanup;
+			isLeft[count++] = 1;
+			r = hb - 1;
+		} else {
+			siblings[count] = *Calendar_node(cal, k, off >> k);
+			isLeft[count++] = 0;
+			off += hb;
+			r -= hb;
+		}
+	}
+
+	res = KSI_HashChainLinkList_new(&links);
+	if (res != KSI_OK) goto cleanup;
+
+	while (count > 0) {
+		count--;
+
+		res = KSI_HashChainLink_new(cal->ksi, &link);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_HashChainLink_setIsLeft(link, isLeft[count]);
+		if (res != KSI_OK) goto cleanup;
+
+		res = newImprintHash(cal->ksi, &siblings[count], &hsh);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_HashChainLink_setImprint(link, hsh);
+		if (res != KSI_OK) goto cleanup;
+		hsh = NULL;
+
+		res = KSI_HashChainLinkList_append(links, link);
+		if (res != KSI_OK) goto cleanup;
+		link = NULL;
+	}
+
+	res = KSI_CalendarHashChain_new(cal->ksi, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_setHashChain(tmp, links);
+	if (res != KSI_OK) goto cleanup;
+	links = NULL;
+
+	res = newImprintHash(cal->ksi, Calendar_node(cal, 0, aggrTime), &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_setInputHash(tmp, hsh);
+	if (res != KSI_OK) goto cleanup;
+	hsh = NULL;
+
+	res = KSI_Integer_new(cal->ksi, pubTime, &time);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_setPublicationTime(tmp, time);
+	if (res != KSI_OK) goto cleanup;
+	time = NULL;
+
+	res = KSI_Integer_new(cal->ksi, aggrTime, &time);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_setAggregationTime(tmp, time);
+	if (res != KSI_OK) goto cleanup;
+	time = NULL;
+
+	*chain = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(time);
+	KSI_DataHash_free(hsh);
+	KSI_HashChainLink_free(link);
+	KSI_HashChainLinkList_free(links);
+	KSI_CalendarHashChain_free(tmp);
+
+	return res;
+}
+
+/* Connections. */
+
+static int Connection_write(Connection *c, const unsigned char *data, size_t len) {
+	int res;
+
+	res = ensureSize(&c->out, &c->outSize, c->outLen + len);
+	if (res != KSI_OK) return res;
+
+	memcpy(c->out + c->outLen, data, len);
+	c->outLen += len;
+
+	return KSI_OK;
+}
+
+static int Connection_writeStr(Connection *c, const char *str) {
+	return Connection_write(c, (const unsigned char *)str, strlen(str));
+}
+
+/* Queues a serialized PDU, over HTTP as the body of a response. */
+static int Connection_writePdu(Connection *c, const unsigned char *raw, size_t len) {
+	int res;
+
+	if (c->http) {
+		char hdr[128];
+
+		snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: application/ksi-response\r\nContent-Length: %u\r\n\r\n", (unsigned)len);
+		res = Connection_writeStr(c, hdr);
+		if (res != KSI_OK) return res;
+	}
+
+	return Connection_write(c, raw, len);
+}
+
+static void Connection_free(Connection *c) {
+	if (c != NULL) {
+		close(c->fd);
+		free(c->in);
+		free(c->out);
+		KSI_AggregationRespList_free(c->aggrResp);
+		KSI_ExtendResp_free(c->extResp);
+		free(c);
+	}
+}
+
+static int Server_newHeader(Server *srv, KSI_Header **hdr) {
+	int res;
+	KSI_Header *tmp = NULL;
+	KSI_Utf8String *loginId = NULL;
+
+	res = KSI_Header_new(srv->ksi, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Utf8String_new(srv->ksi, srv->user, strlen(srv->user) + 1, &loginId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_setLoginId(tmp, loginId);
+	if (res != KSI_OK) goto cleanup;
+	loginId = NULL;
+
+	*hdr = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_Utf8String_free(loginId);
+	KSI_Header_free(tmp);
+
+	return res;
+}
+
+static int Server_newConfig(Server *srv, int service, KSI_Config **conf) {
+	int res;
+	KSI_Config *tmp = NULL;
+	KSI_Integer *val = NULL;
+
+	res = KSI_Config_new(srv->ksi, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	if (srv->maxRequests > 0) {
+		res = KSI_Integer_new(srv->ksi, srv->maxRequests, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setMaxRequests(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+	}
+
+	if (service == SERVICE_AGGREGATOR) {
+		res = KSI_Integer_new(srv->ksi, 0xff, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setMaxLevel(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+
+		res = KSI_Integer_new(srv->ksi, KSI_HASHALG_SHA2_256, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setAggrAlgo(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+
+		res = KSI_Integer_new(srv->ksi, srv->roundMs, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setAggrPeriod(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+	} else if (srv->cal.count > 0) {
+		res = KSI_Integer_new(srv->ksi, srv->cal.first, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setCalendarFirstTime(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+
+		res = KSI_Integer_new(srv->ksi, Calendar_last(&srv->cal), &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Config_setCalendarLastTime(tmp, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+	}
+
+	*conf = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_Integer_free(val);
+	KSI_Config_free(tmp);
+
+	return res;
+}
+
+/* Sends an aggregation PDU with the response or the responses and the configuration, any of them can be NULL.
+ * The ownership of the arguments is taken. */
+static int Server_sendAggregation(Server *srv, Connection *c, KSI_AggregationResp *resp, KSI_LIST(KSI_AggregationResp) *respList, KSI_Config *conf) {
+	int res;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_DataHash *hmac = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_AggregationPdu_new(srv->ksi, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Server_newHeader(srv, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_AggregationPdu_setResponse(pdu, resp);
+	if (res != KSI_OK) goto cleanup;
+	resp = NULL;
+
+	res = KSI_AggregationPdu_setResponseList(pdu, respList);
+	if (res != KSI_OK) goto cleanup;
+	respList = NULL;
+
+	res = KSI_AggregationPdu_setConfResponse(pdu, conf);
+	if (res != KSI_OK) goto cleanup;
+	conf = NULL;
+
+	/* The HMAC is calculated over the PDU with an empty HMAC value. */
+	res = KSI_DataHash_createZero(srv->ksi, c->hmacAlgo, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_AggregationPdu_updateHmac(pdu, c->hmacAlgo, srv->key);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_serialize(pdu, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Connection_writePdu(c, raw, raw_len);
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_DataHash_free(hmac);
+	KSI_Header_free(hdr);
+	KSI_AggregationResp_free(resp);
+	KSI_AggregationRespList_free(respList);
+	KSI_Config_free(conf);
+	KSI_AggregationPdu_free(pdu);
+
+	return res;
+}
+
+/* Sends an extension PDU with the response and the configuration, either of them can be NULL.
+ * The ownership of the arguments is taken. */
+static int Server_sendExtension(Server *srv, Connection *c, KSI_ExtendResp *resp, KSI_Config *conf) {
+	int res;
+	KSI_ExtendPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_DataHash *hmac = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_ExtendPdu_new(srv->ksi, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Server_newHeader(srv, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_ExtendPdu_setResponse(pdu, resp);
+	if (res != KSI_OK) goto cleanup;
+	resp = NULL;
+
+	res = KSI_ExtendPdu_setConfResponse(pdu, conf);
+	if (res != KSI_OK) goto cleanup;
+	conf = NULL;
+
+	res = KSI_DataHash_createZero(srv->ksi, c->hmacAlgo, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_ExtendPdu_updateHmac(pdu, c->hmacAlgo, srv->key);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_serialize(pdu, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Connection_writePdu(c, raw, raw_len);
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_DataHash_free(hmac);
+	KSI_Header_free(hdr);
+	KSI_ExtendResp_free(resp);
+	KSI_Config_free(conf);
+	KSI_ExtendPdu_free(pdu);
+
+	return res;
+}
+
+static int Server_sendConfig(Server *srv, Connection *c) {
+	int res;
+	KSI_Config *conf = NULL;
+
+	res = Server_newConfig(srv, c->service, &conf);
+	if (res != KSI_OK) return res;
+
+	if (c->service == SERVICE_AGGREGATOR) return Server_sendAggregation(srv, c, NULL, NULL, conf);
+	return Server_sendExtension(srv, c, NULL, conf);
+}
+
+/* Completes the current HTTP request, once all its requests have been answered. */
+static int Server_flushHttp(Server *srv, Connection *c) {
+	int res;
+	KSI_Config *conf = NULL;
+	KSI_AggregationResp *resp = NULL;
+
+	if (c->waiting > 0) return KSI_OK;
+
+	if (c->confDue) {
+		res = Server_newConfig(srv, c->service, &conf);
+		if (res != KSI_OK) goto cleanup;
+		c->confDue = 0;
+	}
+
+	if (c->service == SERVICE_AGGREGATOR) {
+		/* A single answer is sent as such, for the clients not expecting a list. */
+		if (KSI_AggregationRespList_length(c->aggrResp) == 1) {
+			res = KSI_AggregationRespList_remove(c->aggrResp, 0, &resp);
+			if (res != KSI_OK) goto cleanup;
+		}
+		if (KSI_AggregationRespList_length(c->aggrResp) == 0) {
+			KSI_AggregationRespList_free(c->aggrResp);
+			c->aggrResp = NULL;
+		}
+
+		res = Server_sendAggregation(srv, c, resp, c->aggrResp, conf);
+		resp = NULL;
+		c->aggrResp = NULL;
+	} else {
+		res = Server_sendExtension(srv, c, c->extResp, conf);
+		c->extResp = NULL;
+	}
+	conf = NULL;
+
+cleanup:
+
+	KSI_AggregationResp_free(resp);
+	KSI_Config_free(conf);
+
+	return res;
+}
+
+static int Server_processHttp(Server *srv, Connection *c);
+
+/* Responses. */
+
+static int injectError(Server *srv) {
+	if (srv->errorRate <= 0) return 0;
+	return rand() < srv->errorRate / 100.0 * ((double)RAND_MAX + 1);
+}
+
+static int Server_queue(Server *srv, Connection *c, KSI_AggregationResp *aggrResp, KSI_ExtendResp *extResp) {
+	Outgoing *o = calloc(1, sizeof(Outgoing));
+
+	if (o == NULL) {
+		KSI_AggregationResp_free(aggrResp);
+		KSI_ExtendResp_free(extResp);
+		return KSI_OUT_OF_MEMORY;
+	}
+
+	o->conn = c;
+	o->due = nowMs() + srv->latencyMs;
+	o->aggrResp = aggrResp;
+	o->extResp = extResp;
+
+	if (srv->outTail != NULL) srv->outTail->next = o;
+	else srv->outHead = o;
+	srv->outTail = o;
+
+	return KSI_OK;
+}
+
+static int Server_deliver(Server *srv, Outgoing *o) {
+	int res;
+	Connection *c = o->conn;
+
+	if (!c->http) {
+		if (o->aggrResp != NULL) return Server_sendAggregation(srv, c, o->aggrResp, NULL, NULL);
+		return Server_sendExtension(srv, c, o->extResp, NULL);
+	}
+
+	if (o->aggrResp != NULL) {
+		if (c->aggrResp == NULL) {
+			res = KSI_AggregationRespList_new(&c->aggrResp);
+			if (res != KSI_OK) {
+				KSI_AggregationResp_free(o->aggrResp);
+				return res;
+			}
+		}
+
+		res = KSI_AggregationRespList_append(c->aggrResp, o->aggrResp);
+		if (res != KSI_OK) {
+			KSI_AggregationResp_free(o->aggrResp);
+			return res;
+		}
+	} else {
+		KSI_ExtendResp_free(c->extResp);
+		c->extResp = o->extResp;
+	}
+
+	c->waiting--;
+	res = Server_flushHttp(srv, c);
+	if (res != KSI_OK) return res;
+
+	/* Continue with the requests received meanwhile. */
+	return Server_processHttp(srv, c);
+}
+
+static int newAggregationResp(Server *srv, KSI_Integer *reqId, KSI_uint64_t status, const char *msg, KSI_AggregationResp **resp) {
+	int res;
+	KSI_AggregationResp *tmp = NULL;
+	KSI_Integer *val = NULL;
+	KSI_Utf8String *str = NULL;
+
+	res = KSI_AggregationResp_new(srv->ksi, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationResp_setRequestId(tmp, KSI_Integer_ref(reqId));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(srv->ksi, status, &val);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationResp_setStatus(tmp, val);
+	if (res != KSI_OK) goto cleanup;
+	val = NULL;
+
+	if (msg != NULL) {
+		res = KSI_Utf8String_new(srv->ksi, msg, strlen(msg) + 1, &str);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationResp_setErrorMsg(tmp, str);
+		if (res != KSI_OK) goto cleanup;
+		str = NULL;
+	}
+
+	*resp = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_Utf8String_free(str);
+	KSI_Integer_free(val);
+	KSI_AggregationResp_free(tmp);
+
+	return res;
+}
+
+static int newExtendResp(Server *srv, KSI_Integer *reqId, KSI_uint64_t status, const char *msg, KSI_ExtendResp **resp) {
+	int res;
+	KSI_ExtendResp *tmp = NULL;
+	KSI_Integer *val = NULL;
+	KSI_Utf8String *str = NULL;
+
+	res = KSI_ExtendResp_new(srv->ksi, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setRequestId(tmp, KSI_Integer_ref(reqId));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(srv->ksi, status, &val);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setStatus(tmp, val);
+	if (res != KSI_OK) goto cleanup;
+	val = NULL;
+
+	if (msg != NULL) {
+		res = KSI_Utf8String_new(srv->ksi, msg, strlen(msg) + 1, &str);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendResp_setErrorMsg(tmp, str);
+		if (res != KSI_OK) goto cleanup;
+		str = NULL;
+	}
+
+	*resp = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_Utf8String_free(str);
+	KSI_Integer_free(val);
+	KSI_ExtendResp_free(tmp);
+
+	return res;
+}
+
+/* Answers all the pending requests with an error. */
+static int Server_failRound(Server *srv, KSI_uint64_t status, const char *msg) {
+	int res = KSI_OK;
+	size_t i;
+
+	for (i = 0; i < srv->pendingCount && res == KSI_OK; i++) {
+		KSI_AggregationResp *resp = NULL;
+
+		res = newAggregationResp(srv, srv->pending[i].reqId, status, msg, &resp);
+		if (res == KSI_OK) res = Server_queue(srv, srv->pending[i].conn, resp, NULL);
+	}
+
+	return res;
+}
+
+/* Builds the tree of the pending requests, appends its root to the calendar and queues the responses. */
+static int Server_closeRound(Server *srv) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	KSI_TreeLeafHandle **leaves = NULL;
+	KSI_TreeLeafHandle *padding = NULL;
+	KSI_DataHash *zero = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_CalendarHashChain *calChain = NULL;
+	KSI_AggregationHashChain *aggrChain = NULL;
+	KSI_LIST(KSI_AggregationHashChain) *chainList = NULL;
+	KSI_LIST(KSI_Integer) *chainIndex = NULL;
+	KSI_Integer *val = NULL;
+	KSI_AggregationResp *resp = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	CalendarNode leaf;
+	KSI_uint64_t t;
+	KSI_uint64_t shape;
+	size_t i;
+
+	leaves = calloc(srv->pendingCount, sizeof(KSI_TreeLeafHandle *));
+	if (leaves == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = KSI_TreeBuilder_new(srv->ksi, KSI_HASHALG_SHA2_256, &builder);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < srv->pendingCount; i++) {
+		res = KSI_TreeBuilder_addDataHash(builder, srv->pending[i].hash, srv->pending[i].level, &leaves[i]);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* A lone leaf would get an empty aggregation chain. */
+	if (srv->pendingCount == 1) {
+		res = KSI_DataHash_createZero(srv->ksi, KSI_HASHALG_SHA2_256, &zero);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_TreeBuilder_addDataHash(builder, zero, 0, &padding);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_TreeBuilder_close(builder);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_TreeNode_getHash(builder->rootNode, &root);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(root, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+	memcpy(leaf.imprint, imprint, IMPRINT_LEN);
+
+	/* Every round takes a second of its own, even if the rounds are shorter than that. */
+	t = (KSI_uint64_t)time(NULL);
+	if (srv->cal.count > 0 && t <= Calendar_last(&srv->cal)) t = Calendar_last(&srv->cal) + 1;
+
+	res = Calendar_add(&srv->cal, t, &leaf);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Calendar_getChain(&srv->cal, t, t, &calChain);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < srv->pendingCount; i++) {
+		res = KSI_TreeLeafHandle_getAggregationChain(leaves[i], &aggrChain);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Integer_new(srv->ksi, t, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationHashChain_setAggregationTime(aggrChain, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+
+		res = KSI_AggregationHashChain_calculateShape(aggrChain, &shape);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_IntegerList_new(&chainIndex);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_Integer_new(srv->ksi, shape, &val);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_IntegerList_append(chainIndex, val);
+		if (res != KSI_OK) goto cleanup;
+		val = NULL;
+
+		res = KSI_AggregationHashChain_setChainIndex(aggrChain, chainIndex);
+		if (res != KSI_OK) goto cleanup;
+		chainIndex = NULL;
+
+		res = KSI_AggregationHashChainList_new(&chainList);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationHashChainList_append(chainList, aggrChain);
+		if (res != KSI_OK) goto cleanup;
+		aggrChain = NULL;
+
+		res = newAggregationResp(srv, srv->pending[i].reqId, STATUS_OK, NULL, &resp);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationResp_setAggregationChainList(resp, chainList);
+		if (res != KSI_OK) goto cleanup;
+		chainList = NULL;
+
+		res = KSI_AggregationResp_setCalendarChain(resp, KSI_CalendarHashChain_ref(calChain));
+		if (res != KSI_OK) goto cleanup;
+
+		res = Server_queue(srv, srv->pending[i].conn, resp, NULL);
+		resp = NULL;
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	srv->roundCount++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (leaves != NULL) {
+		for (i = 0; i < srv->pendingCount; i++) KSI_TreeLeafHandle_free(leaves[i]);
+		free(leaves);
+	}
+	KSI_TreeLeafHandle_free(padding);
+	KSI_TreeBuilder_free(builder);
+	KSI_DataHash_free(zero);
+	KSI_DataHash_free(root);
+	KSI_CalendarHashChain_free(calChain);
+	KSI_AggregationHashChain_free(aggrChain);
+	KSI_AggregationHashChainList_free(chainList);
+	KSI_IntegerList_free(chainIndex);
+	KSI_Integer_free(val);
+	KSI_AggregationResp_free(resp);
+
+	return res;
+}
+
+static void Server_clearPending(Server *srv) {
+	size_t i;
+
+	for (i = 0; i < srv->pendingCount; i++) {
+		KSI_Integer_free(srv->pending[i].reqId);
+		KSI_DataHash_free(srv->pending[i].hash);
+	}
+	srv->pendingCount = 0;
+}
+
+static int Server_addPending(Server *srv, Connection *c, KSI_Integer *reqId, KSI_DataHash *hash, int level) {
+	if (srv->pendingCount == srv->pendingSize) {
+		size_t size = srv->pendingSize != 0 ? 2 * srv->pendingSize : 256;
+		Pending *tmp = realloc(srv->pending, size * sizeof(Pending));
+
+		if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+		srv->pending = tmp;
+		srv->pendingSize = size;
+	}
+
+	if (srv->pendingCount == 0) srv->roundAt = nowMs() + srv->roundMs;
+
+	srv->pending[srv->pendingCount].conn = c;
+	srv->pending[srv->pendingCount].reqId = KSI_Integer_ref(reqId);
+	srv->pending[srv->pendingCount].hash = KSI_DataHash_ref(hash);
+	srv->pending[srv->pendingCount].level = level;
+	srv->pendingCount++;
+
+	return KSI_OK;
+}
+
+static int Server_handleAggregationReq(Server *srv, Connection *c, KSI_AggregationReq *req, int authentic) {
+	int res;
+	KSI_Integer *reqId = NULL;
+	KSI_DataHash *hash = NULL;
+	KSI_Integer *level = NULL;
+	KSI_AggregationResp *resp = NULL;
+	KSI_uint64_t status = STATUS_OK;
+	const char *msg = NULL;
+
+	res = KSI_AggregationReq_getRequestId(req, &reqId);
+	if (res != KSI_OK) return res;
+
+	res = KSI_AggregationReq_getRequestHash(req, &hash);
+	if (res != KSI_OK) return res;
+
+	res = KSI_AggregationReq_getRequestLevel(req, &level);
+	if (res != KSI_OK) return res;
+
+	srv->aggrCount++;
+	if (c->http) c->waiting++;
+
+	if (!authentic) {
+		status = STATUS_AUTHENTICATION_FAILURE;
+		msg = "The request could not be authenticated.";
+	} else if (hash == NULL || KSI_Integer_getUInt64(level) > 0xff) {
+		status = STATUS_INVALID_REQUEST;
+		msg = "Invalid request.";
+	} else if (injectError(srv)) {
+		srv->errorCount++;
+		status = STATUS_UPSTREAM_ERROR;
+		msg = "Injected error.";
+	}
+
+	if (status == STATUS_OK) return Server_addPending(srv, c, reqId, hash, (int)KSI_Integer_getUInt64(level));
+
+	res = newAggregationResp(srv, reqId, status, msg, &resp);
+	if (res != KSI_OK) return res;
+
+	return Server_queue(srv, c, resp, NULL);
+}
+
+static int Server_handleAggregationPdu(Server *srv, Connection *c, const unsigned char *raw, size_t len) {
+	int res;
+	KSI_AggregationPdu *pdu = NULL;
+	KSI_AggregationReq *req = NULL;
+	KSI_LIST(KSI_AggregationReq) *reqList = NULL;
+	KSI_Config *confReq = NULL;
+	KSI_DataHash *hmac = NULL;
+	int authentic;
+	size_t i;
+
+	res = KSI_AggregationPdu_parse(srv->ksi, (unsigned char *)raw, len, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_getHmac(pdu, &hmac);
+	if (res != KSI_OK) goto cleanup;
+	if (hmac != NULL) KSI_DataHash_extract(hmac, &c->hmacAlgo, NULL, NULL);
+
+	authentic = hmac != NULL && KSI_AggregationPdu_verifyHmac(pdu, srv->key) == KSI_OK;
+
+	res = KSI_AggregationPdu_getConfRequest(pdu, &confReq);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_getRequest(pdu, &req);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationPdu_getRequestList(pdu, &reqList);
+	if (res != KSI_OK) goto cleanup;
+
+	if (req != NULL) {
+		res = Server_handleAggregationReq(srv, c, req, authentic);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	for (i = 0; i < KSI_AggregationReqList_length(reqList); i++) {
+		res = KSI_AggregationReqList_elementAt(reqList, i, &req);
+		if (res != KSI_OK) goto cleanup;
+
+		res = Server_handleAggregationReq(srv, c, req, authentic);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (confReq != NULL && authentic) {
+		if (c->http) c->confDue = 1;
+		else res = Server_sendConfig(srv, c);
+	}
+
+	/* Nothing to wait for, the HTTP request is answered right away. */
+	if (c->http && c->waiting == 0) res = Server_flushHttp(srv, c);
+
+cleanup:
+
+	KSI_AggregationPdu_free(pdu);
+
+	return res;
+}
+
+static int Server_extend(Server *srv, KSI_ExtendReq *req, KSI_ExtendResp **resp) {
+	int res;
+	KSI_Integer *reqId = NULL;
+	KSI_Integer *aggrTime = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_ExtendResp *tmp = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_Integer *last = NULL;
+	KSI_uint64_t from;
+	KSI_uint64_t to;
+
+	res = KSI_ExtendReq_getRequestId(req, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getAggregationTime(req, &aggrTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getPublicationTime(req, &pubTime);
+	if (res != KSI_OK) goto cleanup;
+
+	if (aggrTime == NULL) {
+		res = newExtendResp(srv, reqId, STATUS_INVALID_REQUEST, "Aggregation time is missing.", resp);
+		goto cleanup;
+	}
+
+	from = KSI_Integer_getUInt64(aggrTime);
+	to = pubTime != NULL ? KSI_Integer_getUInt64(pubTime) : Calendar_last(&srv->cal);
+
+	if (srv->cal.count == 0 || to > Calendar_last(&srv->cal)) {
+		res = newExtendResp(srv, reqId, to > (KSI_uint64_t)time(NULL) ? STATUS_TIME_IN_FUTURE : STATUS_TIME_TOO_NEW,
+				"The calendar does not reach the publication time.", resp);
+		goto cleanup;
+	}
+	if (from < srv->cal.first) {
+		res = newExtendResp(srv, reqId, STATUS_TIME_TOO_OLD, "The aggregation time precedes the calendar.", resp);
+		goto cleanup;
+	}
+	if (from > to) {
+		res = newExtendResp(srv, reqId, STATUS_INVALID_REQUEST, "The aggregation time is after the publication time.", resp);
+		goto cleanup;
+	}
+
+	res = Calendar_getChain(&srv->cal, from, to, &chain);
+	if (res != KSI_OK) goto cleanup;
+
+	res = newExtendResp(srv, reqId, STATUS_OK, NULL, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setCalendarHashChain(tmp, chain);
+	if (res != KSI_OK) goto cleanup;
+	chain = NULL;
+
+	res = KSI_Integer_new(srv->ksi, Calendar_last(&srv->cal), &last);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setLastTime(tmp, last);
+	if (res != KSI_OK) goto cleanup;
+	last = NULL;
+
+	*resp = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_Integer_free(last);
+	KSI_CalendarHashChain_free(chain);
+	KSI_ExtendResp_free(tmp);
+
+	return res;
+}
+
+static int Server_handleExtensionPdu(Server *srv, Connection *c, const unsigned char *raw, size_t len) {
+	int res;
+	KSI_ExtendPdu *pdu = NULL;
+	KSI_ExtendReq *req = NULL;
+	KSI_Integer *reqId = NULL;
+	KSI_Config *confReq = NULL;
+	KSI_DataHash *hmac = NULL;
+	KSI_ExtendResp *resp = NULL;
+	int authentic;
+
+	res = KSI_ExtendPdu_parse(srv->ksi, (unsigned char *)raw, len, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_getHmac(pdu, &hmac);
+	if (res != KSI_OK) goto cleanup;
+	if (hmac != NULL) KSI_DataHash_extract(hmac, &c->hmacAlgo, NULL, NULL);
+
+	authentic = hmac != NULL && KSI_ExtendPdu_verifyHmac(pdu, srv->key) == KSI_OK;
+
+	res = KSI_ExtendPdu_getConfRequest(pdu, &confReq);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_getRequest(pdu, &req);
+	if (res != KSI_OK) goto cleanup;
+
+	if (req != NULL) {
+		srv->extCount++;
+		if (c->http) c->waiting++;
+
+		res = KSI_ExtendReq_getRequestId(req, &reqId);
+		if (res != KSI_OK) goto cleanup;
+
+		if (!authentic) {
+			res = newExtendResp(srv, reqId, STATUS_AUTHENTICATION_FAILURE, "The request could not be authenticated.", &resp);
+		} else if (injectError(srv)) {
+			srv->errorCount++;
+			res = newExtendResp(srv, reqId, STATUS_UPSTREAM_ERROR, "Injected error.", &resp);
+		} else {
+			res = Server_extend(srv, req, &resp);
+		}
+		if (res != KSI_OK) goto cleanup;
+
+		res = Server_queue(srv, c, NULL, resp);
+		resp = NULL;
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (confReq != NULL && authentic) {
+		if (c->http) c->confDue = 1;
+		else res = Server_sendConfig(srv, c);
+	}
+
+	if (c->http && c->waiting == 0) res = Server_flushHttp(srv, c);
+
+cleanup:
+
+	KSI_ExtendResp_free(resp);
+	KSI_ExtendPdu_free(pdu);
+
+	return res;
+}
+
+static int Server_handlePdu(Server *srv, Connection *c, const unsigned char *raw, size_t len) {
+	unsigned tag;
+
+	if (len < 4 || (raw[0] & 0x80) == 0) return KSI_INVALID_FORMAT;
+	tag = ((unsigned)(raw[0] & 0x1f) << 8) | raw[1];
+
+	switch (tag) {
+		case 0x220:
+			c->service = SERVICE_AGGREGATOR;
+			return Server_handleAggregationPdu(srv, c, raw, len);
+		case 0x320:
+			c->service = SERVICE_EXTENDER;
+			return Server_handleExtensionPdu(srv, c, raw, len);
+		default:
+			return KSI_INVALID_FORMAT;
+	}
+}
+
+static void Connection_consume(Connection *c, size_t len) {
+	memmove(c->in, c->in + len, c->inLen - len);
+	c->inLen -= len;
+}
+
+/* Handles the complete PDUs received over TCP. */
+static int Server_processTcp(Server *srv, Connection *c) {
+	int res;
+
+	for (;;) {
+		size_t hdr = 2;
+		size_t len;
+
+		if (c->inLen < 2) break;
+		if (c->in[0] & 0x80) {
+			/* 16-bit length. */
+			hdr = 4;
+			if (c->inLen < 4) break;
+			len = ((size_t)c->in[2] << 8) | c->in[3];
+		} else {
+			len = c->in[1];
+		}
+		if (c->inLen < hdr + len) break;
+
+		res = Server_handlePdu(srv, c, c->in, hdr + len);
+		if (res != KSI_OK) return res;
+
+		Connection_consume(c, hdr + len);
+	}
+
+	return KSI_OK;
+}
+
+static const unsigned char *findBytes(const unsigned char *buf, size_t len, const char *str) {
+	size_t n = strlen(str);
+	size_t i;
+
+	for (i = 0; i + n <= len; i++) {
+		if (memcmp(buf + i, str, n) == 0) return buf + i;
+	}
+
+	return NULL;
+}
+
+/* Returns the value of the header field, or NULL. The header block is null-terminated. */
+static const char *httpField(const char *hdr, const char *name) {
+	size_t n = strlen(name);
+	const char *p = strstr(hdr, "\r\n");
+
+	while (p != NULL) {
+		p += 2;
+		if (strncasecmp(p, name, n) == 0 && p[n] == ':') {
+			p += n + 1;
+			while (*p == ' ' || *p == '\t') p++;
+			return p;
+		}
+		p = strstr(p, "\r\n");
+	}
+
+	return NULL;
+}
+
+/* Handles the complete HTTP requests one at a time. */
+static int Server_processHttp(Server *srv, Connection *c) {
+	int res;
+
+	while (c->waiting == 0 && c->inLen > 0) {
+		const unsigned char *end = findBytes(c->in, c->inLen, "\r\n\r\n");
+		char hdr[HTTP_MAX_HEADER + 1];
+		size_t hdrLen;
+		size_t bodyLen = 0;
+		const char *val;
+
+		if (end == NULL) return c->inLen > HTTP_MAX_HEADER ? KSI_INVALID_FORMAT : KSI_OK;
+
+		hdrLen = (size_t)(end - c->in) + 4;
+		if (hdrLen > HTTP_MAX_HEADER) return KSI_INVALID_FORMAT;
+
+		memcpy(hdr, c->in, hdrLen);
+		hdr[hdrLen] = '\0';
+
+		if (strncmp(hdr, "POST ", 5) != 0) {
+			res = Connection_writeStr(c, "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n");
+			if (res != KSI_OK) return res;
+			Connection_consume(c, hdrLen);
+			continue;
+		}
+
+		val = httpField(hdr, "Content-Length");
+		if (val != NULL) bodyLen = strtoul(val, NULL, 10);
+
+		if (c->inLen < hdrLen + bodyLen) {
+			/* Let the client send the body. */
+			val = httpField(hdr, "Expect");
+			if (val != NULL && strncasecmp(val, "100-continue", 12) == 0 && c->outLen == c->outPos) {
+				res = Connection_writeStr(c, "HTTP/1.1 100 Continue\r\n\r\n");
+				if (res != KSI_OK) return res;
+			}
+			return KSI_OK;
+		}
+
+		res = Server_handlePdu(srv, c, c->in + hdrLen, bodyLen);
+		if (res != KSI_OK) {
+			res = Connection_writeStr(c, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+			if (res != KSI_OK) return res;
+		}
+
+		Connection_consume(c, hdrLen + bodyLen);
+	}
+
+	return KSI_OK;
+}
+
+static void Server_closeConnection(Server *srv, Connection *c) {
+	Connection **pp;
+	Outgoing **op;
+	size_t i;
+	size_t j = 0;
+
+	for (pp = &srv->conns; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == c) {
+			*pp = c->next;
+			break;
+		}
+	}
+
+	/* Drop everything still addressed to the connection. */
+	for (i = 0; i < srv->pendingCount; i++) {
+		if (srv->pending[i].conn == c) {
+			KSI_Integer_free(srv->pending[i].reqId);
+			KSI_DataHash_free(srv->pending[i].hash);
+		} else {
+			srv->pending[j++] = srv->pending[i];
+		}
+	}
+	srv->pendingCount = j;
+
+	srv->outTail = NULL;
+	op = &srv->outHead;
+	while (*op != NULL) {
+		Outgoing *o = *op;
+
+		if (o->conn == c) {
+			*op = o->next;
+			KSI_AggregationResp_free(o->aggrResp);
+			KSI_ExtendResp_free(o->extResp);
+			free(o);
+		} else {
+			srv->outTail = o;
+			op = &o->next;
+		}
+	}
+
+	Connection_free(c);
+}
+
+/* Runs the timed events, returns the time in milliseconds until the next one or -1. */
+static int Server_tick(Server *srv) {
+	int res;
+	KSI_uint64_t now = nowMs();
+	KSI_uint64_t next = 0;
+	Connection *c;
+
+	if (srv->pendingCount > 0 && now >= srv->roundAt) {
+		res = Server_closeRound(srv);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to close the round: %s\n", KSI_getErrorString(res));
+			res = Server_failRound(srv, STATUS_INTERNAL_ERROR, "Unable to close the round.");
+		}
+		Server_clearPending(srv);
+		if (res != KSI_OK) stopped = 1;
+	}
+
+	while (srv->outHead != NULL && srv->outHead->due <= now) {
+		Outgoing *o = srv->outHead;
+
+		srv->outHead = o->next;
+		if (srv->outHead == NULL) srv->outTail = NULL;
+
+		res = Server_deliver(srv, o);
+		free(o);
+		if (res != KSI_OK) {
+			fprintf(stderr, "Unable to send the response: %s\n", KSI_getErrorString(res));
+			stopped = 1;
+		}
+	}
+
+	if (srv->confMs > 0 && now >= srv->confAt) {
+		for (c = srv->conns; c != NULL; c = c->next) {
+			if (c->service == SERVICE_UNKNOWN) continue;
+			if (c->http) {
+				c->confDue = 1;
+			} else if (Server_sendConfig(srv, c) != KSI_OK) {
+				stopped = 1;
+			}
+		}
+		srv->confAt = now + srv->confMs;
+	}
+
+	if (srv->pendingCount > 0) next = srv->roundAt;
+	if (srv->outHead != NULL && (next == 0 || srv->outHead->due < next)) next = srv->outHead->due;
+	if (srv->confMs > 0 && (next == 0 || srv->confAt < next)) next = srv->confAt;
+
+	if (next == 0) return -1;
+	return next > now ? (int)(next - now) : 0;
+}
+
+static void Server_accept(Server *srv, int listener) {
+	Connection *c;
+	int one = 1;
+	int fd;
+
+	fd = accept(srv->listenFd[listener], NULL, NULL);
+	if (fd < 0) return;
+
+	c = calloc(1, sizeof(Connection));
+	if (c == NULL) {
+		close(fd);
+		return;
+	}
+
+	/* Do not let the small responses wait for the acknowledgements. */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	c->fd = fd;
+	c->http = listener == LISTENER_HTTP;
+	c->hmacAlgo = KSI_HASHALG_SHA2_256;
+	c->next = srv->conns;
+	srv->conns = c;
+}
+
+/* Returns 0 if the connection has to be closed. */
+static int Server_read(Server *srv, Connection *c) {
+	ssize_t n;
+
+	if (ensureSize(&c->in, &c->inSize, c->inLen + 0x4000) != KSI_OK) return 0;
+
+	n = recv(c->fd, c->in + c->inLen, c->inSize - c->inLen, 0);
+	if (n < 0) return errno == EINTR || errno == EAGAIN;
+	if (n == 0) return 0;
+	c->inLen += (size_t)n;
+
+	return (c->http ? Server_processHttp(srv, c) : Server_processTcp(srv, c)) == KSI_OK;
+}
+
+static int Server_write(Connection *c) {
+	ssize_t n;
+
+	n = send(c->fd, c->out + c->outPos, c->outLen - c->outPos, 0);
+	if (n < 0) return errno == EINTR || errno == EAGAIN;
+	c->outPos += (size_t)n;
+
+	if (c->outPos == c->outLen) {
+		c->outPos = 0;
+		c->outLen = 0;
+	}
+
+	return 1;
+}
+
+static int listenOn(unsigned short port, unsigned short *bound) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int one = 1;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0 ||
+			getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+		close(fd);
+		return -1;
+	}
+	*bound = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+static int Server_run(Server *srv) {
+	struct pollfd *fds = NULL;
+	Connection **conns = NULL;
+	size_t size = 0;
+
+	while (!stopped) {
+		int timeout = Server_tick(srv);
+		size_t count = 0;
+		size_t nfds = 0;
+		size_t i;
+		Connection *c;
+
+		for (c = srv->conns; c != NULL; c = c->next) count++;
+
+		if (count + NUMBER_OF_LISTENERS > size) {
+			size = 2 * (count + NUMBER_OF_LISTENERS);
+			free(fds);
+			free(conns);
+			fds = calloc(size, sizeof(struct pollfd));
+			conns = calloc(size, sizeof(Connection *));
+			if (fds == NULL || conns == NULL) break;
+		}
+
+		for (i = 0; i < NUMBER_OF_LISTENERS; i++) {
+			fds[nfds].fd = srv->listenFd[i];
+			fds[nfds].events = POLLIN;
+			conns[nfds++] = NULL;
+		}
+
+		for (c = srv->conns; c != NULL; c = c->next) {
+			fds[nfds].fd = c->fd;
+			/* An HTTP connection is not read while its request is being answered. */
+			fds[nfds].events = (c->http && c->waiting > 0) ? 0 : POLLIN;
+			if (c->outLen > c->outPos) fds[nfds].events |= POLLOUT;
+			conns[nfds++] = c;
+		}
+
+		if (poll(fds, nfds, timeout) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			int ok = 1;
+
+			if (fds[i].revents == 0) continue;
+
+			if (conns[i] == NULL) {
+				Server_accept(srv, (int)i);
+				continue;
+			}
+
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) ok = Server_read(srv, conns[i]);
+			if (ok && (fds[i].revents & POLLOUT)) ok = Server_write(conns[i]);
+			if (!ok) Server_closeConnection(srv, conns[i]);
+		}
+	}
+
+	free(fds);
+	free(conns);
+
+	return KSI_OK;
+}
+
+static void printUsage(const char *prog) {
+	fprintf(stderr,
+			"Usage:\n"
+			"  %s [-t <port>] [-h <port>] [-u <user>] [-k <key>] [-r <ms>] [-l <ms>] [-e <percent>] [-c <ms>] [-q <count>]\n"
+			"\n"
+			"  -t <port>    Port of the TCP endpoint, 0 picks a free one.\n"
+			"  -h <port>    Port of the HTTP endpoint, 0 picks a free one. If neither endpoint is\n"
+			"               given, both are opened on free ports.\n"
+			"  -u <user>    Login id of the responses (default: " DEFAULT_USER ").\n"
+			"  -k <key>     HMAC key of the requests and responses (default: " DEFAULT_KEY ").\n"
+			"  -r <ms>      Duration of an aggregation round (default: 100).\n"
+			"  -l <ms>      Latency added to every response (default: 0).\n"
+			"  -e <percent> Share of the requests answered with an upstream error (default: 0).\n"
+			"  -c <ms>      Interval of the configuration pushes, 0 turns them off (default: 0).\n"
+			"  -q <count>   Maximum number of requests announced in the configuration.\n",
+			prog);
+}
+
+int main(int argc, char **argv) {
+	int res = KSI_UNKNOWN_ERROR;
+	Server srv;
+	int ports[NUMBER_OF_LISTENERS] = {-1, -1};
+	unsigned short bound[NUMBER_OF_LISTENERS] = {0, 0};
+	size_t i;
+	int c;
+
+	memset(&srv, 0, sizeof(srv));
+	srv.user = DEFAULT_USER;
+	srv.key = DEFAULT_KEY;
+	srv.roundMs = 100;
+	for (i = 0; i < NUMBER_OF_LISTENERS; i++) srv.listenFd[i] = -1;
+
+	while ((c = getopt(argc, argv, "t:h:u:k:r:l:e:c:q:")) != -1) {
+		switch (c) {
+			case 't': ports[LISTENER_TCP] = atoi(optarg); break;
+			case 'h': ports[LISTENER_HTTP] = atoi(optarg); break;
+			case 'u': srv.user = optarg; break;
+			case 'k': srv.key = optarg; break;
+			case 'r': srv.roundMs = (unsigned)atoi(optarg); break;
+			case 'l': srv.latencyMs = (unsigned)atoi(optarg); break;
+			case 'e': srv.errorRate = atof(optarg); break;
+			case 'c': srv.confMs = (unsigned)atoi(optarg); break;
+			case 'q': srv.maxRequests = (unsigned)atoi(optarg); break;
+			default:
+				printUsage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (ports[LISTENER_TCP] < 0 && ports[LISTENER_HTTP] < 0) {
+		ports[LISTENER_TCP] = 0;
+		ports[LISTENER_HTTP] = 0;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	srand((unsigned)time(NULL));
+
+	res = KSI_CTX_new(&srv.ksi);
+	if (res != KSI_OK) goto cleanup;
+
+	res = Calendar_init(&srv.cal, srv.ksi);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < NUMBER_OF_LISTENERS; i++) {
+		if (ports[i] < 0) continue;
+
+		srv.listenFd[i] = listenOn((unsigned short)ports[i], &bound[i]);
+		if (srv.listenFd[i] < 0) {
+			fprintf(stderr, "Unable to listen on port %d.\n", ports[i]);
+			res = KSI_NETWORK_ERROR;
+			goto cleanup;
+		}
+	}
+
+	if (srv.listenFd[LISTENER_TCP] >= 0) printf("ksi+tcp://127.0.0.1:%u\n", (unsigned)bound[LISTENER_TCP]);
+	if (srv.listenFd[LISTENER_HTTP] >= 0) printf("http://127.0.0.1:%u/\n", (unsigned)bound[LISTENER_HTTP]);
+	fflush(stdout);
+
+	srv.confAt = nowMs() + srv.confMs;
+
+	res = Server_run(&srv);
+
+	fprintf(stderr, "Aggregation requests: %llu, rounds: %llu, extension requests: %llu, injected errors: %llu\n",
+			srv.aggrCount, srv.roundCount, srv.extCount, srv.errorCount);
+
+cleanup:
+
+	if (res != KSI_OK) KSI_ERR_statusDump(srv.ksi, stderr);
+
+	while (srv.conns != NULL) Server_closeConnection(&srv, srv.conns);
+	Server_clearPending(&srv);
+	free(srv.pending);
+	for (i = 0; i < NUMBER_OF_LISTENERS; i++) {
+		if (srv.listenFd[i] >= 0) close(srv.listenFd[i]);
+	}
+	Calendar_clean(&srv.cal);
+	KSI_CTX_free(srv.ksi);
+
+	return res == KSI_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
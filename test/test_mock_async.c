@@ -42,9 +42,8 @@ typedef struct {
 	/* Input queue. */
 	KSI_LIST(KSI_OctetString) *respQueue;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing. */
+	KSI_AsyncPacer pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -94,19 +93,6 @@ static int dispatch(KSITest_FileAsyncClientCtx *clientCtx) {
 		time_t curTime = 0;
 
 		time(&curTime);
-#if 0
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "Async FILE round request count: %u", clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "Async FILE round max request count reached.");
-			break;
-		}
-#endif
 
 		res = KSI_AsyncHandleList_elementAt(clientCtx->reqQueue, 0, &req);
 		if (res != KSI_OK) {
@@ -114,10 +100,20 @@ static int dispatch(KSITest_FileAsyncClientCtx *clientCtx) {
 			res = KSI_OK;
 			goto cleanup;
 		}
+#if 0
+		/* Check if the pacing limit allows to send more requests. */
+		if (!KSI_AsyncPacer_isReady(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req))) {
+			KSI_LOG_debug(clientCtx->ctx, "[%p] Async FILE. Pacing limit reached.", clientCtx);
+			break;
+		}
+#endif
 		KSI_LOG_logBlob(clientCtx->ctx, KSI_LOG_DEBUG, "[%p] Async FILE. Sending request", req->raw, req->len, clientCtx);
 
 		if (req->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
-			clientCtx->roundCount++;
+			KSI_AsyncPacer_consume(&clientCtx->pacer, clientCtx->options, KSI_AsyncHandle_getPayloadCount(req));
+
+			/* Update state and start receive timeout. */
+			KSI_AsyncHandle_setSent(req, curTime);
 
 			/* Release the serialized payload. */
 			KSI_free(req->raw);
@@ -125,10 +121,6 @@ static int dispatch(KSITest_FileAsyncClientCtx *clientCtx) {
 			req->len = 0;
 			req->sentCount = 0;
 
-			/* Update state. */
-			req->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
-			/* Start receive timeout. */
-			req->sndTime = curTime;
 			/* The request has been successfully dispatched. Remove it from the request queue. */
 			KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
 		} else {
@@ -317,8 +309,7 @@ static int FileAsyncCtx_new(KSI_CTX *ctx, KSITest_FileAsyncClientCtx **clientCtx
 	tmp->nofPaths = 0;
 	tmp->pathCount = 0;
 
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	KSI_AsyncPacer_init(&tmp->pacer);
 
 	/* Initialize io queues. */
 	res = KSI_AsyncHandleList_new(&tmp->reqQueue);